@@ -0,0 +1,481 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * acceptor.c
+ *		SO_REUSEPORT multi-acceptor mode for the agent.
+ *
+ * The master opens one set of listen sockets per acceptor before forking
+ * any of them; the first set is the one main() already opened.  It keeps
+ * every set open for as long as it runs.  If an acceptor dies, the
+ * connections the kernel already queued on its sockets stay there until
+ * the replacement acceptor, which gets the same set, picks them up.
+ *
+ * A hot upgrade hands every set to the new master, which gives each
+ * inherited set to one of its own acceptors instead of opening a new one,
+ * so nothing queued on a retiring acceptor's sockets is lost.  The old
+ * acceptors keep accepting until the new master is up, and then drain
+ * their queues once more before they exit.
+ *
+ * Each acceptor watches only its own sockets, edge-triggered, so every
+ * wakeup has to drain the accept queue until accept4() says EAGAIN.
+ * Otherwise connections that arrived in the same burst would sit in the
+ * queue until the next, unrelated connection triggers another edge.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+
+#include "acceptor.h"
+#include "childreg.h"
+#include "upgrade.h"
+#include "comm.h"
+
+#define STATUS_OK				(0)
+#define STATUS_ERROR			(-1)
+
+#define ACCEPTOR_MAX_LISTEN		64
+
+/* How often an idle acceptor reaps children and checks for the master */
+#define ACCEPTOR_IDLE_CHECK_MS	1000
+
+int			AcceptorCount = 0;
+
+extern volatile sig_atomic_t shutdown_requested;
+
+static AcceptorShmem *AcceptorState = NULL;
+static pid_t AcceptorMasterPid = 0;
+
+/* listen sockets of every acceptor, indexed by slot */
+static int	AcceptorSockets[MAX_ACCEPTORS][ACCEPTOR_MAX_LISTEN];
+static int	AcceptorNumSockets[MAX_ACCEPTORS];
+
+static pid_t StartAcceptor(int slot);
+static void AcceptorProcessMain(int slot);
+static int	AcceptorDrain(int slot, int listen_fd, const struct timespec *woken);
+static void ReapAcceptors(void);
+static void CloseAcceptorSockets(int slot);
+
+/*
+ * SIGCHLD only needs to interrupt sigsuspend() or epoll_wait(); the actual
+ * reaping happens in the main loops.
+ */
+static void
+acceptor_sigchld_handler(int signo)
+{
+    (void) signo;
+}
+
+/*
+ * AcceptorMain -- open the per-acceptor sockets, start the acceptors and
+ * supervise them until shutdown
+ *
+ * listen_sockets must have been opened with ListenReusePort set.
+ */
+int
+AcceptorMain(int *listen_sockets, int nsockets)
+{
+    struct sigaction sa;
+    sigset_t	blockmask,
+                waitmask;
+    int			nacceptors = AcceptorCount;
+    int			i,
+                j;
+
+    if (nacceptors > MAX_ACCEPTORS)
+    {
+        fprintf(stderr, "acceptor count %d exceeds maximum %d, using %d\n",
+                nacceptors, MAX_ACCEPTORS, MAX_ACCEPTORS);
+        nacceptors = MAX_ACCEPTORS;
+    }
+    if (nsockets > ACCEPTOR_MAX_LISTEN)
+        nsockets = ACCEPTOR_MAX_LISTEN;
+
+    /*
+     * Sockets inherited from a previous master stay in the set they were
+     * in; if we run fewer acceptors now, sets are doubled up.
+     */
+    for (i = 0; i < nacceptors; i++)
+        AcceptorNumSockets[i] = 0;
+    for (j = 0; j < nsockets; j++)
+    {
+        int			set = UpgradeInheritedSocketSet(listen_sockets[j]);
+
+        i = set > 0 ? set % nacceptors : 0;
+        if (AcceptorNumSockets[i] < ACCEPTOR_MAX_LISTEN)
+            AcceptorSockets[i][AcceptorNumSockets[i]++] = listen_sockets[j];
+    }
+    for (i = 1; i < nacceptors; i++)
+    {
+        if (AcceptorNumSockets[i] > 0)
+            continue;
+        if (OpenListenSockets(AcceptorSockets[i], &AcceptorNumSockets[i],
+                              ACCEPTOR_MAX_LISTEN) != STATUS_OK)
+        {
+            fprintf(stderr, "could not open listen sockets for acceptor %d, running %d acceptors\n",
+                    i, i);
+            CloseAcceptorSockets(i);
+            /* keep any inherited sets of the slots we give up */
+            for (j = i + 1; j < nacceptors; j++)
+            {
+                int			k;
+
+                for (k = 0; k < AcceptorNumSockets[j] &&
+                     AcceptorNumSockets[0] < ACCEPTOR_MAX_LISTEN; k++)
+                    AcceptorSockets[0][AcceptorNumSockets[0]++] = AcceptorSockets[j][k];
+                AcceptorNumSockets[j] = 0;
+            }
+            nacceptors = i;
+            break;
+        }
+    }
+    for (i = 0; i < nacceptors; i++)
+        UpgradeSetSocketSet(i, AcceptorSockets[i], AcceptorNumSockets[i]);
+
+    /* acceptors drain their queue until EAGAIN, so nobody may block */
+    for (i = 0; i < nacceptors; i++)
+    {
+        for (j = 0; j < AcceptorNumSockets[i]; j++)
+        {
+            if (!set_noblock(AcceptorSockets[i][j]))
+            {
+                fprintf(stderr, "could not set listen socket to non-blocking mode: %m\n");
+                return STATUS_ERROR;
+            }
+        }
+    }
+
+    AcceptorState = mmap(NULL, sizeof(AcceptorShmem), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (AcceptorState == MAP_FAILED)
+    {
+        AcceptorState = NULL;
+        fprintf(stderr, "could not map acceptor state: %m\n");
+        return STATUS_ERROR;
+    }
+    memset(AcceptorState, 0, sizeof(AcceptorShmem));
+    AcceptorState->nslots = nacceptors;
+    AcceptorState->backlog = ListenBacklog > 0 ? ListenBacklog : MaxConnections * 2;
+    AcceptorMasterPid = getpid();
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = acceptor_sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    /* same scheme as the worker pool master, see WorkerPoolMain() */
+    sigemptyset(&blockmask);
+    sigaddset(&blockmask, SIGCHLD);
+    sigaddset(&blockmask, SIGTERM);
+    sigaddset(&blockmask, SIGINT);
+    sigaddset(&blockmask, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &blockmask, &waitmask);
+    sigdelset(&waitmask, SIGCHLD);
+    sigdelset(&waitmask, SIGTERM);
+    sigdelset(&waitmask, SIGINT);
+    sigdelset(&waitmask, SIGUSR2);
+
+    fprintf(stderr, "starting %d acceptors, listen backlog %d\n",
+            nacceptors, AcceptorState->backlog);
+
+    while (!shutdown_requested)
+    {
+        ReapAcceptors();
+        if (upgrade_requested)
+            AgentUpgrade();
+
+        for (i = 0; i < AcceptorState->nslots && !shutdown_requested; i++)
+        {
+            if (AcceptorState->slots[i].pid != 0)
+                continue;
+            if (StartAcceptor(i) < 0)
+            {
+                fprintf(stderr, "could not fork acceptor: %m\n");
+                break;
+            }
+        }
+
+        if (!shutdown_requested)
+            sigsuspend(&waitmask);
+    }
+
+    /* after a hand-over, have the acceptors empty their queues first */
+    AcceptorState->draining = UpgradeHandedOver();
+    for (i = 0; i < AcceptorState->nslots; i++)
+    {
+        if (AcceptorState->slots[i].pid > 0)
+            kill(AcceptorState->slots[i].pid, SIGTERM);
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        ;
+
+    sigprocmask(SIG_UNBLOCK, &blockmask, NULL);
+    return STATUS_OK;
+}
+
+/*
+ * Reap every acceptor that has exited and free its slot.  The counters
+ * are kept, so the stats describe the slot rather than one process.
+ */
+static void
+ReapAcceptors(void)
+{
+    pid_t		pid;
+    int			status;
+    int			i;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        for (i = 0; i < AcceptorState->nslots; i++)
+        {
+            if (AcceptorState->slots[i].pid != pid)
+                continue;
+            if (!shutdown_requested)
+                fprintf(stderr, "acceptor %d (pid %d) exited with status %d\n",
+                        i, (int) pid, status);
+            AcceptorState->slots[i].pid = 0;
+            break;
+        }
+    }
+}
+
+static pid_t
+StartAcceptor(int slot)
+{
+    AcceptorSlot *me = &AcceptorState->slots[slot];
+    pid_t		pid;
+
+    if (me->started != 0)
+        AcceptorState->restarts++;
+    me->started = time(NULL);
+
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0)
+    {
+        AcceptorProcessMain(slot);
+        _exit(0);
+    }
+    if (pid > 0)
+        me->pid = pid;
+    return pid;
+}
+
+/*
+ * Close the listen sockets of one acceptor slot in this process.
+ */
+static void
+CloseAcceptorSockets(int slot)
+{
+    int			i;
+
+    for (i = 0; i < AcceptorNumSockets[slot]; i++)
+        close(AcceptorSockets[slot][i]);
+    AcceptorNumSockets[slot] = 0;
+}
+
+/*
+ * Body of an acceptor process.  Never returns.
+ */
+static void
+AcceptorProcessMain(int slot)
+{
+    AcceptorSlot *me = &AcceptorState->slots[slot];
+    struct epoll_event ev;
+    struct epoll_event events[ACCEPTOR_MAX_LISTEN];
+    sigset_t	unblock;
+    int			nsockets;
+    int			epfd;
+    int			i;
+
+    /* keep only our own sockets */
+    for (i = 0; i < AcceptorState->nslots; i++)
+    {
+        if (i != slot)
+            CloseAcceptorSockets(i);
+    }
+    nsockets = AcceptorNumSockets[slot];
+
+    sigemptyset(&unblock);
+    sigaddset(&unblock, SIGCHLD);
+    sigaddset(&unblock, SIGTERM);
+    sigaddset(&unblock, SIGINT);
+    sigaddset(&unblock, SIGUSR2);
+    sigprocmask(SIG_UNBLOCK, &unblock, NULL);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        fprintf(stderr, "acceptor could not create epoll set: %m\n");
+        _exit(1);
+    }
+    for (i = 0; i < nsockets; i++)
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = AcceptorSockets[slot][i];
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, AcceptorSockets[slot][i], &ev) < 0)
+        {
+            fprintf(stderr, "acceptor could not watch listen socket: %m\n");
+            _exit(1);
+        }
+    }
+
+    while (!shutdown_requested)
+    {
+        struct timespec woken;
+        uint64_t	batch = 0;
+        int			nevents;
+
+        nevents = epoll_wait(epfd, events, nsockets, ACCEPTOR_IDLE_CHECK_MS);
+        if (nevents < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "acceptor epoll_wait failed: %m\n");
+            _exit(1);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &woken);
+
+        if (getppid() != AcceptorMasterPid)
+            break;
+
+        for (i = 0; i < nevents; i++)
+            batch += AcceptorDrain(slot, events[i].data.fd, &woken);
+
+        if (nevents > 0)
+        {
+            me->wakeups++;
+            if (batch > me->max_batch)
+                me->max_batch = batch;
+        }
+
+        /* session children, SIGCHLD got us out of epoll_wait */
+        ChildRegistryReap();
+    }
+
+    if (AcceptorState->draining)
+    {
+        struct timespec woken;
+
+        clock_gettime(CLOCK_MONOTONIC, &woken);
+        for (i = 0; i < nsockets; i++)
+            AcceptorDrain(slot, AcceptorSockets[slot][i], &woken);
+    }
+
+    close(epfd);
+    _exit(0);
+}
+
+/*
+ * Accept connections from listen_fd until the queue is empty and fork a
+ * session child for each.  Returns the number of connections accepted.
+ */
+static int
+AcceptorDrain(int slot, int listen_fd, const struct timespec *woken)
+{
+    AcceptorSlot *me = &AcceptorState->slots[slot];
+    int			count = 0;
+
+    for (;;)
+    {
+        ClientSocket client;
+        struct timespec now;
+        uint64_t	latency_us;
+        int			child_slot;
+        pid_t		pid;
+
+        if (AcceptConnection(listen_fd, &client) != STATUS_OK)
+        {
+            /* the connection went away before we got to it; keep going */
+            if (errno == ECONNABORTED || errno == EINTR)
+                continue;
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        latency_us = (uint64_t) (now.tv_sec - woken->tv_sec) * 1000000 +
+            (now.tv_nsec - woken->tv_nsec) / 1000;
+        me->accepted++;
+        me->latency_sum_us += latency_us;
+        if (latency_us > me->latency_max_us)
+            me->latency_max_us = latency_us;
+        count++;
+
+        child_slot = ChildRegistryReserve();
+        fflush(NULL);
+        pid = fork();
+        if (pid == 0)
+        {
+            ChildRegistryStarted(child_slot);
+            signal(SIGCHLD, SIG_DFL);
+            CloseAcceptorSockets(slot);
+            ServeConnection(&client);
+            _exit(0);
+        }
+        ChildRegistryForked(child_slot, pid);
+        if (pid < 0)
+        {
+            fprintf(stderr, "could not fork new process for connection: %m\n");
+            me->fork_failed++;
+        }
+        close(client.sock);
+    }
+    return count;
+}
+
+/*
+ * AcceptorStats -- append a description of the acceptors to buf
+ */
+void
+AcceptorStats(StringInfo buf)
+{
+    time_t		now = time(NULL);
+    int			i;
+
+    if (AcceptorState == NULL)
+        return;
+
+    appendStringInfo(buf, "acceptors: count=%d backlog=%d restarts=%llu\n",
+                     AcceptorState->nslots, AcceptorState->backlog,
+                     (unsigned long long) AcceptorState->restarts);
+
+    for (i = 0; i < AcceptorState->nslots; i++)
+    {
+        AcceptorSlot *slot = &AcceptorState->slots[i];
+        uint64_t	accepted = slot->accepted;
+
+        appendStringInfo(buf, "  acceptor %d: pid=%d accepted=%llu wakeups=%llu max_batch=%llu"
+                         " latency_avg=%lluus latency_max=%lluus fork_failed=%llu uptime=%lds\n",
+                         i, (int) slot->pid,
+                         (unsigned long long) accepted,
+                         (unsigned long long) slot->wakeups,
+                         (unsigned long long) slot->max_batch,
+                         (unsigned long long) (accepted > 0 ? slot->latency_sum_us / accepted : 0),
+                         (unsigned long long) slot->latency_max_us,
+                         (unsigned long long) slot->fork_failed,
+                         (long) (now - slot->started));
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * acceptor.h
+ *		SO_REUSEPORT multi-acceptor mode for the agent.
+ *
+ * The agent runs several acceptor processes.  Each acceptor has its own
+ * set of listen sockets bound to the agent port with SO_REUSEPORT, so the
+ * kernel balances incoming connections across the acceptors instead of
+ * queueing all of them behind one accept loop.  Each acceptor still forks
+ * one child per connection.
+ *-------------------------------------------------------------------------
+ */
+#ifndef ACCEPTOR_H
+#define ACCEPTOR_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "connutil.h"
+#include "stringinfo.h"
+
+/* Upper bound on DEBO_ACCEPTORS */
+#define MAX_ACCEPTORS 64
+
+/*
+ * Per-acceptor counters.  Like the pool slots, they live in anonymous shared
+ * memory so whichever session child answers a stats request can report
+ * on every acceptor.
+ *
+ * Accept latency is the time from the wakeup that reported a listen socket
+ * readable until accept4() handed us the connection.  It grows when a
+ * burst is larger than one drain pass can keep up with.
+ */
+typedef struct AcceptorSlot
+{
+    pid_t		pid;
+    time_t		started;
+    uint64_t	wakeups;		/* epoll wakeups with a listen socket ready */
+    uint64_t	accepted;		/* connections accepted */
+    uint64_t	max_batch;		/* most connections drained in one wakeup */
+    uint64_t	fork_failed;	/* connections dropped because fork failed */
+    uint64_t	latency_sum_us; /* total accept latency */
+    uint64_t	latency_max_us; /* worst accept latency */
+} AcceptorSlot;
+
+typedef struct AcceptorShmem
+{
+    int			nslots;
+    int			backlog;
+    bool		draining;		/* a new master took over, empty the queues */
+    uint64_t	restarts;		/* acceptors forked again after exiting */
+    AcceptorSlot slots[MAX_ACCEPTORS];
+} AcceptorShmem;
+
+/* number of acceptor processes, 0 disables the mode */
+extern int	AcceptorCount;
+
+extern int	AcceptorMain(int *listen_sockets, int nsockets);
+extern void AcceptorStats(StringInfo buf);
+
+/* provided by debo.c */
+extern int	OpenListenSockets(int *listen_sockets, int *nsockets, int maxlisten);
+extern void ServeConnection(ClientSocket *client_sock);
+
+#endif							/* ACCEPTOR_H */
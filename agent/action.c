@@ -29,80 +29,47 @@
 #include <fcntl.h>
 
 #include "utiles.h"
+#include "subproc.h"
 
-// Structure to capture command execution results
+// Structure to capture command execution results.  The output stays
+// valid until the next executeCommand() in the same thread.
 typedef struct {
     int exit_code;
-    char stdout_output[4096];
-    char stderr_output[4096];
+    const char *stdout_output;
+    const char *stderr_output;
 } CommandResult;
 
+static __thread StringInfoData command_stdout;
+static __thread StringInfoData command_stderr;
+
 // Execute command and capture output
 CommandResult executeCommand(const char* command) {
     CommandResult result = {0};
-    int stdout_pipe[2], stderr_pipe[2];
-    pid_t pid;
-    
-    // Create pipes for stdout and stderr
-    if (pipe(stdout_pipe) < 0 || pipe(stderr_pipe) < 0) {
-        result.exit_code = -1;
-        return result;
-    }
-    
-    pid = fork();
-    if (pid < 0) {
+    SubprocOptions opts;
+    SubprocResult run;
+
+    if (command_stdout.data == NULL) {
+        initStringInfo(&command_stdout);
+        initStringInfo(&command_stderr);
+    }
+    resetStringInfo(&command_stdout);
+    resetStringInfo(&command_stderr);
+
+    // Both streams are read as they fill, so neither can block the other
+    SubprocDefaultOptions(&opts);
+    opts.out = &command_stdout;
+    opts.err = &command_stderr;
+    if (RunSubprocess(command, &opts, &run) != 0) {
+        appendStringInfo(&command_stderr, "could not run command: %s\n", strerror(errno));
         result.exit_code = -1;
-        return result;
-    }
-    
-    if (pid == 0) {
-        // Child process
-        close(stdout_pipe[0]);
-        close(stderr_pipe[0]);
-        
-        // Redirect stdout and stderr to pipes
-        dup2(stdout_pipe[1], STDOUT_FILENO);
-        dup2(stderr_pipe[1], STDERR_FILENO);
-        close(stdout_pipe[1]);
-        close(stderr_pipe[1]);
-        
-        // Execute the command
-        execl("/bin/sh", "sh", "-c", command, NULL);
-        exit(127); // execl failed
     } else {
-        // Parent process
-        close(stdout_pipe[1]);
-        close(stderr_pipe[1]);
-        
-        char buffer[256];
-        ssize_t count;
-        
-        // Read stdout
-        while ((count = read(stdout_pipe[0], buffer, sizeof(buffer)-1)) > 0) {
-            buffer[count] = '\0';
-            strncat(result.stdout_output, buffer, sizeof(result.stdout_output)-strlen(result.stdout_output)-1);
-        }
-        
-        // Read stderr
-        while ((count = read(stderr_pipe[0], buffer, sizeof(buffer)-1)) > 0) {
-            buffer[count] = '\0';
-            strncat(result.stderr_output, buffer, sizeof(result.stderr_output)-strlen(result.stderr_output)-1);
-        }
-        
-        close(stdout_pipe[0]);
-        close(stderr_pipe[0]);
-        
-        // Wait for process to complete and get exit status
-        int status;
-        waitpid(pid, &status, 0);
-        
-        if (WIFEXITED(status)) {
-            result.exit_code = WEXITSTATUS(status);
-        } else {
-            result.exit_code = -1;
-        }
+        if (run.timed_out)
+            appendStringInfo(&command_stderr, "command timed out after %d seconds\n", CommandTimeout);
+        result.exit_code = run.status;
     }
-    
+
+    result.stdout_output = command_stdout.data;
+    result.stderr_output = command_stderr.data;
     return result;
 }
 
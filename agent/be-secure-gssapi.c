@@ -10,15 +10,20 @@
 #include <unistd.h>
 #include <gssapi.h>
 #include <gssapi/gssapi.h>
+#include <gssapi/gssapi_ext.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <netinet/in.h>
 #include "connutil.h"
+#include "format.h"
 #include "latch.h"
+#include "protocol.h"
 
-pg_gssinfo *gss;
+__thread pg_gssinfo *gss;
 #define Min(x, y)               ((x) < (y) ? (x) : (y))
+#define Max(x, y)               ((x) > (y) ? (x) : (y))
 #define pg_hton32(x)            (x)
 #define pg_ntoh32(x)            (x)
 
@@ -47,41 +52,222 @@ char       *pg_krb_server_keyfile;
  * would have to allocate memory for them to then pass them to GSSAPI.
  *
  * Therefore, these two #define's are effectively part of the protocol
- * spec and can't ever be changed.
+ * spec and can't ever be changed.  Connections start out with them; the
+ * capability handshake may then settle on larger packets, up to
+ * PQ_GSS_MAX_BUFFER_SIZE (see secure_gssapi_set_packet_size()).
+ *
+ * Packets are wrapped and unwrapped in place: the data goes into its slot
+ * of the send buffer between the header and the trailer GSSAPI asks for
+ * and is encrypted there, and incoming packets are decrypted where they
+ * were received, from where the data is handed to the caller.  The
+ * concatenated slots are an ordinary gss_wrap() token, so the peer may
+ * still use gss_unwrap().
  */
 #define PQ_GSS_SEND_BUFFER_SIZE 16384
 #define PQ_GSS_RECV_BUFFER_SIZE 16384
+#define PQ_GSS_MAX_BUFFER_SIZE (256 * 1024)
 #define DBINVALID_SOCKET (-1)
 #define STATUS_OK                               (0)
 #define STATUS_ERROR                    (-1)
 #define STATUS_EOF                              (-2)
 
 /*
- * Since we manage at most one GSS-encrypted connection per backend,
- * we can just keep all this state in static variables.  The char *
- * variables point to buffers that are allocated once and re-used.
+ * A process or thread works on at most one GSS-encrypted connection at a
+ * time, so we can just keep all this state in thread-local variables.
+ * The char * variables point to buffers that are allocated once and
+ * re-used.  The event engine, which moves connections between threads,
+ * detaches and reattaches the whole set with secure_gssapi_save() and
+ * secure_gssapi_restore().
  */
-static char *PqGSSSendBuffer;	/* Encrypted data waiting to be sent */
-static int	PqGSSSendLength;	/* End of data available in PqGSSSendBuffer */
-static int	PqGSSSendNext;		/* Next index to send a byte from
-                                 * PqGSSSendBuffer */
-static int	PqGSSSendConsumed;	/* Number of source bytes encrypted but not
-                                 * yet reported as sent */
+static __thread char *PqGSSSendBuffer;	/* Encrypted data waiting to be sent */
+static __thread int	PqGSSSendBufferSize;	/* Allocated size of PqGSSSendBuffer */
+static __thread int	PqGSSSendLength;	/* End of data available in PqGSSSendBuffer */
+static __thread int	PqGSSSendNext;		/* Next index to send a byte from
+                                         * PqGSSSendBuffer */
+static __thread int	PqGSSSendConsumed;	/* Number of source bytes encrypted but not
+                                         * yet reported as sent */
 
-static char *PqGSSRecvBuffer;	/* Received, encrypted data */
-static int	PqGSSRecvLength;	/* End of data available in PqGSSRecvBuffer */
+static __thread char *PqGSSRecvBuffer;	/* Received, encrypted data */
+static __thread int	PqGSSRecvBufferSize;	/* Allocated size of PqGSSRecvBuffer */
+static __thread int	PqGSSRecvLength;	/* End of data available in PqGSSRecvBuffer */
 
-static char *PqGSSResultBuffer; /* Decryption of data in gss_RecvBuffer */
-static int	PqGSSResultLength;	/* End of data available in PqGSSResultBuffer */
-static int	PqGSSResultNext;	/* Next index to read a byte from
-                                 * PqGSSResultBuffer */
+/* The decrypted packet, in place in PqGSSRecvBuffer */
+static __thread int	PqGSSResultLength;	/* End of decrypted data in PqGSSRecvBuffer */
+static __thread int	PqGSSResultNext;	/* Next index to read a byte from
+                                         * PqGSSRecvBuffer */
 
-static uint32_t PqGSSMaxPktSize;	/* Maximum size we can encrypt and fit the
-                                     * results into our output buffer */
+static __thread uint32_t PqGSSMaxPktSize;	/* Maximum size we can encrypt and fit the
+                                             * results into our output buffer */
 
+static __thread int PqGSSTransport;		/* TRANSPORT_* of the connection */
 
+/*
+ * When set, everything written for the client goes unencrypted to this
+ * file instead; background jobs use it to run ordinary request handlers
+ * into their log (see jobs.c).
+ */
+static __thread int PqGSSOutputFd = -1;
+
+/* Detached copy of the variables above, see secure_gssapi_save() */
+struct GSSState
+{
+    pg_gssinfo *gss;
+    char	   *send_buffer;
+    int			send_buffer_size;
+    int			send_length;
+    int			send_next;
+    int			send_consumed;
+    char	   *recv_buffer;
+    int			recv_buffer_size;
+    int			recv_length;
+    int			result_length;
+    int			result_next;
+    uint32_t	max_pkt_size;
+    int			transport;
+};
 
 
+/*
+ * Put the next packet, len bytes from data, into PqGSSSendBuffer after
+ * the length word, encrypting it in place unless this is a local session.
+ *
+ * Returns the length of the packet, or -1 after reporting a failure.
+ */
+static ssize_t
+wrap_packet(const char *data, size_t len)
+{
+    OM_uint32	major,
+                minor;
+    gss_iov_buffer_desc iov[4];
+    char	   *slot = PqGSSSendBuffer + PqGSSSendLength + sizeof(uint32);
+    size_t		room = PqGSSSendBufferSize - PqGSSSendLength - sizeof(uint32);
+    size_t		pktlen = 0;
+    int			conf_state = 0;
+    int			i;
+
+    if (PqGSSTransport != TRANSPORT_PLAIN)
+    {
+        iov[0].type = GSS_IOV_BUFFER_TYPE_HEADER;
+        iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+        iov[2].type = GSS_IOV_BUFFER_TYPE_PADDING;
+        iov[3].type = GSS_IOV_BUFFER_TYPE_TRAILER;
+        for (i = 0; i < 4; i++)
+        {
+            iov[i].buffer.value = NULL;
+            iov[i].buffer.length = 0;
+        }
+        iov[1].buffer.length = len;
+
+        major = gss_wrap_iov_length(&minor, gss->ctx,
+                                    PqGSSTransport == TRANSPORT_ENCRYPT,
+                                    GSS_C_QOP_DEFAULT, NULL, iov, 4);
+        if (major != GSS_S_COMPLETE)
+        {
+            pg_GSS_error(("GSSAPI wrap error"), major, minor);
+            return -1;
+        }
+        for (i = 0; i < 4; i++)
+            pktlen += iov[i].buffer.length;
+    }
+    else
+        pktlen = len;
+
+    if (pktlen > room)
+    {
+        fprintf(stderr, "server tried to send oversize GSSAPI packet (%zu > %zu)\n",
+                pktlen, room);
+        return -1;
+    }
+
+    /*
+     * A local session (see secure_open_local()) or a plaintext listener
+     * sends the data as is.
+     */
+    if (PqGSSTransport == TRANSPORT_PLAIN)
+    {
+        memcpy(slot, data, len);
+        return pktlen;
+    }
+
+    /* header, data, padding and trailer follow each other in the packet */
+    for (i = 0; i < 4; i++)
+    {
+        iov[i].buffer.value = slot;
+        slot += iov[i].buffer.length;
+    }
+    memcpy(iov[1].buffer.value, data, len);
+
+    major = gss_wrap_iov(&minor, gss->ctx, PqGSSTransport == TRANSPORT_ENCRYPT,
+                         GSS_C_QOP_DEFAULT, &conf_state, iov, 4);
+    if (major != GSS_S_COMPLETE)
+    {
+        pg_GSS_error(("GSSAPI wrap error"), major, minor);
+        return -1;
+    }
+    if (conf_state == 0 && PqGSSTransport == TRANSPORT_ENCRYPT)
+    {
+        fprintf(stderr, "outgoing GSSAPI message would not use confidentiality\n");
+        return -1;
+    }
+    return pktlen;
+}
+
+/*
+ * Decrypt the packet of len bytes waiting in PqGSSRecvBuffer after the
+ * length word, in place, and make it the result to return.  The packets
+ * of a local session or a plaintext listener are not wrapped.
+ *
+ * Returns 0, or -1 after reporting a failure.
+ */
+static int
+unwrap_packet(size_t len)
+{
+    OM_uint32	major,
+                minor;
+    gss_iov_buffer_desc iov[2];
+    char	   *data;
+    int			conf_state = 0;
+
+    if (PqGSSTransport == TRANSPORT_PLAIN)
+    {
+        PqGSSResultNext = sizeof(uint32);
+        PqGSSResultLength = sizeof(uint32) + len;
+        return 0;
+    }
+
+    iov[0].type = GSS_IOV_BUFFER_TYPE_STREAM;
+    iov[0].buffer.value = PqGSSRecvBuffer + sizeof(uint32);
+    iov[0].buffer.length = len;
+    iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+    iov[1].buffer.value = NULL;
+    iov[1].buffer.length = 0;
+
+    major = gss_unwrap_iov(&minor, gss->ctx, &conf_state, NULL, iov, 2);
+    if (major != GSS_S_COMPLETE)
+    {
+        pg_GSS_error(("GSSAPI unwrap error"), major, minor);
+        return -1;
+    }
+    if (conf_state == 0 && PqGSSTransport == TRANSPORT_ENCRYPT)
+    {
+        fprintf(stderr, "incoming GSSAPI message did not use confidentiality\n");
+        return -1;
+    }
+
+    /* the data is left inside the token, which is all we sized for */
+    data = iov[1].buffer.value;
+    if (data < PqGSSRecvBuffer + sizeof(uint32) ||
+        data + iov[1].buffer.length > PqGSSRecvBuffer + sizeof(uint32) + len)
+    {
+        fprintf(stderr, "GSSAPI unwrapped a packet out of place\n");
+        gss_release_iov_buffer(&minor, iov, 2);
+        return -1;
+    }
+    PqGSSResultNext = data - PqGSSRecvBuffer;
+    PqGSSResultLength = PqGSSResultNext + iov[1].buffer.length;
+    return 0;
+}
+
 /*
  * Attempt to write len bytes of data from ptr to a GSSAPI-encrypted connection.
  *
@@ -101,13 +287,11 @@ static uint32_t PqGSSMaxPktSize;	/* Maximum size we can encrypt and fit the
 ssize_t
 be_gssapi_write(ClientSocket *client_sock , void *ptr, size_t len)
 {
-    OM_uint32	major,
-                minor;
-    gss_buffer_desc input,
-                    output;
     size_t		bytes_to_encrypt;
     size_t		bytes_encrypted;
-    gss_ctx_id_t gctx = gss->ctx;
+
+    if (PqGSSOutputFd >= 0)
+        return write(PqGSSOutputFd, ptr, len);
 
     /*
      * When we get a retryable failure, we must not tell the caller we have
@@ -143,7 +327,8 @@ be_gssapi_write(ClientSocket *client_sock , void *ptr, size_t len)
      */
     while (bytes_to_encrypt || PqGSSSendLength)
     {
-        int			conf_state = 0;
+        size_t		input_length;
+        ssize_t		pktlen;
         uint32		netlen;
 
         /*
@@ -157,7 +342,9 @@ be_gssapi_write(ClientSocket *client_sock , void *ptr, size_t len)
             ssize_t		ret;
             ssize_t		amount = PqGSSSendLength - PqGSSSendNext;
 
-            ret = secure_raw_write(client_sock, PqGSSSendBuffer + PqGSSSendNext, amount);
+            /* let the kernel pack the tokens of one write together */
+            ret = secure_raw_write_more(client_sock, PqGSSSendBuffer + PqGSSSendNext,
+                                        amount, bytes_to_encrypt > 0);
             if (ret <= 0)
                 return ret;
 
@@ -187,56 +374,30 @@ be_gssapi_write(ClientSocket *client_sock , void *ptr, size_t len)
          * through all the data.
          */
         if (bytes_to_encrypt > PqGSSMaxPktSize)
-            input.length = PqGSSMaxPktSize;
+            input_length = PqGSSMaxPktSize;
         else
-            input.length = bytes_to_encrypt;
-
-        input.value = (char *) ptr + bytes_encrypted;
-
-        output.value = NULL;
-        output.length = 0;
+            input_length = bytes_to_encrypt;
 
         /*
          * Create the next encrypted packet.  Any failure here is considered a
          * hard failure, so we return -1 even if some data has been sent.
          */
-        major = gss_wrap(&minor, gctx, 1, GSS_C_QOP_DEFAULT,
-                         &input, &conf_state, &output);
-        if (major != GSS_S_COMPLETE)
-        {
-            pg_GSS_error(("GSSAPI wrap error"), major, minor);
-            errno = ECONNRESET;
-            return -1;
-        }
-        if (conf_state == 0)
+        pktlen = wrap_packet((char *) ptr + bytes_encrypted, input_length);
+        if (pktlen < 0)
         {
-            fprintf(stderr, "outgoing GSSAPI message would not use confidentiality\n");
-            return -1;
-        }
-        if (output.length > PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32))
-        {
-
-            printf("server tried to send oversize GSSAPI packet (%zu > %zu)",
-                   (size_t) output.length,
-                   PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32));
             errno = ECONNRESET;
             return -1;
         }
 
-        bytes_encrypted += input.length;
-        bytes_to_encrypt -= input.length;
-        PqGSSSendConsumed += input.length;
+        bytes_encrypted += input_length;
+        bytes_to_encrypt -= input_length;
+        PqGSSSendConsumed += input_length;
+        DbSendStats.tokens++;
 
-        /* 4 network-order bytes of length, then payload */
-        netlen = pg_hton32(output.length);
+        /* 4 network-order bytes of length, then the packet, already in place */
+        netlen = pg_hton32(pktlen);
         memcpy(PqGSSSendBuffer + PqGSSSendLength, &netlen, sizeof(uint32));
-        PqGSSSendLength += sizeof(uint32);
-
-        memcpy(PqGSSSendBuffer + PqGSSSendLength, output.value, output.length);
-        PqGSSSendLength += output.length;
-
-        /* Release buffer storage allocated by GSSAPI */
-        gss_release_buffer(&minor, &output);
+        PqGSSSendLength += sizeof(uint32) + pktlen;
     }
 
     /* If we get here, our counters should all match up. */
@@ -265,24 +426,18 @@ be_gssapi_write(ClientSocket *client_sock , void *ptr, size_t len)
 ssize_t
 be_gssapi_read(ClientSocket *client_sock , void *ptr, size_t len)
 {
-    OM_uint32	major,
-                minor;
-    gss_buffer_desc input,
-                    output;
+    size_t		input_length;
     ssize_t		ret;
     size_t		bytes_returned = 0;
-    gss_ctx_id_t gctx = gss->ctx;
 
     /*
      * The plan here is to read one incoming encrypted packet into
-     * PqGSSRecvBuffer, decrypt it into PqGSSResultBuffer, and then dole out
-     * data from there to the caller.  When we exhaust the current input
-     * packet, read another.
+     * PqGSSRecvBuffer, decrypt it where it is, and then dole out data from
+     * there to the caller.  When we exhaust the current input packet, read
+     * another.
      */
     while (bytes_returned < len)
     {
-        int			conf_state = 0;
-
         /* Check if we have data in our buffer that we can return immediately */
         if (PqGSSResultNext < PqGSSResultLength)
         {
@@ -293,7 +448,7 @@ be_gssapi_read(ClientSocket *client_sock , void *ptr, size_t len)
              * Copy the data from our result buffer into the caller's buffer,
              * at the point where we last left off filling their buffer.
              */
-            memcpy((char *) ptr + bytes_returned, PqGSSResultBuffer + PqGSSResultNext, bytes_to_copy);
+            memcpy((char *) ptr + bytes_returned, PqGSSRecvBuffer + PqGSSResultNext, bytes_to_copy);
             PqGSSResultNext += bytes_to_copy;
             bytes_returned += bytes_to_copy;
 
@@ -323,7 +478,7 @@ be_gssapi_read(ClientSocket *client_sock , void *ptr, size_t len)
         /*
          * At this point, our result buffer is empty with more bytes being
          * requested to be read.  We are now ready to load the next packet and
-         * decrypt it (entirely) into our result buffer.
+         * decrypt it (entirely) where it lands.
          */
 
         /* Collect the length if we haven't already */
@@ -338,21 +493,22 @@ be_gssapi_read(ClientSocket *client_sock , void *ptr, size_t len)
 
             PqGSSRecvLength += ret;
 
-            /* If we still haven't got the length, return to the caller */
+            /*
+             * If we still haven't got the length, read on.  A short read is
+             * no reason to give up on a blocking socket, and on one that
+             * isn't, the next read says whether it would block.
+             */
             if (PqGSSRecvLength < sizeof(uint32))
-            {
-                errno = EWOULDBLOCK;
-                return -1;
-            }
+                continue;
         }
 
         /* Decode the packet length and check for overlength packet */
-        input.length = pg_ntoh32(*(uint32 *) PqGSSRecvBuffer);
+        input_length = pg_ntoh32(*(uint32 *) PqGSSRecvBuffer);
 
-        if (input.length > PQ_GSS_RECV_BUFFER_SIZE - sizeof(uint32))
+        if (input_length > PqGSSRecvBufferSize - sizeof(uint32))
         {
-            printf("server tried to send oversize GSSAPI packet (%zu > %zu)", (size_t) input.length,
-                   PQ_GSS_RECV_BUFFER_SIZE - sizeof(uint32));
+            printf("server tried to send oversize GSSAPI packet (%zu > %zu)", input_length,
+                   PqGSSRecvBufferSize - sizeof(uint32));
             return -1;
         }
 
@@ -361,50 +517,31 @@ be_gssapi_read(ClientSocket *client_sock , void *ptr, size_t len)
          * wherever we left off from the last time we were called.
          */
         ret = secure_raw_read(client_sock, PqGSSRecvBuffer + PqGSSRecvLength,
-                              input.length - (PqGSSRecvLength - sizeof(uint32)));
+                              input_length - (PqGSSRecvLength - sizeof(uint32)));
         /* If ret <= 0, secure_raw_read already set the correct errno */
         if (ret <= 0)
             return ret;
 
         PqGSSRecvLength += ret;
 
-        /* If we don't yet have the whole packet, return to the caller */
-        if (PqGSSRecvLength - sizeof(uint32) < input.length)
-        {
-            errno = EWOULDBLOCK;
-            return -1;
-        }
+        /* If we don't yet have the whole packet, read on, as above */
+        if (PqGSSRecvLength - sizeof(uint32) < input_length)
+            continue;
 
         /*
-         * We now have the full packet and we can perform the decryption and
-         * refill our result buffer, then loop back up to pass data back to
-         * the caller.
+         * We now have the full packet and we can perform the decryption,
+         * then loop back up to pass data back to the caller.  The data stays
+         * in PqGSSRecvBuffer until the caller has had all of it, and only
+         * then is the next packet read.
          */
-        output.value = NULL;
-        output.length = 0;
-        input.value = PqGSSRecvBuffer + sizeof(uint32);
-
-        major = gss_unwrap(&minor, gctx, &input, &output, &conf_state, NULL);
-        if (major != GSS_S_COMPLETE)
+        if (unwrap_packet(input_length) < 0)
         {
-            pg_GSS_error(("GSSAPI unwrap error"), major, minor);
             errno = ECONNRESET;
             return -1;
         }
-        if (conf_state == 0)
-        {
-            printf("incoming GSSAPI message did not use confidentiality");
-            return -1;
-        }
 
-        memcpy(PqGSSResultBuffer, output.value, output.length);
-        PqGSSResultLength = output.length;
-
-        /* Our receive buffer is now empty, reset it */
+        /* The packet is taken apart; the next one starts from scratch */
         PqGSSRecvLength = 0;
-
-        /* Release buffer storage allocated by GSSAPI */
-        gss_release_buffer(&minor, &output);
     }
 
     return bytes_returned;
@@ -447,6 +584,131 @@ read_or_wait(ClientSocket *client_sock, ssize_t len)
     PqGSSRecvLength = total_read;
     return len;
 }
+
+/*
+ * Which transport does the listener the client reached offer?  Chosen by
+ * port, see IntegrityPortNumber and PlainPortNumber.
+ */
+static int
+listener_transport(ClientSocket *client_sock)
+{
+    struct sockaddr_storage addr;
+    socklen_t	addrlen = sizeof(addr);
+    int			port;
+
+    if (getsockname(client_sock->sock, (struct sockaddr *) &addr, &addrlen) < 0)
+        return TRANSPORT_ENCRYPT;
+    if (addr.ss_family == AF_INET)
+        port = ntohs(((struct sockaddr_in *) &addr)->sin_port);
+    else if (addr.ss_family == AF_INET6)
+        port = ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+    else
+        return TRANSPORT_ENCRYPT;
+
+    if (IntegrityPortNumber > 0 && port == IntegrityPortNumber)
+        return TRANSPORT_INTEGRITY;
+    if (PlainPortNumber > 0 && port == PlainPortNumber)
+        return TRANSPORT_PLAIN;
+    return TRANSPORT_ENCRYPT;
+}
+
+/*
+ * Settle the transport of a listener that does not encrypt, right after
+ * the handshake: read the client's transport message, answer with our
+ * own, and fail unless the two agree.  Both messages are wrapped with
+ * confidentiality, so a client cannot be talked into a weaker transport
+ * than the one it asked for.
+ *
+ * Returns 0 on agreement, -1 (and logs) otherwise.
+ */
+static int
+agree_transport(ClientSocket *client_sock, int transport)
+{
+    OM_uint32	major,
+                minor;
+    gss_buffer_desc input,
+                output = GSS_C_EMPTY_BUFFER;
+    char		message[TRANSPORT_MESSAGE_LEN];
+    int			conf_state = 0;
+    int			requested;
+    uint32		netlen;
+    size_t		sent = 0;
+    ssize_t		ret;
+
+    if (read_or_wait(client_sock, sizeof(uint32)) < 0)
+        return -1;
+    input.length = pg_ntoh32(*(uint32 *) PqGSSRecvBuffer);
+    PqGSSRecvLength = 0;
+    if (input.length > (size_t) PqGSSRecvBufferSize)
+    {
+        fprintf(stderr, "oversize GSSAPI packet sent by the client (%zu > %d)\n",
+                (size_t) input.length, PqGSSRecvBufferSize);
+        return -1;
+    }
+    if (read_or_wait(client_sock, input.length) < 0)
+        return -1;
+    PqGSSRecvLength = 0;
+    input.value = PqGSSRecvBuffer;
+
+    major = gss_unwrap(&minor, gss->ctx, &input, &output, &conf_state, NULL);
+    if (major != GSS_S_COMPLETE)
+    {
+        pg_GSS_error(("GSSAPI unwrap error"), major, minor);
+        return -1;
+    }
+    if (conf_state == 0 || output.length != TRANSPORT_MESSAGE_LEN ||
+        memcmp(output.value, TRANSPORT_MAGIC, 4) != 0)
+    {
+        fprintf(stderr, "client did not request a transport on a %s port\n",
+                transport == TRANSPORT_PLAIN ? "plaintext" : "integrity-only");
+        gss_release_buffer(&minor, &output);
+        return -1;
+    }
+    requested = ((unsigned char *) output.value)[4];
+    gss_release_buffer(&minor, &output);
+
+    /* answer with ours, whether or not it matches */
+    memcpy(message, TRANSPORT_MAGIC, 4);
+    message[4] = (char) transport;
+    input.value = message;
+    input.length = TRANSPORT_MESSAGE_LEN;
+    major = gss_wrap(&minor, gss->ctx, 1, GSS_C_QOP_DEFAULT, &input,
+                     &conf_state, &output);
+    if (major != GSS_S_COMPLETE || conf_state == 0 ||
+        output.length > (size_t) PqGSSSendBufferSize - sizeof(uint32))
+    {
+        pg_GSS_error(("GSSAPI wrap error"), major, minor);
+        gss_release_buffer(&minor, &output);
+        return -1;
+    }
+    netlen = pg_hton32(output.length);
+    memcpy(PqGSSSendBuffer, &netlen, sizeof(uint32));
+    memcpy(PqGSSSendBuffer + sizeof(uint32), output.value, output.length);
+    PqGSSSendLength = sizeof(uint32) + output.length;
+    gss_release_buffer(&minor, &output);
+
+    while (sent < PqGSSSendLength)
+    {
+        ret = secure_raw_write(client_sock, PqGSSSendBuffer + sent,
+                               PqGSSSendLength - sent);
+        if (ret < 0 &&
+            !(errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR))
+            return -1;
+        if (ret > 0)
+            sent += ret;
+    }
+    PqGSSSendLength = 0;
+
+    if (requested != transport)
+    {
+        fprintf(stderr, "client requested transport %d on a %s port\n",
+                requested,
+                transport == TRANSPORT_PLAIN ? "plaintext" : "integrity-only");
+        return -1;
+    }
+    return 0;
+}
+
 /*
  * Start up a GSSAPI-encrypted connection.  This performs GSSAPI
  * authentication; after this function completes, it is safe to call
@@ -458,6 +720,10 @@ read_or_wait(ClientSocket *client_sock, ssize_t len)
  * function WILL block on the socket to be ready for read/write (using
  * WaitLatchOrSocket) as appropriate while establishing the GSSAPI
  * session.
+ *
+ * On an integrity-only or plaintext listener the client is still
+ * authenticated by the handshake, but the session's packets are then only
+ * signed, or sent as they are; see agree_transport().
  */
 ssize_t secure_open_gssapi(ClientSocket *client_sock)
 {
@@ -486,11 +752,13 @@ ssize_t secure_open_gssapi(ClientSocket *client_sock)
      */
     PqGSSSendBuffer = malloc(PQ_GSS_SEND_BUFFER_SIZE);
     PqGSSRecvBuffer = malloc(PQ_GSS_RECV_BUFFER_SIZE);
-    PqGSSResultBuffer = malloc(PQ_GSS_RECV_BUFFER_SIZE);
-    if (!PqGSSSendBuffer || !PqGSSRecvBuffer || !PqGSSResultBuffer)
+    if (!PqGSSSendBuffer || !PqGSSRecvBuffer)
         fprintf(stderr, "out of memory\n");
+    PqGSSSendBufferSize = PQ_GSS_SEND_BUFFER_SIZE;
+    PqGSSRecvBufferSize = PQ_GSS_RECV_BUFFER_SIZE;
     PqGSSSendLength = PqGSSSendNext = PqGSSSendConsumed = 0;
     PqGSSRecvLength = PqGSSResultLength = PqGSSResultNext = 0;
+    PqGSSTransport = TRANSPORT_ENCRYPT;
 
     /*
      * Use keytab from environment (KRB5_KTNAME) if available.
@@ -646,21 +914,404 @@ ssize_t secure_open_gssapi(ClientSocket *client_sock)
             break;
     }
 
+    PqGSSTransport = listener_transport(client_sock);
+    if (PqGSSTransport != TRANSPORT_ENCRYPT &&
+        agree_transport(client_sock, PqGSSTransport) < 0)
+        return -1;
+
     /*
      * Determine the max packet size which will fit in our buffer, after
      * accounting for the length.  be_gssapi_write will need this.
      */
-    major = gss_wrap_size_limit(&minor, gss->ctx, 1, GSS_C_QOP_DEFAULT,
-                                PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32),
-                                &PqGSSMaxPktSize);
+    if (PqGSSTransport == TRANSPORT_PLAIN)
+        PqGSSMaxPktSize = PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32);
+    else
+    {
+        major = gss_wrap_size_limit(&minor, gss->ctx,
+                                    PqGSSTransport == TRANSPORT_ENCRYPT,
+                                    GSS_C_QOP_DEFAULT,
+                                    PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32),
+                                    &PqGSSMaxPktSize);
 
-    if (GSS_ERROR(major))
+        if (GSS_ERROR(major))
+        {
+            pg_GSS_error(("GSSAPI size check error"), major, minor);
+            return -1;
+        }
+    }
+
+    gss->enc = true;
+
+    return 0;
+}
+
+/*
+ * Set up a session on the agent's Unix socket.
+ *
+ * The peer is identified by its kernel credentials instead of a Kerberos
+ * handshake, and data travels in the same length-prefixed packets as an
+ * encrypted session but without gss_wrap()/gss_unwrap(), so nothing above
+ * this file can tell the difference.  The client waits for a one-byte
+ * verdict: 'S' to go ahead, or 'E' followed by a message, after which it
+ * falls back to TCP and GSSAPI.
+ */
+ssize_t
+secure_open_local(ClientSocket *client_sock)
+{
+    char		msg[128];
+    char		verdict = 'S';
+
+    gss = (pg_gssinfo *) calloc(1, sizeof(pg_gssinfo));
+    PqGSSSendBuffer = malloc(PQ_GSS_SEND_BUFFER_SIZE);
+    PqGSSRecvBuffer = malloc(PQ_GSS_RECV_BUFFER_SIZE);
+    if (!gss || !PqGSSSendBuffer || !PqGSSRecvBuffer)
     {
-        pg_GSS_error(("GSSAPI size check error"), major, minor);
+        fprintf(stderr, "out of memory\n");
         return -1;
     }
+    PqGSSSendBufferSize = PQ_GSS_SEND_BUFFER_SIZE;
+    PqGSSRecvBufferSize = PQ_GSS_RECV_BUFFER_SIZE;
+    PqGSSSendLength = PqGSSSendNext = PqGSSSendConsumed = 0;
+    PqGSSRecvLength = PqGSSResultLength = PqGSSResultNext = 0;
+    PqGSSMaxPktSize = PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32);
+    PqGSSTransport = TRANSPORT_PLAIN;
 
-    gss->enc = true;
+    if (!UnixPeerAllowed(client_sock->sock, msg, sizeof(msg)))
+    {
+        fprintf(stderr, "%s\n", msg);
+        verdict = 'E';
+        /* best effort, we are closing anyway */
+        if (secure_raw_write(client_sock, &verdict, 1) == 1)
+            (void) secure_raw_write(client_sock, msg, strlen(msg) + 1);
+        return -1;
+    }
+
+    if (secure_raw_write(client_sock, &verdict, 1) != 1)
+        return -1;
 
     return 0;
 }
+
+/*
+ * Set up a client session: peer credentials on the Unix socket, GSSAPI
+ * everywhere else.
+ */
+ssize_t
+secure_open_session(ClientSocket *client_sock)
+{
+    if (client_sock->raddr.addr.ss_family == AF_UNIX)
+        return secure_open_local(client_sock);
+    return secure_open_gssapi(client_sock);
+}
+
+/*
+ * Tear down the state set up by secure_open_gssapi() or
+ * secure_open_local().
+ *
+ * A forked-per-connection child simply exits, but a pooled worker goes
+ * on to accept another client, so the security context, the client name
+ * and the packet buffers must be released before the next handshake.
+ */
+void
+secure_close_gssapi(void)
+{
+    OM_uint32	minor;
+
+    if (gss != NULL)
+    {
+        if (gss->ctx != GSS_C_NO_CONTEXT)
+            gss_delete_sec_context(&minor, &gss->ctx, GSS_C_NO_BUFFER);
+        if (gss->name != GSS_C_NO_NAME)
+            gss_release_name(&minor, &gss->name);
+        free(gss);
+        gss = NULL;
+    }
+
+    free(PqGSSSendBuffer);
+    free(PqGSSRecvBuffer);
+    PqGSSSendBuffer = PqGSSRecvBuffer = NULL;
+    PqGSSSendBufferSize = PqGSSRecvBufferSize = 0;
+
+    PqGSSSendLength = PqGSSSendNext = PqGSSSendConsumed = 0;
+    PqGSSRecvLength = PqGSSResultLength = PqGSSResultNext = 0;
+    PqGSSMaxPktSize = 0;
+    PqGSSTransport = TRANSPORT_ENCRYPT;
+}
+
+/*
+ * Switch the connection to packets of up to size bytes, length word
+ * included, both ways, as the capability handshake settled; the client
+ * has already made room for them.  Sizes below the default or above
+ * PQ_GSS_MAX_BUFFER_SIZE are brought within those limits.  Whatever is
+ * waiting in the buffers stays.
+ *
+ * Returns the packet size in effect, which is the old one if we ran out
+ * of memory.
+ */
+int
+secure_gssapi_set_packet_size(int size)
+{
+    OM_uint32	major,
+                minor;
+    OM_uint32	max_pkt_size;
+    char	   *buffer;
+
+    if (PqGSSSendBuffer == NULL || PqGSSRecvBuffer == NULL)
+        return PQ_GSS_SEND_BUFFER_SIZE;
+    if (size < PQ_GSS_SEND_BUFFER_SIZE)
+        size = PQ_GSS_SEND_BUFFER_SIZE;
+    if (size > PQ_GSS_MAX_BUFFER_SIZE)
+        size = PQ_GSS_MAX_BUFFER_SIZE;
+    if (size == PqGSSSendBufferSize && size == PqGSSRecvBufferSize)
+        return size;
+
+    if (PqGSSTransport != TRANSPORT_PLAIN)
+    {
+        major = gss_wrap_size_limit(&minor, gss->ctx,
+                                    PqGSSTransport == TRANSPORT_ENCRYPT,
+                                    GSS_C_QOP_DEFAULT,
+                                    size - sizeof(uint32), &max_pkt_size);
+        if (GSS_ERROR(major))
+        {
+            pg_GSS_error(("GSSAPI size check error"), major, minor);
+            return PqGSSSendBufferSize;
+        }
+    }
+    else
+        max_pkt_size = size - sizeof(uint32);
+
+    /* never shrink below what is waiting to go out or to be read */
+    if (size < PqGSSSendLength || size < PqGSSRecvLength ||
+        size < PqGSSResultLength)
+        return PqGSSSendBufferSize;
+
+    buffer = realloc(PqGSSRecvBuffer, size);
+    if (buffer == NULL)
+        return PqGSSSendBufferSize;
+    PqGSSRecvBuffer = buffer;
+    PqGSSRecvBufferSize = size;
+
+    buffer = realloc(PqGSSSendBuffer, size);
+    if (buffer == NULL)
+        return PqGSSSendBufferSize;
+    PqGSSSendBuffer = buffer;
+    PqGSSSendBufferSize = size;
+    PqGSSMaxPktSize = max_pkt_size;
+    return size;
+}
+
+/*
+ * Detach this thread's GSSAPI connection state into a heap object and
+ * leave the thread with no connection.  Returns NULL if nothing was set
+ * up.
+ */
+GSSState *
+secure_gssapi_save(void)
+{
+    GSSState   *state;
+
+    if (gss == NULL && PqGSSSendBuffer == NULL)
+        return NULL;
+
+    state = malloc(sizeof(GSSState));
+    if (state == NULL)
+        return NULL;
+    state->gss = gss;
+    state->send_buffer = PqGSSSendBuffer;
+    state->send_buffer_size = PqGSSSendBufferSize;
+    state->send_length = PqGSSSendLength;
+    state->send_next = PqGSSSendNext;
+    state->send_consumed = PqGSSSendConsumed;
+    state->recv_buffer = PqGSSRecvBuffer;
+    state->recv_buffer_size = PqGSSRecvBufferSize;
+    state->recv_length = PqGSSRecvLength;
+    state->result_length = PqGSSResultLength;
+    state->result_next = PqGSSResultNext;
+    state->max_pkt_size = PqGSSMaxPktSize;
+    state->transport = PqGSSTransport;
+
+    gss = NULL;
+    PqGSSSendBuffer = PqGSSRecvBuffer = NULL;
+    PqGSSSendBufferSize = PqGSSRecvBufferSize = 0;
+    PqGSSSendLength = PqGSSSendNext = PqGSSSendConsumed = 0;
+    PqGSSRecvLength = PqGSSResultLength = PqGSSResultNext = 0;
+    PqGSSMaxPktSize = 0;
+    PqGSSTransport = TRANSPORT_ENCRYPT;
+
+    return state;
+}
+
+/*
+ * Make a state saved by secure_gssapi_save() current in this thread and
+ * free the holder.  The thread must not have a connection of its own.
+ */
+void
+secure_gssapi_restore(GSSState *state)
+{
+    if (state == NULL)
+        return;
+
+    gss = state->gss;
+    PqGSSSendBuffer = state->send_buffer;
+    PqGSSSendBufferSize = state->send_buffer_size;
+    PqGSSSendLength = state->send_length;
+    PqGSSSendNext = state->send_next;
+    PqGSSSendConsumed = state->send_consumed;
+    PqGSSRecvBuffer = state->recv_buffer;
+    PqGSSRecvBufferSize = state->recv_buffer_size;
+    PqGSSRecvLength = state->recv_length;
+    PqGSSResultLength = state->result_length;
+    PqGSSResultNext = state->result_next;
+    PqGSSMaxPktSize = state->max_pkt_size;
+    PqGSSTransport = state->transport;
+    free(state);
+}
+
+/*
+ * Append this thread's connection to buf for another process, which takes
+ * it up with secure_gssapi_import().  The security context moves out with
+ * gss_export_sec_context(), so the connection is of no further use here;
+ * the caller still owns the buffers and frees them as usual.  Returns -1
+ * if the context could not be exported.
+ */
+int
+secure_gssapi_export(StringInfo buf)
+{
+    OM_uint32	major,
+                minor;
+    gss_buffer_desc token = GSS_C_EMPTY_BUFFER;
+    int			recv_used = Max(PqGSSRecvLength, PqGSSResultLength);
+
+    if (gss != NULL && gss->ctx != GSS_C_NO_CONTEXT)
+    {
+        major = gss_export_sec_context(&minor, &gss->ctx, &token);
+        if (major != GSS_S_COMPLETE)
+        {
+            pg_GSS_error(("GSSAPI context export error"), major, minor);
+            return -1;
+        }
+    }
+
+    sendbyte(buf, gss != NULL);
+    sendint32(buf, (uint32) PqGSSTransport);
+    sendint32(buf, PqGSSMaxPktSize);
+    sendint32(buf, (uint32) PqGSSSendBufferSize);
+    sendint32(buf, (uint32) PqGSSRecvBufferSize);
+    sendint32(buf, (uint32) PqGSSSendLength);
+    sendint32(buf, (uint32) PqGSSSendNext);
+    sendint32(buf, (uint32) PqGSSSendConsumed);
+    sendbytes(buf, PqGSSSendBuffer, PqGSSSendLength);
+    sendint32(buf, (uint32) PqGSSRecvLength);
+    sendint32(buf, (uint32) PqGSSResultLength);
+    sendint32(buf, (uint32) PqGSSResultNext);
+    sendbytes(buf, PqGSSRecvBuffer, recv_used);
+    sendint32(buf, (uint32) token.length);
+    sendbytes(buf, token.value, token.length);
+    gss_release_buffer(&minor, &token);
+    return 0;
+}
+
+/*
+ * Take up a connection exported by secure_gssapi_export(), reading from
+ * buf's cursor.  The thread must not have a connection of its own.
+ * Returns -1 if buf is short or the context cannot be imported.
+ */
+int
+secure_gssapi_import(StringInfo buf)
+{
+    OM_uint32	major,
+                minor;
+    gss_buffer_desc token;
+    int			recv_used;
+
+#define IMPORT_LEFT (buf->len - buf->cursor)
+    if (IMPORT_LEFT < 33)
+        return -1;
+    if (getmsgint(buf, 1))
+    {
+        gss = (pg_gssinfo *) calloc(1, sizeof(pg_gssinfo));
+        if (gss == NULL)
+            return -1;
+    }
+    PqGSSTransport = (int) getmsgint(buf, 4);
+    PqGSSMaxPktSize = getmsgint(buf, 4);
+    PqGSSSendBufferSize = (int) getmsgint(buf, 4);
+    PqGSSRecvBufferSize = (int) getmsgint(buf, 4);
+    if (PqGSSSendBufferSize < 0 || PqGSSSendBufferSize > PQ_GSS_MAX_BUFFER_SIZE ||
+        PqGSSRecvBufferSize < 0 || PqGSSRecvBufferSize > PQ_GSS_MAX_BUFFER_SIZE)
+        return -1;
+    if (PqGSSSendBufferSize > 0 &&
+        (PqGSSSendBuffer = malloc(PqGSSSendBufferSize)) == NULL)
+        return -1;
+    if (PqGSSRecvBufferSize > 0 &&
+        (PqGSSRecvBuffer = malloc(PqGSSRecvBufferSize)) == NULL)
+        return -1;
+
+    PqGSSSendLength = (int) getmsgint(buf, 4);
+    PqGSSSendNext = (int) getmsgint(buf, 4);
+    PqGSSSendConsumed = (int) getmsgint(buf, 4);
+    if (PqGSSSendLength < 0 || PqGSSSendLength > PqGSSSendBufferSize ||
+        PqGSSSendLength > IMPORT_LEFT)
+        return -1;
+    copymsgbytes(buf, PqGSSSendBuffer, PqGSSSendLength);
+
+    if (IMPORT_LEFT < 12)
+        return -1;
+    PqGSSRecvLength = (int) getmsgint(buf, 4);
+    PqGSSResultLength = (int) getmsgint(buf, 4);
+    PqGSSResultNext = (int) getmsgint(buf, 4);
+    recv_used = Max(PqGSSRecvLength, PqGSSResultLength);
+    if (recv_used < 0 || recv_used > PqGSSRecvBufferSize || recv_used > IMPORT_LEFT)
+        return -1;
+    copymsgbytes(buf, PqGSSRecvBuffer, recv_used);
+
+    if (IMPORT_LEFT < 4)
+        return -1;
+    token.length = getmsgint(buf, 4);
+    if (token.length > (size_t) IMPORT_LEFT)
+        return -1;
+    token.value = (void *) getmsgbytes(buf, (int) token.length);
+#undef IMPORT_LEFT
+    if (token.length == 0)
+        return 0;
+    if (gss == NULL)
+        return -1;
+
+    major = gss_import_sec_context(&minor, &token, &gss->ctx);
+    if (major != GSS_S_COMPLETE)
+    {
+        pg_GSS_error(("GSSAPI context import error"), major, minor);
+        return -1;
+    }
+    gss->enc = true;
+    return 0;
+}
+
+/*
+ * Is there already-decrypted data that a read would return without
+ * touching the socket?
+ */
+bool
+be_gssapi_read_pending(void)
+{
+    return PqGSSResultNext < PqGSSResultLength;
+}
+
+/*
+ * Send all further client output to fd, unencrypted.  -1 restores normal
+ * operation.
+ */
+void
+secure_redirect_output(int fd)
+{
+    PqGSSOutputFd = fd;
+}
+
+/*
+ * Is client output currently going to a file descriptor of its own?
+ */
+bool
+secure_output_redirected(void)
+{
+    return PqGSSOutputFd >= 0;
+}
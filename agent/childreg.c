@@ -0,0 +1,555 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * childreg.c
+ *		Registry of session child processes and per-class command caps.
+ *
+ * Everything lives in one anonymous shared mapping created by main()
+ * before any process is forked, guarded by a process-shared robust mutex.
+ * A session child that dies while holding the lock does not wedge the
+ * agent.
+ *
+ * A slot is reserved before fork() so that the child can stamp its start
+ * time into it straight away; the parent fills in the pid after fork()
+ * returns.  Reaping happens only in the process that forked, so the pid is
+ * always in place by the time waitpid() can return it.
+ *
+ * Class caps are enforced by the process that runs the command, around
+ * process_command().  Waiting requests sleep on a process-shared condition
+ * variable.  When a tracked child dies while it holds a class, the reaper
+ * gives the class back, so a crashed install doesn't block the next one
+ * forever.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "childreg.h"
+#include "protocol.h"
+#include "upgrade.h"
+
+#define STATUS_OK				(0)
+#define STATUS_ERROR			(-1)
+
+/* bump whenever ChildRegistryShmem changes, see UpgradeSharedMemory() */
+#define CHILDREG_LAYOUT_VERSION	1
+
+/* reserved, the parent has not seen fork() return yet */
+#define CHILD_PID_RESERVED		((pid_t) -1)
+
+int			ChildClassCaps[NUM_CHILD_CLASSES] = {
+    1,							/* CHILD_CLASS_INSTALL */
+    8,							/* CHILD_CLASS_CONTROL */
+    4,							/* CHILD_CLASS_CONFIGURE */
+    32							/* CHILD_CLASS_REPORT */
+};
+
+static const char *const ChildClassNames[NUM_CHILD_CLASSES] = {
+    "install",
+    "control",
+    "configure",
+    "report"
+};
+
+typedef struct ChildEntry
+{
+    pid_t		pid;			/* 0 if the entry is free */
+    int			cls;			/* ChildClass currently held */
+    uint64_t	forked_us;		/* when the parent called fork() */
+    uint64_t	started_us;		/* when the child began running */
+} ChildEntry;
+
+typedef struct ChildClassState
+{
+    int			cap;
+    int			running;
+    int			waiting;
+    uint64_t	admitted;		/* commands run in this class */
+    uint64_t	queued;			/* commands that had to wait for the cap */
+    uint64_t	wait_sum_us;
+    uint64_t	wait_max_us;
+} ChildClassState;
+
+typedef struct ChildRegistryShmem
+{
+    pthread_mutex_t lock;
+    pthread_cond_t class_cond;	/* broadcast whenever a class frees up */
+    int			live;
+    uint64_t	spawned;
+    uint64_t	fork_failed;
+    uint64_t	untracked;		/* forked while the table was full */
+    uint64_t	exited_ok;
+    uint64_t	exited_error;
+    uint64_t	signaled;
+    uint64_t	spawn_count;
+    uint64_t	spawn_sum_us;
+    uint64_t	spawn_max_us;
+    uint64_t	runtime_count;
+    uint64_t	runtime_sum_us;
+    uint64_t	runtime_max_us;
+    ChildClassState classes[NUM_CHILD_CLASSES];
+    ChildEntry	children[MAX_TRACKED_CHILDREN];
+} ChildRegistryShmem;
+
+static ChildRegistryShmem *Registry = NULL;
+
+/* our own entry, if this process is a tracked session child */
+static int	MyChildSlot = -1;
+
+static uint64_t
+now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+registry_lock(void)
+{
+    if (pthread_mutex_lock(&Registry->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&Registry->lock);
+}
+
+static void
+registry_unlock(void)
+{
+    pthread_mutex_unlock(&Registry->lock);
+}
+
+/*
+ * ChildRegistryInit -- create the shared registry
+ *
+ * Must be called before the first fork.  The caps are taken from
+ * ChildClassCaps[] at this point.  After a hot upgrade the registry of
+ * the previous master is reused, so children it still runs keep counting
+ * against the caps.
+ */
+int
+ChildRegistryInit(void)
+{
+    pthread_mutexattr_t mattr;
+    pthread_condattr_t cattr;
+    bool		inherited;
+    int			i;
+
+    Registry = UpgradeSharedMemory("CHILDREG", sizeof(ChildRegistryShmem),
+                                   CHILDREG_LAYOUT_VERSION, &inherited);
+    if (Registry == NULL)
+    {
+        fprintf(stderr, "could not map child registry: %m\n");
+        return STATUS_ERROR;
+    }
+    if (inherited)
+    {
+        registry_lock();
+        for (i = 0; i < NUM_CHILD_CLASSES; i++)
+            Registry->classes[i].cap = ChildClassCaps[i];
+        pthread_cond_broadcast(&Registry->class_cond);
+        registry_unlock();
+        return STATUS_OK;
+    }
+    memset(Registry, 0, sizeof(ChildRegistryShmem));
+
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&Registry->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&Registry->class_cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    for (i = 0; i < NUM_CHILD_CLASSES; i++)
+        Registry->classes[i].cap = ChildClassCaps[i];
+
+    return STATUS_OK;
+}
+
+/*
+ * ChildRegistryReserve -- claim an entry for a child about to be forked
+ *
+ * Returns the entry index, or -1 if the table is full; the child is then
+ * still forked and reaped, just not tracked individually.
+ */
+int
+ChildRegistryReserve(void)
+{
+    uint64_t	now = now_us();
+    int			i;
+
+    if (Registry == NULL)
+        return -1;
+
+    registry_lock();
+    for (i = 0; i < MAX_TRACKED_CHILDREN; i++)
+    {
+        ChildEntry *entry = &Registry->children[i];
+
+        if (entry->pid != 0)
+            continue;
+        entry->pid = CHILD_PID_RESERVED;
+        entry->cls = CHILD_CLASS_NONE;
+        entry->forked_us = now;
+        entry->started_us = 0;
+        registry_unlock();
+        return i;
+    }
+    registry_unlock();
+    return -1;
+}
+
+/*
+ * ChildRegistryForked -- record the result of fork() in the parent
+ *
+ * pid < 0 means fork() failed and the reservation is dropped.
+ */
+void
+ChildRegistryForked(int slot, pid_t pid)
+{
+    if (Registry == NULL)
+        return;
+
+    registry_lock();
+    if (pid < 0)
+        Registry->fork_failed++;
+    else
+    {
+        Registry->spawned++;
+        if (slot < 0)
+            Registry->untracked++;
+        else
+            Registry->live++;
+    }
+    if (slot >= 0)
+        Registry->children[slot].pid = pid < 0 ? 0 : pid;
+    registry_unlock();
+}
+
+/*
+ * ChildRegistryStarted -- called first thing in a freshly forked child
+ */
+void
+ChildRegistryStarted(int slot)
+{
+    MyChildSlot = slot;
+    if (Registry != NULL && slot >= 0)
+        Registry->children[slot].started_us = now_us();
+}
+
+/*
+ * ChildRegistryDetach -- forget our entry in a process that outlives the
+ * session child it was forked from
+ */
+void
+ChildRegistryDetach(void)
+{
+    MyChildSlot = -1;
+}
+
+/*
+ * Account for one exited child and free its entry.
+ */
+static void
+registry_child_exited(pid_t pid, int status)
+{
+    uint64_t	now = now_us();
+    int			i;
+
+    if (Registry == NULL)
+        return;
+
+    registry_lock();
+    if (WIFSIGNALED(status))
+        Registry->signaled++;
+    else if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        Registry->exited_ok++;
+    else
+        Registry->exited_error++;
+
+    for (i = 0; i < MAX_TRACKED_CHILDREN; i++)
+    {
+        ChildEntry *entry = &Registry->children[i];
+        uint64_t	runtime;
+
+        if (entry->pid != pid)
+            continue;
+
+        if (entry->started_us != 0)
+        {
+            uint64_t	spawn = entry->started_us - entry->forked_us;
+
+            Registry->spawn_count++;
+            Registry->spawn_sum_us += spawn;
+            if (spawn > Registry->spawn_max_us)
+                Registry->spawn_max_us = spawn;
+        }
+        runtime = now - entry->forked_us;
+        Registry->runtime_count++;
+        Registry->runtime_sum_us += runtime;
+        if (runtime > Registry->runtime_max_us)
+            Registry->runtime_max_us = runtime;
+
+        if (entry->cls != CHILD_CLASS_NONE)
+        {
+            fprintf(stderr, "child %d exited while running a %s command\n",
+                    (int) pid, ChildClassNames[entry->cls]);
+            Registry->classes[entry->cls].running--;
+            pthread_cond_broadcast(&Registry->class_cond);
+        }
+        entry->pid = 0;
+        entry->cls = CHILD_CLASS_NONE;
+        Registry->live--;
+        break;
+    }
+    registry_unlock();
+}
+
+/*
+ * ChildRegistryReap -- collect every exited child of this process
+ *
+ * Called when SIGCHLD has been seen.  Also gives back any class a dead
+ * child was still holding.
+ */
+void
+ChildRegistryReap(void)
+{
+    pid_t		pid;
+    int			status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        registry_child_exited(pid, status);
+}
+
+/*
+ * ChildRegistryDrain -- wait until every child of this process has exited
+ *
+ * Used by a master that has handed its work over to a new one.
+ */
+void
+ChildRegistryDrain(void)
+{
+    pid_t		pid;
+    int			status;
+
+    while ((pid = waitpid(-1, &status, 0)) > 0 || errno == EINTR)
+    {
+        if (pid > 0)
+            registry_child_exited(pid, status);
+    }
+}
+
+#define INSTALL_CODES(c) \
+    case CliMsg_##c##_Install: \
+    case CliMsg_##c##_Install_Version: \
+    case CliMsg_##c##_Uninstall
+
+/*
+ * ChildCommandClass -- map a request to the class whose cap it runs under
+ */
+ChildClass
+ChildCommandClass(int action_code)
+{
+    switch (action_code)
+    {
+        case CliMsg_Agent_Stats:
+        case CliMsg_Metrics_Record:
+        case CliMsg_Inventory:
+            return CHILD_CLASS_NONE;
+
+        case CliMsg_Metrics:
+        case CliMsg_Hdfs:
+        case CliMsg_HBase:
+        case CliMsg_Spark:
+        case CliMsg_Kafka:
+        case CliMsg_ZooKeeper:
+        case CliMsg_Flink:
+        case CliMsg_Storm:
+        case CliMsg_Hive:
+        case CliMsg_Pig:
+        case CliMsg_Presto:
+        case CliMsg_Tez:
+        case CliMsg_Atlas:
+        case CliMsg_Ranger:
+        case CliMsg_Livy:
+        case CliMsg_Phoenix:
+        case CliMsg_Solr:
+        case CliMsg_Zeppelin:
+            return CHILD_CLASS_REPORT;
+
+        INSTALL_CODES(Hdfs):
+        INSTALL_CODES(HBase):
+        INSTALL_CODES(Spark):
+        INSTALL_CODES(Kafka):
+        INSTALL_CODES(ZooKeeper):
+        INSTALL_CODES(Flink):
+        INSTALL_CODES(Storm):
+        INSTALL_CODES(Hive):
+        INSTALL_CODES(Pig):
+        INSTALL_CODES(Presto):
+        INSTALL_CODES(Tez):
+        INSTALL_CODES(Atlas):
+        INSTALL_CODES(Ranger):
+        INSTALL_CODES(Livy):
+        INSTALL_CODES(Phoenix):
+        INSTALL_CODES(Solr):
+        INSTALL_CODES(Zeppelin):
+            return CHILD_CLASS_INSTALL;
+
+        case CliMsg_Hdfs_Configure:
+        case CliMsg_HBase_Configure:
+        case CliMsg_Spark_Configure:
+        case CliMsg_Kafka_Configure:
+        case CliMsg_ZooKeeper_Configure:
+        case CliMsg_Flink_Configure:
+        case CliMsg_Storm_Configure:
+        case CliMsg_Hive_Configure:
+        case CliMsg_Pig_Configure:
+        case CliMsg_Presto_Configure:
+        case CliMsg_Tez_Configure:
+        case CliMsg_Atlas_Configure:
+        case CliMsg_Ranger_Configure:
+        case CliMsg_Livy_Configure:
+        case CliMsg_Phoenix_Configure:
+        case CliMsg_Solr_Configure:
+        case CliMsg_Zeppelin_Configure:
+            return CHILD_CLASS_CONFIGURE;
+
+        default:
+            return CHILD_CLASS_CONTROL;
+    }
+}
+
+/*
+ * ChildAcquireClass -- wait until the request's class has room and take
+ * a place in it
+ *
+ * Returns the class taken, to be handed back to ChildReleaseClass().
+ */
+ChildClass
+ChildAcquireClass(int action_code)
+{
+    ChildClass	cls = ChildCommandClass(action_code);
+    ChildClassState *state;
+
+    if (Registry == NULL || cls == CHILD_CLASS_NONE)
+        return CHILD_CLASS_NONE;
+
+    state = &Registry->classes[cls];
+    registry_lock();
+    if (state->cap > 0 && state->running >= state->cap)
+    {
+        uint64_t	start = now_us();
+        uint64_t	waited;
+
+        state->queued++;
+        state->waiting++;
+        while (state->running >= state->cap)
+        {
+            if (pthread_cond_wait(&Registry->class_cond, &Registry->lock) == EOWNERDEAD)
+                pthread_mutex_consistent(&Registry->lock);
+        }
+        state->waiting--;
+
+        waited = now_us() - start;
+        state->wait_sum_us += waited;
+        if (waited > state->wait_max_us)
+            state->wait_max_us = waited;
+    }
+    state->running++;
+    state->admitted++;
+    if (MyChildSlot >= 0)
+        Registry->children[MyChildSlot].cls = cls;
+    registry_unlock();
+
+    return cls;
+}
+
+/*
+ * ChildReleaseClass -- give back a place taken by ChildAcquireClass()
+ */
+void
+ChildReleaseClass(ChildClass cls)
+{
+    if (Registry == NULL || cls == CHILD_CLASS_NONE)
+        return;
+
+    registry_lock();
+    Registry->classes[cls].running--;
+    if (MyChildSlot >= 0)
+        Registry->children[MyChildSlot].cls = CHILD_CLASS_NONE;
+    pthread_cond_broadcast(&Registry->class_cond);
+    registry_unlock();
+}
+
+/*
+ * ChildRegistryStats -- append a description of the registry to buf
+ */
+void
+ChildRegistryStats(StringInfo buf)
+{
+    ChildRegistryShmem snap;
+    int			i;
+
+    if (Registry == NULL)
+        return;
+
+    registry_lock();
+    memcpy(&snap, Registry, offsetof(ChildRegistryShmem, children));
+    registry_unlock();
+
+    appendStringInfo(buf, "children: live=%d spawned=%llu fork_failed=%llu untracked=%llu\n",
+                     snap.live,
+                     (unsigned long long) snap.spawned,
+                     (unsigned long long) snap.fork_failed,
+                     (unsigned long long) snap.untracked);
+    appendStringInfo(buf, "  exited_ok=%llu exited_error=%llu signaled=%llu\n",
+                     (unsigned long long) snap.exited_ok,
+                     (unsigned long long) snap.exited_error,
+                     (unsigned long long) snap.signaled);
+    appendStringInfo(buf, "  spawn_avg=%lluus spawn_max=%lluus runtime_avg=%llums runtime_max=%llums\n",
+                     (unsigned long long) (snap.spawn_count ? snap.spawn_sum_us / snap.spawn_count : 0),
+                     (unsigned long long) snap.spawn_max_us,
+                     (unsigned long long) (snap.runtime_count ? snap.runtime_sum_us / snap.runtime_count / 1000 : 0),
+                     (unsigned long long) snap.runtime_max_us / 1000);
+
+    for (i = 0; i < NUM_CHILD_CLASSES; i++)
+    {
+        ChildClassState *state = &snap.classes[i];
+
+        appendStringInfo(buf, "  class %s: cap=%d running=%d waiting=%d admitted=%llu queued=%llu"
+                         " wait_avg=%llums wait_max=%llums\n",
+                         ChildClassNames[i], state->cap, state->running, state->waiting,
+                         (unsigned long long) state->admitted,
+                         (unsigned long long) state->queued,
+                         (unsigned long long) (state->queued ? state->wait_sum_us / state->queued / 1000 : 0),
+                         (unsigned long long) state->wait_max_us / 1000);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * childreg.h
+ *		Registry of session child processes and per-class command caps.
+ *
+ * The process that forks session children (the agent master, or an
+ * acceptor) records every child here and reaps it when SIGCHLD arrives,
+ * collecting spawn latency, runtime and exit status.
+ *
+ * Independently of how a request reached the agent, every command runs
+ * under a per-class concurrency cap: a request whose class is full waits
+ * until a running one of the same class finishes.
+ *-------------------------------------------------------------------------
+ */
+#ifndef CHILDREG_H
+#define CHILDREG_H
+
+#include <sys/types.h>
+#include "stringinfo.h"
+
+/* Upper bound on tracked session children; extra ones are only counted */
+#define MAX_TRACKED_CHILDREN 1024
+
+typedef enum ChildClass
+{
+    CHILD_CLASS_NONE = -1,		/* not capped (agent stats) */
+    CHILD_CLASS_INSTALL = 0,	/* install, install version, uninstall */
+    CHILD_CLASS_CONTROL,		/* start, stop, restart */
+    CHILD_CLASS_CONFIGURE,		/* configuration changes */
+    CHILD_CLASS_REPORT,			/* component reports and metrics */
+    NUM_CHILD_CLASSES
+} ChildClass;
+
+/* concurrency cap per class, 0 means unlimited */
+extern int	ChildClassCaps[NUM_CHILD_CLASSES];
+
+extern int	ChildRegistryInit(void);
+extern int	ChildRegistryReserve(void);
+extern void ChildRegistryForked(int slot, pid_t pid);
+extern void ChildRegistryStarted(int slot);
+extern void ChildRegistryDetach(void);
+extern void ChildRegistryReap(void);
+extern void ChildRegistryDrain(void);
+extern ChildClass ChildCommandClass(int action_code);
+extern ChildClass ChildAcquireClass(int action_code);
+extern void ChildReleaseClass(ChildClass cls);
+extern void ChildRegistryStats(StringInfo buf);
+
+#endif							/* CHILDREG_H */
@@ -14,12 +14,12 @@
  * limitations under the License.
  */
 
-#ifdef HAVE_POLL_H
+#define _GNU_SOURCE				/* accept4() */
 #include <poll.h>
-#endif
 #include <signal.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <pwd.h>
 #include <unistd.h>
 #include <sys/file.h>
 #include <sys/socket.h>
@@ -29,13 +29,17 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <utime.h>
+#include <time.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 #include "ip.h"
 #include "connutil.h"
 #include "comm.h"
+#include "format.h"
+#include "protocol.h"
 
 
 #define ntoh32(x) (x)
@@ -93,6 +97,12 @@ typedef int32_t int32;
 #define DB_TCP_KEEPALIVE_IDLE_STR "TCP_KEEPALIVE"
 #endif
 int                     MaxConnections = 100;
+
+/* listen() backlog, 0 means derive it from MaxConnections */
+int                     ListenBacklog = 0;
+
+/* open listen sockets with SO_REUSEPORT so several can share a port */
+bool                    ListenReusePort = false;
 #define DBINVALID_SOCKET (-1)
 struct Port *MyProcPort;
 volatile sig_atomic_t ClientConnectionLost = false;
@@ -104,8 +114,30 @@ int                     tcp_user_timeout;
 /*
  * Configuration options
  */
-int			Unix_socket_permissions;
-char	   *Unix_socket_group;
+int			Unix_socket_permissions = 0660;
+char	   *Unix_socket_group = "";
+
+/*
+ * Local fast path: directory holding the agent's Unix socket (empty means
+ * no Unix socket), and the peers allowed to use it.  Connections on the
+ * Unix socket skip GSSAPI, so the peer's kernel-reported uid or primary
+ * gid must be on one of these lists.
+ */
+char	   *UnixSocketDir = DEFAULT_DEBO_SOCKET_DIR;
+
+/*
+ * Trusted-network listeners: ports (0 for none) on the listen addresses
+ * whose clients, once authenticated, talk over TRANSPORT_INTEGRITY or
+ * TRANSPORT_PLAIN instead of encrypting; see be-secure-gssapi.c.
+ */
+int			IntegrityPortNumber = 0;
+int			PlainPortNumber = 0;
+
+#define MAX_UNIX_PEERS 32
+static unsigned int UnixAllowUids[MAX_UNIX_PEERS];
+static int	NumUnixAllowUids = 0;
+static unsigned int UnixAllowGids[MAX_UNIX_PEERS];
+static int	NumUnixAllowGids = 0;
 
 #define MAXPGPATH               1024
 /*
@@ -118,60 +150,176 @@ char	   *Unix_socket_group;
 #define SEND_BUFFER_SIZE 8192
 #define RECV_BUFFER_SIZE 8192
 
-static char *DbSendBuffer;
-static int	DbSendBufferSize;	/* Size send buffer */
-static size_t DbSendPointer;	/* Next index to store a byte in PqSendBuffer */
-static size_t DbSendStart;		/* Next index to send a byte in PqSendBuffer */
+static __thread char *DbSendBuffer;
+static __thread int	DbSendBufferSize;	/* Size send buffer */
+static __thread size_t DbSendPointer;	/* Next index to store a byte in PqSendBuffer */
+static __thread size_t DbSendStart;		/* Next index to send a byte in PqSendBuffer */
 
-static char DbRecvBuffer[RECV_BUFFER_SIZE];
-static int	DbRecvPointer;		/* Next index to read a byte from DbRecvBuffer */
-static int	DbRecvLength;		/* End of data available in DbRecvBuffer */
+static __thread char DbRecvBuffer[RECV_BUFFER_SIZE];
+static __thread int	DbRecvPointer;		/* Next index to read a byte from DbRecvBuffer */
+static __thread int	DbRecvLength;		/* End of data available in DbRecvBuffer */
 
 /*
  * Message status
  */
-static bool DbCommBusy;			/* busy sending data to the client */
-static bool DbCommReadingMsg;	/* in the middle of reading a message */
+static __thread bool DbCommBusy;			/* busy sending data to the client */
+static __thread bool DbCommReadingMsg;	/* in the middle of reading a message */
+
+/* what has been sent to the current client, see reset_send_stats() */
+__thread SendStats DbSendStats;
+
+/* compression agreed with the current client, see putmessage_compressed() */
+__thread int DbCompression = COMPRESS_NONE;
+__thread int DbCompressThreshold;
+
+/* output chunk agreed with the current client, see reserve_output() */
+__thread int DbOutputChunk = DEFAULT_OUTPUT_CHUNK;
+
+/* the current client takes typed response messages, see send_hello_reply() */
+__thread bool DbFramedResponses = false;
+
+/*
+ * When the socket I/O of this thread has to be over, in milliseconds on
+ * CLOCK_MONOTONIC, or 0 for never; see comm_set_timeout().
+ */
+static __thread int64_t DbIoDeadline = 0;
+
+/* input to read before the socket, see comm_set_raw_input() */
+static __thread const char *DbRawInput;
+static __thread size_t DbRawInputLength;
+
+/*
+ * Unread input and the settings agreed with the client of a connection
+ * that is not attached to any thread, see comm_save_state().  Sends are
+ * always flushed before a connection is detached, so only the receive
+ * side needs saving.
+ */
+struct CommState
+{
+    int			compression;
+    int			compress_threshold;
+    int			output_chunk;
+    bool		framed;
+    int			len;
+    char		data[];
+};
 
 
 /* Internal functions */
 static void socket_comm_reset(void);
 static bool socket_is_send_pending(void);
+static int	socket_flush(void);
+static int	socket_putmessage(char msgtype, const char *s, size_t len);
 static void socket_putmessage_noblock(char msgtype, const char *s, size_t len);
 db_noinline int internal_flush_buffer(ClientSocket *client_sock ,const char *buf, size_t *start,
                                       size_t *end);
+static int	Make_AF_UNIX_dir(const char *dir);
+static int	Lock_AF_UNIX(const char *sock_path);
 static int	Setup_AF_UNIX(const char *sock_path);
 
 static const DBcommMethods DbCommSocketMethods = {
     .comm_reset = socket_comm_reset,
+    .flush = socket_flush,
     .is_send_pending = socket_is_send_pending,
+    .putmessage = socket_putmessage,
     .putmessage_noblock = socket_putmessage_noblock
 };
 
 const DBcommMethods *DbCommMethods = &DbCommSocketMethods;
 
+static int64_t
+monotonic_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*
+ * Wait until sock is ready for events, or fail with ETIMEDOUT once the
+ * thread's deadline has passed.  Without a deadline there is nothing to
+ * wait for here: a blocking socket waits in the call itself.
+ */
+static int
+wait_for_deadline(int sock, short events)
+{
+    struct pollfd pfd;
+    int64_t		remaining;
+    int			rc;
+
+    if (DbIoDeadline == 0)
+        return 0;
+    remaining = DbIoDeadline - monotonic_ms();
+    if (remaining <= 0)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    pfd.fd = sock;
+    pfd.events = events;
+    pfd.revents = 0;
+    rc = poll(&pfd, 1, (int) remaining);
+    if (rc == 0)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return rc < 0 ? -1 : 0;
+}
+
+/* --------------------------------
+ *		comm_set_timeout - bound the socket I/O of this thread
+ *
+ * From now on reads and writes on the client socket fail with ETIMEDOUT
+ * once timeout_ms have passed, however the time is split between them;
+ * 0 lifts the bound again.  A slow client then cannot keep a thread that
+ * serves many connections for longer than that.
+ * --------------------------------
+ */
+void
+comm_set_timeout(int timeout_ms)
+{
+    DbIoDeadline = timeout_ms > 0 ? monotonic_ms() + timeout_ms : 0;
+}
+
+/* --------------------------------
+ *		comm_set_raw_input - read these bytes before the socket
+ *
+ * For input that was taken off the socket before the code that reads it
+ * was ready to run.  data must stay valid until it has all been read or
+ * comm_set_raw_input(NULL, 0) drops what is left.
+ * --------------------------------
+ */
+void
+comm_set_raw_input(const char *data, size_t len)
+{
+    DbRawInput = data;
+    DbRawInputLength = len;
+}
+
 ssize_t
 secure_raw_read(ClientSocket *client_sock ,void *ptr, size_t len)
 {
-    size_t         n;
+    ssize_t         n;
 
     /* Read from the "unread" buffered data first. c.f. libpq-be.h */
-    //       if (port->raw_buf_remaining > 0)
-    //     {
-    /* consume up to len bytes from the raw_buf */
-    //           if (len > (size_t)port->raw_buf_remaining)
-    //                 len = port->raw_buf_remaining;
-    //       Assert(port->raw_buf);
-    //     memcpy(ptr, port->raw_buf + port->raw_buf_consumed, len);
-    //   port->raw_buf_consumed += len;
-    // port->raw_buf_remaining -= len;
-    //return len;
-    //}
+    if (DbRawInputLength > 0)
+    {
+        if (len > DbRawInputLength)
+            len = DbRawInputLength;
+        memcpy(ptr, DbRawInput, len);
+        DbRawInput += len;
+        DbRawInputLength -= len;
+        return len;
+    }
 
     /*
      * Try to read from the socket without blocking. If it succeeds we're
      * done, otherwise we'll wait for the socket using the latch mechanism.
      */
+    if (wait_for_deadline(client_sock->sock, POLLIN) < 0)
+        return -1;
 #ifdef WIN32
     pgwin32_noblock = true;
 #endif
@@ -185,20 +333,55 @@ secure_raw_read(ClientSocket *client_sock ,void *ptr, size_t len)
 
 ssize_t
 secure_raw_write(ClientSocket *client_sock, const void *ptr, size_t len)
+{
+    return secure_raw_write_more(client_sock, ptr, len, false);
+}
+
+/*
+ * secure_raw_write_more -- like secure_raw_write, but with more set the
+ * kernel is told that more data follows at once, so it may hold a short
+ * segment back instead of sending it on its own despite TCP_NODELAY.  The
+ * write that ends a burst must be made with more unset.
+ */
+ssize_t
+secure_raw_write_more(ClientSocket *client_sock, const void *ptr, size_t len,
+                      bool more)
 {
     ssize_t         n;
+    int				flags = 0;
 
+#ifdef MSG_MORE
+    if (more)
+        flags |= MSG_MORE;
+#endif
+    if (wait_for_deadline(client_sock->sock, POLLOUT) < 0)
+        return -1;
 #ifdef WIN32
     pgwin32_noblock = true;
 #endif
-    n = send(client_sock->sock, ptr, len, 0);
+    n = send(client_sock->sock, ptr, len, flags);
 #ifdef WIN32
     pgwin32_noblock = false;
 #endif
+    if (n > 0)
+    {
+        DbSendStats.writes++;
+        DbSendStats.bytes += n;
+    }
 
     return n;
 }
 
+/*
+ * Counters of what has been sent to the current client, reset by the
+ * caller at the start of each request.
+ */
+void
+reset_send_stats(void)
+{
+    memset(&DbSendStats, 0, sizeof(DbSendStats));
+}
+
 
 
 
@@ -364,15 +547,87 @@ socket_comm_reset(void)
     DbCommBusy = false;
 }
 
+/* --------------------------------
+ *		comm_save_state - detach this thread's connection buffers
+ *
+ * Returns the unread input and the settings agreed with the client in a
+ * heap object, or NULL if there is nothing to keep, and leaves the
+ * thread's buffers empty.
+ * --------------------------------
+ */
+CommState *
+comm_save_state(void)
+{
+    CommState  *state = NULL;
+    int			len = DbRecvLength - DbRecvPointer;
+
+    if (len > 0 || DbCompression != COMPRESS_NONE ||
+        DbOutputChunk != DEFAULT_OUTPUT_CHUNK || DbFramedResponses)
+    {
+        state = malloc(offsetof(CommState, data) + len);
+        if (state != NULL)
+        {
+            state->compression = DbCompression;
+            state->compress_threshold = DbCompressThreshold;
+            state->output_chunk = DbOutputChunk;
+            state->framed = DbFramedResponses;
+            state->len = len;
+            if (len > 0)
+                memcpy(state->data, DbRecvBuffer + DbRecvPointer, len);
+        }
+    }
+    comm_reset_connection();
+    return state;
+}
+
+/* --------------------------------
+ *		comm_restore_state - attach buffers saved by comm_save_state
+ * --------------------------------
+ */
+void
+comm_restore_state(CommState *state)
+{
+    comm_reset_connection();
+    if (state == NULL)
+        return;
+    memcpy(DbRecvBuffer, state->data, state->len);
+    DbRecvLength = state->len;
+    DbCompression = state->compression;
+    DbCompressThreshold = state->compress_threshold;
+    DbOutputChunk = state->output_chunk;
+    DbFramedResponses = state->framed;
+    free(state);
+}
+
+/* --------------------------------
+ *		comm_reset_connection - forget all per-connection buffer state
+ *
+ * A pooled worker serves many connections in one process, so whatever
+ * is left in the receive and send buffers from the previous client must
+ * not leak into the next one.
+ * --------------------------------
+ */
+void
+comm_reset_connection(void)
+{
+    DbRecvPointer = DbRecvLength = 0;
+    DbSendPointer = DbSendStart = 0;
+    DbCommBusy = false;
+    DbCommReadingMsg = false;
+    DbCompression = COMPRESS_NONE;
+    DbOutputChunk = DEFAULT_OUTPUT_CHUNK;
+    DbFramedResponses = false;
+}
+
 
 
 /*
  * ListenServerPort -- open a "listening" port to accept connections.
  *
  * family should be AF_UNIX or AF_UNSPEC; portNumber is the port number.
- * For AF_UNIX ports, hostName should be NULL and unixSocketDir must be
- * specified.  For TCP ports, hostName is either NULL for all interfaces or
- * the interface to listen on, and unixSocketDir is ignored (can be NULL).
+ * For AF_UNIX ports, hostName is the directory to create the socket file
+ * in.  For TCP ports, hostName is either NULL for all interfaces or the
+ * interface to listen on.
  *
  * Successfully opened sockets are appended to the ListenSockets[] array.  On
  * entry, *NumListenSockets holds the number of elements currently in the
@@ -410,8 +665,27 @@ ListenServerPort(int family, const char *hostName, unsigned short portNumber,
     hint.ai_flags = AI_PASSIVE;
     hint.ai_socktype = SOCK_STREAM;
 
-    snprintf(portNumberStr, sizeof(portNumberStr), "%d", portNumber);
-    service = portNumberStr;
+    if (family == AF_UNIX)
+    {
+        UNIXSOCK_PATH(unixSocketPath, portNumber, hostName);
+        if (strlen(unixSocketPath) >= UNIXSOCK_PATH_BUFLEN)
+        {
+            fprintf(stderr, "Unix-domain socket path \"%s\" is too long (maximum %d bytes)\n",
+                    unixSocketPath, (int) (UNIXSOCK_PATH_BUFLEN - 1));
+            return STATUS_ERROR;
+        }
+        if (hostName[0] != '@' && Make_AF_UNIX_dir(hostName) != STATUS_OK)
+            return STATUS_ERROR;
+        if (Lock_AF_UNIX(unixSocketPath) != STATUS_OK)
+            return STATUS_ERROR;
+        service = unixSocketPath;
+        hostName = NULL;
+    }
+    else
+    {
+        snprintf(portNumberStr, sizeof(portNumberStr), "%d", portNumber);
+        service = portNumberStr;
+    }
 
     ret = getaddrinfo_all(hostName, service, &hint, &addrs);
     if (ret || !addrs)
@@ -516,6 +790,26 @@ ListenServerPort(int family, const char *hostName, unsigned short portNumber,
         }
 #endif
 
+#ifdef SO_REUSEPORT
+        /*
+         * In multi-acceptor mode every acceptor binds its own socket to the
+         * same address and the kernel spreads incoming connections across
+         * them.
+         */
+        if (ListenReusePort && addr->ai_family != AF_UNIX)
+        {
+            if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+                           (char *) &one, sizeof(one)) == -1)
+            {
+                fprintf(stderr, "%s(%s) failed for %s address \"%s\": %m",
+                        "setsockopt", "SO_REUSEPORT",
+                        familyDesc, addrDesc);
+                closesocket(fd);
+                continue;
+            }
+        }
+#endif
+
 #ifdef IPV6_V6ONLY
         if (addr->ai_family == AF_INET6)
         {
@@ -558,9 +852,12 @@ ListenServerPort(int family, const char *hostName, unsigned short portNumber,
         /*
          * Select appropriate accept-queue length limit.  It seems reasonable
          * to use a value similar to the maximum number of child processes
-         * that the postmaster will permit.
+         * that the postmaster will permit, unless one was configured.
          */
-        maxconn = MaxConnections * 2;
+        if (ListenBacklog > 0)
+            maxconn = ListenBacklog;
+        else
+            maxconn = MaxConnections * 2;
 
         err = listen(fd, maxconn);
         if (err < 0)
@@ -593,6 +890,86 @@ ListenServerPort(int family, const char *hostName, unsigned short portNumber,
 
 
 
+/*
+ * Lock_AF_UNIX -- make sure nobody is serving sock_path, then remove any
+ * stale socket file left there by an agent that died
+ *
+ * A hot upgrade hands the socket itself to the new agent, so this only
+ * runs on a cold start.
+ */
+static int
+Lock_AF_UNIX(const char *sock_path)
+{
+    struct sockaddr_un probe;
+    int			fd;
+
+    /* abstract sockets vanish with their owner */
+    if (sock_path[0] == '@')
+        return STATUS_OK;
+
+    if (access(sock_path, F_OK) != 0)
+        return STATUS_OK;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return STATUS_OK;
+    MemSet(&probe, 0, sizeof(probe));
+    probe.sun_family = AF_UNIX;
+    strncpy(probe.sun_path, sock_path, sizeof(probe.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *) &probe, sizeof(probe)) == 0)
+    {
+        closesocket(fd);
+        fprintf(stderr, "Unix socket \"%s\" is in use by another agent\n",
+                sock_path);
+        return STATUS_ERROR;
+    }
+    closesocket(fd);
+
+    if (unlink(sock_path) != 0 && errno != ENOENT)
+    {
+        fprintf(stderr, "could not remove stale socket file \"%s\": %m\n",
+                sock_path);
+        return STATUS_ERROR;
+    }
+    return STATUS_OK;
+}
+
+/*
+ * Make_AF_UNIX_dir -- create the socket directory if it is missing, and
+ * make sure only we or root can create files in it
+ *
+ * Otherwise any local user could bind the socket path before we do and
+ * collect the commands of clients that trust it.
+ */
+static int
+Make_AF_UNIX_dir(const char *dir)
+{
+    struct stat st;
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "could not create directory \"%s\": %m\n", dir);
+        return STATUS_ERROR;
+    }
+    if (lstat(dir, &st) < 0)
+    {
+        fprintf(stderr, "could not stat directory \"%s\": %m\n", dir);
+        return STATUS_ERROR;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        fprintf(stderr, "\"%s\" is not a directory\n", dir);
+        return STATUS_ERROR;
+    }
+    if ((st.st_uid != 0 && st.st_uid != geteuid()) ||
+        (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+    {
+        fprintf(stderr, "Unix socket directory \"%s\" is writable by other users\n", dir);
+        return STATUS_ERROR;
+    }
+    return STATUS_OK;
+}
+
 /*
  * Setup_AF_UNIX -- configure unix socket permissions
  */
@@ -653,6 +1030,142 @@ Setup_AF_UNIX(const char *sock_path)
     }
     return STATUS_OK;
 }
+/*
+ * Parse a comma-separated list of user (or, if groups, group) names or
+ * numeric ids into ids[].  Unknown names are reported and skipped.
+ */
+static int
+parse_peer_list(const char *list, bool groups, unsigned int *ids, int maxids)
+{
+    char	   *copy = strdup(list);
+    char	   *save = NULL;
+    char	   *item;
+    int			n = 0;
+
+    if (copy == NULL)
+        return 0;
+    for (item = strtok_r(copy, ", ", &save); item != NULL && n < maxids;
+         item = strtok_r(NULL, ", ", &save))
+    {
+        char	   *endptr;
+        unsigned long val = strtoul(item, &endptr, 10);
+
+        if (*endptr == '\0')
+            ids[n++] = (unsigned int) val;
+        else if (groups)
+        {
+            struct group *gr = getgrnam(item);
+
+            if (gr)
+                ids[n++] = gr->gr_gid;
+            else
+                fprintf(stderr, "group \"%s\" does not exist\n", item);
+        }
+        else
+        {
+            struct passwd *pw = getpwnam(item);
+
+            if (pw)
+                ids[n++] = pw->pw_uid;
+            else
+                fprintf(stderr, "user \"%s\" does not exist\n", item);
+        }
+    }
+    free(copy);
+    return n;
+}
+
+/*
+ * SetUnixPeerAllowlist -- set the users and groups that may use the Unix
+ * socket
+ *
+ * Either list may be NULL.  With no users given, root and the user the
+ * agent runs as are allowed.  Names are resolved once here so that the
+ * per-connection check never touches NSS.
+ */
+void
+SetUnixPeerAllowlist(const char *users, const char *groups)
+{
+    if (users != NULL && users[0] != '\0')
+        NumUnixAllowUids = parse_peer_list(users, false,
+                                           UnixAllowUids,
+                                           MAX_UNIX_PEERS);
+    else
+    {
+        NumUnixAllowUids = 0;
+        UnixAllowUids[NumUnixAllowUids++] = 0;
+        if (geteuid() != 0)
+            UnixAllowUids[NumUnixAllowUids++] = geteuid();
+    }
+
+    NumUnixAllowGids = 0;
+    if (groups != NULL && groups[0] != '\0')
+        NumUnixAllowGids = parse_peer_list(groups, true,
+                                           UnixAllowGids,
+                                           MAX_UNIX_PEERS);
+}
+
+/*
+ * UnixPeerCredentials -- uid and primary gid of the process at the other
+ * end of a Unix socket connection, as reported by the kernel
+ *
+ * Returns false, with errno set, if they cannot be had.
+ */
+bool
+UnixPeerCredentials(int sock, uid_t *uid, gid_t *gid)
+{
+#if defined(SO_PEERCRED)
+    struct ucred peercred;
+    socklen_t	so_len = sizeof(peercred);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &peercred, &so_len) != 0)
+        return false;
+    if (so_len != sizeof(peercred))
+    {
+        errno = EINVAL;
+        return false;
+    }
+    *uid = peercred.uid;
+    *gid = peercred.gid;
+    return true;
+#else
+    return getpeereid(sock, uid, gid) == 0;
+#endif
+}
+
+/*
+ * UnixPeerAllowed -- may the process at the other end of a Unix socket
+ * connection run commands without GSSAPI?
+ *
+ * The uid and primary gid come from the kernel (SO_PEERCRED), so they
+ * cannot be forged by the client.  On refusal the reason is written to
+ * msg for the client.
+ */
+bool
+UnixPeerAllowed(int sock, char *msg, size_t msglen)
+{
+    uid_t		uid;
+    gid_t		gid;
+    int			i;
+
+    if (!UnixPeerCredentials(sock, &uid, &gid))
+    {
+        snprintf(msg, msglen, "could not get peer credentials: %m");
+        return false;
+    }
+
+    for (i = 0; i < NumUnixAllowUids; i++)
+        if (UnixAllowUids[i] == uid)
+            return true;
+    for (i = 0; i < NumUnixAllowGids; i++)
+        if (UnixAllowGids[i] == gid)
+            return true;
+
+    snprintf(msg, msglen, "local peer uid %u gid %u is not allowed",
+             (unsigned int) uid, (unsigned int) gid);
+    return false;
+}
+
 /*
  * Put socket into nonblock mode.
  * Returns true on success, false on failure.
@@ -680,27 +1193,51 @@ set_noblock(int sock)
 
 /*
  * Accept connection and configure non-blocking mode
+ *
+ * The new socket is close-on-exec, so commands run on behalf of the
+ * client never hold the connection open.
  */
 int
 AcceptConnection(int server_fd, ClientSocket *client_sock)
 {
     client_sock->raddr.salen = sizeof(client_sock->raddr.addr);
+#ifdef SOCK_CLOEXEC
+    client_sock->sock = accept4(server_fd,
+                                (struct sockaddr *) &client_sock->raddr.addr,
+                                &client_sock->raddr.salen,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     client_sock->sock = accept(server_fd,
                                (struct sockaddr *) &client_sock->raddr.addr,
                                &client_sock->raddr.salen);
+#endif
 
     if (client_sock->sock == DBINVALID_SOCKET)
     {
-        printf("could not accept connection: ");
+        /*
+         * Losing the race for a connection to another pool worker is
+         * expected on a non-blocking listen socket; don't log it.
+         */
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            int			save_errno = errno;
+
+            printf("could not accept connection: %m\n");
+            errno = save_errno;
+        }
         return STATUS_ERROR;
     }
 
+#ifndef SOCK_CLOEXEC
     // Set non-blocking mode for the new client socket
     if (!set_noblock(client_sock->sock))
     {
         closesocket(client_sock->sock);
+        client_sock->sock = DBINVALID_SOCKET;
         return STATUS_ERROR;
     }
+    fcntl(client_sock->sock, F_SETFD, FD_CLOEXEC);
+#endif
 
     return STATUS_OK;
 }
@@ -804,6 +1341,105 @@ buffer_remaining_data(void)
 }
 
 
+/* --------------------------------
+ *		comm_request_buffered - is a whole request in the receive buffer?
+ *
+ * A request is the action byte and a message with its length word.  Reads
+ * whatever the socket has without waiting for more, so the socket should
+ * be non-blocking.  Returns 1 once the request is there, 0 if the rest of
+ * it has yet to arrive, or EOF if the client has gone away.  A request
+ * too large for the buffer counts as there: getmessage() refuses it or
+ * reads the rest.
+ * --------------------------------
+ */
+int
+comm_request_buffered(ClientSocket *client_sock)
+{
+    for (;;)
+    {
+        int			avail = DbRecvLength - DbRecvPointer;
+        int			r;
+
+        if (avail >= 1 + 4)
+        {
+            int32		len;
+
+            memcpy(&len, DbRecvBuffer + DbRecvPointer + 1, 4);
+            len = ntoh32(len);
+            if (len < 4 || len >= RECV_BUFFER_SIZE || avail >= 1 + len)
+                return 1;
+        }
+
+        if (DbRecvPointer > 0)
+        {
+            memmove(DbRecvBuffer, DbRecvBuffer + DbRecvPointer, avail);
+            DbRecvLength = avail;
+            DbRecvPointer = 0;
+        }
+        errno = 0;
+        r = be_gssapi_read(client_sock, DbRecvBuffer + DbRecvLength,
+                           RECV_BUFFER_SIZE - DbRecvLength);
+        if (r > 0)
+        {
+            DbRecvLength += r;
+            continue;
+        }
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        return EOF;
+    }
+}
+
+/* --------------------------------
+ *		comm_export_state - append this thread's connection state to buf
+ *
+ * For handing the connection to another process, which takes it up with
+ * comm_import_state().  Like comm_save_state(), only the receive side
+ * and the settings agreed with the client are kept.
+ * --------------------------------
+ */
+void
+comm_export_state(StringInfo buf)
+{
+    int			len = DbRecvLength - DbRecvPointer;
+
+    sendint32(buf, (uint32) DbCompression);
+    sendint32(buf, (uint32) DbCompressThreshold);
+    sendint32(buf, (uint32) DbOutputChunk);
+    sendint32(buf, (uint32) DbFramedResponses);
+    sendint32(buf, (uint32) len);
+    sendbytes(buf, DbRecvBuffer + DbRecvPointer, len);
+}
+
+/* --------------------------------
+ *		comm_import_state - take up a connection exported by
+ *		comm_export_state(), reading from buf's cursor
+ *
+ * Returns 0 if OK, EOF if buf is short.
+ * --------------------------------
+ */
+int
+comm_import_state(StringInfo buf)
+{
+    int			len;
+
+    comm_reset_connection();
+    if (buf->len - buf->cursor < 20)
+        return EOF;
+    DbCompression = (int) getmsgint(buf, 4);
+    DbCompressThreshold = (int) getmsgint(buf, 4);
+    DbOutputChunk = (int) getmsgint(buf, 4);
+    DbFramedResponses = getmsgint(buf, 4) != 0;
+    len = (int) getmsgint(buf, 4);
+    if (len < 0 || len > RECV_BUFFER_SIZE || len > buf->len - buf->cursor)
+        return EOF;
+    copymsgbytes(buf, DbRecvBuffer, len);
+    DbRecvLength = len;
+    return 0;
+}
+
 /* --------------------------------
  *		startmsgread - begin reading a message from the client.
  *
@@ -1055,6 +1691,93 @@ socket_is_send_pending(void)
 
 
 
+/* --------------------------------
+ *		putmessage_more - queue a normal message for the client
+ *
+ *		The message is the type byte, a 4-byte length word that counts
+ *		itself and the body, then the body.  It is appended to the send
+ *		buffer and stays there until the next flush(), so that several
+ *		small messages can go out together: over GSSAPI, in as few packets
+ *		as they fit in.
+ *
+ *		returns 0 if OK, EOF if trouble
+ * --------------------------------
+ */
+int
+putmessage_more(char msgtype, const char *s, size_t len)
+{
+    uint32_t	n32;
+    size_t		required;
+
+    if (global_client_socket == NULL)
+        return EOF;
+
+    required = DbSendPointer + 1 + 4 + len;
+    if (required > (size_t) DbSendBufferSize)
+    {
+        size_t		newsize = (size_t) DbSendBufferSize * 2;
+
+        if (newsize < required)
+            newsize = required;
+        char	   *newbuf = realloc(DbSendBuffer, newsize);
+
+        if (newbuf == NULL)
+            return EOF;
+        DbSendBuffer = newbuf;
+        DbSendBufferSize = newsize;
+    }
+
+    DbSendBuffer[DbSendPointer++] = msgtype;
+    n32 = hton32((uint32_t) (len + 4));
+    memcpy(DbSendBuffer + DbSendPointer, &n32, 4);
+    DbSendPointer += 4;
+    if (len > 0)
+        memcpy(DbSendBuffer + DbSendPointer, s, len);
+    DbSendPointer += len;
+    return 0;
+}
+
+/* --------------------------------
+ *		socket_flush - send everything queued for the client
+ *
+ *		returns 0 if OK, EOF if trouble
+ * --------------------------------
+ */
+static int
+socket_flush(void)
+{
+    int			r;
+
+    if (DbSendStart == DbSendPointer)
+        return 0;
+    if (global_client_socket == NULL)
+        return EOF;
+
+    DbSendStats.flushes++;
+    r = internal_flush_buffer(global_client_socket, DbSendBuffer,
+                              &DbSendStart, &DbSendPointer);
+    if (DbSendStart == DbSendPointer)
+        DbSendStart = DbSendPointer = 0;
+    return r;
+}
+
+/* --------------------------------
+ *		socket_putmessage - send a normal message to the client
+ *
+ *		The message goes out at once, together with anything queued by
+ *		putmessage_more() before it.
+ *
+ *		returns 0 if OK, EOF if trouble
+ * --------------------------------
+ */
+static int
+socket_putmessage(char msgtype, const char *s, size_t len)
+{
+    if (putmessage_more(msgtype, s, len) != 0)
+        return EOF;
+    return socket_flush();
+}
+
 /* --------------------------------
  *		putmessage_noblock	- like putmessage, but never blocks
  *
@@ -256,10 +256,12 @@ typedef struct
 
 /* Configure the UNIX socket location for the well known port. */
 
+#define DEFAULT_DEBO_SOCKET_DIR "/run/debo"
+
 #define UNIXSOCK_PATH(path, port, sockdir) \
     (AssertMacro(sockdir), \
      AssertMacro(*(sockdir) != '\0'), \
-     snprintf(path, sizeof(path), "%s/.s.PGSQL.%d", \
+     snprintf(path, sizeof(path), "%s/.s.DEBO.%d", \
               (sockdir), (port)))
 
 /*
@@ -21,6 +21,8 @@
 void configure_target_component(Component target) {
     ConfigStatus status;
 
+    PROGRESS(global_client_socket, -1, "Configuring %s\n", component_to_string(target));
+
     switch(target) {
         // HDFS Configuration
     case HDFS:
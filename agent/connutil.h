@@ -153,7 +153,15 @@ typedef struct ClientSocket
     SockAddr	raddr;			/* remote addr (client) */
 } ClientSocket;
 
-extern ClientSocket *global_client_socket;
+extern __thread ClientSocket *global_client_socket;
+
+/*
+ * Protocol state of a connection that is not currently attached to a
+ * thread.  Used by the event engine, which serves a connection's
+ * requests on whichever pool thread is free.
+ */
+typedef struct CommState CommState;
+typedef struct GSSState GSSState;
 
 extern DBDLLIMPORT ClientConnectionInfo MyClientConnectionInfo;
 
@@ -190,6 +198,44 @@ typedef struct
 
 extern const DBDLLIMPORT DBcommMethods *DbCommMethods;
 
+/*
+ * What has been sent to the current client since reset_send_stats(): raw
+ * bytes and send() calls on the socket, GSSAPI tokens, and flushes of the
+ * message send buffer.
+ */
+typedef struct SendStats
+{
+    long		bytes;
+    long		writes;
+    long		tokens;
+    long		flushes;
+} SendStats;
+
+extern __thread SendStats DbSendStats;
+
+/*
+ * Compression agreed with the current client (COMPRESS_* in protocol.h),
+ * and the smallest message body worth compressing.
+ */
+extern __thread int DbCompression;
+extern __thread int DbCompressThreshold;
+
+/*
+ * Request output is sent in chunks of this many bytes; a client may ask
+ * for larger ones in its CliMsg_Hello, up to MAX_OUTPUT_CHUNK.
+ */
+#define DEFAULT_OUTPUT_CHUNK	8192
+#define MAX_OUTPUT_CHUNK		(64 * 1024)
+
+extern __thread int DbOutputChunk;
+
+/*
+ * Whether the current client takes responses as typed messages.  Until
+ * it says so with a CliMsg_Hello of protocol version 1 or later, output
+ * goes as plain text, as it did before there were message types.
+ */
+extern __thread bool DbFramedResponses;
+
 #define db_comm_reset() (DbCommMethods->comm_reset())
 #define flush() (DbCommMethods->flush())
 #define flush_if_writable() (DbCommMethods->flush_if_writable())
@@ -229,10 +275,21 @@ extern const DBDLLIMPORT DBcommMethods *DbCommMethods;
 #endif
 
 
+extern int	MaxConnections;
+extern int	ListenBacklog;
+extern bool ListenReusePort;
+extern char *UnixSocketDir;
+extern char *Unix_socket_group;
+extern int	IntegrityPortNumber;
+extern int	PlainPortNumber;
+
 extern int	ListenServerPort(int family, const char *hostName,
                              unsigned short portNumber,
                              int ListenSockets[], int *NumListenSockets, int MaxListen);
 extern int	AcceptConnection(int server_fd, ClientSocket *client_sock);
+extern void SetUnixPeerAllowlist(const char *users, const char *groups);
+extern bool UnixPeerCredentials(int sock, uid_t *uid, gid_t *gid);
+extern bool UnixPeerAllowed(int sock, char *msg, size_t msglen);
 extern void TouchSocketFiles(void);
 extern void RemoveSocketFiles(void);
 extern Port *init(ClientSocket *client_sock);
@@ -246,7 +303,17 @@ extern int	peekbyte(void);
 extern int	getbyte_if_available(unsigned char *c);
 extern ssize_t buffer_remaining_data(void);
 extern int	putmessage_v2(char msgtype, const char *s, size_t len);
+extern int	putmessage_more(char msgtype, const char *s, size_t len);
+extern void reset_send_stats(void);
 extern bool check_connection(void);
+extern void comm_reset_connection(void);
+extern CommState *comm_save_state(void);
+extern void comm_restore_state(CommState *state);
+extern void comm_export_state(StringInfo buf);
+extern int	comm_import_state(StringInfo buf);
+extern int	comm_request_buffered(ClientSocket *client_sock);
+extern void comm_set_timeout(int timeout_ms);
+extern void comm_set_raw_input(const char *data, size_t len);
 extern db_noinline int
 internal_flush_buffer(ClientSocket *client_sock , const char *buf, size_t *start, size_t *end);
 /*
@@ -260,6 +327,8 @@ extern ssize_t secure_read(Port *port, void *ptr, size_t len);
 extern ssize_t secure_write(Port *port, void *ptr, size_t len);
 extern ssize_t secure_raw_read(ClientSocket *client_sock, void *ptr, size_t len);
 extern ssize_t secure_raw_write(ClientSocket *client_sock, const void *ptr, size_t len);
+extern ssize_t secure_raw_write_more(ClientSocket *client_sock, const void *ptr, size_t len,
+                                     bool more);
 
 ssize_t
 be_gssapi_write(ClientSocket *client_sock, void *ptr, size_t len);
@@ -272,4 +341,15 @@ void
 pg_store_delegated_credential(gss_cred_id_t cred);
 
 ssize_t secure_open_gssapi(ClientSocket *client_sock);
+ssize_t secure_open_local(ClientSocket *client_sock);
+ssize_t secure_open_session(ClientSocket *client_sock);
+void secure_close_gssapi(void);
+GSSState *secure_gssapi_save(void);
+void secure_gssapi_restore(GSSState *state);
+int secure_gssapi_export(StringInfo buf);
+int secure_gssapi_import(StringInfo buf);
+int secure_gssapi_set_packet_size(int size);
+bool be_gssapi_read_pending(void);
+void secure_redirect_output(int fd);
+bool secure_output_redirected(void);
 #endif
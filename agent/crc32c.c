@@ -0,0 +1,168 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * crc32c.c
+ *		CRC-32C (Castagnoli), the checksum of file transfer blocks.
+ *
+ * Built with SSE 4.2 (-msse4.2 or a -march that has it) this uses the
+ * CPU's crc32 instruction.  Otherwise it is the slicing-by-8 table
+ * method on little-endian machines and a byte at a time elsewhere; both
+ * keep well ahead of what a GSSAPI-wrapped connection carries.
+ *-------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "crc32c.h"
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+
+/*
+ * crc32c_extend -- the CRC-32C of what crc was computed over followed by
+ * data; crc32c_extend(0, ...) is crc32c(...)
+ */
+uint32_t
+crc32c_extend(uint32_t crc32, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    uint64_t	crc = crc32 ^ 0xFFFFFFFF;
+
+    while (len >= 8)
+    {
+        uint64_t	word;
+
+        memcpy(&word, p, 8);
+        crc = _mm_crc32_u64(crc, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        crc = _mm_crc32_u8((uint32_t) crc, *p++);
+        len--;
+    }
+    return (uint32_t) crc ^ 0xFFFFFFFF;
+}
+
+#else							/* !__SSE4_2__ */
+
+/* the CRC-32C polynomial, bit-reversed */
+#define CRC32C_POLY		0x82F63B78
+
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void
+crc32c_init(void)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint32_t	crc = i;
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        for (int k = 1; k < 8; k++)
+            crc32c_table[k][i] = (crc32c_table[k - 1][i] >> 8) ^
+                crc32c_table[0][crc32c_table[k - 1][i] & 0xFF];
+    }
+}
+
+uint32_t
+crc32c_extend(uint32_t crc, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    crc ^= 0xFFFFFFFF;
+    pthread_once(&crc32c_once, crc32c_init);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8)
+    {
+        uint32_t	lo;
+        uint32_t	hi;
+
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = crc32c_table[7][lo & 0xFF] ^
+            crc32c_table[6][(lo >> 8) & 0xFF] ^
+            crc32c_table[5][(lo >> 16) & 0xFF] ^
+            crc32c_table[4][lo >> 24] ^
+            crc32c_table[3][hi & 0xFF] ^
+            crc32c_table[2][(hi >> 8) & 0xFF] ^
+            crc32c_table[1][(hi >> 16) & 0xFF] ^
+            crc32c_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len > 0)
+    {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+#endif							/* __SSE4_2__ */
+
+uint32_t
+crc32c(const void *data, size_t len)
+{
+    return crc32c_extend(0, data, len);
+}
+
+/*
+ * crc32c_file -- the CRC-32C of the first len bytes of the file fd
+ *
+ * Returns 0, or -1 with errno set if the file could not be read or is
+ * shorter than len.
+ */
+int
+crc32c_file(int fd, off_t len, uint32_t *crc)
+{
+    char		buf[65536];
+    off_t		offset = 0;
+
+    *crc = 0;
+    while (offset < len)
+    {
+        size_t		want = len - offset < (off_t) sizeof(buf) ? (size_t) (len - offset) : sizeof(buf);
+        ssize_t		n = pread(fd, buf, want, offset);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            if (n == 0)
+                errno = EIO;
+            return -1;
+        }
+        *crc = crc32c_extend(*crc, buf, n);
+        offset += n;
+    }
+    return 0;
+}
@@ -28,6 +28,7 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #include "connutil.h"
 #include "format.h"
@@ -42,12 +43,22 @@
 #include "protocol.h"
 #include "latch.h"
 #include "metrics.h"
+#include "pool.h"
+#include "engine.h"
+#include "acceptor.h"
+#include "childreg.h"
+#include "jobs.h"
+#include "session.h"
+#include "subproc.h"
+#include "transfer.h"
+#include "upgrade.h"
 
 #define DBINVALID_SOCKET (-1)
 #define WAIT_USE_EPOLL
 
 struct Latch *MyLatch;
 int                     MyProcPid;
+static Latch LocalLatchData;
 
 #define lengthof(array) (sizeof (array) / sizeof ((array)[0]))
 
@@ -91,6 +102,7 @@ static WaitEventSet *pm_wait_set;
 
 /* Socket configuration */
 int PostPortNumber = 1221;
+static pid_t AgentMasterPid;
 char *ListenAddresses = "0.0.0.0,::";  /* IPv4 + IPv6 wildcards */
 
 /* Socket management */
@@ -99,7 +111,7 @@ static int NumListenSockets = 0;
 static int ListenSockets[MAXLISTEN];
 
 
-ClientSocket *global_client_socket = NULL;
+__thread ClientSocket *global_client_socket = NULL;
 
 volatile sig_atomic_t shutdown_requested = 0;
 /* Event system structures */
@@ -108,6 +120,19 @@ void handle_signal() {
     shutdown_requested = 1;
 }
 
+/*
+ * SIGCHLD in the agent master: wake the main loop, which does the reaping.
+ */
+static void
+handle_sigchld(int signo)
+{
+    int save_errno = errno;
+
+    (void) signo;
+    SetLatch(MyLatch);
+    errno = save_errno;
+}
+
 typedef enum { CLIENT_ACTIVE, CLIENT_CLOSED } HandleCommandResult;
 
 
@@ -150,8 +175,8 @@ static WSADATA wsaData;
 #define closesocket(s) close(s)
 #endif
 
-static void handle_command(ClientSocket *client);
 static int AgentLoop(void);
+void CloseDeboPorts(void);
 static int
 BackendStartup(ClientSocket *client_sock);
 
@@ -183,6 +208,64 @@ WaitEventSet *CreateConnectionEventSet(int nevents) {
 
 
 
+/*
+ * Read an integer tunable from the environment, falling back to the
+ * compiled-in default when it is unset or not a number.
+ */
+static int
+env_int_setting(const char *name, int defval)
+{
+    const char *val = getenv(name);
+    char	   *endptr;
+    long		parsed;
+
+    if (val == NULL || *val == '\0')
+        return defval;
+    errno = 0;
+    parsed = strtol(val, &endptr, 10);
+    if (errno != 0 || *endptr != '\0' || parsed < 0 || parsed > INT_MAX)
+    {
+        fprintf(stderr, "ignoring invalid value \"%s\" for %s\n", val, name);
+        return defval;
+    }
+    return (int) parsed;
+}
+
+/*
+ * OpenListenSockets -- open a listen socket for every address in
+ * ListenAddresses, on the agent's port and on each trusted-network port
+ * configured, and append them to sockets[]
+ *
+ * Returns STATUS_OK if at least one socket was opened.
+ */
+int
+OpenListenSockets(int *sockets, int *nsockets, int maxlisten)
+{
+    int ports[3] = {PostPortNumber, IntegrityPortNumber, PlainPortNumber};
+
+    for (int i = 0; i < 3; i++) {
+        char *hostlist;
+        char *curhost;
+
+        if (ports[i] <= 0)
+            continue;
+        hostlist = strdup(ListenAddresses);
+        curhost = strtok(hostlist, ",");
+        while (curhost != NULL && *nsockets < maxlisten) {
+            int status = ListenServerPort(AF_UNSPEC, curhost, ports[i], sockets, nsockets,
+                                          maxlisten);
+
+            if (status != 0) {
+                fprintf(stderr, "Failed to create socket for '%s' port %d\n", curhost, ports[i]);
+            }
+            curhost = strtok(NULL, ",");
+        }
+        free(hostlist);
+    }
+
+    return *nsockets > 0 ? STATUS_OK : STATUS_ERROR;
+}
+
 /* Main server initialization */
 int main() {
 
@@ -195,27 +278,79 @@ int main() {
     }
 #endif
 
-    char *hostlist = strdup(ListenAddresses);
-    char *curhost = strtok(hostlist, ",");
-
-    while (curhost != NULL && NumListenSockets < MAXLISTEN) {
-        int status = ListenServerPort(AF_UNSPEC, curhost, PostPortNumber, ListenSockets, &NumListenSockets,
-                                      MAXLISTEN);
-
-        if (status != 0) {
-            fprintf(stderr, "Failed to create socket for '%d'\n", ListenSockets[NumListenSockets]);
-        }
-        curhost = strtok(NULL, ",");
+    AgentMasterPid = getpid();
+    MyProcPid = AgentMasterPid;
+    MyLatch = &LocalLatchData;
+    InitLatch(MyLatch);
+    WorkerPoolSize = env_int_setting("DEBO_WORKER_POOL_SIZE", WorkerPoolSize);
+    WorkerMaxRequests = env_int_setting("DEBO_WORKER_MAX_REQUESTS", WorkerMaxRequests);
+    EventEngineThreads = env_int_setting("DEBO_EVENT_THREADS", EventEngineThreads);
+    AcceptorCount = env_int_setting("DEBO_ACCEPTORS", AcceptorCount);
+    ListenBacklog = env_int_setting("DEBO_LISTEN_BACKLOG", ListenBacklog);
+    LogSendStats = env_int_setting("DEBO_LOG_SEND_STATS", 0) > 0;
+    CommandTimeout = env_int_setting("DEBO_COMMAND_TIMEOUT", CommandTimeout);
+    CompressThreshold = env_int_setting("DEBO_COMPRESS_THRESHOLD", CompressThreshold);
+    IntegrityPortNumber = env_int_setting("DEBO_INTEGRITY_PORT", IntegrityPortNumber);
+    PlainPortNumber = env_int_setting("DEBO_PLAIN_PORT", PlainPortNumber);
+    if ((IntegrityPortNumber > 0 && IntegrityPortNumber == PostPortNumber) ||
+        (PlainPortNumber > 0 && PlainPortNumber == PostPortNumber) ||
+        (PlainPortNumber > 0 && PlainPortNumber == IntegrityPortNumber)) {
+        fprintf(stderr, "DEBO_INTEGRITY_PORT and DEBO_PLAIN_PORT need ports of their own\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((WorkerPoolSize > 0) + (EventEngineThreads > 0) + (AcceptorCount > 0) > 1) {
+        fprintf(stderr, "DEBO_WORKER_POOL_SIZE, DEBO_EVENT_THREADS and DEBO_ACCEPTORS are mutually exclusive\n");
+        exit(EXIT_FAILURE);
     }
-    free(hostlist);
 
-    if (NumListenSockets == 0) {
-        fprintf(stderr, "No valid listen sockets created\n");
+    ChildClassCaps[CHILD_CLASS_INSTALL] = env_int_setting("DEBO_MAX_INSTALL",
+                                                          ChildClassCaps[CHILD_CLASS_INSTALL]);
+    ChildClassCaps[CHILD_CLASS_CONTROL] = env_int_setting("DEBO_MAX_CONTROL",
+                                                          ChildClassCaps[CHILD_CLASS_CONTROL]);
+    ChildClassCaps[CHILD_CLASS_CONFIGURE] = env_int_setting("DEBO_MAX_CONFIGURE",
+                                                            ChildClassCaps[CHILD_CLASS_CONFIGURE]);
+    ChildClassCaps[CHILD_CLASS_REPORT] = env_int_setting("DEBO_MAX_REPORT",
+                                                         ChildClassCaps[CHILD_CLASS_REPORT]);
+    if (ChildRegistryInit() != STATUS_OK)
         exit(EXIT_FAILURE);
+    if (getenv("DEBO_JOB_DIR") != NULL)
+        JobDirectory = getenv("DEBO_JOB_DIR");
+    if (JobsInit() != STATUS_OK)
+        exit(EXIT_FAILURE);
+
+    /* every acceptor binds its own sockets to the same port */
+    if (AcceptorCount > 0)
+        ListenReusePort = true;
+
+    /* local clients on the Unix socket authenticate by peer credentials */
+    if (getenv("DEBO_UNIX_SOCKET_DIR") != NULL)
+        UnixSocketDir = getenv("DEBO_UNIX_SOCKET_DIR");
+    /* the socket is mode 0660: allowed users who are not root need the group */
+    if (getenv("DEBO_UNIX_SOCKET_GROUP") != NULL)
+        Unix_socket_group = getenv("DEBO_UNIX_SOCKET_GROUP");
+    SetUnixPeerAllowlist(getenv("DEBO_UNIX_ALLOW_USERS"), getenv("DEBO_UNIX_ALLOW_GROUPS"));
+
+    /* after a hot upgrade the previous master's sockets are still open */
+    if (UpgradeInheritSockets(ListenSockets, &NumListenSockets, MAXLISTEN) != STATUS_OK) {
+        if (OpenListenSockets(ListenSockets, &NumListenSockets, MAXLISTEN) != STATUS_OK) {
+            fprintf(stderr, "No valid listen sockets created\n");
+            exit(EXIT_FAILURE);
+        }
+        if (UnixSocketDir[0] != '\0' &&
+            ListenServerPort(AF_UNIX, UnixSocketDir, PostPortNumber, ListenSockets,
+                             &NumListenSockets, MAXLISTEN) != STATUS_OK)
+            fprintf(stderr, "Failed to create Unix socket in '%s'\n", UnixSocketDir);
     }
+    UpgradeInit(ListenSockets, NumListenSockets);
 
     int  status = AgentLoop();
 
+    /* a new master owns the sockets now; let our own sessions finish */
+    if (UpgradeHandedOver()) {
+        CloseDeboPorts();
+        ChildRegistryDrain();
+    }
+
     /*
      * ServerLoop probably shouldn't ever return, but if it does, close down.
      */
@@ -261,10 +396,42 @@ static int
 AgentLoop(void)
 {
 
+    /* In pool mode the workers accept; we only supervise them. */
+    if (WorkerPoolSize > 0)
+        return WorkerPoolMain(ListenSockets, NumListenSockets);
+    if (EventEngineThreads > 0)
+        return EventEngineMain(ListenSockets, NumListenSockets);
+    if (AcceptorCount > 0)
+        return AcceptorMain(ListenSockets, NumListenSockets);
+
     WaitEventSet *event_set = CreateConnectionEventSet(MAXLISTEN);
+    struct sigaction sa;
+    sigset_t chldmask, waitmask;
 
-    /* Register all listening sockets */
+    /*
+     * Children are reaped through the latch.  SIGCHLD stays blocked except
+     * while we sleep in epoll_pwait(), so a child that exits just before we
+     * go to sleep still wakes us up.  The same goes for an upgrade request.
+     */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    sigemptyset(&chldmask);
+    sigaddset(&chldmask, SIGCHLD);
+    sigaddset(&chldmask, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &chldmask, &waitmask);
+    sigdelset(&waitmask, SIGCHLD);
+    sigdelset(&waitmask, SIGUSR2);
+
+    /*
+     * Register all listening sockets.  They are edge-triggered, so each
+     * wakeup must drain the accept queue, which needs non-blocking sockets.
+     */
     for (int i = 0; i < NumListenSockets; i++) {
+        if (!set_noblock(ListenSockets[i]))
+            fprintf(stderr, "could not set listen socket to non-blocking mode: %m\n");
         AddSocketEvent(event_set, WL_SOCKET_ACCEPT, ListenSockets[i], NULL);
     }
 
@@ -273,8 +440,8 @@ AgentLoop(void)
         WaitEvent events[MAXLISTEN];
 
 #if defined(WAIT_USE_EPOLL)
-        nevents = epoll_wait(event_set->epoll_fd, event_set->epoll_ret_events,
-                             MAXLISTEN, -1);
+        nevents = epoll_pwait(event_set->epoll_fd, event_set->epoll_ret_events,
+                              MAXLISTEN, -1, &waitmask);
         /* Convert epoll events to generic format */
         for (int i = 0; i < nevents; i++) {
             events[i] = *(WaitEvent*)event_set->epoll_ret_events[i].data.ptr;
@@ -305,20 +472,34 @@ AgentLoop(void)
         // ... Windows-specific event processing ...
 #endif
 
+        if (MyLatch->is_set)
+        {
+            ResetLatch(MyLatch);
+            ChildRegistryReap();
+        }
+        if (upgrade_requested)
+            AgentUpgrade();
+
         /* Process all events */
 
         for (int i = 0; i < nevents; i++)
         {
             if (events[i].events & WL_SOCKET_ACCEPT)
             {
-                ClientSocket s;
-
-                if (AcceptConnection(events[i].fd, &s) == STATUS_OK)
+                /* take everything that queued up since the edge fired */
+                for (;;)
+                {
+                    ClientSocket s;
+
+                    if (AcceptConnection(events[i].fd, &s) != STATUS_OK)
+                    {
+                        if (errno == ECONNABORTED || errno == EINTR)
+                            continue;
+                        break;
+                    }
                     BackendStartup(&s);
 
-                /* Close client socket in the postmaster process */
-                if (s.sock != DBINVALID_SOCKET)
-                {
+                    /* Close client socket in the postmaster process */
                     if (closesocket(s.sock) != 0)
                         fprintf(stderr, "could not close client socket");
                 }
@@ -400,40 +581,60 @@ CopySockAddr(SockAddr *dest, const SockAddr *src)
     dest->salen = src->salen;
 }
 
+/*
+ * ServeConnection -- run one client session to completion in this process
+ *
+ * Used by the child forked for a single connection as well as by the
+ * long-lived pool workers, so everything the session sets up is torn
+ * down again before returning.  The socket is closed here.
+ */
+void
+ServeConnection(ClientSocket *client_sock)
+{
+    ClientSocket MyClientSocket;
+    int flags = fcntl(client_sock->sock, F_GETFL, 0);
+    fcntl(client_sock->sock, F_SETFL, flags & ~O_NONBLOCK);  // Disable non-blocking mode
+
+    // Copy the socket FD and SockAddr
+    MyClientSocket.sock = client_sock->sock;
+    CopySockAddr(&MyClientSocket.raddr, &client_sock->raddr);
+
+    comm_reset_connection();
+    // Perform GSSAPI handshake, or check the peer on the Unix socket
+    if (secure_open_session(&MyClientSocket) != 0)
+        fprintf(stderr, "client handshake failed\n");
+    else
+        handle_command(&MyClientSocket);
+
+    secure_close_gssapi();
+    global_client_socket = NULL;
+    closesocket(MyClientSocket.sock);
+}
+
 pid_t
 debo_child_launch(ClientSocket *client_sock)
 {
+    int slot = ChildRegistryReserve();
     pid_t pid = fork_process();
     if (pid == 0) {  // Child process
+        sigset_t chldmask;
+
+        ChildRegistryStarted(slot);
+        signal(SIGCHLD, SIG_DFL);
+        sigemptyset(&chldmask);
+        sigaddset(&chldmask, SIGCHLD);
+        sigaddset(&chldmask, SIGUSR2);
+        sigprocmask(SIG_UNBLOCK, &chldmask, NULL);
+
                      // Close parent's listening sockets (no memory deallocation!)
         CloseDeboPorts();
-        // Deep copy the entire ClientSocket
-        ClientSocket *MyClientSocket = malloc(sizeof(ClientSocket));
-        if (!MyClientSocket) {
-            fprintf(stderr, "Child: malloc failed\n");
-            _exit(1);
-        }
-        int flags = fcntl(client_sock->sock, F_GETFL, 0);
-        fcntl(client_sock->sock, F_SETFL, flags & ~O_NONBLOCK);  // Disable non-blocking mode
-
-        // Copy the socket FD and SockAddr
-        MyClientSocket->sock = client_sock->sock;  // Integer copy is safe
-        CopySockAddr(&MyClientSocket->raddr, &client_sock->raddr);  // Deep copy
-                                                                    // Perform GSSAPI handshake
-        if (secure_open_gssapi(MyClientSocket) != 0)
-        {
-            fprintf(stderr, "GSSAPI handshake failed\n");
-        }
-        // Handle the client command
-        handle_command(MyClientSocket);
 
-        // Cleanup: Close socket and free memory
-        closesocket(MyClientSocket->sock);
-        free(MyClientSocket);
+        ServeConnection(client_sock);
 
         // Use _exit() to avoid flushing parent's I/O buffers
         _exit(0);
     }
+    ChildRegistryForked(slot, pid);
     return pid;
 }
 
@@ -468,65 +669,394 @@ BackendStartup(ClientSocket *client_sock)
 
 #define MAX_LIMIT 1024
 
-static void handle_command(ClientSocket *client_socket) {
+/*
+ * send_agent_stats -- answer CliMsg_Agent_Stats with the agent's own
+ * process statistics as one block of text.
+ */
+static void
+send_agent_stats(ClientSocket *client_socket)
+{
+    StringInfoData buf;
+
+    initStringInfo(&buf);
+    appendStringInfo(&buf, "agent pid=%d port=%d", (int) AgentMasterPid, PostPortNumber);
+    if (IntegrityPortNumber > 0)
+        appendStringInfo(&buf, " integrity_port=%d", IntegrityPortNumber);
+    if (PlainPortNumber > 0)
+        appendStringInfo(&buf, " plain_port=%d", PlainPortNumber);
+    appendStringInfoChar(&buf, '\n');
+    WorkerPoolStats(&buf);
+    EventEngineStats(&buf);
+    AcceptorStats(&buf);
+    ChildRegistryStats(&buf);
+    JobStats(&buf);
+    UpgradeStats(&buf);
+    SEND_STRING(client_socket, buf.data);
+    free(buf.data);
+}
+
+/*
+ * send_inventory -- answer CliMsg_Inventory with the name of every
+ * component installed here, one a line, for the CLI's inventory cache.
+ * Only looks for the installations, so it is quick.
+ */
+static void
+send_inventory(ClientSocket *client_socket)
+{
+    StringInfoData buf;
+
+    initStringInfo(&buf);
+    for (Component c = FLINK; c <= ZOOKEEPER; c++) {
+        const char *name = component_to_string(c);
+
+        if (name != NULL && isComponentInstalled(c))
+            appendStringInfo(&buf, "%s\n", name);
+    }
+    SEND_STRING(client_socket, buf.data);
+    free(buf.data);
+}
+
+/*
+ * send_compression_choice -- answer CliMsg_Compress with the algorithm
+ * picked from the client's offer and the threshold that goes with it.
+ * Output sent after this reply may be compressed.
+ */
+static void
+send_compression_choice(StringInfo offer)
+{
+    StringInfoData buf;
+    int			algorithm;
+
+    /* session and job workers do not talk to the client themselves */
+    if (secure_output_redirected()) {
+        set_response_status(RESP_UNSUPPORTED);
+        FPRINTF(global_client_socket, "compression must be set up outside a session or job\n");
+        return;
+    }
+
+    algorithm = choose_compression(offer);
+    beginmessage(&buf, RespMsg_Compression);
+    sendbyte(&buf, algorithm);
+    sendint32(&buf, (uint32) CompressThreshold);
+    endmessage_more(&buf);
+    free(buf.data);
+
+    DbCompression = algorithm;
+    DbCompressThreshold = CompressThreshold;
+}
+
+/*
+ * send_hello_reply -- answer CliMsg_Hello, the capability handshake
+ *
+ * The client offers its protocol version, the GSSAPI packet size, the
+ * features it understands, the output chunk it would like and the
+ * compression algorithms it can take; the reply settles each of them for
+ * the rest of the connection.  protocol.h has the layout.
+ */
+static void
+send_hello_reply(StringInfo offer)
+{
+    StringInfoData buf;
+    int			version;
+    int			packet_kb;
+    int			features;
+    int			chunk;
+    int			algorithm;
+
+    /* session and job workers do not talk to the client themselves */
+    if (secure_output_redirected()) {
+        set_response_status(RESP_UNSUPPORTED);
+        FPRINTF(global_client_socket, "the handshake must come first on a connection\n");
+        return;
+    }
+    if (offer->len < 12) {
+        set_response_status(RESP_ERROR);
+        FPRINTF(global_client_socket, "malformed handshake\n");
+        return;
+    }
+
+    offer->cursor = 0;
+    version = getmsgint(offer, 2);
+    if (version < 1) {
+        set_response_status(RESP_UNSUPPORTED);
+        FPRINTF(global_client_socket, "protocol version %d has no handshake\n", version);
+        return;
+    }
+    packet_kb = getmsgint(offer, 2);
+    features = getmsgint(offer, 4);
+    chunk = getmsgint(offer, 4);
+    algorithm = choose_compression(offer);
+
+    if (version > PROTOCOL_VERSION)
+        version = PROTOCOL_VERSION;
+    features &= PROTO_FEATURE_SESSION | PROTO_FEATURE_JOBS |
+        PROTO_FEATURE_METRICS_RECORD | PROTO_FEATURE_FILE_TRANSFER;
+    if (algorithm != COMPRESS_NONE)
+        features |= PROTO_FEATURE_COMPRESS;
+    if (chunk < DEFAULT_OUTPUT_CHUNK)
+        chunk = DEFAULT_OUTPUT_CHUNK;
+    if (chunk > MAX_OUTPUT_CHUNK)
+        chunk = MAX_OUTPUT_CHUNK;
+
+    /*
+     * The client takes packets of the size it offered from now on, so the
+     * reply itself may already come in larger ones.
+     */
+    if (packet_kb > 0)
+        packet_kb = secure_gssapi_set_packet_size(packet_kb * 1024) / 1024;
+
+    /* this reply and everything after it are typed messages */
+    DbFramedResponses = true;
+
+    beginmessage(&buf, RespMsg_Hello);
+    sendint16(&buf, version);
+    sendint16(&buf, packet_kb);
+    sendint32(&buf, (uint32) features);
+    sendint32(&buf, MAX_LIMIT);
+    sendint32(&buf, (uint32) chunk);
+    sendbyte(&buf, algorithm);
+    sendint32(&buf, (uint32) CompressThreshold);
+    endmessage_more(&buf);
+    free(buf.data);
+
+    DbCompression = algorithm;
+    DbCompressThreshold = CompressThreshold;
+    DbOutputChunk = chunk;
+}
+
+/*
+ * send_metrics_record -- answer CliMsg_Metrics_Record with the host's
+ * counters as one binary record, laid out as protocol.h describes.
+ */
+static void
+send_metrics_record(void)
+{
+    StringInfoData buf;
+
+    /* session and job output only carries text */
+    if (secure_output_redirected()) {
+        set_response_status(RESP_UNSUPPORTED);
+        FPRINTF(global_client_socket, "metrics records cannot be sent in a session or job\n");
+        return;
+    }
+
+    beginmessage(&buf, RespMsg_Metrics);
+    build_metrics_record(&buf);
+    endmessage_compressed(&buf);
+    free(buf.data);
+}
+
+/*
+ * Replies for requests that cannot go ahead, with the matching status.
+ */
+static void
+reply_not_installed(Component comp)
+{
+    set_response_status(RESP_NOT_INSTALLED);
+    FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(comp));
+}
+
+static void
+reply_already_installed(Component comp)
+{
+    set_response_status(RESP_ALREADY_INSTALLED);
+    FPRINTF(global_client_socket, "%s is already installed.\n", component_to_string(comp));
+}
+
+static void
+reply_unsupported_parameter(void)
+{
+    set_response_status(RESP_UNSUPPORTED);
+    FPRINTF(global_client_socket, "configuration parameter not supported yet\n");
+}
+
+/*
+ * Requests whose replies only exist as typed messages.
+ */
+static bool
+needs_typed_messages(int action_code)
+{
+    return action_code == CliMsg_Compress ||
+        action_code == CliMsg_Metrics_Record ||
+        action_code == CliMsg_Session ||
+        action_code == CliMsg_File_Put ||
+        action_code == CliMsg_File_Get;
+}
+
+/*
+ * answer_command -- run one client request and complete its response
+ *
+ * The response of a session is made of the session's own frames.
+ */
+bool
+answer_command(ClientSocket *client_socket, int action_code, StringInfo param_buffer)
+{
+    bool		keep;
+
+    if (!DbFramedResponses && needs_typed_messages(action_code)) {
+        begin_response(action_code);
+        set_response_status(RESP_UNSUPPORTED);
+        FPRINTF(client_socket, "request 0x%02X needs the capability handshake first\n",
+                (unsigned char) action_code);
+        end_response();
+        return true;
+    }
+    if (action_code == CliMsg_Session)
+        return process_command(client_socket, action_code, param_buffer);
+
+    begin_response(action_code);
+    keep = process_command(client_socket, action_code, param_buffer);
+    end_response();
+    return keep;
+}
+
+void handle_command(ClientSocket *client_socket) {
     StringInfoData param_buffer;
-    StringInfoData value_buffer;
     initStringInfo(&param_buffer);
-    initStringInfo(&value_buffer);
     global_client_socket = client_socket;
     for (;;) {
         resetStringInfo(&param_buffer);
         int action_code = getbyte(client_socket);
-        if (getmessage(&param_buffer, client_socket, MAX_LIMIT))
-            free(param_buffer.data);
-        if (action_code == EOF || action_code == CliMsg_Finish) {
-            close(client_socket->sock);
-            return;  // Let ServerLoop free client_socket and update event_set
+        if (action_code == EOF ||
+            getmessage(&param_buffer, client_socket, MAX_LIMIT) == EOF)
+            break;
+        if (action_code == CliMsg_Finish)
+            break;  // ServeConnection closes the socket
+        if (!answer_command(client_socket, action_code, &param_buffer))
+            break;
+    }
+    free(param_buffer.data);
+}
+
+/*
+ * upgrade_allowed -- may this client replace the agent binary?
+ *
+ * Only over the local Unix socket, where the kernel vouches for the
+ * peer, and only for root or the user the agent runs as; GSSAPI
+ * principals allowed to run commands are not enough.  On refusal the
+ * reason is written to msg.
+ */
+static bool
+upgrade_allowed(ClientSocket *client_socket, char *msg, size_t msglen)
+{
+    uid_t uid;
+    gid_t gid;
+
+    if (client_socket->raddr.addr.ss_family != AF_UNIX) {
+        snprintf(msg, msglen, "agent upgrade is only accepted on the local socket");
+        return false;
+    }
+    if (!UnixPeerCredentials(client_socket->sock, &uid, &gid)) {
+        snprintf(msg, msglen, "could not get peer credentials: %s", strerror(errno));
+        return false;
+    }
+    if (uid != 0 && uid != geteuid()) {
+        snprintf(msg, msglen, "local user %u may not upgrade the agent", (unsigned int) uid);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * process_command -- execute one client request
+ *
+ * Returns false if the session ends after this request.
+ */
+bool
+process_command(ClientSocket *client_socket, int action_code, StringInfo param_buffer)
+{
+        if (action_code == CliMsg_Agent_Stats) {
+            send_agent_stats(client_socket);
+            return true;
+        }
+        if (action_code == CliMsg_Inventory) {
+            send_inventory(client_socket);
+            return true;
+        }
+        if (action_code == CliMsg_Agent_Upgrade) {
+            char msg[128];
+
+            if (!upgrade_allowed(client_socket, msg, sizeof(msg))) {
+                set_response_status(RESP_ERROR);
+                FPRINTF(client_socket, "%s\n", msg);
+            } else if (kill(AgentMasterPid, SIGUSR2) < 0) {
+                set_response_status(RESP_ERROR);
+                FPRINTF(client_socket, "could not signal agent %d: %s\n",
+                        (int) AgentMasterPid, strerror(errno));
+            } else
+                FPRINTF(client_socket, "upgrade of agent %d requested\n", (int) AgentMasterPid);
+            return true;
         }
+        if (action_code == CliMsg_Metrics_Record) {
+            send_metrics_record();
+            return true;
+        }
+        if (action_code == CliMsg_Compress) {
+            send_compression_choice(param_buffer);
+            return true;
+        }
+        if (action_code == CliMsg_Hello) {
+            send_hello_reply(param_buffer);
+            return true;
+        }
+        if (action_code >= CliMsg_Job_Submit && action_code <= CliMsg_Job_Cancel)
+            return JobCommand(client_socket, action_code, param_buffer);
+        if (action_code == CliMsg_Session)
+            return SessionCommand(client_socket, param_buffer);
+        if (action_code == CliMsg_File_Put || action_code == CliMsg_File_Get)
+            return FileTransferCommand(client_socket, action_code, param_buffer);
 
+        /* wait here if too many commands of this kind are running */
+        ChildClass cls = ChildAcquireClass(action_code);
 
-        char **result = split_string(param_buffer.data);
+        char **result = split_string(param_buffer->data);
         //printf(" the  data %s", param_buffer.data);
         // printf(" first second data %s", result[0]);
         //printf(" first second data %s", result[1]);
         if (action_code == CliMsg_Metrics){
-            FPRINTF(global_client_socket, collect_metrics());
-            return;
+            /* the report has '%' signs of its own, so it is not a format */
+            char *report = collect_metrics();
+
+            if (report != NULL)
+                FPRINTF(client_socket, "%s", report);
+            free(report);
+            ChildReleaseClass(cls);
+            return false;
             }
             
         switch (action_code) {
             /* ===================== HDFS Commands ===================== */
         case CliMsg_Hdfs_Start:
             if (!isComponentInstalled(HDFS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HDFS));
+                reply_not_installed(HDFS);
                 break;
             }
             hadoop_action(START);
             break;
         case CliMsg_Hdfs_Stop:
             if (!isComponentInstalled(HDFS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HDFS));
+                reply_not_installed(HDFS);
                 break;
             }
             hadoop_action(STOP);
             break;
         case CliMsg_Hdfs_Restart:
             if (!isComponentInstalled(HDFS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HDFS));
+                reply_not_installed(HDFS);
                 break;
             }
             hadoop_action(RESTART);
             break;
         case CliMsg_Hdfs_Uninstall:
             if (!isComponentInstalled(HDFS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HDFS));
+                reply_not_installed(HDFS);
                 break;
             }
             uninstall_hadoop();
             break;
         case CliMsg_Hdfs_Install_Version:
             if (isComponentInstalled(HDFS)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(HDFS));
+                reply_already_installed(HDFS);
                 break;
             }
             install_hadoop(result[0],result[1]);
@@ -534,7 +1064,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Hdfs_Install:
             if (isComponentInstalled(HDFS)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(HDFS));
+                reply_already_installed(HDFS);
                 break;
             }
             install_hadoop(NULL, NULL);
@@ -542,45 +1072,45 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Hdfs:
             if (!isComponentInstalled(HDFS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HDFS));
+                reply_not_installed(HDFS);
                 break;
             }
-            FPRINTF(global_client_socket, report_hdfs());
+            FPRINTF(global_client_socket, "%s", report_hdfs());
             break;
 
 
             /* ===================== Spark Commands ==================== */
         case CliMsg_Spark_Start:
             if (!isComponentInstalled(SPARK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SPARK));
+                reply_not_installed(SPARK);
                 break;
             }
             spark_action(START);
             break;
         case CliMsg_Spark_Stop:
             if (!isComponentInstalled(SPARK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SPARK));
+                reply_not_installed(SPARK);
                 break;
             }
             spark_action(STOP);
             break;
         case CliMsg_Spark_Restart:
             if (!isComponentInstalled(SPARK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SPARK));
+                reply_not_installed(SPARK);
                 break;
             }
             spark_action(RESTART);
             break;
         case CliMsg_Spark_Uninstall:
             if (!isComponentInstalled(SPARK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SPARK));
+                reply_not_installed(SPARK);
                 break;
             }
             uninstall_spark();
             break;
         case CliMsg_Spark_Install_Version:
             if (isComponentInstalled(SPARK)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(SPARK));
+                reply_already_installed(SPARK);
                 break;
             }
             install_spark(result[0],result[1]);
@@ -588,7 +1118,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Spark_Install:
             if (isComponentInstalled(SPARK)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(SPARK));
+                reply_already_installed(SPARK);
                 break;
             }
             install_spark(NULL, NULL);
@@ -596,43 +1126,43 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Spark:
             if (!isComponentInstalled(SPARK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SPARK));
+                reply_not_installed(SPARK);
                 break;
             }
-            FPRINTF(global_client_socket, report_spark());
+            FPRINTF(global_client_socket, "%s", report_spark());
             break;
             /* ===================== Kafka Commands ===================== */
         case CliMsg_Kafka_Start:
             if (!isComponentInstalled(KAFKA)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(KAFKA));
+                reply_not_installed(KAFKA);
                 break;
             }
             kafka_action(START);
             break;
         case CliMsg_Kafka_Stop:
             if (!isComponentInstalled(KAFKA)){
-                PRINTF(global_client_socket, "%s is not installed.\n", component_to_string(KAFKA));
+                reply_not_installed(KAFKA);
                 break;
             }
             kafka_action(STOP);
             break;
         case CliMsg_Kafka_Restart:
             if (!isComponentInstalled(KAFKA)){
-                PRINTF(global_client_socket, "%s is not installed.\n", component_to_string(KAFKA));
+                reply_not_installed(KAFKA);
                 break;
             }
             kafka_action(RESTART);
             break;
         case CliMsg_Kafka_Uninstall:
             if (!isComponentInstalled(KAFKA)){
-                PRINTF(global_client_socket, "%s is not installed.\n", component_to_string(KAFKA));
+                reply_not_installed(KAFKA);
                 break;
             }
             uninstall_kafka();
             break;
         case CliMsg_Kafka_Install_Version:
             if (isComponentInstalled(KAFKA)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(KAFKA));
+                reply_already_installed(KAFKA);
                 break;
             }
             install_kafka(result[0],result[1]);
@@ -640,7 +1170,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Kafka_Install:
             if (isComponentInstalled(KAFKA)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(KAFKA));
+                reply_already_installed(KAFKA);
                 break;
             }
             install_kafka(NULL, NULL);
@@ -648,7 +1178,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Kafka:
             if (!isComponentInstalled(KAFKA)){
-                PRINTF(global_client_socket, "%s is not installed.\n", component_to_string(KAFKA));
+                reply_not_installed(KAFKA);
                 break;
             }
             SEND_STRING(global_client_socket, report_kafka());
@@ -657,35 +1187,35 @@ static void handle_command(ClientSocket *client_socket) {
             /* ===================== HBase Commands ===================== */
         case CliMsg_HBase_Start:
             if (!isComponentInstalled(HBASE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HBASE));
+                reply_not_installed(HBASE);
                 break;
             }
             HBase_action(START);
             break;
         case CliMsg_HBase_Stop:
             if (!isComponentInstalled(HBASE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HBASE));
+                reply_not_installed(HBASE);
                 break;
             }
             HBase_action(STOP);
             break;
         case CliMsg_HBase_Restart:
             if (!isComponentInstalled(HBASE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HBASE));
+                reply_not_installed(HBASE);
                 break;
             }
             HBase_action(RESTART);
             break;
         case CliMsg_HBase_Uninstall:
             if (!isComponentInstalled(HBASE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HBASE));
+                reply_not_installed(HBASE);
                 break;
             }
             uninstall_HBase();
             break;
         case CliMsg_HBase_Install_Version:
             if (isComponentInstalled(HBASE)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(HBASE));
+                reply_already_installed(HBASE);
                 break;
             }
             install_HBase(result[0],result[1]);
@@ -693,7 +1223,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_HBase_Install:
             if (isComponentInstalled(HBASE)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(HBASE));
+                reply_already_installed(HBASE);
                 break;
             }
             install_HBase(NULL, NULL);
@@ -701,7 +1231,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_HBase:
             if (!isComponentInstalled(HBASE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HBASE));
+                reply_not_installed(HBASE);
                 break;
             }
             SEND_STRING(global_client_socket, report_hbase());
@@ -710,35 +1240,35 @@ static void handle_command(ClientSocket *client_socket) {
             /* =================== ZooKeeper Commands =================== */
         case CliMsg_ZooKeeper_Start:
             if (!isComponentInstalled(ZOOKEEPER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZOOKEEPER));
+                reply_not_installed(ZOOKEEPER);
                 break;
             }
             zookeeper_action(START);
             break;
         case CliMsg_ZooKeeper_Stop:
             if (!isComponentInstalled(ZOOKEEPER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZOOKEEPER));
+                reply_not_installed(ZOOKEEPER);
                 break;
             }
             zookeeper_action(STOP);
             break;
         case CliMsg_ZooKeeper_Restart:
             if (!isComponentInstalled(ZOOKEEPER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZOOKEEPER));
+                reply_not_installed(ZOOKEEPER);
                 break;
             }
             zookeeper_action(RESTART);
             break;
         case CliMsg_ZooKeeper_Uninstall:
             if (!isComponentInstalled(ZOOKEEPER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZOOKEEPER));
+                reply_not_installed(ZOOKEEPER);
                 break;
             }
             uninstall_zookeeper();
             break;
         case CliMsg_ZooKeeper_Install_Version:
             if (isComponentInstalled(ZOOKEEPER)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(ZOOKEEPER));
+                reply_already_installed(ZOOKEEPER);
                 break;
             }
             install_zookeeper(result[0],result[1]);
@@ -746,7 +1276,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_ZooKeeper_Install:
             if (isComponentInstalled(ZOOKEEPER)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(ZOOKEEPER));
+                reply_already_installed(ZOOKEEPER);
                 break;
             }
             install_zookeeper(NULL, NULL);
@@ -754,44 +1284,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_ZooKeeper:
             if (!isComponentInstalled(ZOOKEEPER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZOOKEEPER));
+                reply_not_installed(ZOOKEEPER);
                 break;
             }
-            FPRINTF(global_client_socket, report_zookeeper());
+            FPRINTF(global_client_socket, "%s", report_zookeeper());
             break;
 
             /* ===================== Flink Commands ===================== */
         case CliMsg_Flink_Start:
             if (!isComponentInstalled(FLINK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(FLINK));
+                reply_not_installed(FLINK);
                 break;
             }
             flink_action(START);
             break;
         case CliMsg_Flink_Stop:
             if (!isComponentInstalled(FLINK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(FLINK));
+                reply_not_installed(FLINK);
                 break;
             }
             flink_action(STOP);
             break;
         case CliMsg_Flink_Restart:
             if (!isComponentInstalled(FLINK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(FLINK));
+                reply_not_installed(FLINK);
                 break;
             }
             flink_action(RESTART);
             break;
         case CliMsg_Flink_Uninstall:
             if (!isComponentInstalled(FLINK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(FLINK));
+                reply_not_installed(FLINK);
                 break;
             }
             uninstall_flink();
             break;
         case CliMsg_Flink_Install_Version:
             if (isComponentInstalled(FLINK)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(FLINK));
+                reply_already_installed(FLINK);
                 break;
             }
             install_flink(result[0],result[1]);
@@ -799,7 +1329,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Flink_Install:
             if (isComponentInstalled(FLINK)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(FLINK));
+                reply_already_installed(FLINK);
                 break;
             }
             install_flink(NULL, NULL);
@@ -807,44 +1337,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Flink:
             if (!isComponentInstalled(FLINK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(FLINK));
+                reply_not_installed(FLINK);
                 break;
             }
-            FPRINTF(global_client_socket, report_flink());
+            FPRINTF(global_client_socket, "%s", report_flink());
             break;
 
             /* ===================== Storm Commands ===================== */
         case CliMsg_Storm_Start:
             if (!isComponentInstalled(STORM)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(STORM));
+                reply_not_installed(STORM);
                 break;
             }
             storm_action(START);
             break;
         case CliMsg_Storm_Stop:
             if (!isComponentInstalled(STORM)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(STORM));
+                reply_not_installed(STORM);
                 break;
             }
             storm_action(STOP);
             break;
         case CliMsg_Storm_Restart:
             if (!isComponentInstalled(STORM)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(STORM));
+                reply_not_installed(STORM);
                 break;
             }
             storm_action(RESTART);
             break;
         case CliMsg_Storm_Uninstall:
             if (!isComponentInstalled(STORM)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(STORM));
+                reply_not_installed(STORM);
                 break;
             }
             uninstall_Storm();
             break;
         case CliMsg_Storm_Install_Version:
             if (isComponentInstalled(STORM)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(STORM));
+                reply_already_installed(STORM);
                 break;
             }
             install_Storm(result[0],result[1]);
@@ -852,7 +1382,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Storm_Install:
             if (isComponentInstalled(STORM)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(STORM));
+                reply_already_installed(STORM);
                 break;
             }
             install_Storm(NULL, NULL);
@@ -860,44 +1390,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Storm:
             if (!isComponentInstalled(STORM)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(STORM));
+                reply_not_installed(STORM);
                 break;
             }
-            PRINTF(global_client_socket, report_storm());
+            PRINTF(global_client_socket, "%s", report_storm());
             break;
 
             /* ===================== Hive Commands ====================== */
         case CliMsg_Hive_Start:
             if (!isComponentInstalled(HIVE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HIVE));
+                reply_not_installed(HIVE);
                 break;
             }
             hive_action(START);
             break;
         case CliMsg_Hive_Stop:
             if (!isComponentInstalled(HIVE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HIVE));
+                reply_not_installed(HIVE);
                 break;
             }
             hive_action(STOP);
             break;
         case CliMsg_Hive_Restart:
             if (!isComponentInstalled(HIVE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HIVE));
+                reply_not_installed(HIVE);
                 break;
             }
             hive_action(RESTART);
             break;
         case CliMsg_Hive_Uninstall:
             if (!isComponentInstalled(HIVE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HIVE));
+                reply_not_installed(HIVE);
                 break;
             }
             uninstall_hive();
             break;
         case CliMsg_Hive_Install_Version:
             if (isComponentInstalled(HIVE)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(HIVE));
+                reply_already_installed(HIVE);
                 break;
             }
             install_hive(result[0],result[1]);
@@ -905,7 +1435,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Hive_Install:
             if (isComponentInstalled(HIVE)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(HIVE));
+                reply_already_installed(HIVE);
                 break;
             }
             install_hive(NULL, NULL);
@@ -913,44 +1443,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Hive:
             if (!isComponentInstalled(HIVE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HIVE));
+                reply_not_installed(HIVE);
                 break;
             }
-            FPRINTF(global_client_socket, report_hive());
+            FPRINTF(global_client_socket, "%s", report_hive());
             break;
 
             /* ===================== Pig Commands ====================== */
         case CliMsg_Pig_Start:
             if (!isComponentInstalled(PIG)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PIG));
+                reply_not_installed(PIG);
                 break;
             }
             pig_action(START);
             break;
         case CliMsg_Pig_Stop:
             if (!isComponentInstalled(PIG)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PIG));
+                reply_not_installed(PIG);
                 break;
             }
             pig_action(STOP);
             break;
         case CliMsg_Pig_Restart:
             if (!isComponentInstalled(PIG)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PIG));
+                reply_not_installed(PIG);
                 break;
             }
             pig_action(RESTART);
             break;
         case CliMsg_Pig_Uninstall:
             if (!isComponentInstalled(PIG)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PIG));
+                reply_not_installed(PIG);
                 break;
             }
             uninstall_pig();
             break;
         case CliMsg_Pig_Install_Version:
             if (isComponentInstalled(PIG)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(PIG));
+                reply_already_installed(PIG);
                 break;
             }
             install_pig(result[0],result[1]);
@@ -958,7 +1488,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Pig_Install:
             if (isComponentInstalled(PIG)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(PIG));
+                reply_already_installed(PIG);
                 break;
             }
             install_pig(NULL, NULL);
@@ -966,44 +1496,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Pig:
             if (!isComponentInstalled(PIG)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PIG));
+                reply_not_installed(PIG);
                 break;
             }
-            FPRINTF(global_client_socket, report_pig());
+            FPRINTF(global_client_socket, "%s", report_pig());
             break;
 
             /* ===================== Tez Commands ====================== */
         case CliMsg_Tez_Start:
             if (!isComponentInstalled(TEZ)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(TEZ));
+                reply_not_installed(TEZ);
                 break;
             }
             tez_action(START);
             break;
         case CliMsg_Tez_Stop:
             if (!isComponentInstalled(TEZ)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(TEZ));
+                reply_not_installed(TEZ);
                 break;
             }
             tez_action(STOP);
             break;
         case CliMsg_Tez_Restart:
             if (!isComponentInstalled(TEZ)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(TEZ));
+                reply_not_installed(TEZ);
                 break;
             }
             tez_action(RESTART);
             break;
         case CliMsg_Tez_Uninstall:
             if (!isComponentInstalled(TEZ)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(TEZ));
+                reply_not_installed(TEZ);
                 break;
             }
             uninstall_Tez();
             break;
         case CliMsg_Tez_Install_Version:
             if (isComponentInstalled(TEZ)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(TEZ));
+                reply_already_installed(TEZ);
                 break;
             }
             install_Tez(result[0],result[1]);
@@ -1011,7 +1541,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Tez_Install:
             if (isComponentInstalled(TEZ)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(TEZ));
+                reply_already_installed(TEZ);
                 break;
             }
             install_Tez(NULL, NULL);
@@ -1019,44 +1549,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Tez:
             if (!isComponentInstalled(TEZ)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(TEZ));
+                reply_not_installed(TEZ);
                 break;
             }
-            FPRINTF(global_client_socket, report_tez());
+            FPRINTF(global_client_socket, "%s", report_tez());
             break;
 
             /* ==================== Atlas Commands ===================== */
         case CliMsg_Atlas_Start:
             if (!isComponentInstalled(ATLAS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ATLAS));
+                reply_not_installed(ATLAS);
                 break;
             }
             atlas_action(START);
             break;
         case CliMsg_Atlas_Stop:
             if (!isComponentInstalled(ATLAS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ATLAS));
+                reply_not_installed(ATLAS);
                 break;
             }
             atlas_action(STOP);
             break;
         case CliMsg_Atlas_Restart:
             if (!isComponentInstalled(ATLAS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ATLAS));
+                reply_not_installed(ATLAS);
                 break;
             }
             atlas_action(RESTART);
             break;
         case CliMsg_Atlas_Uninstall:
             if (!isComponentInstalled(ATLAS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ATLAS));
+                reply_not_installed(ATLAS);
                 break;
             }
             uninstall_Atlas();
             break;
         case CliMsg_Atlas_Install_Version:
             if (isComponentInstalled(ATLAS)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(ATLAS));
+                reply_already_installed(ATLAS);
                 break;
             }
             install_Atlas(result[0],result[1]);
@@ -1064,7 +1594,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Atlas_Install:
             if (isComponentInstalled(ATLAS)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(ATLAS));
+                reply_already_installed(ATLAS);
                 break;
             }
             install_Atlas(NULL, NULL);
@@ -1072,44 +1602,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Atlas:
             if (!isComponentInstalled(ATLAS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ATLAS));
+                reply_not_installed(ATLAS);
                 break;
             }
-            FPRINTF(global_client_socket, report_atlas());
+            FPRINTF(global_client_socket, "%s", report_atlas());
             break;
 
             /* ==================== Ranger Commands ==================== */
         case CliMsg_Ranger_Start:
             if (!isComponentInstalled(RANGER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(RANGER));
+                reply_not_installed(RANGER);
                 break;
             }
             ranger_action(START);
             break;
         case CliMsg_Ranger_Stop:
             if (!isComponentInstalled(RANGER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(RANGER));
+                reply_not_installed(RANGER);
                 break;
             }
             ranger_action(STOP);
             break;
         case CliMsg_Ranger_Restart:
             if (!isComponentInstalled(RANGER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(RANGER));
+                reply_not_installed(RANGER);
                 break;
             }
             ranger_action(RESTART);
             break;
         case CliMsg_Ranger_Uninstall:
             if (!isComponentInstalled(RANGER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(RANGER));
+                reply_not_installed(RANGER);
                 break;
             }
             uninstall_ranger();
             break;
         case CliMsg_Ranger_Install_Version:
             if (isComponentInstalled(RANGER)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(RANGER));
+                reply_already_installed(RANGER);
                 break;
             }
             install_Ranger(result[0],result[1]);
@@ -1117,7 +1647,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Ranger_Install:
             if (isComponentInstalled(RANGER)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(RANGER));
+                reply_already_installed(RANGER);
                 break;
             }
             install_Ranger(NULL, NULL);
@@ -1125,44 +1655,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Ranger:
             if (!isComponentInstalled(RANGER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(RANGER));
+                reply_not_installed(RANGER);
                 break;
             }
-            FPRINTF(global_client_socket, report_ranger());
+            FPRINTF(global_client_socket, "%s", report_ranger());
             break;
 
             /* ===================== Livy Commands ===================== */
         case CliMsg_Livy_Start:
             if (!isComponentInstalled(LIVY)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(LIVY));
+                reply_not_installed(LIVY);
                 break;
             }
             livy_action(START);
             break;
         case CliMsg_Livy_Stop:
             if (!isComponentInstalled(LIVY)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(LIVY));
+                reply_not_installed(LIVY);
                 break;
             }
             livy_action(STOP);
             break;
         case CliMsg_Livy_Restart:
             if (!isComponentInstalled(LIVY)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(LIVY));
+                reply_not_installed(LIVY);
                 break;
             }
             livy_action(RESTART);
             break;
         case CliMsg_Livy_Uninstall:
             if (!isComponentInstalled(LIVY)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(LIVY));
+                reply_not_installed(LIVY);
                 break;
             }
             uninstall_livy();
             break;
         case CliMsg_Livy_Install_Version:
             if (isComponentInstalled(LIVY)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(LIVY));
+                reply_already_installed(LIVY);
                 break;
             }
             install_Livy(result[0],result[1]);
@@ -1170,7 +1700,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Livy_Install:
             if (isComponentInstalled(LIVY)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(LIVY));
+                reply_already_installed(LIVY);
                 break;
             }
             install_Livy(NULL, NULL);
@@ -1178,10 +1708,10 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Livy:
             if (!isComponentInstalled(LIVY)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(LIVY));
+                reply_not_installed(LIVY);
                 break;
             }
-            FPRINTF(global_client_socket, report_livy());
+            FPRINTF(global_client_socket, "%s", report_livy());
             break;
 
             /* =================== Phoenix Commands =================== */
@@ -1235,41 +1765,41 @@ static void handle_command(ClientSocket *client_socket) {
             //   FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PHOENIX));
             //  break;
             //}
-            PRINTF(global_client_socket, report_phoenix());
+            PRINTF(global_client_socket, "%s", report_phoenix());
             break;
 
             /* ===================== Solr Commands =================== */
         case CliMsg_Solr_Start:
             if (!isComponentInstalled(SOLR)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SOLR));
+                reply_not_installed(SOLR);
                 break;
             }
             Solr_action(START);
             break;
         case CliMsg_Solr_Stop:
             if (!isComponentInstalled(SOLR)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SOLR));
+                reply_not_installed(SOLR);
                 break;
             }
             Solr_action(STOP);
             break;
         case CliMsg_Solr_Restart:
             if (!isComponentInstalled(SOLR)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SOLR));
+                reply_not_installed(SOLR);
                 break;
             }
             Solr_action(RESTART);
             break;
         case CliMsg_Solr_Uninstall:
             if (!isComponentInstalled(SOLR)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SOLR));
+                reply_not_installed(SOLR);
                 break;
             }
             uninstall_Solr();
             break;
         case CliMsg_Solr_Install_Version:
             if (isComponentInstalled(SOLR)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(SOLR));
+                reply_already_installed(SOLR);
                 break;
             }
             install_Solr(result[0],result[1]);
@@ -1277,7 +1807,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Solr_Install:
             if (isComponentInstalled(SOLR)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(SOLR));
+                reply_already_installed(SOLR);
                 break;
             }
             install_Solr(NULL, NULL);
@@ -1285,44 +1815,44 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Solr:
             if (!isComponentInstalled(SOLR)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SOLR));
+                reply_not_installed(SOLR);
                 break;
             }
-            PRINTF(global_client_socket, report_solr());
+            PRINTF(global_client_socket, "%s", report_solr());
             break;
 
             /* =================== Zeppelin Commands ================== */
         case CliMsg_Zeppelin_Stop:
             if (!isComponentInstalled(ZEPPELIN)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZEPPELIN));
+                reply_not_installed(ZEPPELIN);
                 break;
             }
             Zeppelin_action(STOP);
             break;
         case CliMsg_Zeppelin_Start:
             if (!isComponentInstalled(ZEPPELIN)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZEPPELIN));
+                reply_not_installed(ZEPPELIN);
                 break;
             }
             Zeppelin_action(START);
             break;
         case CliMsg_Zeppelin_Restart:
             if (!isComponentInstalled(ZEPPELIN)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZEPPELIN));
+                reply_not_installed(ZEPPELIN);
                 break;
             }
             Zeppelin_action(RESTART);
             break;
         case CliMsg_Zeppelin_Uninstall:
             if (!isComponentInstalled(ZEPPELIN)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZEPPELIN));
+                reply_not_installed(ZEPPELIN);
                 break;
             }
             uninstall_Zeppelin();
             break;
         case CliMsg_Zeppelin_Install_Version:
             if (isComponentInstalled(ZEPPELIN)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(ZEPPELIN));
+                reply_already_installed(ZEPPELIN);
                 break;
             }
             install_Zeppelin(result[0],result[1]);
@@ -1330,7 +1860,7 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Zeppelin_Install:
             if (isComponentInstalled(ZEPPELIN)){
-                PRINTF(global_client_socket, "%s is already installed.\n", component_to_string(ZEPPELIN));
+                reply_already_installed(ZEPPELIN);
                 break;
             }
             install_Zeppelin(NULL, NULL);
@@ -1338,10 +1868,10 @@ static void handle_command(ClientSocket *client_socket) {
             break;
         case CliMsg_Zeppelin:
             if (!isComponentInstalled(ZEPPELIN)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZEPPELIN));
+                reply_not_installed(ZEPPELIN);
                 break;
             }
-            PRINTF(global_client_socket, report_zeppelin());
+            PRINTF(global_client_socket, "%s", report_zeppelin());
             break;
 
             /* =================== Zeppelin Commands ================== */
@@ -1394,13 +1924,13 @@ static void handle_command(ClientSocket *client_socket) {
             //   FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PRESTO));
             //  break;
             // }
-            PRINTF(global_client_socket, report_presto());
+            PRINTF(global_client_socket, "%s", report_presto());
             break;
 
             /* ================= Configuration Commands =============== */
         case CliMsg_Hdfs_Configure:
             if (!isComponentInstalled(HDFS)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HDFS));
+                reply_not_installed(HDFS);
                 break;
             }
             ValidationResult validationresult = validateHdfsConfigParam(result[0], result[1]);
@@ -1408,13 +1938,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *hdfsResult= find_hdfs_config(result[0]);
             if (hdfsResult == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus hdfsStatus =  modify_hdfs_config(hdfsResult->canonical_name,hdfsResult->value,hdfsResult->config_file);
             handle_result(hdfsStatus, hdfsResult->canonical_name,result[1],hdfsResult->config_file);
             break;
         case CliMsg_HBase_Configure:
             if (!isComponentInstalled(HBASE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HBASE));
+                reply_not_installed(HBASE);
                 break;
             }
             ValidationResult validationHbase = validateHBaseConfigParam(result[0], result[1]);
@@ -1422,13 +1952,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *hbaseResult= process_hbase_config(result[0],result[1]);
             if (hbaseResult == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus hbaseStatus =  update_hbase_config(hbaseResult->canonical_name, hbaseResult->value, hbaseResult->config_file);
             handle_result(hbaseStatus, hbaseResult->canonical_name, hbaseResult->value, hbaseResult->config_file);
             break;
         case CliMsg_Spark_Configure:
             if (!isComponentInstalled(SPARK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SPARK));
+                reply_not_installed(SPARK);
                 break;
             }
             ValidationResult validationSpark = validateSparkConfigParam(result[0], result[1]);
@@ -1436,13 +1966,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *sparkResult= get_spark_config(result[0],result[1]);
             if (sparkResult == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus sparkStatus = update_spark_config(sparkResult->canonical_name, sparkResult->value, sparkResult->config_file);
             handle_result(sparkStatus, sparkResult->canonical_name, sparkResult->value, sparkResult->config_file);
             break;
         case CliMsg_Kafka_Configure:
             if (!isComponentInstalled(KAFKA)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(KAFKA));
+                reply_not_installed(KAFKA);
                 break;
             }
             ValidationResult validationKafka = validateKafkaConfigParam(result[0], result[1]);
@@ -1450,13 +1980,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *kafkaResult = validate_kafka_config_param(result[0],result[1]);
             if (kafkaResult == NULL)
-                PRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus kafkaStatus = modify_kafka_config(kafkaResult->canonical_name,kafkaResult->value,kafkaResult->config_file);
             handle_result(kafkaStatus, kafkaResult->canonical_name,kafkaResult->value,kafkaResult->config_file);
             break;
         case CliMsg_Flink_Configure:
             if (!isComponentInstalled(FLINK)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(FLINK));
+                reply_not_installed(FLINK);
                 break;
             }
             ValidationResult validationflink = validateFlinkConfigParam(result[0], result[1]);
@@ -1464,13 +1994,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *flinkResult = set_flink_config(result[0],result[1]);
             if (flinkResult ==NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus flinkStatus = update_flink_config(flinkResult->canonical_name,flinkResult->value, flinkResult->config_file);
             handle_result(flinkStatus, flinkResult->canonical_name,flinkResult->value, flinkResult->config_file);
             break;
         case CliMsg_ZooKeeper_Configure:
             if (!isComponentInstalled(ZOOKEEPER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZOOKEEPER));
+                reply_not_installed(ZOOKEEPER);
                 break;
             }
             ValidationResult validationZookeeper = validateZooKeeperConfigParam(result[0], result[1]);
@@ -1478,13 +2008,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *zookeperResult = parse_zookeeper_param(result[0],result[1]);
             if (zookeperResult == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus zookeeperStatus = modify_zookeeper_config(zookeperResult->canonical_name, zookeperResult->value, zookeperResult->config_file);
             handle_result(zookeeperStatus, zookeperResult->canonical_name, zookeperResult->value, zookeperResult->config_file);
             break;
         case CliMsg_Storm_Configure:
             if (!isComponentInstalled(STORM)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(STORM));
+                reply_not_installed(STORM);
                 break;
             }
             ValidationResult validationStorm = validateStormConfigParam(result[0], result[1]);
@@ -1492,13 +2022,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *conf = validate_storm_config_param(result[0],result[1]);
             if (conf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus stormStatus = modify_storm_config(conf->canonical_name, conf->value, conf->config_file);
             handle_result(stormStatus, conf->canonical_name, conf->value, conf->config_file);
             break;
         case CliMsg_Hive_Configure:
             if (!isComponentInstalled(HIVE)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(HIVE));
+                reply_not_installed(HIVE);
                 break;
             }
             ValidationResult validationHive = validateHiveConfigParam(result[0], result[1]);
@@ -1506,13 +2036,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *hiveConf = process_hive_parameter(result[0],result[1]);
             if (hiveConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus hiveStatus = modify_hive_config(hiveConf->canonical_name, hiveConf->value, hiveConf->config_file);
             handle_result(hiveStatus, hiveConf->canonical_name, hiveConf->value, hiveConf->config_file);
             break;
         case CliMsg_Pig_Configure:
             if (!isComponentInstalled(PIG)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(PIG));
+                reply_not_installed(PIG);
                 break;
             }
             ValidationResult validationPig = validatePigConfigParam(result[0], result[1]);
@@ -1520,7 +2050,7 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *pigConf = validate_pig_config_param(result[0],result[1]);
             if (pigConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus pigStatus = update_pig_config(pigConf->canonical_name, pigConf->value);
             handle_result(pigStatus, pigConf->canonical_name, pigConf->value,pigConf->config_file);
             break;
@@ -1530,18 +2060,18 @@ static void handle_command(ClientSocket *client_socket) {
             //  return modify_oozie_config(result[0],result[1]);
         case CliMsg_Ranger_Configure:
             if (!isComponentInstalled(RANGER)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(RANGER));
+                reply_not_installed(RANGER);
                 break;
             }
             ConfigResult *rangerConf = process_zeppelin_config_param(result[0],result[1]);
             if (rangerConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus rangerStatus =  set_ranger_config(rangerConf->canonical_name, rangerConf->value, rangerConf->config_file);
             handle_result(rangerStatus, rangerConf->canonical_name, rangerConf->value, rangerConf->config_file);
             break;
         case CliMsg_Livy_Configure:
             if (!isComponentInstalled(LIVY)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(LIVY));
+                reply_not_installed(LIVY);
                 break;
             }
             ValidationResult validationLivy = validateLivyConfigParam(result[0], result[1]);
@@ -1549,7 +2079,7 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *livyConf = parse_livy_config_param(result[0],result[1]);
             if (livyConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus livyStatus = set_livy_config(livyConf->canonical_name, livyConf->value,livyConf->config_file);
             handle_result(livyStatus, livyConf->canonical_name, livyConf->value,livyConf->config_file);
             break;
@@ -1559,7 +2089,7 @@ static void handle_command(ClientSocket *client_socket) {
             // break;
         case CliMsg_Solr_Configure:
             if (!isComponentInstalled(SOLR)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(SOLR));
+                reply_not_installed(SOLR);
                 break;
             }
             ValidationResult validationSolr = validateSolrConfigParam(result[0], result[1]);
@@ -1567,13 +2097,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *solrConf = validate_solr_parameter(result[0],result[1]);
             if (solrConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus solrStatus =  update_solr_config(solrConf->canonical_name, solrConf->value, solrConf->config_file);
             handle_result(solrStatus, solrConf->canonical_name, solrConf->value, solrConf->config_file);
             break;
         case CliMsg_Zeppelin_Configure:
             if (!isComponentInstalled(ZEPPELIN)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(ZEPPELIN));
+                reply_not_installed(ZEPPELIN);
                 break;
             }
             ValidationResult validationZeppelin = validateZeppelinConfigParam(result[0], result[1]);
@@ -1581,13 +2111,13 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *zeppelinConf = process_zeppelin_config_param(result[0],result[1]);
             if (zeppelinConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus zeppStatus =  set_zeppelin_config(zeppelinConf->config_file , zeppelinConf->canonical_name, zeppelinConf->value);
             handle_result(zeppStatus, zeppelinConf->canonical_name, zeppelinConf->value,zeppelinConf->config_file);
             break;
         case CliMsg_Tez_Configure:
             if (!isComponentInstalled(TEZ)){
-                FPRINTF(global_client_socket, "%s is not installed.\n", component_to_string(TEZ));
+                reply_not_installed(TEZ);
                 break;
             }
             ValidationResult validationTez = validateTezConfigParam(result[0], result[1]);
@@ -1595,7 +2125,7 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *tezConf = parse_tez_config_param(result[0],result[1]);
             if (tezConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus tezStatus =   modify_tez_config(tezConf->canonical_name, tezConf->value, "tez-site.xml");
             handle_result(tezStatus, tezConf->canonical_name, tezConf->value, "tez-site.xml");
             break;
@@ -1609,7 +2139,7 @@ static void handle_command(ClientSocket *client_socket) {
                 break;
             ConfigResult *prestoConf = get_presto_config_setting(result[0],result[1]);
             if (prestoConf == NULL)
-                FPRINTF(global_client_socket,"configuration parameter not supported yet");
+                reply_unsupported_parameter();
             ConfigStatus prestoStatus =   set_presto_config(prestoConf->canonical_name, prestoConf->value, prestoConf->config_file);
             handle_result(prestoStatus, prestoConf->canonical_name, prestoConf->value, prestoConf->config_file);
             break;
@@ -1619,5 +2149,6 @@ static void handle_command(ClientSocket *client_socket) {
             // send_error(client_socket, "Invalid command");
             break;
         }
-    }
+        ChildReleaseClass(cls);
+        return true;
 }
@@ -0,0 +1,908 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * engine.c
+ *		Event-driven command engine.
+ *
+ * Every client socket is registered EPOLLONESHOT, so a connection is
+ * owned by at most one command thread at a time and the main thread
+ * never has to lock it.  When a thread picks up a connection it attaches
+ * the connection's saved protocol state (comm.c receive buffer, GSSAPI
+ * context and packet buffers) to itself, serves whatever requests are
+ * complete, detaches the state again and re-arms the socket.
+ *
+ * A thread never waits for a client.  Sockets stay non-blocking, and a
+ * request that has not fully arrived is left in the receive buffer with
+ * the rest of the state until epoll reports more.  Only the handshake,
+ * which takes several round trips, and the answer to a request are done
+ * with blocking I/O, and both are bounded by ENGINE_IO_TIMEOUT_MS.
+ *
+ * Only requests that are cheap and safe to run next to each other are
+ * served on a thread.  For anything else (start/stop, install,
+ * configure, ...) the thread exports the connection state, GSSAPI
+ * context included, and passes it with the socket to the session
+ * spawner.  That process was forked before the threads were started and
+ * so has a single thread; it forks a child that takes the connection up,
+ * runs the request and then the remainder of the session exactly like a
+ * fork-per-connection child would.  Forking the child from a command
+ * thread instead would leave it with whatever locks (malloc, stdio, the
+ * Kerberos library) other threads held at that moment.  The engine
+ * forgets the connection once it is handed over.
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE				/* memfd_create() */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+
+#include "engine.h"
+#include "upgrade.h"
+#include "comm.h"
+#include "format.h"
+#include "protocol.h"
+
+#define STATUS_OK				(0)
+#define STATUS_ERROR			(-1)
+
+#define MAX_LIMIT				1024
+#define ENGINE_MAX_EVENTS		64
+#define ENGINE_MAX_THREADS		256
+
+/* how often the main thread looks for exited session children */
+#define ENGINE_REAP_INTERVAL_MS 1000
+
+/* bound on a client's handshake, and on reading and answering a request */
+#define ENGINE_IO_TIMEOUT_MS	10000
+
+/* largest first handshake packet the GSSAPI code takes, see be-secure-gssapi.c */
+#define ENGINE_MAX_HANDSHAKE_PACKET 16384
+
+int			EventEngineThreads = 0;
+
+extern volatile sig_atomic_t shutdown_requested;
+
+typedef enum EngineSourceKind
+{
+    ENGINE_LISTENER,
+    ENGINE_CLIENT
+} EngineSourceKind;
+
+typedef struct EngineListener
+{
+    EngineSourceKind kind;		/* must be first */
+    int			fd;
+} EngineListener;
+
+typedef struct AgentConn
+{
+    EngineSourceKind kind;		/* must be first */
+    ClientSocket client;
+    bool		handshake_done;
+    char	   *prefetch;		/* first handshake packet, as it arrives */
+    size_t		prefetch_len;
+    CommState  *comm;			/* detached comm.c state */
+    GSSState   *gss;			/* detached GSSAPI state */
+    struct AgentConn *next;		/* work queue link */
+} AgentConn;
+
+/* session children of the spawner that may still be running */
+typedef struct SessionChild
+{
+    pid_t		pid;
+    struct SessionChild *next;
+} SessionChild;
+
+static int	engine_epfd = -1;
+static int *engine_listen_sockets;
+static int	engine_nlisten;
+static bool engine_stopping = false;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static AgentConn *queue_head = NULL;
+static AgentConn *queue_tail = NULL;
+static int	queue_depth = 0;
+
+static pthread_mutex_t children_lock = PTHREAD_MUTEX_INITIALIZER;
+static SessionChild *session_children = NULL;
+
+/* our end of the session spawner's socket, one hand-over at a time */
+static pthread_mutex_t spawner_lock = PTHREAD_MUTEX_INITIALIZER;
+static int	spawner_sock = -1;
+
+/* metrics.c keeps static per-device state, so collectors run one at a time */
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* counters, updated with atomic builtins */
+static uint64_t stat_accepted;
+static uint64_t stat_open;
+static uint64_t stat_inline;
+static uint64_t stat_escalated;
+static uint64_t stat_handshake_failed;
+
+static void *EngineThreadMain(void *arg);
+static bool EngineServe(AgentConn *conn);
+static void EngineAccept(int listen_fd);
+static void EngineReapChildren(void);
+static void EngineCloseConn(AgentConn *conn);
+static bool EngineStartSpawner(void);
+
+/*
+ * Requests that are answered on a command thread.  These only read state
+ * and send text back, and none of them runs for long.
+ */
+static bool
+command_is_inline(int action_code)
+{
+    switch (action_code)
+    {
+        case CliMsg_Metrics:
+        case CliMsg_Metrics_Record:
+        case CliMsg_Agent_Stats:
+        case CliMsg_Inventory:
+        case CliMsg_Compress:
+        case CliMsg_Hello:
+        case CliMsg_Job_Poll:
+        case CliMsg_Job_Tail:
+        case CliMsg_Job_Cancel:
+        case CliMsg_Hdfs:
+        case CliMsg_HBase:
+        case CliMsg_Spark:
+        case CliMsg_Kafka:
+        case CliMsg_ZooKeeper:
+        case CliMsg_Flink:
+        case CliMsg_Storm:
+        case CliMsg_Hive:
+        case CliMsg_Pig:
+        case CliMsg_Presto:
+        case CliMsg_Tez:
+        case CliMsg_Atlas:
+        case CliMsg_Ranger:
+        case CliMsg_Livy:
+        case CliMsg_Phoenix:
+        case CliMsg_Solr:
+        case CliMsg_Zeppelin:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * EventEngineMain -- run the engine until shutdown
+ */
+int
+EventEngineMain(int *listen_sockets, int nsockets)
+{
+    EngineListener *listeners;
+    struct epoll_event ev;
+    struct epoll_event events[ENGINE_MAX_EVENTS];
+    pthread_t  *threads;
+    sigset_t	blockmask,
+                oldmask;
+    int			nthreads = EventEngineThreads;
+    int			i;
+
+    if (nthreads > ENGINE_MAX_THREADS)
+        nthreads = ENGINE_MAX_THREADS;
+
+    engine_listen_sockets = listen_sockets;
+    engine_nlisten = nsockets;
+
+    engine_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (engine_epfd < 0)
+    {
+        fprintf(stderr, "could not create epoll set: %m\n");
+        return STATUS_ERROR;
+    }
+
+    listeners = calloc(nsockets, sizeof(EngineListener));
+    threads = calloc(nthreads, sizeof(pthread_t));
+    if (listeners == NULL || threads == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return STATUS_ERROR;
+    }
+
+    for (i = 0; i < nsockets; i++)
+    {
+        listeners[i].kind = ENGINE_LISTENER;
+        listeners[i].fd = listen_sockets[i];
+        if (!set_noblock(listen_sockets[i]))
+        {
+            fprintf(stderr, "could not set listen socket to non-blocking mode: %m\n");
+            return STATUS_ERROR;
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &listeners[i];
+        if (epoll_ctl(engine_epfd, EPOLL_CTL_ADD, listen_sockets[i], &ev) < 0)
+        {
+            fprintf(stderr, "could not watch listen socket: %m\n");
+            return STATUS_ERROR;
+        }
+    }
+
+    if (!EngineStartSpawner())
+        return STATUS_ERROR;
+
+    /* only the main thread handles signals */
+    sigemptyset(&blockmask);
+    sigaddset(&blockmask, SIGTERM);
+    sigaddset(&blockmask, SIGINT);
+    sigaddset(&blockmask, SIGCHLD);
+    sigaddset(&blockmask, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &blockmask, &oldmask);
+    for (i = 0; i < nthreads; i++)
+    {
+        if (pthread_create(&threads[i], NULL, EngineThreadMain, NULL) != 0)
+        {
+            fprintf(stderr, "could not start command thread %d\n", i);
+            nthreads = i;
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+    if (nthreads == 0)
+        return STATUS_ERROR;
+
+    fprintf(stderr, "event engine running with %d command threads\n", nthreads);
+
+    /*
+     * After a hot upgrade the new master takes the new connections, but
+     * the ones we already have are served until their clients hang up.
+     */
+    while (!shutdown_requested ||
+           (UpgradeHandedOver() && __atomic_load_n(&stat_open, __ATOMIC_RELAXED) > 0))
+    {
+        int			nevents;
+
+        if (upgrade_requested && AgentUpgrade())
+        {
+            for (i = 0; i < nsockets; i++)
+                epoll_ctl(engine_epfd, EPOLL_CTL_DEL, listen_sockets[i], NULL);
+        }
+
+        nevents = epoll_wait(engine_epfd, events, ENGINE_MAX_EVENTS,
+                             ENGINE_REAP_INTERVAL_MS);
+        if (nevents < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "epoll_wait failed: %m\n");
+            break;
+        }
+
+        for (i = 0; i < nevents; i++)
+        {
+            EngineSourceKind kind = *(EngineSourceKind *) events[i].data.ptr;
+
+            if (kind == ENGINE_LISTENER)
+            {
+                EngineAccept(((EngineListener *) events[i].data.ptr)->fd);
+                continue;
+            }
+
+            /* queue the connection for the next free thread */
+            AgentConn  *conn = (AgentConn *) events[i].data.ptr;
+
+            pthread_mutex_lock(&queue_lock);
+            conn->next = NULL;
+            if (queue_tail)
+                queue_tail->next = conn;
+            else
+                queue_head = conn;
+            queue_tail = conn;
+            queue_depth++;
+            pthread_cond_signal(&queue_cond);
+            pthread_mutex_unlock(&queue_lock);
+        }
+
+        EngineReapChildren();
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    engine_stopping = true;
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    /* the spawner exits once its session children have */
+    close(spawner_sock);
+    spawner_sock = -1;
+    close(engine_epfd);
+    engine_epfd = -1;
+    free(threads);
+    return STATUS_OK;
+}
+
+/*
+ * Accept every pending connection on a listen socket and register it.
+ */
+static void
+EngineAccept(int listen_fd)
+{
+    for (;;)
+    {
+        ClientSocket client;
+        AgentConn  *conn;
+        struct epoll_event ev;
+
+        /* the socket comes non-blocking, and stays so between requests */
+        if (AcceptConnection(listen_fd, &client) != STATUS_OK)
+            return;
+        fcntl(client.sock, F_SETFD, FD_CLOEXEC);
+
+        conn = calloc(1, sizeof(AgentConn));
+        if (conn == NULL)
+        {
+            close(client.sock);
+            continue;
+        }
+        conn->kind = ENGINE_CLIENT;
+        conn->client = client;
+
+        /*
+         * On the Unix socket the agent speaks first, so start the
+         * handshake as soon as the socket is writable.
+         */
+        memset(&ev, 0, sizeof(ev));
+        ev.events = (client.raddr.addr.ss_family == AF_UNIX ? EPOLLOUT : EPOLLIN) |
+            EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if (epoll_ctl(engine_epfd, EPOLL_CTL_ADD, client.sock, &ev) < 0)
+        {
+            fprintf(stderr, "could not watch client socket: %m\n");
+            close(client.sock);
+            free(conn);
+            continue;
+        }
+        __atomic_add_fetch(&stat_accepted, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stat_open, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Forget session children that are gone.  The spawner reaps them, so all
+ * we can see is that the pid no longer exists.
+ */
+static void
+EngineReapChildren(void)
+{
+    SessionChild **prev;
+    SessionChild *child;
+
+    pthread_mutex_lock(&children_lock);
+    prev = &session_children;
+    while ((child = *prev) != NULL)
+    {
+        if (kill(child->pid, 0) < 0 && errno == ESRCH)
+        {
+            *prev = child->next;
+            free(child);
+        }
+        else
+            prev = &child->next;
+    }
+    pthread_mutex_unlock(&children_lock);
+}
+
+static void *
+EngineThreadMain(void *arg)
+{
+    (void) arg;
+
+    for (;;)
+    {
+        AgentConn  *conn;
+
+        pthread_mutex_lock(&queue_lock);
+        while (queue_head == NULL && !engine_stopping)
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        if (engine_stopping)
+        {
+            pthread_mutex_unlock(&queue_lock);
+            break;
+        }
+        conn = queue_head;
+        queue_head = conn->next;
+        if (queue_head == NULL)
+            queue_tail = NULL;
+        queue_depth--;
+        pthread_mutex_unlock(&queue_lock);
+
+        comm_restore_state(conn->comm);
+        secure_gssapi_restore(conn->gss);
+        conn->comm = NULL;
+        conn->gss = NULL;
+        global_client_socket = &conn->client;
+
+        if (EngineServe(conn))
+        {
+            struct epoll_event ev;
+
+            conn->comm = comm_save_state();
+            conn->gss = secure_gssapi_save();
+            global_client_socket = NULL;
+
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.ptr = conn;
+            if (epoll_ctl(engine_epfd, EPOLL_CTL_MOD, conn->client.sock, &ev) < 0)
+            {
+                comm_restore_state(conn->comm);
+                secure_gssapi_restore(conn->gss);
+                EngineCloseConn(conn);
+            }
+        }
+        else
+            EngineCloseConn(conn);
+    }
+    return NULL;
+}
+
+/*
+ * Close a connection whose state is attached to the calling thread.
+ */
+static void
+EngineCloseConn(AgentConn *conn)
+{
+    secure_close_gssapi();
+    comm_reset_connection();
+    global_client_socket = NULL;
+    close(conn->client.sock);	/* also drops it from the epoll set */
+    free(conn->prefetch);
+    free(conn);
+    __atomic_sub_fetch(&stat_open, 1, __ATOMIC_RELAXED);
+}
+
+static void
+set_blocking(int sock, bool blocking)
+{
+    int			flags = fcntl(sock, F_GETFL, 0);
+
+    fcntl(sock, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+/*
+ * Take in what has arrived of the client's first handshake packet, length
+ * word and token.  Until all of it is there the connection waits in epoll
+ * instead of holding a thread through the handshake.  Returns true once
+ * the handshake can start: the packet is complete, or the client has
+ * gone or sent a packet the handshake will refuse, so that it fails.
+ */
+static bool
+handshake_prefetch(AgentConn *conn)
+{
+    size_t		want = sizeof(uint32);
+    ssize_t		n;
+
+    if (conn->prefetch == NULL)
+    {
+        conn->prefetch = malloc(sizeof(uint32) + ENGINE_MAX_HANDSHAKE_PACKET);
+        if (conn->prefetch == NULL)
+            return true;
+    }
+    for (;;)
+    {
+        if (conn->prefetch_len >= sizeof(uint32))
+        {
+            uint32		len;
+
+            memcpy(&len, conn->prefetch, sizeof(len));
+            if (len > ENGINE_MAX_HANDSHAKE_PACKET)
+                return true;
+            want = sizeof(uint32) + len;
+            if (conn->prefetch_len >= want)
+                return true;
+        }
+        n = recv(conn->client.sock, conn->prefetch + conn->prefetch_len,
+                 want - conn->prefetch_len, 0);
+        if (n > 0)
+            conn->prefetch_len += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else
+            return n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+}
+
+/*
+ * Body of a session child: take up the connection described in the
+ * memfd state_fd, answer the request in it and serve the rest of the
+ * session.  Never returns.
+ */
+static void
+SessionChildMain(int sock, int state_fd)
+{
+    StringInfoData state;
+    StringInfoData param_buffer;
+    ClientSocket client;
+    struct stat st;
+    int			action_code;
+    int			len;
+
+    initStringInfo(&state);
+    if (fstat(state_fd, &st) < 0 || st.st_size < 12)
+        goto broken;
+    enlargeStringInfo(&state, st.st_size);
+    if (pread(state_fd, state.data, st.st_size, 0) != st.st_size)
+        goto broken;
+    state.len = st.st_size;
+    close(state_fd);
+
+    memset(&client, 0, sizeof(client));
+    client.sock = sock;
+    action_code = (int) getmsgint(&state, 4);
+    len = (int) getmsgint(&state, 4);
+    if (len < 0 || len > (int) sizeof(client.raddr.addr) ||
+        len + 4 > state.len - state.cursor)
+        goto broken;
+    client.raddr.salen = len;
+    copymsgbytes(&state, (char *) &client.raddr.addr, len);
+    len = (int) getmsgint(&state, 4);
+    if (len < 0 || len > state.len - state.cursor)
+        goto broken;
+    initStringInfo(&param_buffer);
+    appendBinaryStringInfo(&param_buffer, getmsgbytes(&state, len), len);
+    if (comm_import_state(&state) != 0 || secure_gssapi_import(&state) != 0)
+        goto broken;
+    free(state.data);
+
+    set_blocking(sock, true);
+    global_client_socket = &client;
+    if (answer_command(&client, action_code, &param_buffer))
+        handle_command(&client);
+    close(sock);
+    _exit(0);
+
+broken:
+    fprintf(stderr, "session process could not take up the connection\n");
+    _exit(1);
+}
+
+/*
+ * Main loop of the session spawner.  Each message from the engine carries
+ * a client socket and a memfd with the connection state; the answer is
+ * the pid of the child that took them, or -1.  Returns once the engine
+ * has closed its end and the children have exited.
+ */
+static void
+SpawnerMain(int sock)
+{
+    for (;;)
+    {
+        struct pollfd pfd;
+        struct msghdr msg;
+        struct iovec iov;
+        struct cmsghdr *cmsg;
+        char		control[CMSG_SPACE(2 * sizeof(int))];
+        char		byte;
+        int			fds[2];
+        pid_t		pid;
+        int			rc;
+
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        rc = poll(&pfd, 1, ENGINE_REAP_INTERVAL_MS);
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+            ;
+        if (rc < 0 && errno != EINTR)
+            break;
+        if (rc <= 0)
+            continue;
+
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = &byte;
+        iov.iov_len = 1;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        rc = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            break;				/* the engine is gone */
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+        {
+            pid = -1;
+            (void) send(sock, &pid, sizeof(pid), 0);
+            continue;
+        }
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+        pid = fork();
+        if (pid == 0)
+        {
+            close(sock);
+            SessionChildMain(fds[0], fds[1]);
+        }
+        if (pid < 0)
+            fprintf(stderr, "could not fork session process: %m\n");
+        close(fds[0]);
+        close(fds[1]);
+        if (send(sock, &pid, sizeof(pid), 0) != sizeof(pid))
+            break;
+    }
+
+    /* as the master would have, let the sessions finish */
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        ;
+}
+
+/*
+ * Fork the session spawner.  Must be called before the command threads
+ * are started.
+ */
+static bool
+EngineStartSpawner(void)
+{
+    int			sv[2];
+    pid_t		pid;
+    int			i;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        fprintf(stderr, "could not create session spawner socket: %m\n");
+        return false;
+    }
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0)
+    {
+        fprintf(stderr, "could not fork session spawner: %m\n");
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(sv[0]);
+        close(engine_epfd);
+        for (i = 0; i < engine_nlisten; i++)
+            close(engine_listen_sockets[i]);
+        SpawnerMain(sv[1]);
+        _exit(0);
+    }
+    close(sv[1]);
+    spawner_sock = sv[0];
+    return true;
+}
+
+/*
+ * Hand the session over to a child process of the spawner, starting with
+ * the request that was just read.
+ */
+static void
+EngineEscalate(AgentConn *conn, int action_code, StringInfo param_buffer)
+{
+    StringInfoData state;
+    SessionChild *child;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char		control[CMSG_SPACE(2 * sizeof(int))];
+    char		byte = 'S';
+    int			fds[2];
+    int			memfd;
+    pid_t		pid = -1;
+
+    initStringInfo(&state);
+    sendint32(&state, (uint32) action_code);
+    sendint32(&state, (uint32) conn->client.raddr.salen);
+    sendbytes(&state, &conn->client.raddr.addr, conn->client.raddr.salen);
+    sendint32(&state, (uint32) param_buffer->len);
+    sendbytes(&state, param_buffer->data, param_buffer->len);
+    comm_export_state(&state);
+    if (secure_gssapi_export(&state) < 0)
+    {
+        free(state.data);
+        return;
+    }
+
+    /* the child's copy of the socket would keep it in our epoll set */
+    epoll_ctl(engine_epfd, EPOLL_CTL_DEL, conn->client.sock, NULL);
+
+    memfd = memfd_create("debo-session", MFD_CLOEXEC);
+    if (memfd < 0 || write(memfd, state.data, state.len) != state.len)
+    {
+        fprintf(stderr, "could not save session state: %m\n");
+        if (memfd >= 0)
+            close(memfd);
+        free(state.data);
+        return;
+    }
+    free(state.data);
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    fds[0] = conn->client.sock;
+    fds[1] = memfd;
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    pthread_mutex_lock(&spawner_lock);
+    if (sendmsg(spawner_sock, &msg, 0) != 1 ||
+        recv(spawner_sock, &pid, sizeof(pid), 0) != sizeof(pid))
+        pid = -1;
+    pthread_mutex_unlock(&spawner_lock);
+    close(memfd);
+
+    if (pid < 0)
+    {
+        fprintf(stderr, "could not start session process\n");
+        return;
+    }
+
+    __atomic_add_fetch(&stat_escalated, 1, __ATOMIC_RELAXED);
+    child = malloc(sizeof(SessionChild));
+    if (child == NULL)
+        return;
+    child->pid = pid;
+    pthread_mutex_lock(&children_lock);
+    child->next = session_children;
+    session_children = child;
+    pthread_mutex_unlock(&children_lock);
+}
+
+/*
+ * Serve whatever is ready on a connection.  Returns true if the
+ * connection should stay registered, false if the caller should close
+ * it.
+ */
+static bool
+EngineServe(AgentConn *conn)
+{
+    StringInfoData param_buffer;
+    bool		keep = true;
+
+    if (!conn->handshake_done)
+    {
+        int			rc;
+
+        /* on the Unix socket the agent speaks first */
+        if (conn->client.raddr.addr.ss_family != AF_UNIX &&
+            !handshake_prefetch(conn))
+            return true;
+
+        set_blocking(conn->client.sock, true);
+        comm_set_timeout(ENGINE_IO_TIMEOUT_MS);
+        comm_set_raw_input(conn->prefetch, conn->prefetch_len);
+        rc = secure_open_session(&conn->client);
+        comm_set_raw_input(NULL, 0);
+        comm_set_timeout(0);
+        set_blocking(conn->client.sock, false);
+        free(conn->prefetch);
+        conn->prefetch = NULL;
+        if (rc != 0)
+        {
+            fprintf(stderr, "client handshake failed\n");
+            __atomic_add_fetch(&stat_handshake_failed, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        conn->handshake_done = true;
+        return true;
+    }
+
+    initStringInfo(&param_buffer);
+    while (keep)
+    {
+        int			action_code;
+        int			ready;
+
+        /* a request that is not all there yet waits for epoll */
+        ready = comm_request_buffered(&conn->client);
+        if (ready == 0)
+            break;
+        if (ready == EOF)
+        {
+            keep = false;
+            break;
+        }
+
+        set_blocking(conn->client.sock, true);
+        comm_set_timeout(ENGINE_IO_TIMEOUT_MS);
+        resetStringInfo(&param_buffer);
+        action_code = getbyte(&conn->client);
+        if (action_code == EOF ||
+            getmessage(&param_buffer, &conn->client, MAX_LIMIT) == EOF ||
+            action_code == CliMsg_Finish)
+            keep = false;
+        else if (!command_is_inline(action_code))
+        {
+            /* the socket is shared with the session child from here on */
+            comm_set_timeout(0);
+            EngineEscalate(conn, action_code, &param_buffer);
+            keep = false;
+            break;
+        }
+        else
+        {
+            __atomic_add_fetch(&stat_inline, 1, __ATOMIC_RELAXED);
+            if (action_code == CliMsg_Metrics)
+                pthread_mutex_lock(&metrics_lock);
+            keep = answer_command(&conn->client, action_code, &param_buffer);
+            if (action_code == CliMsg_Metrics)
+                pthread_mutex_unlock(&metrics_lock);
+        }
+        comm_set_timeout(0);
+        set_blocking(conn->client.sock, false);
+    }
+
+    free(param_buffer.data);
+    return keep;
+}
+
+/*
+ * EventEngineStats -- append a description of the engine to buf
+ */
+void
+EventEngineStats(StringInfo buf)
+{
+    int			depth;
+    int			children = 0;
+    SessionChild *child;
+
+    if (engine_epfd < 0)
+        return;
+
+    pthread_mutex_lock(&queue_lock);
+    depth = queue_depth;
+    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_lock(&children_lock);
+    for (child = session_children; child != NULL; child = child->next)
+        children++;
+    pthread_mutex_unlock(&children_lock);
+
+    appendStringInfo(buf, "event engine: threads=%d open=%llu queued=%d session_children=%d\n",
+                     EventEngineThreads,
+                     (unsigned long long) __atomic_load_n(&stat_open, __ATOMIC_RELAXED),
+                     depth, children);
+    appendStringInfo(buf, "  accepted=%llu inline=%llu escalated=%llu handshake_failed=%llu\n",
+                     (unsigned long long) __atomic_load_n(&stat_accepted, __ATOMIC_RELAXED),
+                     (unsigned long long) __atomic_load_n(&stat_inline, __ATOMIC_RELAXED),
+                     (unsigned long long) __atomic_load_n(&stat_escalated, __ATOMIC_RELAXED),
+                     (unsigned long long) __atomic_load_n(&stat_handshake_failed, __ATOMIC_RELAXED));
+}
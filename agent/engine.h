@@ -0,0 +1,49 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * engine.h
+ *		Event-driven command engine.
+ *
+ * In this run mode a single agent process owns every client connection.
+ * The main thread waits on the listen sockets and all client sockets in
+ * one epoll set and hands a connection to a bounded pool of threads
+ * whenever it becomes readable.  Cheap requests (metrics, component
+ * reports, agent stats) are answered on the thread; anything else gets
+ * a forked child that takes over the rest of the session.
+ *-------------------------------------------------------------------------
+ */
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "connutil.h"
+#include "stringinfo.h"
+
+/* number of command threads, 0 disables the engine */
+extern int	EventEngineThreads;
+
+extern int	EventEngineMain(int *listen_sockets, int nsockets);
+extern void EventEngineStats(StringInfo buf);
+
+/* provided by debo.c */
+extern bool process_command(ClientSocket *client_socket, int action_code,
+                            StringInfo param_buffer);
+extern bool answer_command(ClientSocket *client_socket, int action_code,
+                           StringInfo param_buffer);
+extern void handle_command(ClientSocket *client_socket);
+
+#endif							/* ENGINE_H */
@@ -53,6 +53,8 @@
  *		sendstring	- append a null-terminated text string (with conversion)
  *		send_ascii_string - append a null-terminated text string (without conversion)
  *		endmessage	- send the completed message to the frontend
+ *		endmessage_more - queue the completed message for the frontend
+ *		endmessage_compressed - queue it, compressed if worthwhile
  * Note: it is also possible to append data to the StringInfo buffer using
  * the regular StringInfo routines, but this is discouraged since required
  * character set conversion may not occur.
@@ -64,6 +66,11 @@
  * Special-case message output:
  *		puttextmessage - generate a character set-converted message in one step
  *		putemptymessage - convenience routine for message with empty body
+ *		putmessage_compressed - queue a message, compressed if worthwhile
+ *
+ * Response compression:
+ *		compression_available - was the agent built with an algorithm
+ *		choose_compression - pick an algorithm from a client's offer
  *
  * Message parsing after input:
  *		getmsgbyte	- get a raw byte from a message buffer
@@ -80,9 +87,17 @@
  */
 #include <sys/param.h>
 #include <errno.h>
+#include <limits.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "connutil.h"
 #include "format.h"
+#include "protocol.h"
 #include "stringinfo.h"
 #if defined(__cplusplus)
 #define unconstify(underlying_type, expr) const_cast<underlying_type>(expr)
@@ -341,6 +356,175 @@ endmessage_reuse(StringInfo buf)
     (void) putmessage(buf->cursor, buf->data, buf->len);
 }
 
+/* --------------------------------
+ *		endmessage_more	- queue the completed message for the frontend
+ *
+ * Like endmessage_reuse, but the message waits in the send buffer until
+ * the next flush(), to go out together with the messages after it.
+ * --------------------------------
+ */
+void
+endmessage_more(StringInfo buf)
+{
+    /* msgtype was saved in cursor field */
+    (void) putmessage_more(buf->cursor, buf->data, buf->len);
+}
+
+/* --------------------------------
+ *		endmessage_compressed	- queue the completed message, compressed
+ *
+ * Like endmessage_more, but goes through putmessage_compressed.
+ * --------------------------------
+ */
+void
+endmessage_compressed(StringInfo buf)
+{
+    /* msgtype was saved in cursor field */
+    (void) putmessage_compressed(buf->cursor, buf->data, buf->len);
+}
+
+
+/*
+ * Response compression.
+ *
+ * A client that wants it offers the algorithms it can decompress with
+ * CliMsg_Compress or in its CliMsg_Hello; from then on, message bodies of
+ * at least the threshold the agent answered with are compressed and sent
+ * as
+ *
+ *		'X' byte algorithm, byte message type, int32 body length, data
+ *
+ * Bodies that do not get smaller are sent as they are.  Each message is
+ * compressed on its own, so the client never needs more than the one
+ * message to decompress it.
+ */
+
+/* zstd level: fast, output is compressed on the way out */
+#define ZSTD_COMPRESS_LEVEL		1
+
+/* smallest body compressed by default; DEBO_COMPRESS_THRESHOLD */
+int			CompressThreshold = DEFAULT_COMPRESS_THRESHOLD;
+
+/* the wrapped message being built, per thread */
+static __thread StringInfoData CompressBuffer;
+
+/* --------------------------------
+ *		compression_available	- was the agent built with the algorithm
+ * --------------------------------
+ */
+bool
+compression_available(int algorithm)
+{
+    switch (algorithm)
+    {
+#ifdef HAVE_LZ4
+        case COMPRESS_LZ4:
+            return true;
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+/* --------------------------------
+ *		choose_compression	- pick an algorithm from a client's offer
+ *
+ * The offer is one byte per algorithm, in the client's order of
+ * preference; the first one compression_available() knows wins.
+ * Returns COMPRESS_NONE if there is none.
+ * --------------------------------
+ */
+int
+choose_compression(StringInfo offer)
+{
+    while (offer->cursor < offer->len)
+    {
+        int			algorithm = getmsgbyte(offer);
+
+        if (algorithm != COMPRESS_NONE && compression_available(algorithm))
+            return algorithm;
+    }
+    return COMPRESS_NONE;
+}
+
+/*
+ * Compress len bytes at s onto the end of buf, which has room for len
+ * more bytes.  Returns the compressed size, or 0 if the data did not fit
+ * into len bytes or could not be compressed.
+ */
+static size_t
+compress_data(int algorithm, const char *s, size_t len, StringInfo buf)
+{
+    char	   *dst = buf->data + buf->len;
+
+    switch (algorithm)
+    {
+#ifdef HAVE_LZ4
+        case COMPRESS_LZ4:
+            {
+                int			n;
+
+                n = LZ4_compress_default(s, dst, (int) len, (int) len);
+                return n > 0 ? (size_t) n : 0;
+            }
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+            {
+                size_t		n;
+
+                n = ZSTD_compress(dst, len, s, len, ZSTD_COMPRESS_LEVEL);
+                return ZSTD_isError(n) ? 0 : n;
+            }
+#endif
+        default:
+            (void) s;
+            (void) len;
+            (void) dst;
+            return 0;
+    }
+}
+
+/* --------------------------------
+ *		putmessage_compressed	- queue a message, compressed if worthwhile
+ *
+ *		Queues the message like putmessage_more.  When the client has
+ *		agreed to compression and the body is at least the agreed
+ *		threshold, the body is compressed and the message wrapped in a
+ *		RespMsg_Compressed message, unless that would not be smaller.
+ *
+ *		returns 0 if OK, EOF if trouble
+ * --------------------------------
+ */
+int
+putmessage_compressed(char msgtype, const char *s, size_t len)
+{
+    StringInfo	buf = &CompressBuffer;
+    size_t		n;
+
+    if (DbCompression == COMPRESS_NONE || len < (size_t) DbCompressThreshold ||
+        len > INT_MAX / 2)
+        return putmessage_more(msgtype, s, len);
+
+    if (buf->data == NULL)
+        initStringInfo(buf);
+    resetStringInfo(buf);
+    sendbyte(buf, DbCompression);
+    sendbyte(buf, msgtype);
+    sendint32(buf, (uint32) len);
+    enlargeStringInfo(buf, (int) len);
+
+    n = compress_data(DbCompression, s, len, buf);
+    if (n == 0 || buf->len + n >= len)
+        return putmessage_more(msgtype, s, len);
+    buf->len += n;
+    return putmessage_more(RespMsg_Compressed, buf->data, buf->len);
+}
+
 
 /* --------------------------------
  *		begintypsend		- initialize for constructing a bytea result
@@ -48,6 +48,16 @@ extern void beginmessage(StringInfo buf, char msgtype);
 extern void beginmessage_reuse(StringInfo buf, char msgtype);
 extern void endmessage(StringInfo buf);
 extern void endmessage_reuse(StringInfo buf);
+extern void endmessage_more(StringInfo buf);
+extern void endmessage_compressed(StringInfo buf);
+extern int	putmessage_compressed(char msgtype, const char *s, size_t len);
+
+/* smallest message body worth compressing, unless configured otherwise */
+#define DEFAULT_COMPRESS_THRESHOLD	1024
+
+extern int	CompressThreshold;
+extern bool compression_available(int algorithm);
+extern int	choose_compression(StringInfo offer);
 
 extern void sendbytes(StringInfo buf, const void *data, int datalen);
 extern void sendcountedtext(StringInfo buf, const char *str, int slen);
@@ -0,0 +1,796 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * jobs.c
+ *		Background jobs for long-running requests.
+ *
+ * The job table lives in shared memory created by main(), so every
+ * session child sees the same jobs, and a hot upgrade hands it to the new
+ * agent.  Submitting a job double-forks a runner process that starts its
+ * own session: it is not a child of anything that waits for connections,
+ * and neither an agent restart nor the client going away takes it down.
+ * A cold restart does lose the table, though, so the runners of earlier
+ * jobs go on but can no longer be polled or cancelled; their logs stay.
+ * Job ids carry on from the highest log in JobDirectory, and each log is
+ * created anew, so a new job never writes into an old one's log.
+ *
+ * The runner points stdout and stderr at the job log and forks a worker,
+ * in a process group of its own, which runs the request through
+ * process_command() with client output redirected into the log.  The
+ * runner then waits for the worker and records how it ended.  Cancelling
+ * signals the worker's process group, which also reaches whatever the
+ * request spawned; the runner survives to record the result.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "jobs.h"
+#include "childreg.h"
+#include "engine.h"
+#include "protocol.h"
+#include "subproc.h"
+#include "utiles.h"
+#include "upgrade.h"
+
+#define STATUS_OK				(0)
+#define STATUS_ERROR			(-1)
+
+/* default amount of log returned by a tail request */
+#define JOB_TAIL_BYTES			4096
+
+/* how often an attached client is sent new log output */
+#define JOB_ATTACH_POLL_MS		200
+
+#define JOB_IO_CHUNK			8192
+
+/* bump whenever JobShmem or AgentJob changes, see UpgradeSharedMemory() */
+#define JOBS_LAYOUT_VERSION		1
+
+char	   *JobDirectory = DEFAULT_JOB_DIR;
+
+typedef struct JobShmem
+{
+    pthread_mutex_t lock;
+    int			next_id;
+    AgentJob	jobs[MAX_AGENT_JOBS];
+} JobShmem;
+
+static JobShmem *JobTable = NULL;
+
+static const char *const JobStateNames[] = {
+    "free",
+    "starting",
+    "running",
+    "exited",
+    "cancelled",
+    "lost"
+};
+
+static bool JobSubmit(ClientSocket *client_socket, StringInfo param_buffer);
+static bool JobPoll(ClientSocket *client_socket, StringInfo param_buffer);
+static bool JobTail(ClientSocket *client_socket, StringInfo param_buffer);
+static bool JobAttach(ClientSocket *client_socket, StringInfo param_buffer);
+static bool JobCancel(ClientSocket *client_socket, StringInfo param_buffer);
+static void JobRunnerMain(AgentJob *job, int action_code, StringInfo request,
+                         int log_fd);
+
+static void
+job_lock(void)
+{
+    if (pthread_mutex_lock(&JobTable->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&JobTable->lock);
+}
+
+static void
+job_unlock(void)
+{
+    pthread_mutex_unlock(&JobTable->lock);
+}
+
+static bool
+job_finished(int state)
+{
+    return state == JOB_EXITED || state == JOB_CANCELLED || state == JOB_LOST;
+}
+
+static void
+job_log_path(char *path, size_t size, int id)
+{
+    snprintf(path, size, "%s/job-%d.log", JobDirectory, id);
+}
+
+/*
+ * The highest job id with a log in JobDirectory, or 0.
+ */
+static int
+job_highest_logged_id(void)
+{
+    DIR		   *dir;
+    struct dirent *de;
+    int			highest = 0;
+
+    dir = opendir(JobDirectory);
+    if (dir == NULL)
+        return 0;
+    while ((de = readdir(dir)) != NULL)
+    {
+        int			id;
+        char		tail[8];
+
+        if (sscanf(de->d_name, "job-%d%7s", &id, tail) == 2 &&
+            strcmp(tail, ".log") == 0 && id > highest)
+            highest = id;
+    }
+    closedir(dir);
+    return highest;
+}
+
+/*
+ * Create the log of a new job, taking the next id that has none yet.
+ * Caller must hold the lock.  Returns the open log, or -1 with errno set.
+ */
+static int
+job_create_log(int *id)
+{
+    char		path[PATH_MAX];
+    int			fd;
+
+    do
+    {
+        *id = ++JobTable->next_id;
+        job_log_path(path, sizeof(path), *id);
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_NOFOLLOW, 0640);
+    } while (fd < 0 && errno == EEXIST);
+    return fd;
+}
+
+/*
+ * JobsInit -- create the shared job table and the log directory
+ *
+ * Must be called before the first fork.  After a hot upgrade the table of
+ * the previous master is reused, so running jobs stay visible.
+ */
+int
+JobsInit(void)
+{
+    pthread_mutexattr_t mattr;
+    bool		inherited;
+
+    JobTable = UpgradeSharedMemory("JOBS", sizeof(JobShmem), JOBS_LAYOUT_VERSION,
+                                   &inherited);
+    if (JobTable == NULL)
+    {
+        fprintf(stderr, "could not map job table: %m\n");
+        return STATUS_ERROR;
+    }
+    if (!inherited)
+    {
+        memset(JobTable, 0, sizeof(JobShmem));
+
+        pthread_mutexattr_init(&mattr);
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&JobTable->lock, &mattr);
+        pthread_mutexattr_destroy(&mattr);
+    }
+
+    if (mkdir(JobDirectory, 0750) < 0 && errno != EEXIST)
+        fprintf(stderr, "could not create job directory \"%s\": %m\n", JobDirectory);
+
+    /* runners of the jobs before a cold restart may still be logging */
+    if (!inherited)
+        JobTable->next_id = job_highest_logged_id();
+
+    return STATUS_OK;
+}
+
+/*
+ * Find a job by id.  Caller must hold the lock.  A job whose runner has
+ * disappeared without recording a result is marked lost here.
+ */
+static AgentJob *
+job_lookup(int id)
+{
+    int			i;
+
+    for (i = 0; i < MAX_AGENT_JOBS; i++)
+    {
+        AgentJob   *job = &JobTable->jobs[i];
+
+        if (job->state == JOB_FREE || job->id != id)
+            continue;
+        if (job->state == JOB_RUNNING && job->runner > 0 &&
+            kill(job->runner, 0) < 0 && errno == ESRCH)
+        {
+            job->state = JOB_LOST;
+            job->finished = time(NULL);
+        }
+        return job;
+    }
+    return NULL;
+}
+
+/*
+ * Take a free entry, or the one that finished longest ago.  Caller must
+ * hold the lock.
+ */
+static AgentJob *
+job_allocate(void)
+{
+    AgentJob   *oldest = NULL;
+    int			i;
+
+    for (i = 0; i < MAX_AGENT_JOBS; i++)
+    {
+        AgentJob   *job = &JobTable->jobs[i];
+
+        if (job->state == JOB_FREE)
+            return job;
+        if (job_finished(job->state) &&
+            (oldest == NULL || job->finished < oldest->finished))
+            oldest = job;
+    }
+    return oldest;
+}
+
+static void
+describe_job(StringInfo buf, AgentJob *job)
+{
+    time_t		end = job_finished(job->state) ? job->finished : time(NULL);
+    char		path[PATH_MAX];
+    struct stat st;
+
+    job_log_path(path, sizeof(path), job->id);
+    appendStringInfo(buf, "job %d: %s action=0x%02X pid=%d elapsed=%lds",
+                     job->id, JobStateNames[job->state],
+                     (unsigned char) job->action_code, (int) job->worker,
+                     (long) (end - job->submitted));
+    if (job->state == JOB_EXITED || job->state == JOB_CANCELLED)
+    {
+        if (WIFSIGNALED(job->status))
+            appendStringInfo(buf, " signal=%d", WTERMSIG(job->status));
+        else
+            appendStringInfo(buf, " status=%d", WEXITSTATUS(job->status));
+    }
+    if (stat(path, &st) == 0)
+        appendStringInfo(buf, " log=%s bytes=%lld", path, (long long) st.st_size);
+    appendStringInfoChar(buf, '\n');
+}
+
+/*
+ * Parse "<id> [number]" from a request body.  Returns false if there is no
+ * id; *extra is left alone if the number is missing.
+ */
+static bool
+parse_job_args(StringInfo param_buffer, int *id, long *extra)
+{
+    char	   *endptr;
+    long		val;
+
+    val = strtol(param_buffer->data, &endptr, 10);
+    if (endptr == param_buffer->data || val <= 0)
+        return false;
+    *id = (int) val;
+    if (extra != NULL)
+    {
+        char	   *p = endptr;
+
+        val = strtol(p, &endptr, 10);
+        if (endptr != p && val >= 0)
+            *extra = val;
+    }
+    return true;
+}
+
+/*
+ * Send a block of log data to the client.
+ */
+static bool
+send_log_data(ClientSocket *client_socket, char *data, size_t len)
+{
+    return send_output_data(client_socket, data, len) == 0;
+}
+
+/*
+ * JobCommand -- handle one of the CliMsg_Job_* requests
+ *
+ * Returns false if the session should end.
+ */
+bool
+JobCommand(ClientSocket *client_socket, int action_code, StringInfo param_buffer)
+{
+    if (JobTable == NULL)
+    {
+        FPRINTF(client_socket, "background jobs are not available\n");
+        return true;
+    }
+
+    switch (action_code)
+    {
+        case CliMsg_Job_Submit:
+            return JobSubmit(client_socket, param_buffer);
+        case CliMsg_Job_Poll:
+            return JobPoll(client_socket, param_buffer);
+        case CliMsg_Job_Tail:
+            return JobTail(client_socket, param_buffer);
+        case CliMsg_Job_Attach:
+            return JobAttach(client_socket, param_buffer);
+        case CliMsg_Job_Cancel:
+            return JobCancel(client_socket, param_buffer);
+    }
+    return true;
+}
+
+/*
+ * The body of a submit request is the wrapped request: one action code
+ * byte followed by that request's own parameters.
+ */
+static bool
+JobSubmit(ClientSocket *client_socket, StringInfo param_buffer)
+{
+    StringInfoData request;
+    AgentJob   *job;
+    int			inner_code;
+    int			id;
+    int			log_fd;
+    pid_t		pid;
+
+    if (param_buffer->len < 1)
+    {
+        FPRINTF(client_socket, "job submit without a request\n");
+        return true;
+    }
+    inner_code = (unsigned char) param_buffer->data[0];
+    switch (inner_code)
+    {
+        case CliMsg_Finish:
+        case CliMsg_Agent_Stats:
+        case CliMsg_Job_Submit:
+        case CliMsg_Job_Poll:
+        case CliMsg_Job_Tail:
+        case CliMsg_Job_Attach:
+        case CliMsg_Job_Cancel:
+            FPRINTF(client_socket, "request 0x%02X cannot run as a job\n", inner_code);
+            return true;
+    }
+
+    job_lock();
+    job = job_allocate();
+    if (job == NULL)
+    {
+        job_unlock();
+        FPRINTF(client_socket, "too many running jobs\n");
+        return true;
+    }
+    log_fd = job_create_log(&id);
+    if (log_fd < 0)
+    {
+        int			save_errno = errno;
+
+        job_unlock();
+        FPRINTF(client_socket, "could not create job log in \"%s\": %s\n",
+                JobDirectory, strerror(save_errno));
+        return true;
+    }
+    memset(job, 0, sizeof(AgentJob));
+    job->id = id;
+    job->state = JOB_STARTING;
+    job->action_code = inner_code;
+    job->submitted = time(NULL);
+    job_unlock();
+
+    initStringInfo(&request);
+    appendBinaryStringInfo(&request, param_buffer->data + 1, param_buffer->len - 1);
+
+    /*
+     * Fork twice so the runner is adopted by init right away and nobody in
+     * the agent has to reap it.
+     */
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0)
+    {
+        if (fork() == 0)
+            JobRunnerMain(job, inner_code, &request, log_fd);
+        _exit(0);
+    }
+    free(request.data);
+    close(log_fd);
+    if (pid < 0)
+    {
+        job_lock();
+        job->state = JOB_LOST;
+        job->finished = time(NULL);
+        job_unlock();
+        FPRINTF(client_socket, "could not start job: %s\n", strerror(errno));
+        return true;
+    }
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+
+    FPRINTF(client_socket, "job %d submitted\n", id);
+    return true;
+}
+
+/*
+ * Close every descriptor inherited from the agent except stdio.
+ */
+static void
+close_inherited_fds(void)
+{
+    long		maxfd;
+    int			fd;
+
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, ~0U, 0) == 0)
+        return;
+#endif
+    maxfd = sysconf(_SC_OPEN_MAX);
+    if (maxfd < 0 || maxfd > 65536)
+        maxfd = 65536;
+    for (fd = 3; fd < maxfd; fd++)
+        close(fd);
+}
+
+/*
+ * SIGTERM in a job worker, i.e. the job is being cancelled: commands run
+ * in process groups of their own, so pass it on to the one in progress
+ * before going down the same way.
+ */
+static void
+job_worker_terminate(int signo)
+{
+    SubprocessKillRunning(signo);
+    signal(signo, SIG_DFL);
+    raise(signo);
+}
+
+/*
+ * Body of the runner process.  Never returns.
+ */
+static void
+JobRunnerMain(AgentJob *job, int action_code, StringInfo request, int log_fd)
+{
+    pid_t		worker;
+    int			status;
+    int			fd;
+
+    setsid();
+    ChildRegistryDetach();
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_IGN);
+    dup2(log_fd, STDOUT_FILENO);
+    dup2(log_fd, STDERR_FILENO);
+    close_inherited_fds();
+
+    fd = open("/dev/null", O_RDONLY);
+    if (fd >= 0)
+    {
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+
+    job_lock();
+    job->runner = getpid();
+    job->state = JOB_RUNNING;
+    job_unlock();
+
+    worker = fork();
+    if (worker == 0)
+    {
+        ClientSocket nobody;
+
+        setpgid(0, 0);
+        signal(SIGTERM, job_worker_terminate);
+        memset(&nobody, 0, sizeof(nobody));
+        nobody.sock = -1;
+        global_client_socket = &nobody;
+        secure_redirect_output(STDOUT_FILENO);
+        begin_response(action_code);
+        process_command(&nobody, action_code, request);
+        end_response();
+        fflush(NULL);
+        _exit(get_response_status());
+    }
+    if (worker < 0)
+    {
+        printf("could not fork job worker: %m\n");
+        status = 1 << 8;
+    }
+    else
+    {
+        /* set it here as well, so a cancel can never miss the group */
+        setpgid(worker, worker);
+        job_lock();
+        job->worker = worker;
+        if (job->cancel_requested)
+            kill(-worker, SIGTERM);
+        job_unlock();
+
+        while (waitpid(worker, &status, 0) < 0)
+        {
+            if (errno != EINTR)
+            {
+                status = 1 << 8;
+                break;
+            }
+        }
+    }
+
+    job_lock();
+    job->status = status;
+    job->finished = time(NULL);
+    job->state = job->cancel_requested ? JOB_CANCELLED : JOB_EXITED;
+    job_unlock();
+
+    if (WIFSIGNALED(status))
+        printf("\n[job %d %s by signal %d]\n", job->id,
+               job->cancel_requested ? "cancelled" : "killed", WTERMSIG(status));
+    else
+        printf("\n[job %d exited with status %d]\n", job->id, WEXITSTATUS(status));
+    fflush(NULL);
+    _exit(0);
+}
+
+/*
+ * Poll one job, or list every job if no id was given.
+ */
+static bool
+JobPoll(ClientSocket *client_socket, StringInfo param_buffer)
+{
+    StringInfoData buf;
+    int			id;
+    int			i;
+
+    initStringInfo(&buf);
+    job_lock();
+    if (parse_job_args(param_buffer, &id, NULL))
+    {
+        AgentJob   *job = job_lookup(id);
+
+        if (job != NULL)
+            describe_job(&buf, job);
+        else
+            appendStringInfo(&buf, "job %d not found\n", id);
+    }
+    else
+    {
+        for (i = 0; i < MAX_AGENT_JOBS; i++)
+        {
+            AgentJob   *job = &JobTable->jobs[i];
+
+            if (job->state != JOB_FREE && job_lookup(job->id) != NULL)
+                describe_job(&buf, job);
+        }
+        if (buf.len == 0)
+            appendStringInfoString(&buf, "no jobs\n");
+    }
+    job_unlock();
+
+    SEND_STRING(client_socket, buf.data);
+    free(buf.data);
+    return true;
+}
+
+/*
+ * Send the last bytes of a job's log, JOB_TAIL_BYTES unless the request
+ * asks for a different amount.
+ */
+static bool
+JobTail(ClientSocket *client_socket, StringInfo param_buffer)
+{
+    char		path[PATH_MAX];
+    char		buf[JOB_IO_CHUNK];
+    long		want = JOB_TAIL_BYTES;
+    struct stat st;
+    off_t		off;
+    int			id;
+    int			fd;
+    bool		ok = true;
+
+    if (!parse_job_args(param_buffer, &id, &want))
+    {
+        FPRINTF(client_socket, "job tail needs a job id\n");
+        return true;
+    }
+
+    job_log_path(path, sizeof(path), id);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        FPRINTF(client_socket, "job %d has no log\n", id);
+        if (fd >= 0)
+            close(fd);
+        return true;
+    }
+
+    off = st.st_size > want ? st.st_size - want : 0;
+    while (ok)
+    {
+        ssize_t		n = pread(fd, buf, sizeof(buf), off);
+
+        if (n <= 0)
+            break;
+        ok = send_log_data(client_socket, buf, n);
+        off += n;
+    }
+    if (ok && st.st_size == 0)
+        ok = FPRINTF(client_socket, "job %d log is empty\n", id) >= 0;
+    close(fd);
+    return ok;
+}
+
+/*
+ * Stream a job's log from the requested offset and keep following it
+ * until the job has finished.  The last line sent is always
+ * "job <id> done: <state>".
+ */
+static bool
+JobAttach(ClientSocket *client_socket, StringInfo param_buffer)
+{
+    char		path[PATH_MAX];
+    char		buf[JOB_IO_CHUNK];
+    long		start = 0;
+    off_t		off;
+    int			id;
+    int			fd;
+    int			state;
+
+    if (!parse_job_args(param_buffer, &id, &start))
+    {
+        FPRINTF(client_socket, "job attach needs a job id\n");
+        return true;
+    }
+
+    job_lock();
+    state = job_lookup(id) ? job_lookup(id)->state : JOB_FREE;
+    job_unlock();
+    if (state == JOB_FREE)
+    {
+        FPRINTF(client_socket, "job %d not found\n", id);
+        return true;
+    }
+
+    job_log_path(path, sizeof(path), id);
+    fd = -1;
+    off = start;
+    for (;;)
+    {
+        AgentJob   *job;
+        ssize_t		n;
+
+        /* the runner creates the log, which may not have happened yet */
+        if (fd < 0)
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        n = fd >= 0 ? pread(fd, buf, sizeof(buf), off) : 0;
+        if (n > 0)
+        {
+            if (!send_log_data(client_socket, buf, n))
+            {
+                close(fd);
+                return false;
+            }
+            off += n;
+            continue;
+        }
+
+        /* all caught up; stop if the job was already over before this read */
+        if (job_finished(state))
+            break;
+
+        job_lock();
+        job = job_lookup(id);
+        state = job ? job->state : JOB_LOST;
+        job_unlock();
+        if (!job_finished(state))
+        {
+            /* the client sees what is there before we wait for more */
+            if (flush_output() != 0)
+            {
+                if (fd >= 0)
+                    close(fd);
+                return false;
+            }
+            usleep(JOB_ATTACH_POLL_MS * 1000);
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+
+    return FPRINTF(client_socket, "job %d done: %s\n", id, JobStateNames[state]) >= 0;
+}
+
+static bool
+JobCancel(ClientSocket *client_socket, StringInfo param_buffer)
+{
+    AgentJob   *job;
+    int			id;
+
+    if (!parse_job_args(param_buffer, &id, NULL))
+    {
+        FPRINTF(client_socket, "job cancel needs a job id\n");
+        return true;
+    }
+
+    job_lock();
+    job = job_lookup(id);
+    if (job == NULL)
+    {
+        job_unlock();
+        FPRINTF(client_socket, "job %d not found\n", id);
+        return true;
+    }
+    if (job_finished(job->state))
+    {
+        job_unlock();
+        FPRINTF(client_socket, "job %d already %s\n", id, JobStateNames[job->state]);
+        return true;
+    }
+    job->cancel_requested = true;
+    if (job->worker > 0)
+        kill(-job->worker, SIGTERM);
+    job_unlock();
+
+    FPRINTF(client_socket, "job %d cancelling\n", id);
+    return true;
+}
+
+/*
+ * JobStats -- append a summary of the job table to buf
+ */
+void
+JobStats(StringInfo buf)
+{
+    int			active = 0;
+    int			finished = 0;
+    int			i;
+
+    if (JobTable == NULL)
+        return;
+
+    job_lock();
+    for (i = 0; i < MAX_AGENT_JOBS; i++)
+    {
+        int			state = JobTable->jobs[i].state;
+
+        if (state == JOB_STARTING || state == JOB_RUNNING)
+            active++;
+        else if (state != JOB_FREE)
+            finished++;
+    }
+    job_unlock();
+
+    appendStringInfo(buf, "jobs: active=%d finished=%d submitted=%d dir=%s\n",
+                     active, finished, JobTable->next_id, JobDirectory);
+}
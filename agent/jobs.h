@@ -0,0 +1,74 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * jobs.h
+ *		Background jobs for long-running requests.
+ *
+ * A client wraps an ordinary request (install, restart, ...) in a
+ * CliMsg_Job_Submit message and gets a job id back at once.  The request
+ * runs in a detached process that writes everything it would have sent
+ * to the client into a per-job log file.  Any later connection can poll,
+ * tail, attach to or cancel the job by id, so a dropped CLI session
+ * neither stops nor restarts the work.
+ *-------------------------------------------------------------------------
+ */
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <time.h>
+#include <sys/types.h>
+#include "connutil.h"
+#include "stringinfo.h"
+
+/* Number of jobs remembered; finished ones are reused oldest first */
+#define MAX_AGENT_JOBS 128
+
+#define DEFAULT_JOB_DIR "/var/tmp/debo-jobs"
+
+typedef enum AgentJobState
+{
+    JOB_FREE = 0,
+    JOB_STARTING,				/* submitted, runner not up yet */
+    JOB_RUNNING,
+    JOB_EXITED,
+    JOB_CANCELLED,
+    JOB_LOST					/* runner vanished without recording a result */
+} AgentJobState;
+
+typedef struct AgentJob
+{
+    int			id;
+    volatile int state;			/* AgentJobState */
+    int			action_code;	/* the wrapped request */
+    pid_t		runner;			/* supervising process */
+    pid_t		worker;			/* process group running the request */
+    volatile int cancel_requested;
+    int			status;			/* wait status of the worker */
+    time_t		submitted;
+    time_t		finished;
+} AgentJob;
+
+/* directory for the per-job logs */
+extern char *JobDirectory;
+
+extern int	JobsInit(void);
+extern bool JobCommand(ClientSocket *client_socket, int action_code,
+                       StringInfo param_buffer);
+extern void JobStats(StringInfo buf);
+
+#endif							/* JOBS_H */
@@ -30,6 +30,12 @@
 #include <sys/sysmacros.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+
+#include "format.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "stringinfo.h"
 
 typedef struct {
     unsigned long long user;
@@ -809,3 +815,291 @@ char *collect_metrics() {
     
     return result;
 }
+
+////////////////////////////binary record/////////////////////////
+
+/*
+ * The structured metrics request (CliMsg_Metrics_Record) is answered with
+ * the raw kernel counters in the binary layout described in protocol.h.
+ * Nothing is sampled twice or kept between calls, so building a record
+ * costs a handful of /proc reads and no waiting.
+ */
+
+/* /proc file contents, reused by every record built in the thread */
+static __thread StringInfoData ProcBuffer;
+
+/* fields of /proc/meminfo in the order they go into the record */
+static const char *const meminfo_fields[] = {
+    "MemTotal", "MemFree", "MemAvailable", "Buffers", "Cached",
+    "SReclaimable", "SwapTotal", "SwapFree"
+};
+
+#define METRICS_MEMINFO_FIELDS (sizeof(meminfo_fields) / sizeof(meminfo_fields[0]))
+
+/*
+ * Read a whole /proc file into ProcBuffer.  Returns the contents, or
+ * NULL if the file could not be read.
+ */
+static const char *read_proc_file(const char *path) {
+    StringInfo buf = &ProcBuffer;
+    int fd;
+
+    if (buf->data == NULL)
+        initStringInfo(buf);
+    resetStringInfo(buf);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    for (;;) {
+        ssize_t n;
+
+        enlargeStringInfo(buf, 4096);
+        n = read(fd, buf->data + buf->len, buf->maxlen - buf->len - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            close(fd);
+            return NULL;
+        }
+        if (n == 0)
+            break;
+        buf->len += n;
+    }
+    close(fd);
+    buf->data[buf->len] = '\0';
+    return buf->data;
+}
+
+/* Next unsigned number on the line at *p; 0 if there is none. */
+static uint64 next_counter(const char **p) {
+    const char *s = *p;
+    uint64 value = 0;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    while (*s >= '0' && *s <= '9')
+        value = value * 10 + (uint64) (*s++ - '0');
+    *p = s;
+    return value;
+}
+
+/* Next blank-separated word on the line at *p; sets *len, 0 at the end. */
+static const char *next_word(const char **p, int *len) {
+    const char *s = *p;
+    const char *word;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    word = s;
+    while (*s != '\0' && *s != ' ' && *s != '\t' && *s != '\n')
+        s++;
+    *len = (int) (s - word);
+    *p = s;
+    return word;
+}
+
+static const char *next_line(const char *p) {
+    p = strchr(p, '\n');
+    return p ? p + 1 : NULL;
+}
+
+/* Append a string of at most 255 bytes: length byte, then the bytes. */
+static void send_short_string(StringInfo buf, const char *s, int len) {
+    if (len > 255)
+        len = 255;
+    sendbyte(buf, (uint8) len);
+    sendbytes(buf, s, len);
+}
+
+/* Store an int16 count at offset, where a placeholder was sent. */
+static void patch_count(StringInfo buf, int offset, int count) {
+    uint16 n = hton16((uint16) count);
+
+    memcpy(buf->data + offset, &n, sizeof(n));
+}
+
+static void send_cpu_counters(StringInfo buf) {
+    const char *p = read_proc_file("/proc/stat");
+    uint64 ticks[8] = {0};
+
+    while (p != NULL && strncmp(p, "cpu ", 4) != 0)
+        p = next_line(p);
+    if (p != NULL) {
+        p += 4;
+        for (int i = 0; i < 8; i++)
+            ticks[i] = next_counter(&p);
+    }
+    for (int i = 0; i < 8; i++)
+        sendint64(buf, ticks[i]);
+}
+
+static void send_load_averages(StringInfo buf) {
+    const char *p = read_proc_file("/proc/loadavg");
+
+    for (int i = 0; i < 3; i++) {
+        double load = 0.0;
+        char *end;
+
+        if (p != NULL) {
+            load = strtod(p, &end);
+            p = end;
+        }
+        sendint32(buf, (uint32) (load * 100.0 + 0.5));
+    }
+}
+
+static void send_memory_counters(StringInfo buf) {
+    const char *p = read_proc_file("/proc/meminfo");
+    uint64 kib[METRICS_MEMINFO_FIELDS] = {0};
+
+    for (; p != NULL; p = next_line(p)) {
+        const char *colon = strchr(p, ':');
+
+        if (colon == NULL)
+            break;
+        for (size_t i = 0; i < METRICS_MEMINFO_FIELDS; i++) {
+            size_t len = strlen(meminfo_fields[i]);
+
+            if ((size_t) (colon - p) == len && strncmp(p, meminfo_fields[i], len) == 0) {
+                const char *v = colon + 1;
+
+                kib[i] = next_counter(&v);
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < METRICS_MEMINFO_FIELDS; i++)
+        sendint64(buf, kib[i]);
+}
+
+/* Block devices that have done any I/O, from /proc/diskstats. */
+static void send_disk_counters(StringInfo buf) {
+    const char *p = read_proc_file("/proc/diskstats");
+    int count_at = buf->len;
+    int count = 0;
+
+    sendint16(buf, 0);
+    for (; p != NULL && *p != '\0'; p = next_line(p)) {
+        const char *name;
+        int name_len;
+        uint64 field[10];
+
+        (void) next_counter(&p);	/* major */
+        (void) next_counter(&p);	/* minor */
+        name = next_word(&p, &name_len);
+        if (name_len == 0)
+            continue;
+        for (int i = 0; i < 10; i++)
+            field[i] = next_counter(&p);
+        if (field[0] == 0 && field[4] == 0)
+            continue;
+
+        send_short_string(buf, name, name_len);
+        sendint64(buf, field[0]);	/* reads completed */
+        sendint64(buf, field[2]);	/* sectors read */
+        sendint64(buf, field[3]);	/* ms reading */
+        sendint64(buf, field[4]);	/* writes completed */
+        sendint64(buf, field[6]);	/* sectors written */
+        sendint64(buf, field[7]);	/* ms writing */
+        sendint64(buf, field[9]);	/* ms doing I/O */
+        count++;
+    }
+    patch_count(buf, count_at, count);
+}
+
+/* Mounted block device filesystems, as get_disk_metrics() counts them. */
+static void send_filesystem_usage(StringInfo buf) {
+    FILE *mtab = setmntent("/proc/mounts", "r");
+    struct mntent *entry;
+    int count_at = buf->len;
+    int count = 0;
+
+    sendint16(buf, 0);
+    if (mtab == NULL)
+        return;
+    while ((entry = getmntent(mtab)) != NULL) {
+        struct statvfs vfs;
+        uint64 frsize;
+
+        if (strncmp(entry->mnt_fsname, "/dev/", 5) != 0)
+            continue;
+        if (statvfs(entry->mnt_dir, &vfs) != 0)
+            continue;
+
+        frsize = (uint64) vfs.f_frsize;
+        send_short_string(buf, entry->mnt_dir, (int) strlen(entry->mnt_dir));
+        send_short_string(buf, entry->mnt_fsname, (int) strlen(entry->mnt_fsname));
+        sendint64(buf, (uint64) vfs.f_blocks * frsize);
+        sendint64(buf, (uint64) vfs.f_bfree * frsize);
+        sendint64(buf, (uint64) vfs.f_bavail * frsize);
+        count++;
+    }
+    endmntent(mtab);
+    patch_count(buf, count_at, count);
+}
+
+/* Every interface in /proc/net/dev, loopback included. */
+static void send_interface_counters(StringInfo buf) {
+    const char *p = read_proc_file("/proc/net/dev");
+    int count_at = buf->len;
+    int count = 0;
+
+    sendint16(buf, 0);
+    /* two header lines */
+    if (p != NULL)
+        p = next_line(p);
+    if (p != NULL)
+        p = next_line(p);
+    for (; p != NULL && *p != '\0'; p = next_line(p)) {
+        const char *name;
+        const char *colon = strchr(p, ':');
+        const char *eol = strchr(p, '\n');
+        uint64 field[12];
+        int name_len;
+
+        if (colon == NULL || (eol != NULL && colon > eol))
+            continue;
+        while (*p == ' ')
+            p++;
+        name = p;
+        name_len = (int) (colon - p);
+        p = colon + 1;
+        for (int i = 0; i < 12; i++)
+            field[i] = next_counter(&p);
+
+        send_short_string(buf, name, name_len);
+        for (int i = 0; i < 4; i++)
+            sendint64(buf, field[i]);		/* received */
+        for (int i = 8; i < 12; i++)
+            sendint64(buf, field[i]);		/* sent */
+        count++;
+    }
+    patch_count(buf, count_at, count);
+}
+
+/*
+ * build_metrics_record -- append a metrics record to buf
+ *
+ * Parts whose /proc file cannot be read are sent as zeros or as empty
+ * arrays, so the layout is always complete.
+ */
+void build_metrics_record(StringInfo buf) {
+    struct timespec now;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    long ticks = sysconf(_SC_CLK_TCK);
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    sendint16(buf, METRICS_RECORD_VERSION);
+    sendint16(buf, 0);
+    sendint64(buf, (uint64) now.tv_sec * 1000000 + (uint64) (now.tv_nsec / 1000));
+    sendint32(buf, (uint32) (ticks > 0 ? ticks : 0));
+    sendint32(buf, (uint32) (ncpu > 0 ? ncpu : 0));
+
+    send_cpu_counters(buf);
+    send_load_averages(buf);
+    send_memory_counters(buf);
+    send_disk_counters(buf);
+    send_filesystem_usage(buf);
+    send_interface_counters(buf);
+}
@@ -16,9 +16,12 @@
  * limitations under the License.
  */
 
+#include "stringinfo.h"
+
 char *get_cpu_usage_extended();
 char *get_memory_usage();
 char* get_disk_metrics();
 char *get_network_metrics();
 char *collect_metrics();
+extern void build_metrics_record(StringInfo buf);
 #endif
@@ -0,0 +1,399 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * pool.c
+ *		Pre-forked worker pool for the agent.
+ *
+ * The master forks WorkerPoolSize workers before accepting anything and
+ * then only supervises them: it sleeps in sigsuspend() until a worker
+ * exits, reaps it and forks a replacement into the same slot.  Workers
+ * wait on the inherited listen sockets with their own epoll set and call
+ * AcceptConnection() directly.  The listen sockets are non-blocking, so
+ * a worker that loses the race for a connection just goes back to
+ * waiting.  Where the kernel supports EPOLLEXCLUSIVE only one waiter is
+ * woken per incoming connection.
+ *
+ * All bookkeeping lives in one anonymous shared mapping created before
+ * the first fork, so whichever worker happens to get a stats request can
+ * describe the whole pool.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+
+#include "pool.h"
+#include "upgrade.h"
+#include "comm.h"
+
+#define STATUS_OK				(0)
+#define STATUS_ERROR			(-1)
+
+#define POOL_MAX_LISTEN			64
+
+/* How often an idle worker checks whether the master is still there */
+#define POOL_IDLE_CHECK_MS		1000
+
+#ifdef EPOLLEXCLUSIVE
+#define POOL_EPOLL_FLAGS		(EPOLLIN | EPOLLEXCLUSIVE)
+#else
+#define POOL_EPOLL_FLAGS		EPOLLIN
+#endif
+
+int			WorkerPoolSize = 0;
+int			WorkerMaxRequests = 1000;
+
+extern volatile sig_atomic_t shutdown_requested;
+
+static PoolShmem *PoolState = NULL;
+static pid_t PoolMasterPid = 0;
+
+static pid_t StartPoolWorker(int slot, int *listen_sockets, int nsockets);
+static void PoolWorkerMain(int slot, int *listen_sockets, int nsockets);
+static void ReapPoolWorkers(void);
+
+/*
+ * SIGCHLD only needs to interrupt sigsuspend() in the master; the actual
+ * reaping happens in the main loop.
+ */
+static void
+pool_sigchld_handler(int signo)
+{
+    (void) signo;
+}
+
+/*
+ * WorkerPoolActive -- is this process part of a pre-forked pool?
+ */
+bool
+WorkerPoolActive(void)
+{
+    return PoolState != NULL;
+}
+
+/*
+ * WorkerPoolMain -- start the pool and supervise it until shutdown
+ *
+ * Returns STATUS_OK after a clean shutdown, STATUS_ERROR if the pool
+ * could not be set up at all.
+ */
+int
+WorkerPoolMain(int *listen_sockets, int nsockets)
+{
+    struct sigaction sa;
+    sigset_t	blockmask,
+                waitmask;
+    int			i;
+
+    if (WorkerPoolSize > MAX_POOL_WORKERS)
+    {
+        fprintf(stderr, "worker pool size %d exceeds maximum %d, using %d\n",
+                WorkerPoolSize, MAX_POOL_WORKERS, MAX_POOL_WORKERS);
+        WorkerPoolSize = MAX_POOL_WORKERS;
+    }
+
+    PoolState = mmap(NULL, sizeof(PoolShmem), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (PoolState == MAP_FAILED)
+    {
+        PoolState = NULL;
+        fprintf(stderr, "could not map worker pool state: %m\n");
+        return STATUS_ERROR;
+    }
+    memset(PoolState, 0, sizeof(PoolShmem));
+    PoolState->nslots = WorkerPoolSize;
+    PoolState->max_requests = WorkerMaxRequests;
+    PoolMasterPid = getpid();
+
+    /* workers race for connections, so nobody may block in accept() */
+    for (i = 0; i < nsockets; i++)
+    {
+        if (!set_noblock(listen_sockets[i]))
+        {
+            fprintf(stderr, "could not set listen socket to non-blocking mode: %m\n");
+            return STATUS_ERROR;
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = pool_sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    /*
+     * Keep SIGCHLD and the shutdown signals blocked except while waiting
+     * in sigsuspend(), so that none of them can slip in between checking
+     * the state and going to sleep.
+     */
+    sigemptyset(&blockmask);
+    sigaddset(&blockmask, SIGCHLD);
+    sigaddset(&blockmask, SIGTERM);
+    sigaddset(&blockmask, SIGINT);
+    sigaddset(&blockmask, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &blockmask, &waitmask);
+    sigdelset(&waitmask, SIGCHLD);
+    sigdelset(&waitmask, SIGTERM);
+    sigdelset(&waitmask, SIGINT);
+    sigdelset(&waitmask, SIGUSR2);
+
+    fprintf(stderr, "starting worker pool with %d workers, %d requests per worker\n",
+            WorkerPoolSize, WorkerMaxRequests);
+
+    while (!shutdown_requested)
+    {
+        ReapPoolWorkers();
+        if (upgrade_requested)
+            AgentUpgrade();
+
+        for (i = 0; i < PoolState->nslots && !shutdown_requested; i++)
+        {
+            if (PoolState->slots[i].pid != 0)
+                continue;
+            if (StartPoolWorker(i, listen_sockets, nsockets) < 0)
+            {
+                fprintf(stderr, "could not fork pool worker: %m\n");
+                break;
+            }
+        }
+
+        if (!shutdown_requested)
+            sigsuspend(&waitmask);
+    }
+
+    /* Ask every worker to finish its current client and exit */
+    for (i = 0; i < PoolState->nslots; i++)
+    {
+        if (PoolState->slots[i].pid > 0)
+            kill(PoolState->slots[i].pid, SIGTERM);
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        ;
+
+    sigprocmask(SIG_UNBLOCK, &blockmask, NULL);
+    return STATUS_OK;
+}
+
+/*
+ * Reap every worker that has exited and free its slot.
+ */
+static void
+ReapPoolWorkers(void)
+{
+    pid_t		pid;
+    int			status;
+    int			i;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        for (i = 0; i < PoolState->nslots; i++)
+        {
+            PoolWorkerSlot *slot = &PoolState->slots[i];
+
+            if (slot->pid != pid)
+                continue;
+
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                PoolState->total_recycled++;
+            else
+            {
+                PoolState->total_died++;
+                fprintf(stderr, "pool worker %d exited abnormally (status %d)\n",
+                        (int) pid, status);
+            }
+            slot->pid = 0;
+            slot->state = POOL_SLOT_EMPTY;
+            break;
+        }
+    }
+}
+
+/*
+ * Fork one worker into the given slot.
+ */
+static pid_t
+StartPoolWorker(int slot, int *listen_sockets, int nsockets)
+{
+    PoolWorkerSlot *me = &PoolState->slots[slot];
+    pid_t		pid;
+
+    /* set up the slot before the child can start touching it */
+    me->state = POOL_SLOT_IDLE;
+    me->requests = 0;
+    me->started = time(NULL);
+
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0)
+    {
+        PoolWorkerMain(slot, listen_sockets, nsockets);
+        _exit(0);
+    }
+    if (pid > 0)
+    {
+        me->pid = pid;
+        PoolState->total_spawned++;
+    }
+    else
+        me->state = POOL_SLOT_EMPTY;
+    return pid;
+}
+
+/*
+ * Body of a pool worker.  Never returns.
+ */
+static void
+PoolWorkerMain(int slot, int *listen_sockets, int nsockets)
+{
+    PoolWorkerSlot *me = &PoolState->slots[slot];
+    struct epoll_event ev;
+    struct epoll_event events[POOL_MAX_LISTEN];
+    struct sigaction sa;
+    sigset_t	unblock;
+    int			epfd;
+    int			i;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+
+    sigemptyset(&unblock);
+    sigaddset(&unblock, SIGCHLD);
+    sigaddset(&unblock, SIGTERM);
+    sigaddset(&unblock, SIGINT);
+    sigaddset(&unblock, SIGUSR2);
+    sigprocmask(SIG_UNBLOCK, &unblock, NULL);
+
+    if (nsockets > POOL_MAX_LISTEN)
+        nsockets = POOL_MAX_LISTEN;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        fprintf(stderr, "pool worker could not create epoll set: %m\n");
+        _exit(1);
+    }
+    for (i = 0; i < nsockets; i++)
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = POOL_EPOLL_FLAGS;
+        ev.data.fd = listen_sockets[i];
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_sockets[i], &ev) < 0)
+        {
+            fprintf(stderr, "pool worker could not watch listen socket: %m\n");
+            _exit(1);
+        }
+    }
+
+    while (!shutdown_requested)
+    {
+        int			nevents;
+
+        nevents = epoll_wait(epfd, events, nsockets, POOL_IDLE_CHECK_MS);
+        if (nevents < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "pool worker epoll_wait failed: %m\n");
+            _exit(1);
+        }
+
+        /* don't outlive the master; nobody would replace us */
+        if (getppid() != PoolMasterPid)
+            break;
+
+        for (i = 0; i < nevents && !shutdown_requested; i++)
+        {
+            ClientSocket client;
+
+            if (AcceptConnection(events[i].data.fd, &client) != STATUS_OK)
+                continue;
+
+            me->state = POOL_SLOT_BUSY;
+            ServeConnection(&client);
+            me->requests++;
+            __atomic_add_fetch(&PoolState->total_served, 1, __ATOMIC_RELAXED);
+            me->state = POOL_SLOT_IDLE;
+
+            if (WorkerMaxRequests > 0 && me->requests >= (uint64_t) WorkerMaxRequests)
+            {
+                close(epfd);
+                _exit(0);
+            }
+        }
+    }
+
+    close(epfd);
+    _exit(0);
+}
+
+/*
+ * WorkerPoolStats -- append a description of the pool to buf
+ */
+void
+WorkerPoolStats(StringInfo buf)
+{
+    time_t		now = time(NULL);
+    int			idle = 0;
+    int			busy = 0;
+    int			i;
+
+    if (PoolState == NULL)
+    {
+        appendStringInfoString(buf, "worker pool: disabled\n");
+        return;
+    }
+
+    for (i = 0; i < PoolState->nslots; i++)
+    {
+        if (PoolState->slots[i].state == POOL_SLOT_BUSY)
+            busy++;
+        else if (PoolState->slots[i].state == POOL_SLOT_IDLE)
+            idle++;
+    }
+
+    appendStringInfo(buf, "worker pool: size=%d busy=%d idle=%d max_requests=%d\n",
+                     PoolState->nslots, busy, idle, PoolState->max_requests);
+    appendStringInfo(buf, "  served=%llu spawned=%llu recycled=%llu died=%llu\n",
+                     (unsigned long long) PoolState->total_served,
+                     (unsigned long long) PoolState->total_spawned,
+                     (unsigned long long) PoolState->total_recycled,
+                     (unsigned long long) PoolState->total_died);
+
+    for (i = 0; i < PoolState->nslots; i++)
+    {
+        PoolWorkerSlot *slot = &PoolState->slots[i];
+
+        if (slot->pid == 0)
+            continue;
+        appendStringInfo(buf, "  worker %d: pid=%d %s requests=%llu uptime=%lds\n",
+                         i, (int) slot->pid,
+                         slot->state == POOL_SLOT_BUSY ? "busy" : "idle",
+                         (unsigned long long) slot->requests,
+                         (long) (now - slot->started));
+    }
+}
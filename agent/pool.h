@@ -0,0 +1,83 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * pool.h
+ *		Pre-forked worker pool for the agent.
+ *
+ * Instead of forking one child per accepted connection, the agent can
+ * start a fixed number of workers up front.  Every worker inherits the
+ * listen sockets and accepts connections itself, so the handoff is done
+ * by the kernel through the shared listen queue.  A worker serves
+ * connections one at a time and exits after WorkerMaxRequests of them;
+ * the master notices the exit and forks a replacement.
+ *-------------------------------------------------------------------------
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "connutil.h"
+#include "stringinfo.h"
+
+/* Upper bound on DEBO_WORKER_POOL_SIZE */
+#define MAX_POOL_WORKERS 256
+
+typedef enum PoolWorkerState
+{
+    POOL_SLOT_EMPTY = 0,		/* no process attached */
+    POOL_SLOT_IDLE,				/* waiting in accept */
+    POOL_SLOT_BUSY				/* serving a connection */
+} PoolWorkerState;
+
+/*
+ * Per-worker bookkeeping.  Lives in anonymous shared memory so that any
+ * worker can report on the whole pool when a client asks for stats.
+ */
+typedef struct PoolWorkerSlot
+{
+    pid_t		pid;
+    volatile int state;			/* PoolWorkerState */
+    uint64_t	requests;		/* connections served by this process */
+    time_t		started;		/* when the process was forked */
+} PoolWorkerSlot;
+
+typedef struct PoolShmem
+{
+    int			nslots;
+    int			max_requests;
+    uint64_t	total_served;	/* connections served by all workers */
+    uint64_t	total_spawned;	/* workers forked, including replacements */
+    uint64_t	total_recycled; /* workers retired at max_requests */
+    uint64_t	total_died;		/* workers that exited abnormally */
+    PoolWorkerSlot slots[MAX_POOL_WORKERS];
+} PoolShmem;
+
+/* tunables, 0 pool size keeps the fork-per-connection behaviour */
+extern int	WorkerPoolSize;
+extern int	WorkerMaxRequests;
+
+extern int	WorkerPoolMain(int *listen_sockets, int nsockets);
+extern bool WorkerPoolActive(void);
+extern void WorkerPoolStats(StringInfo buf);
+
+/* provided by debo.c: run one client session in the current process */
+extern void ServeConnection(ClientSocket *client_sock);
+
+#endif							/* POOL_H */
@@ -0,0 +1,463 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * session.c
+ *		Pipelined multi-command sessions.
+ *
+ * The process serving the connection becomes the session's dispatcher.
+ * It keeps reading tagged requests into a FIFO while earlier ones run,
+ * and forks one worker per request.  A worker runs the request through
+ * process_command() with client output redirected into a pipe; the
+ * dispatcher forwards whatever arrives on the pipes to the client as
+ * tagged output frames and reports each request with a done frame when
+ * its worker has exited.  Frames are queued while the dispatcher is busy
+ * and flushed before it waits again.
+ *
+ * A read-only request starts as soon as there is a free slot, even while
+ * a mutating request is running or waiting ahead of it, so that a probe is
+ * answered in the middle of a long install.  Mutating requests run one at
+ * a time in the order they arrived, each once every request sent before
+ * it has finished.  The per-class caps of childreg.c still apply inside
+ * the workers.
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE				/* pipe2() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "session.h"
+#include "childreg.h"
+#include "engine.h"
+#include "format.h"
+#include "protocol.h"
+#include "utiles.h"
+
+/* largest request accepted inside a session, as in handle_command() */
+#define SESSION_MAX_MESSAGE		1024
+
+#define SESSION_IO_CHUNK		8192
+
+typedef struct SessionRequest
+{
+    uint32		tag;
+    uint64		seq;			/* order of arrival */
+    int			action_code;
+    bool		independent;	/* may run alongside other read-only ones */
+    StringInfoData params;
+    pid_t		pid;			/* worker, 0 until started */
+    int			fd;				/* read end of the worker's output pipe */
+    struct SessionRequest *next;
+} SessionRequest;
+
+typedef struct Session
+{
+    ClientSocket *client;
+    SessionRequest *head;		/* queued, not started yet */
+    SessionRequest *tail;
+    int			nqueued;
+    uint64		nreceived;		/* requests queued so far */
+    SessionRequest *running[SESSION_MAX_INFLIGHT];
+    int			nrunning;
+    bool		exclusive;		/* a mutating request is running */
+    StringInfoData frame;		/* reused for every outgoing frame */
+} Session;
+
+/*
+ * Can the request run at the same time as other read-only requests?
+ */
+static bool
+request_is_independent(int action_code)
+{
+    switch (action_code)
+    {
+        case CliMsg_Job_Poll:
+        case CliMsg_Job_Tail:
+        case CliMsg_Job_Attach:
+            return true;
+        default:
+            break;
+    }
+    switch (ChildCommandClass(action_code))
+    {
+        case CHILD_CLASS_NONE:
+        case CHILD_CLASS_REPORT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void
+send_output(Session *session, uint32 tag, const char *data, int len)
+{
+    beginmessage_reuse(&session->frame, SessionMsg_Output);
+    sendint32(&session->frame, tag);
+    sendbytes(&session->frame, data, len);
+    endmessage_compressed(&session->frame);
+}
+
+static void
+send_done(Session *session, uint32 tag, int status)
+{
+    beginmessage_reuse(&session->frame, SessionMsg_Done);
+    sendint32(&session->frame, tag);
+    sendint32(&session->frame, (uint32) status);
+    endmessage_more(&session->frame);
+}
+
+/*
+ * Refuse a request without running it.
+ */
+static void
+refuse_request(Session *session, uint32 tag, const char *reason)
+{
+    send_output(session, tag, reason, strlen(reason));
+    send_done(session, tag, -1);
+}
+
+static void
+free_request(SessionRequest *req)
+{
+    free(req->params.data);
+    free(req);
+}
+
+/*
+ * Queue one session message: int32 tag, request code, request parameters.
+ */
+static void
+queue_request(Session *session, StringInfo msg)
+{
+    SessionRequest *req;
+    uint32		tag;
+    int			action_code;
+
+    if (msg->len < 5)
+    {
+        refuse_request(session, 0, "malformed session request\n");
+        return;
+    }
+    msg->cursor = 0;
+    tag = getmsgint(msg, 4);
+    action_code = getmsgbyte(msg);
+
+    if (action_code == CliMsg_Session || action_code == CliMsg_Finish)
+    {
+        char		reason[64];
+
+        snprintf(reason, sizeof(reason),
+                 "request 0x%02X cannot run in a session\n", action_code);
+        refuse_request(session, tag, reason);
+        return;
+    }
+
+    req = calloc(1, sizeof(SessionRequest));
+    if (req == NULL)
+    {
+        refuse_request(session, tag, "out of memory\n");
+        return;
+    }
+    req->tag = tag;
+    req->seq = session->nreceived++;
+    req->action_code = action_code;
+    req->independent = request_is_independent(action_code);
+    req->fd = -1;
+    initStringInfo(&req->params);
+    appendBinaryStringInfo(&req->params, msg->data + msg->cursor,
+                           msg->len - msg->cursor);
+
+    if (session->tail)
+        session->tail->next = req;
+    else
+        session->head = req;
+    session->tail = req;
+    session->nqueued++;
+}
+
+/*
+ * Fork the worker for a request.  Returns false if it could not be
+ * started; the request has been answered in that case.
+ */
+static bool
+start_request(Session *session, SessionRequest *req)
+{
+    int			pipefd[2];
+    pid_t		pid;
+
+    if (pipe2(pipefd, O_CLOEXEC) < 0)
+    {
+        refuse_request(session, req->tag, "could not create output pipe\n");
+        return false;
+    }
+
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0)
+    {
+        ClientSocket nobody;
+
+        close(pipefd[0]);
+        memset(&nobody, 0, sizeof(nobody));
+        nobody.sock = -1;
+        global_client_socket = &nobody;
+        secure_redirect_output(pipefd[1]);
+        begin_response(req->action_code);
+        process_command(&nobody, req->action_code, &req->params);
+        end_response();
+        fflush(NULL);
+        _exit(get_response_status());
+    }
+    close(pipefd[1]);
+    if (pid < 0)
+    {
+        close(pipefd[0]);
+        refuse_request(session, req->tag, "could not start request\n");
+        return false;
+    }
+
+    req->pid = pid;
+    req->fd = pipefd[0];
+    return true;
+}
+
+/*
+ * Is a request that arrived before seq still running?
+ */
+static bool
+earlier_running(Session *session, uint64 seq)
+{
+    int			i;
+
+    for (i = 0; i < session->nrunning; i++)
+    {
+        if (session->running[i]->seq < seq)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Start queued requests as far as the ordering rules allow.  Read-only
+ * requests may pass a mutating one that has to wait; mutating ones never
+ * pass anything.
+ */
+static void
+start_ready_requests(Session *session)
+{
+    SessionRequest *prev = NULL;
+    SessionRequest *req = session->head;
+
+    while (req != NULL && session->nrunning < SESSION_MAX_INFLIGHT)
+    {
+        SessionRequest *next = req->next;
+
+        /* nothing queued ahead of it, nothing older running */
+        if (!req->independent &&
+            (prev != NULL || session->exclusive ||
+             earlier_running(session, req->seq)))
+        {
+            prev = req;
+            req = next;
+            continue;
+        }
+
+        if (prev != NULL)
+            prev->next = next;
+        else
+            session->head = next;
+        if (session->tail == req)
+            session->tail = prev;
+        session->nqueued--;
+        req->next = NULL;
+
+        if (!start_request(session, req))
+            free_request(req);
+        else
+        {
+            session->running[session->nrunning++] = req;
+            if (!req->independent)
+                session->exclusive = true;
+        }
+        req = next;
+    }
+}
+
+/*
+ * Forward the output of a running request.  When its pipe reaches EOF,
+ * collect the worker and report the request as done.
+ */
+static void
+drain_request(Session *session, int slot)
+{
+    SessionRequest *req = session->running[slot];
+    char		buf[SESSION_IO_CHUNK];
+    ssize_t		n;
+    int			status;
+
+    n = read(req->fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n > 0)
+    {
+        send_output(session, req->tag, buf, (int) n);
+        return;
+    }
+
+    close(req->fd);
+    while (waitpid(req->pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            status = 1 << 8;
+            break;
+        }
+    }
+    if (WIFSIGNALED(status))
+        send_done(session, req->tag, 128 + WTERMSIG(status));
+    else
+        send_done(session, req->tag, WEXITSTATUS(status));
+
+    if (!req->independent)
+        session->exclusive = false;
+    session->running[slot] = session->running[--session->nrunning];
+    free_request(req);
+}
+
+/*
+ * Read one message from the client.  Returns false once the client has
+ * finished the session or gone away.
+ */
+static bool
+read_request(Session *session, StringInfo msg)
+{
+    int			action_code;
+
+    resetStringInfo(msg);
+    action_code = getbyte(session->client);
+    if (action_code == EOF ||
+        getmessage(msg, session->client, SESSION_MAX_MESSAGE) == EOF)
+        return false;
+    if (action_code == CliMsg_Finish)
+        return false;
+    if (action_code != CliMsg_Session)
+    {
+        refuse_request(session, 0, "expected a session request\n");
+        return true;
+    }
+    queue_request(session, msg);
+    return true;
+}
+
+/*
+ * SessionCommand -- serve a pipelined session, starting with the request
+ * in param_buffer
+ *
+ * Returns when the client has finished the session and every request it
+ * sent has been answered.  The connection is not reused afterwards.
+ */
+bool
+SessionCommand(ClientSocket *client_socket, StringInfo param_buffer)
+{
+    Session		session;
+    StringInfoData msg;
+    struct pollfd fds[SESSION_MAX_INFLIGHT + 1];
+    bool		reading = true;
+
+    memset(&session, 0, sizeof(session));
+    session.client = client_socket;
+    initStringInfo(&session.frame);
+    initStringInfo(&msg);
+    global_client_socket = client_socket;
+
+    queue_request(&session, param_buffer);
+
+    for (;;)
+    {
+        int			nfds = 0;
+        int			first_pipe;
+        int			nrunning;
+        int			i;
+
+        start_ready_requests(&session);
+        if (!reading && session.head == NULL && session.nrunning == 0)
+            break;
+
+        /* input that has already been received needs no poll */
+        if (reading && session.nqueued < SESSION_MAX_QUEUED &&
+            (buffer_remaining_data() > 0 || be_gssapi_read_pending()))
+        {
+            reading = read_request(&session, &msg);
+            continue;
+        }
+
+        if (reading && session.nqueued < SESSION_MAX_QUEUED)
+        {
+            fds[nfds].fd = client_socket->sock;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        first_pipe = nfds;
+        for (i = 0; i < session.nrunning; i++)
+        {
+            fds[nfds].fd = session.running[i]->fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+
+        if (nfds == 0)
+            break;				/* cannot happen: something is queued */
+
+        /* frames queued since the last wait go out together */
+        (void) flush();
+        if (poll(fds, nfds, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "session poll failed: %m\n");
+            reading = false;
+            continue;
+        }
+
+        /*
+         * Drain the pipes before reading more requests.  drain_request()
+         * may drop a finished request from the running array, so walk it
+         * from the end to keep the remaining slots in step with fds[].
+         */
+        nrunning = session.nrunning;
+        for (i = nrunning - 1; i >= 0; i--)
+        {
+            if (fds[first_pipe + i].revents)
+                drain_request(&session, i);
+        }
+
+        if (first_pipe > 0 && fds[0].revents)
+            reading = read_request(&session, &msg);
+    }
+
+    (void) flush();
+    free(msg.data);
+    free(session.frame.data);
+    return false;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * session.h
+ *		Pipelined multi-command sessions.
+ *
+ * A client that opens a session with CliMsg_Session may send any number
+ * of tagged requests back to back over the one authenticated connection,
+ * without waiting for the answer to the previous one.  Read-only requests
+ * run concurrently, also alongside a request that changes something; such
+ * a request waits for everything before it and holds back the later ones
+ * that change something.  Output of the requests comes back interleaved,
+ * in framed messages carrying the tag of the request that produced it:
+ *
+ *		'O' int32 tag, bytes	output of a running request
+ *		'D' int32 tag, int32 status		request finished
+ *
+ * Each frame is the type byte followed by an int32 length that counts
+ * itself and the rest of the frame.  The status is the request's result
+ * (RESP_* in protocol.h), or -1 if the agent refused to run it.  If the
+ * client has turned on response compression, an output frame may come
+ * wrapped in a RespMsg_Compressed message like any other.
+ *-------------------------------------------------------------------------
+ */
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include "connutil.h"
+#include "stringinfo.h"
+
+/* requests of one session that may run at the same time */
+#define SESSION_MAX_INFLIGHT	8
+
+/* requests read ahead of the ones running before reading stops */
+#define SESSION_MAX_QUEUED		64
+
+/* session frame types */
+#define SessionMsg_Output		'O'
+#define SessionMsg_Done			'D'
+
+extern bool SessionCommand(ClientSocket *client_socket, StringInfo param_buffer);
+
+#endif							/* SESSION_H */
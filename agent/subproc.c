@@ -0,0 +1,363 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * subproc.c
+ *		Running shell commands on behalf of a request.
+ *
+ * The command is started with posix_spawn(), which does not copy the
+ * agent's address space, and the caller then polls both output pipes
+ * until the command is done.  Start scripts often leave daemons behind
+ * that still hold the pipes open; once the shell itself has exited, the
+ * pipes are read only as long as data keeps coming, and for no more than
+ * SUBPROC_DRAIN_MAX_MS in all.  A daemon that left the process group and
+ * keeps writing is cut off there, as it is once the shell has been
+ * killed at the hard timeout: the pipes are closed and whatever it
+ * writes after that is lost to it.
+ *
+ * Nothing here forks or waits for anything but the command itself, so it
+ * is safe on the command threads of the event engine as well.
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE				/* pipe2() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "subproc.h"
+#include "utiles.h"
+
+#define STATUS_OK				(0)
+#define STATUS_ERROR			(-1)
+
+#define SUBPROC_IO_CHUNK		8192
+
+/* how often to look for the shell's exit while its pipes stay open */
+#define SUBPROC_CHECK_MS		250
+
+/* after the shell has exited, silence on its pipes that ends the wait */
+#define SUBPROC_DRAIN_MS		1000
+
+/* after the shell has exited, the longest the pipes are read at all */
+#define SUBPROC_DRAIN_MAX_MS	10000
+
+extern char **environ;
+
+int			CommandTimeout = DEFAULT_COMMAND_TIMEOUT;
+
+/* process group of the command running in this thread, 0 if none */
+static __thread volatile sig_atomic_t RunningGroup = 0;
+
+static long
+now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Options for a command that is kept to CommandTimeout and whose output
+ * is neither kept nor forwarded.
+ */
+void
+SubprocDefaultOptions(SubprocOptions *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+    if (CommandTimeout > 0)
+    {
+        opts->soft_timeout_ms = CommandTimeout * 1000;
+        opts->hard_timeout_ms = opts->soft_timeout_ms + SUBPROC_KILL_GRACE_MS;
+    }
+}
+
+/*
+ * SubprocessKillRunning -- signal the group of the command in progress
+ *
+ * For a process that is being told to stop: the command runs in a group
+ * of its own and would not get the signal otherwise.  Safe to call from
+ * a signal handler.
+ */
+void
+SubprocessKillRunning(int signo)
+{
+    pid_t		pgid = RunningGroup;
+
+    if (pgid > 0)
+        kill(-pgid, signo);
+}
+
+/*
+ * Start the command.  Returns its pid, or -1 with errno set.
+ */
+static pid_t
+spawn_command(const char *command, int outfd, int errfd)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t	mask;
+    sigset_t	deflt;
+    char	   *argv[] = {"sh", "-c", (char *) command, NULL};
+    pid_t		pid;
+    int			rc;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, outfd, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, errfd, STDERR_FILENO);
+
+    /* own group, nothing blocked, and the agent's handlers reset */
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigemptyset(&deflt);
+    sigaddset(&deflt, SIGCHLD);
+    sigaddset(&deflt, SIGPIPE);
+    sigaddset(&deflt, SIGTERM);
+    sigaddset(&deflt, SIGINT);
+    sigaddset(&deflt, SIGHUP);
+    sigaddset(&deflt, SIGUSR1);
+    sigaddset(&deflt, SIGUSR2);
+    posix_spawnattr_setsigdefault(&attr, &deflt);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                             POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    rc = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0)
+    {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
+/*
+ * Read what is there on one pipe.  Returns false at EOF.
+ */
+static bool
+read_pipe(int fd, StringInfo keep, bool forward)
+{
+    char		buf[SUBPROC_IO_CHUNK];
+    ssize_t		n;
+
+    n = read(fd, buf, sizeof(buf));
+    if (n < 0)
+        return errno == EINTR || errno == EAGAIN;
+    if (n == 0)
+        return false;
+    if (keep)
+        appendBinaryStringInfo(keep, buf, n);
+    if (forward)
+        (void) send_output_data(global_client_socket, buf, n);
+    return true;
+}
+
+/*
+ * RunSubprocess -- run a shell command to completion
+ *
+ * Returns STATUS_OK once the command has run, whatever its outcome, with
+ * the outcome in *result; STATUS_ERROR if it could not be started.
+ */
+int
+RunSubprocess(const char *command, const SubprocOptions *opts,
+              SubprocResult *result)
+{
+    int			outpipe[2];
+    int			errpipe[2];
+    int			fds[2];
+    pid_t		pid;
+    int			status = 0;
+    bool		exited = false;
+    bool		termed = false;
+    bool		killed = false;
+    long		started;
+    long		last_data;
+    long		exited_at = 0;
+
+    result->status = -1;
+    result->timed_out = false;
+
+    if (pipe2(outpipe, O_CLOEXEC) < 0)
+        return STATUS_ERROR;
+    if (pipe2(errpipe, O_CLOEXEC) < 0)
+    {
+        close(outpipe[0]);
+        close(outpipe[1]);
+        return STATUS_ERROR;
+    }
+
+    /* the command may take a while; show what was said before it */
+    (void) flush_output();
+
+    pid = spawn_command(command, outpipe[1], errpipe[1]);
+    close(outpipe[1]);
+    close(errpipe[1]);
+    if (pid < 0)
+    {
+        int			save_errno = errno;
+
+        close(outpipe[0]);
+        close(errpipe[0]);
+        errno = save_errno;
+        return STATUS_ERROR;
+    }
+    RunningGroup = pid;
+
+    fds[0] = outpipe[0];
+    fds[1] = errpipe[0];
+    started = last_data = now_ms();
+
+    while (fds[0] >= 0 || fds[1] >= 0 || !exited)
+    {
+        struct pollfd pfd[2];
+        int			npfd = 0;
+        long		now = now_ms();
+        long		wait_ms = -1;
+        int			rc;
+
+        /* timeouts apply to the whole group, daemons left behind included */
+        if (!termed && opts->soft_timeout_ms > 0 &&
+            now - started >= opts->soft_timeout_ms)
+        {
+            kill(-pid, SIGTERM);
+            termed = true;
+            result->timed_out = true;
+        }
+        if (!killed && opts->hard_timeout_ms > 0 &&
+            now - started >= opts->hard_timeout_ms)
+        {
+            kill(-pid, SIGKILL);
+            killed = true;
+            result->timed_out = true;
+        }
+
+        /*
+         * Whoever still holds the pipes once the shell is gone gets a
+         * bounded time to finish, none if the shell had to be killed.
+         */
+        if (exited && (killed || now - last_data >= SUBPROC_DRAIN_MS ||
+                       now - exited_at >= SUBPROC_DRAIN_MAX_MS))
+            break;
+
+        if (!termed && opts->soft_timeout_ms > 0)
+            wait_ms = started + opts->soft_timeout_ms - now;
+        if (!killed && opts->hard_timeout_ms > 0 &&
+            (wait_ms < 0 || started + opts->hard_timeout_ms - now < wait_ms))
+            wait_ms = started + opts->hard_timeout_ms - now;
+        if (!exited && (wait_ms < 0 || wait_ms > SUBPROC_CHECK_MS))
+            wait_ms = SUBPROC_CHECK_MS;
+        if (exited && (wait_ms < 0 || last_data + SUBPROC_DRAIN_MS - now < wait_ms))
+            wait_ms = last_data + SUBPROC_DRAIN_MS - now;
+        if (exited && exited_at + SUBPROC_DRAIN_MAX_MS - now < wait_ms)
+            wait_ms = exited_at + SUBPROC_DRAIN_MAX_MS - now;
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (fds[i] < 0)
+                continue;
+            pfd[npfd].fd = fds[i];
+            pfd[npfd].events = POLLIN;
+            npfd++;
+        }
+
+        /* the client sees what has arrived before we wait for more */
+        rc = poll(pfd, npfd, 0);
+        if (rc == 0 && wait_ms != 0)
+        {
+            if (opts->forward_out || opts->forward_err)
+                (void) flush_output();
+            rc = poll(pfd, npfd, (int) wait_ms);
+        }
+        if (rc < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "poll on command output failed: %m\n");
+            break;
+        }
+
+        for (int i = 0, j = 0; rc > 0 && i < 2; i++)
+        {
+            if (fds[i] < 0)
+                continue;
+            if (pfd[j++].revents == 0)
+                continue;
+            if (read_pipe(fds[i], i == 0 ? opts->out : opts->err,
+                          i == 0 ? opts->forward_out : opts->forward_err))
+                last_data = now_ms();
+            else
+            {
+                close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+
+        if (!exited)
+        {
+            pid_t		r = waitpid(pid, &status, WNOHANG);
+
+            if (r == pid || (r < 0 && errno == ECHILD))
+            {
+                exited = true;
+                if (r < 0)
+                    status = -1;
+                last_data = exited_at = now_ms();
+            }
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    if (!exited)
+    {
+        kill(-pid, SIGKILL);
+        while (waitpid(pid, &status, 0) < 0)
+        {
+            if (errno != EINTR)
+            {
+                status = -1;
+                break;
+            }
+        }
+    }
+    RunningGroup = 0;
+    if (opts->forward_out || opts->forward_err)
+        (void) flush_output();
+
+    if (status == -1)
+        result->status = -1;
+    else if (WIFEXITED(status))
+        result->status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        result->status = 128 + WTERMSIG(status);
+    return STATUS_OK;
+}
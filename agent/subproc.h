@@ -0,0 +1,65 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * subproc.h
+ *		Running shell commands on behalf of a request.
+ *
+ * A command runs under /bin/sh in a process group of its own, with stdin
+ * on /dev/null and stdout and stderr on pipes that are read together as
+ * data arrives, so neither stream can fill up and stall the other.  The
+ * output can be kept, sent on to the client as it comes, or both.  After
+ * the soft timeout the whole group gets SIGTERM, after the hard timeout
+ * SIGKILL.
+ *-------------------------------------------------------------------------
+ */
+#ifndef SUBPROC_H
+#define SUBPROC_H
+
+#include <stdbool.h>
+#include "stringinfo.h"
+
+/* time a command gets by default, in seconds; DEBO_COMMAND_TIMEOUT */
+#define DEFAULT_COMMAND_TIMEOUT		600
+
+/* between the soft and the hard timeout of a command run with defaults */
+#define SUBPROC_KILL_GRACE_MS		10000
+
+typedef struct SubprocOptions
+{
+    int			soft_timeout_ms;	/* SIGTERM the group, 0 = never */
+    int			hard_timeout_ms;	/* SIGKILL the group, 0 = never */
+    bool		forward_out;	/* send stdout to the client as it arrives */
+    bool		forward_err;	/* send stderr to the client as it arrives */
+    StringInfo	out;			/* append stdout here, if set */
+    StringInfo	err;			/* append stderr here, if set */
+} SubprocOptions;
+
+typedef struct SubprocResult
+{
+    int			status;			/* exit code, 128 + signal if killed, -1 if unknown */
+    bool		timed_out;		/* a timeout sent the group a signal */
+} SubprocResult;
+
+extern int	CommandTimeout;
+
+extern void SubprocDefaultOptions(SubprocOptions *opts);
+extern int	RunSubprocess(const char *command, const SubprocOptions *opts,
+                          SubprocResult *result);
+extern void SubprocessKillRunning(int signo);
+
+#endif							/* SUBPROC_H */
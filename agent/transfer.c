@@ -0,0 +1,550 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * transfer.c
+ *		Moving files over the client connection.
+ *
+ * The request is answered in the process or thread that read it, which
+ * keeps reading and writing the connection itself until the transfer is
+ * over: blocks and acknowledgements go back and forth without the
+ * request/response turn of ordinary requests, so the link stays busy as
+ * long as the window allows.  Blocks are read straight into the message
+ * that carries them and written out straight from the message they came
+ * in, and download blocks are compressed like any other response message
+ * when the client asked for compression.
+ *
+ * Only verified data is ever written to a part file, so whatever a part
+ * file holds can be resumed from, provided it still belongs to the same
+ * source: the mtime it is given on the way out says it should, and the
+ * CRC-32C of the part, checked against that of the source, that it does.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "transfer.h"
+#include "crc32c.h"
+#include "format.h"
+#include "protocol.h"
+#include "utiles.h"
+
+#define PART_SUFFIX				".debo-part"
+
+/* the largest acknowledgement or stop message */
+#define TRANSFER_SMALL_MESSAGE	64
+
+typedef struct Transfer
+{
+    ClientSocket *client;
+    int			fd;
+    int64		size;
+    int64		mtime;			/* of the source, ns since the epoch */
+    int			block;			/* agreed block size */
+    int			window;			/* agreed window, in blocks */
+    StringInfoData msg;			/* reused for every message */
+} Transfer;
+
+static int64
+mtime_ns(const struct stat *st)
+{
+    return (int64) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/*
+ * Give the part file the mtime of its source, which is what lets a later
+ * transfer resume from it.
+ */
+static void
+mark_part(int fd, int64 mtime)
+{
+    struct timespec times[2];
+
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = mtime / 1000000000;
+    times[1].tv_nsec = mtime % 1000000000;
+    (void) futimens(fd, times);
+}
+
+static int
+settle(int wanted, int deflt, int max)
+{
+    if (wanted <= 0)
+        return deflt;
+    return wanted < max ? wanted : max;
+}
+
+/* acknowledge at least this often, so the window never runs dry */
+static int
+ack_interval(const Transfer *xfer)
+{
+    return xfer->window > 1 ? xfer->window / 2 : 1;
+}
+
+/*
+ * Refuse a request before the transfer has started.
+ */
+static bool
+refuse(const char *format,...)
+{
+    char		message[PATH_MAX + 128];
+    va_list		args;
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    set_response_status(RESP_ERROR);
+    FPRINTF(global_client_socket, "%s", message);
+    return true;
+}
+
+static void
+send_ack(Transfer *xfer, int64 offset)
+{
+    beginmessage_reuse(&xfer->msg, RespMsg_File_Ack);
+    sendint64(&xfer->msg, (uint64) offset);
+    endmessage_more(&xfer->msg);
+    (void) flush();
+}
+
+static void
+send_stop_block(Transfer *xfer)
+{
+    beginmessage_reuse(&xfer->msg, RespMsg_File_Block);
+    sendint64(&xfer->msg, (uint64) FILE_OFFSET_STOP);
+    sendint32(&xfer->msg, 0);
+    endmessage_more(&xfer->msg);
+    (void) flush();
+}
+
+/*
+ * Read the next message of the transfer.  Returns its type, or EOF if the
+ * client has gone away.
+ */
+static int
+read_transfer_message(Transfer *xfer, int maxlen)
+{
+    int			type = getbyte(xfer->client);
+
+    if (type == EOF || getmessage(&xfer->msg, xfer->client, maxlen) == EOF)
+        return EOF;
+    return type;
+}
+
+/*
+ * Discard what the client still had in flight until it answers our stop
+ * with its own.  Returns false if the client went away first.
+ */
+static bool
+await_stop(Transfer *xfer, int type_wanted, int maxlen)
+{
+    for (;;)
+    {
+        int			type = read_transfer_message(xfer, maxlen);
+
+        if (type == EOF)
+            return false;
+        if (type == type_wanted && xfer->msg.len >= 8 &&
+            (int64) getmsgint64(&xfer->msg) == FILE_OFFSET_STOP)
+            return true;
+    }
+}
+
+/*
+ * Write all of len bytes.  Returns 0, or -1 with errno set.
+ */
+static int
+write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t		n = write(fd, data, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * receive_file -- CliMsg_File_Put: take a file from the client
+ */
+static bool
+receive_file(StringInfo params)
+{
+    Transfer	xfer;
+    const char *path;
+    char		part[PATH_MAX];
+    struct stat st;
+    int64		offset = 0;
+    uint32		part_crc = 0;
+    int			mode;
+    int			since_ack = 0;
+    int			maxlen;
+    bool		first = true;
+    const char *failure = NULL;
+
+    path = params->data;
+    if (memchr(params->data, '\0', params->len) == NULL)
+        return refuse("malformed upload request\n");
+    params->cursor = strlen(path) + 1;
+    if (params->len - params->cursor < 28)
+        return refuse("malformed upload request\n");
+    if (path[0] != '/')
+        return refuse("destination must be an absolute path: %s\n", path);
+    if (snprintf(part, sizeof(part), "%s" PART_SUFFIX, path) >= (int) sizeof(part))
+        return refuse("destination path too long: %s\n", path);
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.client = global_client_socket;
+    xfer.size = (int64) getmsgint64(params);
+    xfer.mtime = (int64) getmsgint64(params);
+    mode = getmsgint(params, 4);
+    xfer.block = settle(getmsgint(params, 4), DEFAULT_TRANSFER_BLOCK, MAX_TRANSFER_BLOCK);
+    xfer.window = settle(getmsgint(params, 4), DEFAULT_TRANSFER_WINDOW, MAX_TRANSFER_WINDOW);
+    if (xfer.size < 0)
+        return refuse("malformed upload request\n");
+
+    /* read as well, for the checksum of what it holds */
+    xfer.fd = open(part, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (xfer.fd < 0)
+        return refuse("could not open %s: %s\n", part, strerror(errno));
+    if (fstat(xfer.fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(xfer.fd);
+        return refuse("not a regular file: %s\n", part);
+    }
+
+    /*
+     * A part as long as the file would leave the client no block to start
+     * over with if it does not match, so it is sent again.
+     */
+    if (st.st_size < xfer.size && mtime_ns(&st) == xfer.mtime &&
+        crc32c_file(xfer.fd, st.st_size, &part_crc) == 0)
+        offset = st.st_size;
+    else
+        part_crc = 0;
+    if (ftruncate(xfer.fd, offset) < 0 || lseek(xfer.fd, offset, SEEK_SET) < 0)
+    {
+        int			save_errno = errno;
+
+        close(xfer.fd);
+        return refuse("could not prepare %s: %s\n", part, strerror(save_errno));
+    }
+
+    initStringInfo(&xfer.msg);
+    beginmessage_reuse(&xfer.msg, RespMsg_File_Start);
+    sendint64(&xfer.msg, (uint64) offset);
+    sendint32(&xfer.msg, (uint32) xfer.block);
+    sendint32(&xfer.msg, (uint32) xfer.window);
+    sendint32(&xfer.msg, part_crc);
+    endmessage_more(&xfer.msg);
+    (void) flush();
+
+    maxlen = 4 + FILE_BLOCK_HEADER + xfer.block;
+    while (offset < xfer.size)
+    {
+        int			type = read_transfer_message(&xfer, maxlen);
+        int64		block_offset;
+        uint32		crc;
+        const char *data;
+        int			len;
+
+        if (type == EOF)
+        {
+            mark_part(xfer.fd, xfer.mtime);
+            close(xfer.fd);
+            free(xfer.msg.data);
+            return false;
+        }
+        if (type != CliMsg_File_Block || xfer.msg.len < FILE_BLOCK_HEADER)
+        {
+            failure = "unexpected message during upload";
+            break;
+        }
+        block_offset = (int64) getmsgint64(&xfer.msg);
+        crc = getmsgint(&xfer.msg, 4);
+        data = xfer.msg.data + xfer.msg.cursor;
+        len = xfer.msg.len - xfer.msg.cursor;
+
+        if (block_offset == FILE_OFFSET_STOP)
+        {
+            /* the client gave up; it discards our acks up to this one */
+            send_ack(&xfer, FILE_OFFSET_STOP);
+            mark_part(xfer.fd, xfer.mtime);
+            close(xfer.fd);
+            free(xfer.msg.data);
+            set_response_status(RESP_ERROR);
+            FPRINTF(global_client_socket, "upload stopped by the client at %lld bytes\n",
+                    (long long) offset);
+            return true;
+        }
+        if (first && block_offset == 0 && offset > 0)
+        {
+            /* the client's file does not match the part: start over */
+            if (ftruncate(xfer.fd, 0) < 0 || lseek(xfer.fd, 0, SEEK_SET) < 0)
+            {
+                failure = strerror(errno);
+                offset = 0;
+                break;
+            }
+            offset = 0;
+        }
+        first = false;
+        if (block_offset != offset || len == 0 || len > xfer.size - offset)
+        {
+            failure = "block out of order";
+            break;
+        }
+        if (crc32c(data, len) != crc)
+        {
+            failure = "block checksum mismatch";
+            break;
+        }
+        if (write_all(xfer.fd, data, len) < 0)
+        {
+            failure = strerror(errno);
+            break;
+        }
+        offset += len;
+
+        if (++since_ack >= ack_interval(&xfer) && offset < xfer.size)
+        {
+            mark_part(xfer.fd, xfer.mtime);
+            send_ack(&xfer, offset);
+            since_ack = 0;
+        }
+    }
+
+    if (failure != NULL)
+    {
+        /* keep what was verified, and have the client stop sending */
+        if (ftruncate(xfer.fd, offset) == 0)
+            mark_part(xfer.fd, xfer.mtime);
+        close(xfer.fd);
+        send_ack(&xfer, FILE_OFFSET_STOP);
+        if (!await_stop(&xfer, CliMsg_File_Block, maxlen))
+        {
+            free(xfer.msg.data);
+            return false;
+        }
+        free(xfer.msg.data);
+        set_response_status(RESP_ERROR);
+        FPRINTF(global_client_socket, "upload to %s failed at %lld bytes: %s\n",
+                path, (long long) offset, failure);
+        return true;
+    }
+    free(xfer.msg.data);
+
+    /* in place only once it is all on disk, with the source's mode and mtime */
+    if (fsync(xfer.fd) < 0 || fchmod(xfer.fd, mode & 07777) < 0)
+        failure = strerror(errno);
+    mark_part(xfer.fd, xfer.mtime);
+    close(xfer.fd);
+    if (failure == NULL && rename(part, path) < 0)
+        failure = strerror(errno);
+    if (failure != NULL)
+    {
+        set_response_status(RESP_ERROR);
+        FPRINTF(global_client_socket, "could not put %s in place: %s\n", path, failure);
+    }
+    return true;
+}
+
+/*
+ * send_file -- CliMsg_File_Get: hand a file to the client
+ */
+static bool
+send_file(StringInfo params)
+{
+    Transfer	xfer;
+    const char *path;
+    struct stat st;
+    int64		have;
+    int64		have_mtime;
+    uint32		have_crc;
+    uint32		crc;
+    int64		sent;
+    int64		acked;
+    const char *failure = NULL;
+
+    path = params->data;
+    if (memchr(params->data, '\0', params->len) == NULL)
+        return refuse("malformed download request\n");
+    params->cursor = strlen(path) + 1;
+    if (params->len - params->cursor < 28)
+        return refuse("malformed download request\n");
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.client = global_client_socket;
+    have = (int64) getmsgint64(params);
+    have_mtime = (int64) getmsgint64(params);
+    have_crc = getmsgint(params, 4);
+    xfer.block = settle(getmsgint(params, 4), DEFAULT_TRANSFER_BLOCK, MAX_TRANSFER_BLOCK);
+    xfer.window = settle(getmsgint(params, 4), DEFAULT_TRANSFER_WINDOW, MAX_TRANSFER_WINDOW);
+
+    xfer.fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (xfer.fd < 0)
+        return refuse("could not open %s: %s\n", path, strerror(errno));
+    if (fstat(xfer.fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(xfer.fd);
+        return refuse("not a regular file: %s\n", path);
+    }
+    xfer.size = st.st_size;
+    xfer.mtime = mtime_ns(&st);
+    sent = acked = (have >= 0 && have <= xfer.size && have_mtime == xfer.mtime &&
+                    crc32c_file(xfer.fd, have, &crc) == 0 && crc == have_crc) ? have : 0;
+
+    initStringInfo(&xfer.msg);
+    beginmessage_reuse(&xfer.msg, RespMsg_File_Start);
+    sendint64(&xfer.msg, (uint64) sent);
+    sendint32(&xfer.msg, (uint32) xfer.block);
+    sendint32(&xfer.msg, (uint32) xfer.window);
+    sendint64(&xfer.msg, (uint64) xfer.size);
+    sendint64(&xfer.msg, (uint64) xfer.mtime);
+    sendint32(&xfer.msg, (uint32) (st.st_mode & 07777));
+    endmessage_more(&xfer.msg);
+
+    while (acked < xfer.size)
+    {
+        int			type;
+        int64		offset;
+
+        /* fill the window, then wait for the client to make room */
+        while (sent < xfer.size && sent - acked < (int64) xfer.window * xfer.block)
+        {
+            int			want = xfer.size - sent < xfer.block ? (int) (xfer.size - sent) : xfer.block;
+            char	   *data;
+            ssize_t		n;
+            uint32		crc;
+
+            beginmessage_reuse(&xfer.msg, RespMsg_File_Block);
+            sendint64(&xfer.msg, (uint64) sent);
+            sendint32(&xfer.msg, 0);
+            enlargeStringInfo(&xfer.msg, want);
+            data = xfer.msg.data + xfer.msg.len;
+            do
+                n = pread(xfer.fd, data, want, sent);
+            while (n < 0 && errno == EINTR);
+            if (n <= 0)
+            {
+                failure = n < 0 ? strerror(errno) : "file shrank while being sent";
+                break;
+            }
+            crc = hton32(crc32c(data, n));
+            memcpy(xfer.msg.data + xfer.msg.len - 4, &crc, 4);
+            xfer.msg.len += n;
+            endmessage_compressed(&xfer.msg);
+            sent += n;
+        }
+        if (failure != NULL)
+            break;
+        if (flush() != 0)
+        {
+            close(xfer.fd);
+            free(xfer.msg.data);
+            return false;
+        }
+
+        type = read_transfer_message(&xfer, TRANSFER_SMALL_MESSAGE);
+        if (type == EOF)
+        {
+            close(xfer.fd);
+            free(xfer.msg.data);
+            return false;
+        }
+        if (type != CliMsg_File_Ack || xfer.msg.len < 8)
+        {
+            failure = "unexpected message during download";
+            break;
+        }
+        offset = (int64) getmsgint64(&xfer.msg);
+        if (offset == FILE_OFFSET_STOP)
+        {
+            /* the client gave up; it discards our blocks up to this one */
+            send_stop_block(&xfer);
+            close(xfer.fd);
+            free(xfer.msg.data);
+            set_response_status(RESP_ERROR);
+            FPRINTF(global_client_socket, "download stopped by the client at %lld bytes\n",
+                    (long long) acked);
+            return true;
+        }
+        if (offset < acked || offset > sent)
+        {
+            failure = "acknowledgement out of range";
+            break;
+        }
+        acked = offset;
+    }
+
+    if (failure == NULL && (fstat(xfer.fd, &st) < 0 || mtime_ns(&st) != xfer.mtime))
+        failure = "file changed while being sent";
+    close(xfer.fd);
+
+    if (failure != NULL)
+    {
+        send_stop_block(&xfer);
+        if (!await_stop(&xfer, CliMsg_File_Ack, TRANSFER_SMALL_MESSAGE))
+        {
+            free(xfer.msg.data);
+            return false;
+        }
+        set_response_status(RESP_ERROR);
+        FPRINTF(global_client_socket, "download of %s failed at %lld bytes: %s\n",
+                path, (long long) acked, failure);
+    }
+    free(xfer.msg.data);
+    return true;
+}
+
+/*
+ * FileTransferCommand -- run an upload or a download request
+ *
+ * Returns false if the client went away in the middle of it.
+ */
+bool
+FileTransferCommand(ClientSocket *client_socket, int action_code,
+                    StringInfo param_buffer)
+{
+    global_client_socket = client_socket;
+
+    /* session and job workers do not talk to the client themselves */
+    if (secure_output_redirected())
+    {
+        set_response_status(RESP_UNSUPPORTED);
+        return refuse("file transfers cannot run in a session or job\n");
+    }
+
+    if (action_code == CliMsg_File_Put)
+        return receive_file(param_buffer);
+    return send_file(param_buffer);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * transfer.h
+ *		Moving files over the client connection.
+ *
+ * CliMsg_File_Put uploads a file to the agent's host and CliMsg_File_Get
+ * downloads one from it, over the authenticated connection the request
+ * came in on.  The file goes in checksummed blocks under a window of
+ * unacknowledged data, and an interrupted transfer resumes where it
+ * stopped; protocol.h describes the exchange.
+ *-------------------------------------------------------------------------
+ */
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdbool.h>
+#include "connutil.h"
+#include "stringinfo.h"
+
+/* block size and window used when the client leaves them to the agent */
+#define DEFAULT_TRANSFER_BLOCK	(256 * 1024)
+#define DEFAULT_TRANSFER_WINDOW	8
+
+/* the most the agent agrees to */
+#define MAX_TRANSFER_BLOCK		(1024 * 1024)
+#define MAX_TRANSFER_WINDOW		64
+
+extern bool FileTransferCommand(ClientSocket *client_socket, int action_code,
+                                StringInfo param_buffer);
+
+#endif							/* TRANSFER_H */
@@ -0,0 +1,629 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * upgrade.c
+ *		Hot upgrade of the agent binary.
+ *
+ * Everything the new master needs is passed as inherited descriptors
+ * named in the environment:
+ *
+ *	DEBO_LISTEN_FDS			comma separated listen sockets; in acceptor
+ *							mode one ';' separated set per acceptor
+ *	DEBO_SHM_<NAME>			memfd backing a shared segment, e.g. the
+ *							child registry; it starts with a magic and
+ *							the owner's layout version, and a segment
+ *							that does not match is not taken over
+ *	DEBO_UPGRADE_READY_FD	pipe the new master writes one byte to once
+ *							it is ready to accept
+ *	DEBO_UPGRADE_FROM		pid of the previous master
+ *	DEBO_UPGRADE_GENERATION	number of upgrades so far
+ *
+ * The new master is started through an intermediate process that exits
+ * right away, so it is not a child of the old master, which would
+ * otherwise wait for it when shutting down.  If the new binary fails to
+ * start, the ready pipe reports EOF and the old master simply carries on.
+ *
+ * Children of the old master cannot be handed over; they finish their
+ * current commands and are reaped by the old master.  Because the child
+ * registry is shared with the new master, the per-class caps still count
+ * them while they run.
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "upgrade.h"
+
+#define STATUS_OK				(0)
+#define STATUS_ERROR			(-1)
+
+#define MAX_UPGRADE_SEGMENTS	8
+#define MAX_UPGRADE_SOCKETS		1024
+
+/* "DEBO" at the start of every segment the agent hands over */
+#define UPGRADE_SEGMENT_MAGIC	0x4445424f
+
+extern volatile sig_atomic_t shutdown_requested;
+
+volatile sig_atomic_t upgrade_requested = 0;
+
+/*
+ * Header at the start of each shared segment.  A new binary only takes a
+ * segment over if the magic, the owner's layout version and the size all
+ * match; otherwise it starts with an empty one.  Padded so the caller's
+ * data stays suitably aligned.
+ */
+typedef union UpgradeSegmentHeader
+{
+    struct
+    {
+        uint32_t	magic;
+        uint32_t	layout_version;
+        uint64_t	size;
+    }			h;
+    char		pad[64];
+} UpgradeSegmentHeader;
+
+typedef struct UpgradeSegment
+{
+    const char *name;
+    int			fd;
+} UpgradeSegment;
+
+static UpgradeSegment UpgradeSegments[MAX_UPGRADE_SEGMENTS];
+static int	NumUpgradeSegments = 0;
+
+/*
+ * Sockets to hand over, and the set each belongs to.  Every acceptor has
+ * a set of its own; in the other modes everything is set 0.
+ */
+static int	UpgradeSockets[MAX_UPGRADE_SOCKETS];
+static int	UpgradeSocketSets[MAX_UPGRADE_SOCKETS];
+static int	NumUpgradeSockets = 0;
+
+/* sockets we took over, and the set the previous master had them in */
+static int	InheritedSockets[MAX_UPGRADE_SOCKETS];
+static int	InheritedSocketSets[MAX_UPGRADE_SOCKETS];
+static int	NumInheritedSockets = 0;
+
+static char UpgradeBinary[PATH_MAX];
+static pid_t UpgradeMasterPid = 0;
+static pid_t UpgradePreviousPid = 0;
+static int	UpgradeGeneration = 0;
+static int	UpgradeInheritedSockets = 0;
+static int	UpgradeInheritedSegments = 0;
+static int	UpgradeFailed = 0;
+static bool HandedOver = false;
+
+static void
+handle_sigusr2(int signo)
+{
+    (void) signo;
+    upgrade_requested = 1;
+}
+
+static int
+env_fd(const char *name)
+{
+    const char *val = getenv(name);
+    char	   *endptr;
+    long		fd;
+
+    if (val == NULL)
+        return -1;
+    fd = strtol(val, &endptr, 10);
+    if (endptr == val || *endptr != '\0' || fd < 0 || fd > INT_MAX)
+        return -1;
+    return (int) fd;
+}
+
+/*
+ * UpgradeSharedMemory -- map a segment that survives a hot upgrade
+ *
+ * If the previous master passed a segment of this name, size and layout
+ * version, map that one and set *inherited; the caller must then leave
+ * its contents alone.  Otherwise create a new zeroed segment.  The owner
+ * bumps version whenever the layout of its segment changes.  Must be
+ * called before the first fork.  Returns NULL on failure.
+ */
+void *
+UpgradeSharedMemory(const char *name, size_t size, uint32_t version, bool *inherited)
+{
+    UpgradeSegmentHeader *hdr;
+    size_t		total = sizeof(UpgradeSegmentHeader) + size;
+    char		envname[64];
+    struct stat st;
+    void	   *ptr;
+    int			fd;
+
+    *inherited = false;
+    snprintf(envname, sizeof(envname), "DEBO_SHM_%s", name);
+    fd = env_fd(envname);
+    unsetenv(envname);
+    if (fd >= 0)
+    {
+        UpgradeSegmentHeader old;
+
+        if (fstat(fd, &st) == 0 && (size_t) st.st_size == total &&
+            pread(fd, &old, sizeof(old), 0) == sizeof(old) &&
+            old.h.magic == UPGRADE_SEGMENT_MAGIC &&
+            old.h.layout_version == version &&
+            old.h.size == size)
+            *inherited = true;
+        else
+        {
+            /* the layout changed between the two binaries */
+            fprintf(stderr, "not inheriting shared segment %s of a different layout\n", name);
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd < 0)
+    {
+        fd = memfd_create(name, MFD_CLOEXEC);
+        if (fd >= 0 && ftruncate(fd, total) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    else
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if (fd < 0)
+    {
+        /* still works, it just cannot be handed over */
+        ptr = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+    else
+    {
+        ptr = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED && NumUpgradeSegments < MAX_UPGRADE_SEGMENTS)
+        {
+            UpgradeSegments[NumUpgradeSegments].name = name;
+            UpgradeSegments[NumUpgradeSegments].fd = fd;
+            NumUpgradeSegments++;
+        }
+        if (*inherited)
+            UpgradeInheritedSegments++;
+    }
+    if (ptr == MAP_FAILED)
+    {
+        *inherited = false;
+        return NULL;
+    }
+
+    hdr = (UpgradeSegmentHeader *) ptr;
+    if (!*inherited)
+    {
+        hdr->h.magic = UPGRADE_SEGMENT_MAGIC;
+        hdr->h.layout_version = version;
+        hdr->h.size = size;
+    }
+    return (char *) ptr + sizeof(UpgradeSegmentHeader);
+}
+
+/*
+ * UpgradeInheritSockets -- take over the listen sockets of the previous
+ * master, if we were started by a hot upgrade
+ *
+ * DEBO_LISTEN_FDS separates the sets with ';'.  All sockets are returned
+ * in sockets[]; UpgradeInheritedSocketSet() tells which set each was in.
+ * Returns STATUS_OK if at least one socket was inherited.
+ */
+int
+UpgradeInheritSockets(int *sockets, int *nsockets, int maxlisten)
+{
+    const char *val = getenv("DEBO_LISTEN_FDS");
+    char	   *list;
+    char	   *set;
+    char	   *tok;
+    char	   *setsave;
+    char	   *saveptr;
+    int			setno = 0;
+
+    if (val == NULL)
+        return STATUS_ERROR;
+
+    list = strdup(val);
+    for (set = strtok_r(list, ";", &setsave); set != NULL;
+         set = strtok_r(NULL, ";", &setsave), setno++)
+    {
+        for (tok = strtok_r(set, ",", &saveptr); tok != NULL;
+             tok = strtok_r(NULL, ",", &saveptr))
+        {
+            int			fd = atoi(tok);
+            int			listening = 0;
+            socklen_t	len = sizeof(listening);
+
+            if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening)
+            {
+                fprintf(stderr, "inherited descriptor %d is not a listen socket\n", fd);
+                continue;
+            }
+            if (*nsockets >= maxlisten || NumInheritedSockets >= MAX_UPGRADE_SOCKETS)
+            {
+                /* closing it would reset whatever is queued on it */
+                fprintf(stderr, "too many inherited listen sockets, leaving %d unwatched\n", fd);
+                continue;
+            }
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            sockets[(*nsockets)++] = fd;
+            InheritedSockets[NumInheritedSockets] = fd;
+            InheritedSocketSets[NumInheritedSockets] = setno;
+            NumInheritedSockets++;
+            UpgradeInheritedSockets++;
+        }
+    }
+    free(list);
+    unsetenv("DEBO_LISTEN_FDS");
+
+    return UpgradeInheritedSockets > 0 ? STATUS_OK : STATUS_ERROR;
+}
+
+/*
+ * UpgradeInheritedSocketSet -- the set an inherited socket was in, or -1
+ * if fd was not inherited
+ */
+int
+UpgradeInheritedSocketSet(int fd)
+{
+    int			i;
+
+    for (i = 0; i < NumInheritedSockets; i++)
+    {
+        if (InheritedSockets[i] == fd)
+            return InheritedSocketSets[i];
+    }
+    return -1;
+}
+
+/*
+ * UpgradeSetSocketSet -- replace the sockets handed over as set number
+ * setno
+ *
+ * Acceptor mode calls this for every acceptor, so that a new master gets
+ * all their sockets, and with them whatever is queued on them.
+ */
+void
+UpgradeSetSocketSet(int setno, const int *sockets, int nsockets)
+{
+    int			i,
+                n = 0;
+
+    for (i = 0; i < NumUpgradeSockets; i++)
+    {
+        if (UpgradeSocketSets[i] == setno)
+            continue;
+        UpgradeSockets[n] = UpgradeSockets[i];
+        UpgradeSocketSets[n] = UpgradeSocketSets[i];
+        n++;
+    }
+    for (i = 0; i < nsockets && n < MAX_UPGRADE_SOCKETS; i++, n++)
+    {
+        UpgradeSockets[n] = sockets[i];
+        UpgradeSocketSets[n] = setno;
+    }
+    NumUpgradeSockets = n;
+}
+
+/*
+ * UpgradeInit -- get ready to be upgraded, and finish our own upgrade
+ *
+ * Called by the master once it is ready to accept connections.  If a
+ * previous master started us, tell it that it can stop now.
+ */
+void
+UpgradeInit(int *sockets, int nsockets)
+{
+    struct sigaction sa;
+    const char *val;
+    ssize_t		len;
+    int			fd;
+
+    UpgradeMasterPid = getpid();
+    NumUpgradeSockets = 0;
+    UpgradeSetSocketSet(0, sockets, nsockets);
+
+    /*
+     * Remember where our binary lives.  After a package upgrade the path
+     * names the new binary, which is exactly what we want to run next.
+     */
+    val = getenv("DEBO_UPGRADE_BINARY");
+    if (val != NULL)
+        snprintf(UpgradeBinary, sizeof(UpgradeBinary), "%s", val);
+    else if ((len = readlink("/proc/self/exe", UpgradeBinary, sizeof(UpgradeBinary) - 1)) > 0)
+    {
+        UpgradeBinary[len] = '\0';
+        if (len > 10 && strcmp(UpgradeBinary + len - 10, " (deleted)") == 0)
+            UpgradeBinary[len - 10] = '\0';
+    }
+
+    if ((val = getenv("DEBO_UPGRADE_FROM")) != NULL)
+        UpgradePreviousPid = atoi(val);
+    if ((val = getenv("DEBO_UPGRADE_GENERATION")) != NULL)
+        UpgradeGeneration = atoi(val);
+    fd = env_fd("DEBO_UPGRADE_READY_FD");
+    if (fd >= 0)
+    {
+        fprintf(stderr, "took over %d listen sockets from agent %d\n",
+                UpgradeInheritedSockets, (int) UpgradePreviousPid);
+        if (write(fd, "R", 1) != 1)
+            fprintf(stderr, "could not notify the previous agent: %m\n");
+        close(fd);
+    }
+    unsetenv("DEBO_UPGRADE_READY_FD");
+    unsetenv("DEBO_UPGRADE_FROM");
+    unsetenv("DEBO_UPGRADE_GENERATION");
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigusr2;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);
+}
+
+/*
+ * Append "name=value" to env.
+ */
+static void
+env_append(char **env, int *n, const char *name, const char *value)
+{
+    StringInfoData buf;
+
+    initStringInfo(&buf);
+    appendStringInfo(&buf, "%s=%s", name, value);
+    env[(*n)++] = buf.data;
+}
+
+/*
+ * Build the environment of the new master: ours, minus whatever a
+ * previous upgrade left behind, plus the descriptors we hand over.
+ *
+ * This runs before fork(), since the event engine master has threads and
+ * the child may only call async-signal-safe functions until it execs.
+ */
+static char **
+build_upgrade_environ(int ready_fd)
+{
+    extern char **environ;
+    StringInfoData fds;
+    char		envname[64];
+    char		val[32];
+    char	  **env;
+    int			nenv = 0;
+    int			n = 0;
+    int			setno;
+    int			maxset = 0;
+    int			i;
+
+    while (environ[nenv] != NULL)
+        nenv++;
+    env = malloc((nenv + NumUpgradeSegments + 5) * sizeof(char *));
+    if (env == NULL)
+        return NULL;
+
+    for (i = 0; i < nenv; i++)
+    {
+        if (strncmp(environ[i], "DEBO_LISTEN_FDS=", 16) == 0 ||
+            strncmp(environ[i], "DEBO_SHM_", 9) == 0 ||
+            strncmp(environ[i], "DEBO_UPGRADE_READY_FD=", 22) == 0 ||
+            strncmp(environ[i], "DEBO_UPGRADE_FROM=", 18) == 0 ||
+            strncmp(environ[i], "DEBO_UPGRADE_GENERATION=", 24) == 0)
+            continue;
+        env[n++] = strdup(environ[i]);
+    }
+
+    /* sets in order, separated by ';' */
+    initStringInfo(&fds);
+    for (i = 0; i < NumUpgradeSockets; i++)
+        maxset = UpgradeSocketSets[i] > maxset ? UpgradeSocketSets[i] : maxset;
+    for (setno = 0; setno <= maxset; setno++)
+    {
+        bool		first = true;
+
+        if (setno > 0)
+            appendStringInfoChar(&fds, ';');
+        for (i = 0; i < NumUpgradeSockets; i++)
+        {
+            if (UpgradeSocketSets[i] != setno)
+                continue;
+            appendStringInfo(&fds, "%s%d", first ? "" : ",", UpgradeSockets[i]);
+            first = false;
+        }
+    }
+    env_append(env, &n, "DEBO_LISTEN_FDS", fds.data);
+    free(fds.data);
+
+    for (i = 0; i < NumUpgradeSegments; i++)
+    {
+        snprintf(envname, sizeof(envname), "DEBO_SHM_%s", UpgradeSegments[i].name);
+        snprintf(val, sizeof(val), "%d", UpgradeSegments[i].fd);
+        env_append(env, &n, envname, val);
+    }
+
+    snprintf(val, sizeof(val), "%d", ready_fd);
+    env_append(env, &n, "DEBO_UPGRADE_READY_FD", val);
+    snprintf(val, sizeof(val), "%d", (int) UpgradeMasterPid);
+    env_append(env, &n, "DEBO_UPGRADE_FROM", val);
+    snprintf(val, sizeof(val), "%d", UpgradeGeneration + 1);
+    env_append(env, &n, "DEBO_UPGRADE_GENERATION", val);
+    env[n] = NULL;
+    return env;
+}
+
+static void
+free_upgrade_environ(char **env)
+{
+    int			i;
+
+    for (i = 0; env[i] != NULL; i++)
+        free(env[i]);
+    free(env);
+}
+
+/*
+ * Body of the process that becomes the new master.  Never returns.
+ */
+static void
+exec_new_master(char **env)
+{
+    sigset_t	none;
+    int			i;
+
+    /* the exec'd image must not start with our blocked signals */
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+
+    for (i = 0; i < NumUpgradeSockets; i++)
+        fcntl(UpgradeSockets[i], F_SETFD, 0);
+    for (i = 0; i < NumUpgradeSegments; i++)
+        fcntl(UpgradeSegments[i].fd, F_SETFD, 0);
+
+    execve(UpgradeBinary, (char *[]) {UpgradeBinary, NULL}, env);
+    _exit(127);
+}
+
+/*
+ * AgentUpgrade -- start the new binary and hand everything over to it
+ *
+ * Called from the master's main loop after SIGUSR2.  On success
+ * shutdown_requested is set, and the caller's normal shutdown path lets
+ * the remaining children finish.  Returns false if the old binary has to
+ * keep serving.
+ */
+bool
+AgentUpgrade(void)
+{
+    struct pollfd pfd;
+    char	  **env;
+    int			pipefd[2];
+    pid_t		pid;
+    char		byte;
+    int			rc;
+
+    upgrade_requested = 0;
+    if (getpid() != UpgradeMasterPid || HandedOver)
+        return false;
+    if (UpgradeBinary[0] == '\0')
+    {
+        fprintf(stderr, "cannot upgrade: agent binary location unknown\n");
+        UpgradeFailed++;
+        return false;
+    }
+
+    fprintf(stderr, "upgrading agent to \"%s\"\n", UpgradeBinary);
+    if (pipe(pipefd) < 0)
+    {
+        fprintf(stderr, "cannot upgrade: could not create pipe: %m\n");
+        UpgradeFailed++;
+        return false;
+    }
+    env = build_upgrade_environ(pipefd[1]);
+    if (env == NULL)
+    {
+        fprintf(stderr, "cannot upgrade: out of memory\n");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        UpgradeFailed++;
+        return false;
+    }
+
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0)
+    {
+        pid_t		grandchild;
+
+        close(pipefd[0]);
+        grandchild = fork();
+        if (grandchild == 0)
+            exec_new_master(env);
+        _exit(grandchild < 0 ? 1 : 0);
+    }
+    close(pipefd[1]);
+    free_upgrade_environ(env);
+    if (pid < 0)
+    {
+        fprintf(stderr, "cannot upgrade: could not fork: %m\n");
+        close(pipefd[0]);
+        UpgradeFailed++;
+        return false;
+    }
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+
+    /* wait for the new master to say it is up, or for its pipe end to close */
+    pfd.fd = pipefd[0];
+    pfd.events = POLLIN;
+    do
+        rc = poll(&pfd, 1, UPGRADE_READY_TIMEOUT_MS);
+    while (rc < 0 && errno == EINTR);
+    rc = (rc > 0 && read(pipefd[0], &byte, 1) == 1);
+    close(pipefd[0]);
+
+    if (!rc)
+    {
+        fprintf(stderr, "new agent did not start, staying on the current binary\n");
+        UpgradeFailed++;
+        return false;
+    }
+
+    fprintf(stderr, "new agent is accepting connections, finishing current work\n");
+    HandedOver = true;
+    shutdown_requested = 1;
+    return true;
+}
+
+/*
+ * UpgradeHandedOver -- true once a new master has taken over
+ */
+bool
+UpgradeHandedOver(void)
+{
+    return HandedOver;
+}
+
+/*
+ * UpgradeStats -- append upgrade state to buf
+ */
+void
+UpgradeStats(StringInfo buf)
+{
+    appendStringInfo(buf, "upgrade: generation=%d previous_pid=%d inherited_sockets=%d "
+                     "inherited_segments=%d failed=%d binary=%s\n",
+                     UpgradeGeneration, (int) UpgradePreviousPid,
+                     UpgradeInheritedSockets, UpgradeInheritedSegments,
+                     UpgradeFailed, UpgradeBinary);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * upgrade.h
+ *		Hot upgrade of the agent binary.
+ *
+ * On SIGUSR2 (or CliMsg_Agent_Upgrade) the master starts the agent binary
+ * found on disk as a new master and hands it the open listen sockets and
+ * the shared child registry and job table.  Once the new master reports
+ * that it is up, the old one stops accepting and lets its children finish
+ * their current commands before exiting.  The listen sockets are never
+ * closed, so clients see no gap.
+ *-------------------------------------------------------------------------
+ */
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "stringinfo.h"
+
+/* how long the old master waits for the new one to come up */
+#define UPGRADE_READY_TIMEOUT_MS 30000
+
+/* set by the SIGUSR2 handler, acted on by the master's main loop */
+extern volatile sig_atomic_t upgrade_requested;
+
+extern void *UpgradeSharedMemory(const char *name, size_t size, uint32_t version,
+                                 bool *inherited);
+extern int	UpgradeInheritSockets(int *sockets, int *nsockets, int maxlisten);
+extern int	UpgradeInheritedSocketSet(int fd);
+extern void UpgradeSetSocketSet(int setno, const int *sockets, int nsockets);
+extern void UpgradeInit(int *sockets, int nsockets);
+extern bool AgentUpgrade(void);
+extern bool UpgradeHandedOver(void);
+extern void UpgradeStats(StringInfo buf);
+
+#endif							/* UPGRADE_H */
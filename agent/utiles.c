@@ -17,12 +17,16 @@
 
 #include "utiles.h"
 #include "connutil.h"
+#include "format.h"
+#include "protocol.h"
 #include <libssh/libssh.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
+#include <unistd.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 
@@ -283,7 +287,11 @@ char* trim_leading(char* str) {
 
 
 bool executeSystemCommand(const char *cmd) {
-    int ret = system(cmd);
+    int ret;
+
+    /* the command may take a while; show what was said before it */
+    (void) flush_output();
+    ret = system(cmd);
 
 #ifdef _WIN32
     /* Windows-specific return value handling */
@@ -419,40 +427,286 @@ void buffer_intermediary_function(ClientSocket *client_sock, char *buf) {
     }
 }
 
-int send_string_over_gssapi(ClientSocket *client_sock, char *buffer) {
-    size_t len = 0;
-    
-    if (buffer != NULL) {
-        len = strlen(buffer);
+/*
+ * Responses.
+ *
+ * Whatever a request sends to the client goes out as typed messages (see
+ * protocol.h): output chunks and progress notes while the request runs,
+ * then a result message with its status and an end-of-response marker,
+ * so the client reads exactly one response per request.  Output that is
+ * redirected into a job log or a session pipe stays plain text.  So does
+ * output to a client that has not sent a CliMsg_Hello of protocol
+ * version 1 or later: such a client predates message types, and gets
+ * each piece of output in a write of its own, with no result or end
+ * marker.
+ *
+ * Request output is formatted straight into a per-connection buffer and
+ * sent in large chunks: once DbOutputChunk bytes have piled up, once
+ * the oldest of them has waited OUTPUT_FLUSH_MS, before the agent runs a
+ * subprocess or waits for something, and at the end of the request, when
+ * the last chunk, the result and the end marker leave in one write.
+ */
+#define OUTPUT_FLUSH_MS		200
+
+bool LogSendStats = false;
+
+static __thread int ResponseStatus = RESP_OK;
+static __thread int ResponseCode;		/* request being answered */
+static __thread pid_t ResponsePid;		/* process that answers it */
+static __thread StringInfoData OutputBuffer;
+static __thread struct timespec OutputPendingSince;
+static bool OutputExitHookSet = false;
+
+/*
+ * Does output go as plain text rather than typed messages?
+ */
+static bool output_plain(void) {
+    return secure_output_redirected() || !DbFramedResponses;
+}
+
+/*
+ * A client that predates message types reads one write per print, so
+ * its output is not batched.
+ */
+static bool output_unbatched(void) {
+    return !DbFramedResponses && !secure_output_redirected();
+}
+
+/*
+ * Write plain text to the redirected output or the client.
+ */
+static int write_plain(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = be_gssapi_write(global_client_socket, (void *) data, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
     }
-    
-    return be_gssapi_write(client_sock, buffer, len);
+    return 0;
 }
 
-int FPRINTF(ClientSocket *client_sock, const char *format, ...) {
-    va_list args;
-    int needed;
-    char *buffer = NULL;
-    va_start(args, format);
-    needed = vsnprintf(NULL, 0, format, args);
-    va_end(args);
+/*
+ * Queue the buffered output as one output message; nothing is sent yet.
+ */
+static int queue_output(void) {
+    int r = 0;
+
+    if (OutputBuffer.len == 0)
+        return 0;
+    if (output_plain())
+        r = write_plain(OutputBuffer.data, OutputBuffer.len);
+    else if (putmessage_compressed(RespMsg_Output, OutputBuffer.data, OutputBuffer.len) != 0)
+        r = -1;
+    resetStringInfo(&OutputBuffer);
+    return r;
+}
+
+/*
+ * flush_output -- send all pending request output to the client now
+ *
+ * Returns 0 on success, -1 if the client could not be written to.
+ */
+int flush_output(void) {
+    int r = queue_output();
+
+    if (!output_plain() && flush() != 0)
+        r = -1;
+    return r;
+}
+
+/*
+ * Output still pending when a request exit()s goes out before the
+ * process ends.  Children forked to run a program share the buffer but
+ * must not write it.
+ */
+static void flush_output_at_exit(void) {
+    if (ResponsePid == getpid())
+        (void) flush_output();
+}
+
+/*
+ * Make room for len more bytes of output, flushing first if the buffer
+ * has had enough.
+ */
+static int reserve_output(size_t len) {
+    struct timespec now;
+
+    if (OutputBuffer.data == NULL)
+        initStringInfo(&OutputBuffer);
+
+    if (OutputBuffer.len == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &OutputPendingSince);
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (OutputBuffer.len + len >= (size_t) DbOutputChunk ||
+        (now.tv_sec - OutputPendingSince.tv_sec) * 1000 +
+        (now.tv_nsec - OutputPendingSince.tv_nsec) / 1000000 >= OUTPUT_FLUSH_MS) {
+        OutputPendingSince = now;
+        return flush_output();
+    }
+    return 0;
+}
+
+/*
+ * Start the response to a new request.
+ */
+void begin_response(int action_code) {
+    ResponseStatus = RESP_OK;
+    ResponseCode = action_code;
+    ResponsePid = getpid();
+    if (OutputBuffer.data != NULL)
+        resetStringInfo(&OutputBuffer);
+    reset_send_stats();
+    if (!OutputExitHookSet) {
+        OutputExitHookSet = true;
+        atexit(flush_output_at_exit);
+    }
+}
+
+/*
+ * Record how the current request went.  The first failure reported is
+ * the one the client sees.
+ */
+void set_response_status(int status) {
+    if (ResponseStatus == RESP_OK)
+        ResponseStatus = status;
+}
+
+int get_response_status(void) {
+    return ResponseStatus;
+}
+
+/*
+ * Finish the response to the current request: the rest of its output,
+ * its result, then the end marker, all in one flush.
+ */
+void end_response(void) {
+    uint32 n32;
 
-    if (needed < 0) {
+    if (output_plain()) {
+        (void) flush_output();
+        return;
+    }
+    (void) queue_output();
+    n32 = hton32((uint32) ResponseStatus);
+    (void) putmessage_more(RespMsg_Result, (char *) &n32, 4);
+    (void) putmessage_more(RespMsg_End, NULL, 0);
+    (void) flush();
+
+    if (LogSendStats)
+        fprintf(stderr, "request 0x%02X: %ld bytes in %ld writes, %ld GSS tokens, %ld flushes\n",
+                ResponseCode, DbSendStats.bytes, DbSendStats.writes,
+                DbSendStats.tokens, DbSendStats.flushes);
+}
+
+/*
+ * Send a chunk of request output.  Returns 0 on success, -1 if the client
+ * could not be written to.
+ */
+int send_output_data(ClientSocket *client_sock, const char *data, size_t len) {
+    (void) client_sock;
+
+    if (len == 0)
+        return 0;
+    if (reserve_output(len) != 0)
         return -1;
+
+    /* a chunk that fills a packet by itself is not worth copying */
+    if (len >= (size_t) DbOutputChunk) {
+        if (flush_output() != 0)
+            return -1;
+        if (output_plain())
+            return write_plain(data, len);
+        if (putmessage_compressed(RespMsg_Output, data, len) != 0)
+            return -1;
+        return flush() == 0 ? 0 : -1;
     }
+    appendBinaryStringInfo(&OutputBuffer, data, len);
+    return output_unbatched() ? flush_output() : 0;
+}
 
-    buffer = malloc(needed + 1);
-    if (!buffer) {
+/*
+ * Format request output straight into the output buffer.  Returns the
+ * number of bytes added, or -1 on failure.
+ */
+static int vformat_output(const char *format, va_list args) {
+    int save_errno = errno;
+    int start;
+    int added;
+
+    if (reserve_output(0) != 0)
         return -1;
+    start = OutputBuffer.len;
+    for (;;) {
+        va_list copy;
+        int needed;
+
+        errno = save_errno;
+        va_copy(copy, args);
+        needed = appendStringInfoVA(&OutputBuffer, format, copy);
+        va_end(copy);
+        if (needed == 0)
+            break;
+        if (needed < 0)
+            return -1;
+        enlargeStringInfo(&OutputBuffer, needed);
     }
+    added = OutputBuffer.len - start;
+    if (output_unbatched() && flush_output() != 0)
+        return -1;
+    return added;
+}
+
+/*
+ * Send a progress note.  percent is 0-100, or -1 if the request cannot
+ * tell how far along it is.  The note goes out at once, after whatever
+ * output came before it.
+ */
+int PROGRESS(ClientSocket *client_sock, int percent, const char *format, ...) {
+    StringInfoData buf;
+    va_list args;
+    char text[512];
+    int needed;
 
     va_start(args, format);
-    vsnprintf(buffer, needed + 1, format, args);
+    needed = vsnprintf(text, sizeof(text), format, args);
     va_end(args);
+    if (needed < 0)
+        return -1;
+
+    if (output_plain()) {
+        if (send_output_data(client_sock, text, strlen(text)) != 0)
+            return -1;
+        return flush_output() == 0 ? needed : -1;
+    }
+
+    (void) queue_output();
+    beginmessage(&buf, RespMsg_Progress);
+    sendint32(&buf, (uint32) percent);
+    sendstring(&buf, text);
+    endmessage(&buf);
+    return needed;
+}
+
+int send_string_over_gssapi(ClientSocket *client_sock, char *buffer) {
+    if (buffer == NULL)
+        return 0;
+    return send_output_data(client_sock, buffer, strlen(buffer));
+}
 
-    send_string_over_gssapi(client_sock, buffer);
-    
-    free(buffer);
+int FPRINTF(ClientSocket *client_sock, const char *format, ...) {
+    va_list args;
+    int needed;
+
+    (void) client_sock;
+    va_start(args, format);
+    needed = vformat_output(format, args);
+    va_end(args);
 
     return needed;
 }
@@ -460,26 +714,22 @@ int FPRINTF(ClientSocket *client_sock, const char *format, ...) {
 int PRINTF(ClientSocket *client_sock, const char *format, ...) {
     va_list args;
     int needed;
-    char *buffer = NULL;
 
+    (void) client_sock;
     va_start(args, format);
-    needed = vsnprintf(NULL, 0, format, args);
+    needed = vformat_output(format, args);
     va_end(args);
 
-    if (needed < 0) {
-        return -1;
-    }
+    return needed;
+}
 
-    buffer = malloc(needed + 1);
-    if (!buffer) {
-        return -1;
-    }
+static int format_output(const char *format, ...) {
+    va_list args;
+    int needed;
 
     va_start(args, format);
-    vsnprintf(buffer, needed + 1, format, args);
+    needed = vformat_output(format, args);
     va_end(args);
-    send_string_over_gssapi(client_sock, buffer);
-    free(buffer);
 
     return needed;
 }
@@ -487,69 +737,34 @@ int PRINTF(ClientSocket *client_sock, const char *format, ...) {
 void PERROR(ClientSocket *client_sock, const char *s) {
     int errno_copy = errno; // Save errno as subsequent calls may alter it
     const char *error_str = strerror(errno_copy);
-    int needed;
-    char *buffer = NULL;
-
 
+    (void) client_sock;
     if (s == NULL) {
         s = "";
     }
 
     if (*s) {
-        needed = snprintf(NULL, 0, "%s: %s\n", s, error_str);
+        format_output("%s: %s\n", s, error_str);
     } else {
-        needed = snprintf(NULL, 0, "%s\n", error_str);
-    }
-
-    if (needed < 0) {
-        return;
-    }
-
-    buffer = malloc(needed + 1);
-    if (!buffer) {
-        return;
+        format_output("%s\n", error_str);
     }
-
-    if (*s) {
-        snprintf(buffer, needed + 1, "%s: %s\n", s, error_str);
-    } else {
-        snprintf(buffer, needed + 1, "%s\n", error_str);
-    }
-    send_string_over_gssapi(client_sock, buffer);
-    free(buffer);
 }
 
 
 int SEND_STRING(ClientSocket *client_sock, const char *str) {
     if (!str) {
-        // Handle NULL pointer case
-        buffer_intermediary_function(client_sock, "");
         return 0;
     }
 
-    // Calculate length automatically for null-terminated strings
     size_t length = strlen(str);
-    
-    // Special case: empty string
-    if (length == 0) {
-        buffer_intermediary_function(client_sock, "");
-        return 0;
-    }
 
-    // Create buffer and copy content
-    char *buffer = malloc(length + 1);
-    if (!buffer) {
-        return -1;  // Allocation failure
+    if (send_output_data(client_sock, str, length) != 0) {
+        return -1;
     }
 
-    strcpy(buffer, str);  // Safe since we know exact length
-    send_string_over_gssapi(client_sock, buffer);
-    free(buffer);
-    
     return length;  // Return number of characters sent
 }
 
-
 static bool directory_exists(const char *path) {
     struct stat info;
     if (stat(path, &info) != 0) {
@@ -651,6 +866,8 @@ char **split_string(char *input) {
 }
 
 void handle_result(ConfigStatus status, const char *config_param, const char *config_value, const char *config_file) {
+    if (status != SUCCESS)
+        set_response_status(RESP_ERROR);
     switch(status) {
     case SUCCESS:
         PRINTF(global_client_socket, "Successfully configure '%s' to '%s' in %s\n",
@@ -190,6 +190,16 @@ void PERROR(ClientSocket *client_sock, const char *s);
 int PRINTF(ClientSocket *client_sock, const char *format, ...);
 int FPRINTF(ClientSocket *client_sock, const char *format, ...);
 int SEND_STRING(ClientSocket *client_sock, const char *str);
+int PROGRESS(ClientSocket *client_sock, int percent, const char *format, ...);
+int send_output_data(ClientSocket *client_sock, const char *data, size_t len);
+void begin_response(int action_code);
+void set_response_status(int status);
+int get_response_status(void);
+void end_response(void);
+int flush_output(void);
+
+/* log what each response cost on the wire */
+extern bool LogSendStats;
 void handle_result(ConfigStatus status, const char *config_param, const char *config_value, const char *config_file);
 bool handleValidationResult(ValidationResult result);
 bool isPositiveInteger(const char *value);
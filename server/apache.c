@@ -23,6 +23,14 @@
 #include "report.h"
 #include "protocol.h"
 #include "metrics.h"
+#include "transfer.h"
+#include "session.h"
+#include "debod.h"
+#include "fanout.h"
+#include "rolling.h"
+#include "inventory.h"
+#include "depgraph.h"
+#include "localpool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -61,6 +69,52 @@ OS_TYPE detect_os() {
 static bool all = false;
 bool dependency = false;
 bool metrics = false;
+static bool agent_stats = false;
+static bool async = false;
+static bool pipeline = false;
+static bool pipeline_metrics = false;
+static int job_request = 0;
+static char *job_arg = NULL;
+
+/* --metrics-format: print the agent's metrics record as text or JSON */
+#define METRICS_FORMAT_HUMAN 1
+#define METRICS_FORMAT_JSON 2
+static int metrics_format = 0;
+
+/* --put=LOCAL:REMOTE and --get=REMOTE:LOCAL */
+static char *put_arg = NULL;
+static char *get_arg = NULL;
+
+/* --prefetch-tickets=HOST[,HOST...] */
+static char *prefetch_arg = NULL;
+
+/* --no-daemon: connect to the agent even when debod is running */
+static bool no_daemon = false;
+static bool daemon_status = false;
+
+/* --hosts=HOST[,HOST...] and --host-file=PATH: run on many hosts at once */
+static char *hosts_arg = NULL;
+static char *host_file = NULL;
+static int fanout_parallel = FANOUT_DEFAULT_PARALLEL;
+static int local_parallel = LOCALPOOL_DEFAULT_PARALLEL;	/* for --all here */
+static int fanout_timeout = 0;		/* --host-timeout, seconds */
+
+/* --rolling: the action a batch of hosts at a time, see rolling.h */
+static bool rolling = false;
+static RollingPlan rolling_plan = {
+    .batch = 1,
+    .max_unavailable = 0,		/* the batch size unless given */
+    .max_failures = 0,
+    .health_timeout_ms = ROLLING_DEFAULT_HEALTH_TIMEOUT,
+    .health_interval_ms = ROLLING_DEFAULT_HEALTH_INTERVAL,
+};
+
+/* --inventory=PATH, --cluster, --role=ROLE and --tag=KEY=VALUE: see inventory.h */
+static char *inventory_path = NULL;
+static bool inventory_refresh = false;
+static bool cluster = false;
+static char *role_filter = NULL;
+static char *tag_filter = NULL;
 
 
 const char *port = NULL;
@@ -80,6 +134,32 @@ static void handle_local_components(bool ALL, Component component, Action action
                                     char *version ,char *config_param, char *value);
 static void handle_remote_components(bool ALL, Component component, Action action,
                                      char *version ,char *config_param, char *value);
+static void show_agent_stats(void);
+static int prefetch_tickets(char *hostlist);
+static void show_metrics_record(bool json);
+static void transfer_file(bool upload, char *arg);
+static void agent_control_request(unsigned char code, const char *body);
+static void submit_remote_jobs(bool ALL, Component component, Action action,
+                               char *version , char *config_param , char *value);
+static void pipeline_remote_components(bool ALL, Component component, Action action,
+                                       char *version , char *config_param , char *value);
+static bool daemon_remote_components(bool ALL, Component component, Action action,
+                                     char *version , char *config_param , char *value);
+static bool daemon_control_request(unsigned char code, const char *body);
+static void show_daemon_status(void);
+static void fanout_remote_components(Component component, Action action,
+                                     char *version , char *config_param , char *value);
+static void fanout_control_request(unsigned char code, const char *body);
+static void rolling_remote_components(Component component, Action action,
+                                      char *version , char *config_param , char *value);
+static void refresh_inventory(void);
+
+/* Is the action for many hosts: --hosts, --host-file or --cluster? */
+static bool
+many_hosts(void)
+{
+    return hosts_arg || host_file || cluster;
+}
 
 
 void validate_options(Action action, Component component, bool all, bool dependency) {
@@ -172,6 +252,41 @@ main(int argc, char *argv[])
         {"solr", no_argument, NULL, 'X'},
         {"zeppelin", no_argument, NULL, 'Z'},
         {"with-dependency", no_argument, NULL, 'd'},
+        {"agent-stats", no_argument, NULL, 1},
+        {"async", no_argument, NULL, 2},
+        {"jobs", no_argument, NULL, 3},
+        {"job-status", required_argument, NULL, 4},
+        {"job-tail", required_argument, NULL, 5},
+        {"job-attach", required_argument, NULL, 6},
+        {"job-cancel", required_argument, NULL, 7},
+        {"agent-upgrade", no_argument, NULL, 8},
+        {"pipeline", no_argument, NULL, 9},
+        {"with-metrics", no_argument, NULL, 14},
+        {"compress", optional_argument, NULL, 10},
+        {"metrics-format", required_argument, NULL, 11},
+        {"put", required_argument, NULL, 12},
+        {"get", required_argument, NULL, 13},
+        {"transport", required_argument, NULL, 15},
+        {"prefetch-tickets", required_argument, NULL, 16},
+        {"no-daemon", no_argument, NULL, 17},
+        {"daemon-status", no_argument, NULL, 18},
+        {"hosts", required_argument, NULL, 19},
+        {"host-file", required_argument, NULL, 20},
+        {"parallel", required_argument, NULL, 21},
+        {"host-timeout", required_argument, NULL, 22},
+        {"rolling", no_argument, NULL, 23},
+        {"batch", required_argument, NULL, 24},
+        {"max-unavailable", required_argument, NULL, 25},
+        {"max-failures", required_argument, NULL, 26},
+        {"on-failure", required_argument, NULL, 27},
+        {"health-expect", required_argument, NULL, 28},
+        {"health-port", required_argument, NULL, 29},
+        {"health-timeout", required_argument, NULL, 30},
+        {"inventory", required_argument, NULL, 31},
+        {"inventory-refresh", no_argument, NULL, 32},
+        {"cluster", no_argument, NULL, 33},
+        {"role", required_argument, NULL, 34},
+        {"tag", required_argument, NULL, 35},
         {NULL, 0, NULL, 0}
     };
     Component component = NONE;
@@ -295,15 +410,260 @@ main(int argc, char *argv[])
         case 'd':
             dependency = true;
             break;
+        case 1:
+            agent_stats = true;
+            break;
+        case 2:
+            async = true;
+            break;
+        case 3:
+            job_request = CliMsg_Job_Poll;
+            break;
+        case 4:
+            job_request = CliMsg_Job_Poll;
+            job_arg = apache_strdup(optarg);
+            break;
+        case 5:
+            job_request = CliMsg_Job_Tail;
+            job_arg = apache_strdup(optarg);
+            break;
+        case 6:
+            job_request = CliMsg_Job_Attach;
+            job_arg = apache_strdup(optarg);
+            break;
+        case 7:
+            job_request = CliMsg_Job_Cancel;
+            job_arg = apache_strdup(optarg);
+            break;
+        case 8:
+            job_request = CliMsg_Agent_Upgrade;
+            break;
+        case 9:
+            pipeline = true;
+            break;
+        case 10:
+            if (set_compress_offer(optarg) < 0) {
+                fprintf(stderr, "Error: compression \"%s\" is not supported by this client\n",
+                        optarg ? optarg : "auto");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 11:
+            if (strcmp(optarg, "human") == 0)
+                metrics_format = METRICS_FORMAT_HUMAN;
+            else if (strcmp(optarg, "json") == 0)
+                metrics_format = METRICS_FORMAT_JSON;
+            else {
+                fprintf(stderr, "Error: --metrics-format must be human or json\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 14:
+            pipeline_metrics = true;
+            break;
+        case 12:
+            put_arg = apache_strdup(optarg);
+            break;
+        case 13:
+            get_arg = apache_strdup(optarg);
+            break;
+        case 16:
+            prefetch_arg = apache_strdup(optarg);
+            break;
+        case 17:
+            no_daemon = true;
+            break;
+        case 18:
+            daemon_status = true;
+            break;
+        case 19:
+            hosts_arg = apache_strdup(optarg);
+            break;
+        case 20:
+            host_file = apache_strdup(optarg);
+            break;
+        case 21:
+            if (!isPositiveInteger(optarg) || (fanout_parallel = atoi(optarg)) <= 0) {
+                fprintf(stderr, "Error: --parallel must be a positive number\n");
+                exit(EXIT_FAILURE);
+            }
+            local_parallel = fanout_parallel;
+            break;
+        case 22:
+            if (!isPositiveInteger(optarg) || (fanout_timeout = atoi(optarg)) <= 0) {
+                fprintf(stderr, "Error: --host-timeout must be a positive number of seconds\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 23:
+            rolling = true;
+            break;
+        case 24:
+            if (!isPositiveInteger(optarg) || (rolling_plan.batch = atoi(optarg)) <= 0) {
+                fprintf(stderr, "Error: --batch must be a positive number\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 25:
+            if (!isPositiveInteger(optarg) ||
+                (rolling_plan.max_unavailable = atoi(optarg)) <= 0) {
+                fprintf(stderr, "Error: --max-unavailable must be a positive number\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 26:
+            if (!isNonNegativeInteger(optarg)) {
+                fprintf(stderr, "Error: --max-failures must be a number\n");
+                exit(EXIT_FAILURE);
+            }
+            rolling_plan.max_failures = atoi(optarg);
+            break;
+        case 27:
+            if (strcmp(optarg, "pause") == 0)
+                rolling_plan.pause_on_failure = true;
+            else if (strcmp(optarg, "abort") == 0)
+                rolling_plan.pause_on_failure = false;
+            else {
+                fprintf(stderr, "Error: --on-failure must be pause or abort\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 28:
+            rolling_plan.health_expect = apache_strdup(optarg);
+            break;
+        case 29:
+            if (!isValidPort(optarg)) {
+                fprintf(stderr, "Error: --health-port must be a port number\n");
+                exit(EXIT_FAILURE);
+            }
+            rolling_plan.health_port = atoi(optarg);
+            break;
+        case 30:
+            if (!isPositiveInteger(optarg) || atoi(optarg) <= 0) {
+                fprintf(stderr, "Error: --health-timeout must be a positive number of seconds\n");
+                exit(EXIT_FAILURE);
+            }
+            rolling_plan.health_timeout_ms = atoi(optarg) * 1000;
+            break;
+        case 31:
+            inventory_path = apache_strdup(optarg);
+            break;
+        case 32:
+            inventory_refresh = true;
+            break;
+        case 33:
+            cluster = true;
+            break;
+        case 34:
+            role_filter = apache_strdup(optarg);
+            break;
+        case 35:
+            if (strchr(optarg, '=') == NULL) {
+                fprintf(stderr, "Error: --tag must be KEY=VALUE\n");
+                exit(EXIT_FAILURE);
+            }
+            tag_filter = apache_strdup(optarg);
+            break;
+        case 15:
+            if (set_transport_mode(optarg) < 0) {
+                fprintf(stderr, "Error: --transport must be encrypt, integrity or plain\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
         default:
             /* getopt_long already emitted a complaint */
             fprintf(stderr, "Try %s --help for more information.", progname);
             exit(EXIT_FAILURE);
         }
     }
+    if (prefetch_arg) {
+        exit(prefetch_tickets(prefetch_arg) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (daemon_status) {
+        show_daemon_status();
+        exit(EXIT_SUCCESS);
+    }
+    if (inventory_refresh) {
+        if (host || hosts_arg || host_file) {
+            fprintf(stderr, "Error: --inventory-refresh asks the hosts of the inventory\n");
+            exit(EXIT_FAILURE);
+        }
+        refresh_inventory();
+        exit(EXIT_SUCCESS);
+    }
+    if ((role_filter || tag_filter) && !many_hosts()) {
+        fprintf(stderr, "Error: --role and --tag require --cluster, --hosts or --host-file\n");
+        exit(EXIT_FAILURE);
+    }
+    if (rolling && !many_hosts()) {
+        fprintf(stderr, "Error: --rolling requires --hosts, --host-file or --cluster\n");
+        exit(EXIT_FAILURE);
+    }
+    if (many_hosts()) {
+        if (host) {
+            fprintf(stderr, "Error: --host cannot be combined with --hosts, --host-file or --cluster\n");
+            exit(EXIT_FAILURE);
+        }
+        if (async || pipeline || metrics_format || put_arg || get_arg ||
+            (job_request && job_request != CliMsg_Job_Poll)) {
+            fprintf(stderr, "Error: --hosts, --host-file and --cluster only take component actions, --agent-stats and --jobs\n");
+            exit(EXIT_FAILURE);
+        }
+        if (rolling && (agent_stats || job_request)) {
+            fprintf(stderr, "Error: --rolling only takes component actions\n");
+            exit(EXIT_FAILURE);
+        }
+        if (agent_stats || job_request) {
+            fanout_control_request(agent_stats ? CliMsg_Agent_Stats : job_request,
+                                   job_arg);
+            exit(EXIT_SUCCESS);
+        }
+    }
+    if (agent_stats) {
+        if (!(port && host)) {
+            fprintf(stderr, "Error: --agent-stats requires --host and --port\n");
+            exit(EXIT_FAILURE);
+        }
+        show_agent_stats();
+        exit(EXIT_SUCCESS);
+    }
+    if (metrics_format) {
+        if (!(port && host)) {
+            fprintf(stderr, "Error: --metrics-format requires --host and --port\n");
+            exit(EXIT_FAILURE);
+        }
+        show_metrics_record(metrics_format == METRICS_FORMAT_JSON);
+        exit(EXIT_SUCCESS);
+    }
+    if (put_arg || get_arg) {
+        if (!(port && host)) {
+            fprintf(stderr, "Error: --put and --get require --host and --port\n");
+            exit(EXIT_FAILURE);
+        }
+        if (put_arg && get_arg) {
+            fprintf(stderr, "Error: --put and --get cannot be used together\n");
+            exit(EXIT_FAILURE);
+        }
+        transfer_file(put_arg != NULL, put_arg ? put_arg : get_arg);
+        exit(EXIT_SUCCESS);
+    }
+    if (job_request) {
+        if (!(port && host)) {
+            fprintf(stderr, "Error: job and agent options require --host and --port\n");
+            exit(EXIT_FAILURE);
+        }
+        agent_control_request(job_request, job_arg);
+        exit(EXIT_SUCCESS);
+    }
     validate_options(action, component, all, dependency);
+    if (many_hosts()) {
+        if (component == NONE && !all) {
+            fprintf(stderr, "Error: --hosts, --host-file and --cluster require --all or a component\n");
+            exit(EXIT_FAILURE);
+        }
+    }
     // Validate connection options group
-    if (port || host) {
+    else if (port || host) {
         // Check all connection parameters are present
         if (!(port && host)) {
             fprintf(stderr, "Error: --port and  --host, must be used together\n");
@@ -358,8 +718,46 @@ main(int argc, char *argv[])
                 argv[optind]);
         exit(EXIT_FAILURE);
     }
-    if (port || host )
-        handle_remote_components(all , component , action, version , config_param, value);
+    if (async) {
+        if (!(port && host)) {
+            fprintf(stderr, "Error: --async requires --host and --port\n");
+            exit(EXIT_FAILURE);
+        }
+        if (dependency || action == VERSION_SWITCH) {
+            fprintf(stderr, "Error: --async cannot be used with --with-dependency or --verswitch\n");
+            exit(EXIT_FAILURE);
+        }
+        submit_remote_jobs(all , component , action, version , config_param, value);
+    }
+    else if (pipeline) {
+        if (!(port && host)) {
+            fprintf(stderr, "Error: --pipeline requires --host and --port\n");
+            exit(EXIT_FAILURE);
+        }
+        if (action == VERSION_SWITCH) {
+            fprintf(stderr, "Error: --pipeline cannot be used with --verswitch\n");
+            exit(EXIT_FAILURE);
+        }
+        if (!daemon_remote_components(all , component , action, version , config_param, value))
+            pipeline_remote_components(all , component , action, version , config_param, value);
+    }
+    else if (pipeline_metrics) {
+        fprintf(stderr, "Error: --with-metrics requires --pipeline\n");
+        exit(EXIT_FAILURE);
+    }
+    else if (rolling)
+        rolling_remote_components(component, action, version, config_param, value);
+    else if (many_hosts())
+        fanout_remote_components(component, action, version, config_param, value);
+    else if (port || host ) {
+        /*
+         * a version switch is an uninstall then an install, in two steps,
+         * and a dependency graph needs connections of its own
+         */
+        if (action == VERSION_SWITCH || dependency ||
+            !daemon_remote_components(all , component , action, version , config_param, value))
+            handle_remote_components(all , component , action, version , config_param, value);
+    }
     else
         handle_local_components(all , component , action, version , config_param, value);
 
@@ -388,7 +786,32 @@ help(const char *progname)
     printf("  --verswitch           switch between version\n");
     printf("  --uninstall         Remove the component\n");
     printf("  --configure         Apply configuration changes\n");
-    printf("  --metrics         Collect metrics\n\n");
+    printf("  --with-dependency   Also act on everything the component needs, the\n");
+    printf("                      independent ones at the same time (remote only)\n");
+    printf("  --metrics         Collect metrics\n");
+    printf("  --metrics-format=FMT  Fetch the agent's counters as a structured record\n");
+    printf("                      and print them as human or json (remote only)\n");
+    printf("  --agent-stats       Show agent worker/process statistics (remote only)\n");
+    printf("  --agent-upgrade     Restart the agent on its installed binary without\n");
+    printf("                      dropping connections (--host=localhost, as root\n");
+    printf("                      or the agent's user)\n\n");
+
+    printf("File transfer (remote only):\n");
+    printf("  --put=LOCAL:REMOTE  Copy a local file to the agent's host\n");
+    printf("  --get=REMOTE:LOCAL  Copy a file from the agent's host\n");
+    printf("                      An interrupted copy resumes when run again\n\n");
+
+    printf("Background jobs (remote only):\n");
+    printf("  --async             Run the action as a job on the agent and return its id\n");
+    printf("  --jobs              List the agent's jobs\n");
+    printf("  --job-status=ID     Show the state of a job\n");
+    printf("  --job-tail=ID       Show the end of a job's log\n");
+    printf("  --job-attach=ID     Follow a job's log until it finishes\n");
+    printf("  --job-cancel=ID     Cancel a running job\n");
+    printf("  --pipeline          Send the requests for all targets at once over one\n");
+    printf("                      session; read-only ones run concurrently\n");
+    printf("  --with-metrics      With --pipeline, also fetch the agent's metrics over\n");
+    printf("                      the same session while the actions run\n\n");
 
     printf("Target components (use with action options):\n");
     printf("  --all               Apply action to all components\n");
@@ -413,6 +836,51 @@ help(const char *progname)
     printf("General options:\n");
     printf("  -h, --host=HOSTNAME   Target server hostname\n");
     printf("  -p, --port=PORT       Connection port number\n");
+    printf("  --compress[=ALGO]     Ask the agent to compress large responses, with\n");
+    printf("                        lz4, zstd or auto (the default)\n");
+    printf("  --transport=MODE      encrypt (the default), or integrity or plain for\n");
+    printf("                        an agent port on a trusted network\n");
+    printf("  --prefetch-tickets=HOST[,HOST...]\n");
+    printf("                        Fetch the agents' service tickets in parallel and\n");
+    printf("                        report the KDC latency\n");
+    printf("  --no-daemon           Connect to the agent directly even if debod runs\n");
+    printf("  --daemon-status       Show the agent sessions debod keeps and their health\n");
+    printf("  --hosts=HOST[:PORT][,...]\n");
+    printf("                        Run the action, --agent-stats or --jobs on the\n");
+    printf("                        agents of all these hosts at once\n");
+    printf("  --host-file=PATH      The same, for the hosts listed in PATH, one a line\n");
+    printf("  --parallel=N          Hosts, or components of --with-dependency, in\n");
+    printf("                        progress at once (default %d); for --all on this\n",
+           FANOUT_DEFAULT_PARALLEL);
+    printf("                        host, components at once (default %d, 1 for one\n",
+           LOCALPOOL_DEFAULT_PARALLEL);
+    printf("                        after another in this process)\n");
+    printf("  --host-timeout=SECS   Give up on a host that has not answered in time\n\n");
+
+    printf("Rolling operations (with --hosts or --host-file):\n");
+    printf("  --rolling             Run the action a batch of hosts at a time, waiting\n");
+    printf("                        for each batch to turn healthy before the next\n");
+    printf("  --batch=N             Hosts per batch (default 1)\n");
+    printf("  --max-unavailable=M   Hosts that may be down at once, failed ones\n");
+    printf("                        included (default the batch size)\n");
+    printf("  --max-failures=K      Failed hosts tolerated before stopping (default 0)\n");
+    printf("  --on-failure=MODE     abort (the default), or pause to ask whether to\n");
+    printf("                        go on\n");
+    printf("  --health-expect=TEXT  Healthy only once the component report says TEXT\n");
+    printf("  --health-port=PORT    Healthy only once PORT accepts connections\n");
+    printf("  --health-timeout=SECS How long a batch gets to turn healthy (default %d)\n\n",
+           ROLLING_DEFAULT_HEALTH_TIMEOUT / 1000);
+
+    printf("Cluster inventory (see the header of server/inventory.h for the format):\n");
+    printf("  --inventory=PATH      The inventory of hosts and their roles (default\n");
+    printf("                        $DEBO_INVENTORY, else ~/.debo/inventory)\n");
+    printf("  --inventory-refresh   Ask every inventory host's agent what it has\n");
+    printf("                        installed and cache the answers\n");
+    printf("  --cluster             Run on every host of the inventory, like --hosts\n");
+    printf("  --role=ROLE           Only the hosts with ROLE, a role or component name\n");
+    printf("  --tag=KEY=VALUE       Only the hosts with this tag\n");
+    printf("  An action goes only to the components each host has: those of its\n");
+    printf("  roles, or else the ones its agent last said are installed.\n\n");
     printf("  -V, --version         Show component version\n");
     printf("  --help                Display this help message\n\n");
 
@@ -421,6 +889,14 @@ help(const char *progname)
     printf("  Start Zookeeper:         %s --start --zookeeper\n", progname);
     printf("  Restart all components:  %s --restart --all\n", progname);
     printf("  Install Kafka:           %s --install --kafka\n", progname);
+    printf("  Install HDFS remotely in the background:\n");
+    printf("    %s --install --hdfs --async --host=HOST --port=PORT\n", progname);
+    printf("  Start HDFS on every host of a cluster:\n");
+    printf("    %s --start --hdfs --host-file=hosts.txt --port=PORT\n", progname);
+    printf("  Restart Kafka four brokers at a time:\n");
+    printf("    %s --restart --kafka --host-file=hosts.txt --rolling --batch=4\n", progname);
+    printf("  Start everything on the hosts of rack r1, each only what it runs:\n");
+    printf("    %s --start --all --cluster --tag=rack=r1\n", progname);
 }
 
 
@@ -1206,25 +1682,122 @@ void perform(Component comp, Action action, char *version , char *config_param ,
 }
 
 
+static Inventory inventory;
+
+/*
+ * get_inventory
+ *
+ * The inventory of --inventory, or else the default one, read the first
+ * time it is asked for.  NULL if there is none, which is an error if
+ * --inventory named it or required is set.
+ */
+static Inventory *
+get_inventory(bool required)
+{
+    static bool loaded = false;
+    static int result;
+    const char *path = inventory_path ? inventory_path : inventory_default_path();
+
+    if (!loaded) {
+        loaded = true;
+        result = InventoryLoad(&inventory, path);
+        if (result < 0)
+            exit(EXIT_FAILURE);
+    }
+    if (result > 0 && (required || inventory_path)) {
+        fprintf(stderr, "Error: there is no inventory at %s\n", path ? path : "$HOME/.debo/inventory");
+        exit(EXIT_FAILURE);
+    }
+    return result == 0 ? &inventory : NULL;
+}
+
+/*
+ * target_inventory_host
+ *
+ * The inventory's entry of the one host an action is for: --host, or
+ * else this machine.  NULL if the inventory does not list it.
+ */
+static const InventoryHost *
+target_inventory_host(void)
+{
+    Inventory *inv = get_inventory(false);
+    InventoryHost *h;
+    char name[MAX_PATH_LEN];
+
+    if (inv == NULL)
+        return NULL;
+    if (host) {
+        snprintf(name, sizeof(name), "%s%s%s", host, port ? ":" : "", port ? port : "");
+        return InventoryFind(inv, name);
+    }
+    if (gethostname(name, sizeof(name)) == 0 && (h = InventoryFind(inv, name)) != NULL)
+        return h;
+    return InventoryFind(inv, "localhost");
+}
+
+/* What each component of a local --all gets */
+typedef struct LocalAction
+{
+    Action action;
+    char *version;
+    char *config_param;
+    char *value;
+} LocalAction;
+
+static void
+local_component_action(Component c, void *arg)
+{
+    LocalAction *la = arg;
+
+    if (la->action != NO_ACTION) {
+        printBorder("┌", "┐", YELLOW);
+        printTextBlock(component_to_string(c), BOLD GREEN, YELLOW);
+        printBorder("├", "┤", YELLOW);
+        if (strcmp(action_to_string(la->action), "Installing...") == 0)
+            printTextBlock("Installing might take several minutes", BOLD GREEN, YELLOW);
+        printTextBlock(action_to_string(la->action), CYAN, YELLOW);
+        perform(c, la->action, la->version, la->config_param, la->value);
+    } else {
+        report(c);
+    }
+}
+
 static void handle_local_components(bool ALL, Component component, Action action,
                                     char *version , char *config_param , char *value) {
     if (ALL) {
+        const InventoryHost *ih = target_inventory_host();
+        LocalAction la = {action, version, config_param, value};
+        Component comps[RANGER + 8];
+        int ncomps = 0;
+
         // Handle all components (skip NONE)
         for (Component c = HDFS; c <= RANGER; c++) {
             const char *comp_str = component_to_string(c);
             if (!comp_str) continue; // Skip if component string is NULL
+            if (!InventoryHostHas(ih, c)) continue; // not on this host
+            comps[ncomps++] = c;
+        }
 
-            if (action != NO_ACTION) {
-                printBorder("┌", "┐", YELLOW);
-                printTextBlock(comp_str, BOLD GREEN, YELLOW); // Use validated string
-                printBorder("├", "┤", YELLOW);
-                if (strcmp(action_to_string(action), "Installing...") == 0)
-                    printTextBlock("Installing might take several minutes", BOLD GREEN, YELLOW);
-                printTextBlock(action_to_string(action), CYAN, YELLOW);
-                perform(c, action, version, config_param, value);
-            } else {
-                report(c);
-            }
+        /*
+         * Reports and service control go to workers, several at once; an
+         * install or uninstall holds the package manager's lock anyway.
+         */
+        if (local_parallel > 1 && (action == NO_ACTION || action == START ||
+                                   action == STOP || action == RESTART)) {
+            LocalPool pool = {
+                .parallel = local_parallel,
+                .ordered = action != NO_ACTION,
+                .reverse = action == STOP,
+                .run = local_component_action,
+                .arg = &la,
+            };
+
+            /* a failed component no longer stops the rest, but still fails */
+            if (LocalPoolRun(&pool, comps, ncomps) != 0)
+                exit(EXIT_FAILURE);
+        } else {
+            for (int i = 0; i < ncomps; i++)
+                local_component_action(comps[i], &la);
         }
     } else {
         // Handle single component
@@ -1301,48 +1874,29 @@ print_inBuffer(const Conn *conn)
 }
 
 
-// Helper function to get required reads for INSTALL based on component
-static int get_required_reads_for_install(Component comp) {
-    const char *comp_str = component_to_string(comp);
-    if (strcasecmp(comp_str, "HDFS") == 0) return 465;
-    if (strcasecmp(comp_str, "HBASE") == 0) return 111;
-    if (strcasecmp(comp_str, "HIVE") == 0) return 508;
-    if (strcasecmp(comp_str, "KAFKA") == 0) return 213;
-    if (strcasecmp(comp_str, "LIVY") == 0) return 19;
-    if (strcasecmp(comp_str, "STORM") == 0) return 4;
-    if (strcasecmp(comp_str, "PIG") == 0) return 4;
-    if (strcasecmp(comp_str, "PRESTO") == 0) return 14;
-    if (strcasecmp(comp_str, "ATLAS") == 0) return 7;
-    if (strcasecmp(comp_str, "RANGER") == 0) return 4;
-    if (strcasecmp(comp_str, "SOLR") == 0) return 5;
-    if (strcasecmp(comp_str, "SPARK") == 0) return 66;
-    if (strcasecmp(comp_str, "TEZ") == 0) return 46;
-    if (strcasecmp(comp_str, "ZEPPELIN") == 0) return 55;
-    if (strcasecmp(comp_str, "ZOOKEEPER") == 0) return 30;
-    if (strcasecmp(comp_str, "FLINK") == 0) return 129;
-    return 1; // Default for unknown components
-}
+// Helper function to read the agent's response to one request
+static int do_read(Conn *conn, Component comp) {
+    int status = ReadResponse(conn, RESPONSE_BLOCKS, NULL);
 
-// Helper function to perform required reads
-static void do_read(Conn *conn, int num_reads, Component comp, Action action) {
-    bool break_on_success = (action == INSTALL);
-    for (int i = 0; i < num_reads; i++) {
-        reset_connection_buffers(conn);
-        int dataResult;
-        do {
-            dataResult = ReadData(conn);
-            if (dataResult < 0) {
-                fprintf(stderr, "Failed to read from socket for %s\n", component_to_string(comp));
-                return;
-            }
-        } while (dataResult <= 0);
+    if (status < 0)
+        fprintf(stderr, "Failed to read from socket for %s\n", component_to_string(comp));
+    return status;
+}
 
-        printTextBlock(conn->inBuffer + conn->inStart, BOLD GREEN, YELLOW);
+// Helper function to send an install and read its response, keeping a copy
+// of the output in <component>configuration.txt
+static int do_install(Conn *conn, Component comp, char *version,
+                      char *config_param, char *value) {
+    int status;
 
-        if (break_on_success && check_installed_message(conn->inBuffer + conn->inStart)) {
-            break;
-        }
+    SendComponentActionCommand(comp, INSTALL, version, config_param, value, conn);
+    if (start_stdout_capture(comp) != 0) {
+        fprintf(stderr, "Failed to capture stdout for %s\n", component_to_string(comp));
+        exit(EXIT_FAILURE);
     }
+    status = do_read(conn, comp);
+    stop_stdout_capture();
+    return status;
 }
 
 // Helper function to handle dependency operations
@@ -1367,41 +1921,99 @@ static void process_dependencies(Component component, Action action, Conn *conn,
         printTextBlock(dep_header, CYAN, YELLOW);
         printTextBlock(action_to_string(action), CYAN, YELLOW);
 
-        // Send command and handle reads based on action
-        SendComponentActionCommand(dep, action, NULL, NULL, NULL, conn);
-
         if (action == INSTALL) {
-            if (start_stdout_capture(dep) != 0) {
-                fprintf(stderr, "Failed to capture stdout for %s\n", dep_name);
-                continue;
-            }
-            do_read(conn, get_required_reads_for_install(dep), dep, action);
-            stop_stdout_capture();
+            do_install(conn, dep, NULL, NULL, NULL);
         } else if (action == VERSION_SWITCH) {
             // Special handling for version switch in dependencies
             SendComponentActionCommand(dep, UNINSTALL, NULL, NULL, NULL, conn);
-            do_read(conn, 1, dep, UNINSTALL);
-
-            SendComponentActionCommand(dep, INSTALL, NULL, NULL, NULL, conn);
-            do_read(conn, get_required_reads_for_install(dep), dep, INSTALL);
+            do_read(conn, dep);
+            do_install(conn, dep, NULL, NULL, NULL);
         } else {
             // START/STOP/RESTART/REPORT/UNINSTALL
-            do_read(conn, 1, dep, action);
+            SendComponentActionCommand(dep, action, NULL, NULL, NULL, conn);
+            do_read(conn, dep);
         }
     }
 }
 
+/*
+ * save_install_output
+ *
+ * Keep a copy of the output of a component's install in the graph in
+ * <component>configuration.txt, as do_install does.
+ */
+static void
+save_install_output(const DepNode *node, FanoutHost *h, void *arg)
+{
+    Action action = *(Action *) arg;
+    char path[MAX_PATH_LEN];
+    FILE *fp;
+
+    if ((action != INSTALL && action != VERSION_SWITCH) || h->output->len == 0)
+        return;
+    snprintf(path, sizeof(path), "%sconfiguration.txt", component_to_string(node->component));
+    if ((fp = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "Error: Failed to create %s\n", path);
+        return;
+    }
+    fwrite(h->output->data, 1, h->output->len, fp);
+    fclose(fp);
+    printf("Configuration data saved to: %s\n", path);
+}
+
+/*
+ * run_dependency_graph
+ *
+ * Do the action on the component and everything it needs, directly or
+ * not, each branch of the dependencies at the same time as the others,
+ * over connections of their own.  Exits unless all of them succeeded.
+ */
+static void
+run_dependency_graph(Component component, Action action,
+                     char *version , char *config_param , char *value)
+{
+    DepGraph graph;
+    DepPlan plan;
+
+    if (DepGraphBuild(&graph, &component, 1) < 0)
+        exit(EXIT_FAILURE);
+
+    memset(&plan, 0, sizeof(plan));
+    plan.action = action;
+    plan.version = version;
+    plan.config_param = config_param;
+    plan.value = value;
+    plan.parallel = fanout_parallel;
+    plan.timeout_ms = fanout_timeout * 1000;
+    plan.done = save_install_output;
+    plan.arg = &action;
+
+    printf("%s %s and %d component(s) it needs\n", action_to_string(action),
+           component_to_string(component), graph.nnodes - 1);
+    if (DepGraphRun(&graph, &plan, host, port) != 0)
+        exit(EXIT_FAILURE);
+}
+
 static void handle_remote_components(bool ALL, Component component, Action action,
                                      char *version , char *config_param , char *value) {
+    /* a configuration is for the component alone, whatever it needs */
+    if (!ALL && dependency && action != CONFIGURE) {
+        run_dependency_graph(component, action, version, config_param, value);
+        return;
+    }
+
     Conn* conn = connect_to_debo(host, port);
     if (conn == NULL)
         fprintf(stderr, "Failed to connect to Debo\n");
 
     if (ALL) {
+        const InventoryHost *ih = target_inventory_host();
+
         // Handle all components (skip NONE)
         for (Component c = HDFS; c <= RANGER; c++) {
             const char *comp_str = component_to_string(c);
             if (!comp_str) continue; // Skip if component string is NULL
+            if (!InventoryHostHas(ih, c)) continue; // not on this host
 
             printBorder("┌", "┐", YELLOW);
             printTextBlock(component_to_string(c), BOLD GREEN, YELLOW);
@@ -1409,49 +2021,16 @@ static void handle_remote_components(bool ALL, Component component, Action actio
             if (strcmp(action_to_string(action), "Installing...") == 0)
                 printTextBlock("Installing might take several minutes", BOLD GREEN, YELLOW);
             printTextBlock(action_to_string(action), CYAN, YELLOW);
-            SendComponentActionCommand(c, action, version , config_param, value, conn);
-
-            // Determine read strategy based on action type
-            int num_reads;
-            int check_early_exit = 0;  // Flag for install/version-switch early exit
 
             if (action == INSTALL) {
-                num_reads = get_required_reads_for_install(c);
-                check_early_exit = 1;
-                if (start_stdout_capture(c) != 0) exit(EXIT_FAILURE);
-            }
-            else if (action == VERSION_SWITCH) {
-                num_reads = get_required_reads_for_install(c) + 1;
-                check_early_exit = 1;
-                if (start_stdout_capture(c) != 0) exit(EXIT_FAILURE);
-            }
-            else {
-                num_reads = 1;  // Single read for other actions
-            }
-
-            // Unified read handling for all actions
-            for (int i = 0; i < num_reads; i++) {
-                int dataResult;
-                reset_connection_buffers(conn);
-                do {
-                    dataResult = ReadData(conn);
-                    if (dataResult < 0) {
-                        fprintf(stderr, "Failed to read from socket\n");
-                        break;
-                    }
-                } while (dataResult <= 0);
-
-                printTextBlock(conn->inBuffer + conn->inStart, BOLD GREEN, YELLOW);
-
-                // Early exit check for install/version-switch
-                if (check_early_exit && check_installed_message(conn->inBuffer + conn->inStart)) {
-                    break;
-                }
-            }
-
-            // Only stop capture if we started it
-            if (action == INSTALL || action == VERSION_SWITCH) {
-                stop_stdout_capture();
+                do_install(conn, c, version, config_param, value);
+            } else if (action == VERSION_SWITCH) {
+                SendComponentActionCommand(c, UNINSTALL, NULL, NULL, NULL, conn);
+                do_read(conn, c);
+                do_install(conn, c, version, config_param, value);
+            } else {
+                SendComponentActionCommand(c, action, version , config_param, value, conn);
+                do_read(conn, c);
             }
         }
         // Fixed component handling code
@@ -1462,7 +2041,6 @@ static void handle_remote_components(bool ALL, Component component, Action actio
         }
 
         const char* comp_name = component_to_string(component);
-        int dep_count = 0;
 
         // Print main component header
         printBorder("┌", "┐", YELLOW);
@@ -1475,56 +2053,19 @@ static void handle_remote_components(bool ALL, Component component, Action actio
 
         printTextBlock(action_to_string(action), CYAN, YELLOW);
 
-        // Handle VERSION_SWITCH first (special case)
-        if (action == VERSION_SWITCH) {
-            // Process dependencies for version switch
-            process_dependencies(component, VERSION_SWITCH, conn, dependency);
+        // Process dependencies first (if specified)
+        process_dependencies(component, action, conn, dependency);
 
-            // Handle main component version switch
+        // Now handle the main component
+        if (action == VERSION_SWITCH) {
             SendComponentActionCommand(component, UNINSTALL, NULL, NULL, NULL, conn);
-            do_read(conn, 1, component, UNINSTALL);
-
-            SendComponentActionCommand(component, INSTALL, version, config_param, value, conn);
-            if (start_stdout_capture(component) != 0) {
-                fprintf(stderr, "Failed to capture stdout for %s\n", comp_name);
-                exit(EXIT_FAILURE);
-            }
-            do_read(conn, get_required_reads_for_install(component) + 1, component, INSTALL);
-            stop_stdout_capture();
-        }
-        // Handle all other actions
-        else {
-            // Process dependencies first (if specified)
-            process_dependencies(component, action, conn, dependency);
-
-            // Now handle the main component
+            do_read(conn, component);
+            do_install(conn, component, version, config_param, value);
+        } else if (action == INSTALL) {
+            do_install(conn, component, version, config_param, value);
+        } else {
             SendComponentActionCommand(component, action, version, config_param, value, conn);
-
-            switch (action) {
-            case INSTALL:
-                if (start_stdout_capture(component) != 0) {
-                    fprintf(stderr, "Failed to capture stdout for %s\n", comp_name);
-                    exit(EXIT_FAILURE);
-                }
-                do_read(conn, get_required_reads_for_install(component), component, INSTALL);
-                stop_stdout_capture();
-                break;
-
-            case START:
-            case STOP:
-            case RESTART:
-            case REPORT:
-            case METRICS:
-            case UNINSTALL:
-                // Single read for these actions
-                do_read(conn, 1, component, action);
-                break;
-
-            default:
-                // Handle other actions with single read
-                do_read(conn, 1, component, action);
-                break;
-            }
+            do_read(conn, component);
         }
 
         // Send finish message
@@ -1540,3 +2081,1052 @@ static void handle_remote_components(bool ALL, Component component, Action actio
         printf("\n");
     }
 }
+
+/*
+ * agent_control_request
+ *
+ * Send a request that is answered by the agent itself rather than a
+ * component and print the reply.  The reply to a job attach request is
+ * the job's log as it grows, up to the end of the job.
+ */
+static void
+agent_control_request(unsigned char code, const char *body)
+{
+    Conn *conn;
+    int status;
+
+    /* an upgrade ends the agent's sessions, so it gets a connection of its own */
+    if (code != CliMsg_Agent_Upgrade && daemon_control_request(code, body))
+        return;
+
+    conn = connect_to_debo(host, port);
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to connect to Debo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (PutMsgStart(code, conn) < 0 ||
+        (body && Putnchar(body, strlen(body), conn) < 0)) {
+        fprintf(stderr, "Failed to send request\n");
+        exit(EXIT_FAILURE);
+    }
+    PutMsgEnd(conn);
+    (void) Flush(conn);
+
+    status = ReadResponse(conn, RESPONSE_RAW, NULL);
+    if (status < 0) {
+        fprintf(stderr, "Failed to read from socket\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (PutMsgStart(CliMsg_Finish, conn) >= 0) {
+        PutMsgEnd(conn);
+        (void) Flush(conn);
+    }
+    /* a refused or failed request must fail the command, for scripts */
+    if (status != RESP_OK)
+        exit(EXIT_FAILURE);
+}
+
+/*
+ * prefetch_tickets
+ *
+ * Fetch the service tickets of the agents on a comma-separated list of
+ * hosts, as an operation over them would first, and report the KDC
+ * latency.  Returns the number of tickets missing, -1 without
+ * credentials.
+ */
+static int
+prefetch_tickets(char *hostlist)
+{
+    const char **hosts;
+    int nhosts = 1;
+    int result;
+
+    for (char *p = hostlist; *p; p++)
+        if (*p == ',')
+            nhosts++;
+    hosts = malloc(nhosts * sizeof(char *));
+    if (hosts == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    nhosts = 0;
+    for (char *h = strtok(hostlist, ","); h != NULL; h = strtok(NULL, ","))
+        hosts[nhosts++] = h;
+
+    result = prefetch_service_tickets(hosts, nhosts);
+    free(hosts);
+    return result;
+}
+
+/*
+ * show_agent_stats
+ *
+ * Ask the remote agent for its process statistics and print them.
+ */
+static void
+show_agent_stats(void)
+{
+    agent_control_request(CliMsg_Agent_Stats, NULL);
+}
+
+/*
+ * show_metrics_record
+ *
+ * Ask the remote agent for its structured metrics record and print it,
+ * as text or as JSON.
+ */
+static void
+show_metrics_record(bool json)
+{
+    Conn *conn = connect_to_debo(host, port);
+    ExpBufferData msg;
+    MetricsRecord record;
+    int status = -1;
+    char type;
+
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to connect to Debo\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!(conn->features & PROTO_FEATURE_METRICS_RECORD)) {
+        fprintf(stderr, "The agent does not support metrics records\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (PutMsgStart(CliMsg_Metrics_Record, conn) < 0 || PutMsgEnd(conn) < 0) {
+        fprintf(stderr, "Failed to send request\n");
+        exit(EXIT_FAILURE);
+    }
+    (void) Flush(conn);
+
+    initExpBuffer(&msg);
+    for (;;) {
+        resetExpBuffer(&msg);
+        if (GetResponseMessage(conn, &type, &msg) < 0) {
+            fprintf(stderr, "Failed to read from socket\n");
+            exit(EXIT_FAILURE);
+        }
+        if (type == RespMsg_End)
+            break;
+        if (type == RespMsg_Metrics) {
+            if (decode_metrics_record(msg.data, msg.len, &record) < 0) {
+                fprintf(stderr, "Malformed metrics record\n");
+                exit(EXIT_FAILURE);
+            }
+            print_metrics_record(&record, json);
+            free_metrics_record(&record);
+        } else if (type == RespMsg_Output)
+            fwrite(msg.data, 1, msg.len, stderr);
+        else if (type == RespMsg_Result && msg.len >= 4) {
+            memcpy(&status, msg.data, 4);
+        }
+    }
+    termExpBuffer(&msg);
+
+    if (PutMsgStart(CliMsg_Finish, conn) >= 0) {
+        PutMsgEnd(conn);
+        (void) Flush(conn);
+    }
+    if (status != RESP_OK)
+        exit(EXIT_FAILURE);
+}
+
+/*
+ * transfer_file
+ *
+ * Upload or download one file, arg being "LOCAL:REMOTE" for an upload and
+ * "REMOTE:LOCAL" for a download, and report how fast it went.
+ */
+static void
+transfer_file(bool upload, char *arg)
+{
+    char *sep = strchr(arg, ':');
+    TransferResult result;
+    Conn *conn;
+    int rc;
+
+    if (sep == NULL || sep == arg || sep[1] == '\0') {
+        fprintf(stderr, "Error: %s expects %s\n", upload ? "--put" : "--get",
+                upload ? "LOCAL:REMOTE" : "REMOTE:LOCAL");
+        exit(EXIT_FAILURE);
+    }
+    *sep = '\0';
+
+    conn = connect_to_debo(host, port);
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to connect to Debo\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!(conn->features & PROTO_FEATURE_FILE_TRANSFER)) {
+        fprintf(stderr, "The agent does not support file transfer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (upload)
+        rc = UploadFile(conn, arg, sep + 1, &result);
+    else
+        rc = DownloadFile(conn, arg, sep + 1, &result);
+
+    if (PutMsgStart(CliMsg_Finish, conn) >= 0) {
+        PutMsgEnd(conn);
+        (void) Flush(conn);
+    }
+    if (rc < 0)
+        exit(EXIT_FAILURE);
+
+    printf("%s %lld bytes in %.2f s (%.1f MB/s)", upload ? "uploaded" : "downloaded",
+           result.bytes, result.seconds,
+           result.seconds > 0 ? result.bytes / result.seconds / (1024 * 1024) : 0.0);
+    if (result.resumed > 0)
+        printf(", resumed after %lld bytes", result.resumed);
+    printf("\n");
+}
+
+/*
+ * submit_remote_jobs
+ *
+ * Submit the action as a background job for one component, or one job
+ * per component with --all, and print the job ids the agent hands back.
+ */
+static void
+submit_remote_jobs(bool ALL, Component component, Action action,
+                   char *version , char *config_param , char *value)
+{
+    Conn *conn = connect_to_debo(host, port);
+    Component first = ALL ? HDFS : component;
+    Component last = ALL ? RANGER : component;
+    ExpBufferData reply;
+
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to connect to Debo\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!(conn->features & PROTO_FEATURE_JOBS)) {
+        fprintf(stderr, "The agent does not support background jobs\n");
+        exit(EXIT_FAILURE);
+    }
+
+    initExpBuffer(&reply);
+    for (Component c = first; c <= last; c++) {
+        if (!component_to_string(c))
+            continue;
+
+        SendComponentJobSubmit(c, action, version, config_param, value, conn);
+
+        resetExpBuffer(&reply);
+        if (ReadResponse(conn, RESPONSE_QUIET, &reply) < 0) {
+            fprintf(stderr, "Failed to read from socket\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("%s: %s", component_to_string(c), reply.data);
+    }
+    termExpBuffer(&reply);
+
+    if (PutMsgStart(CliMsg_Finish, conn) >= 0) {
+        PutMsgEnd(conn);
+        (void) Flush(conn);
+    }
+}
+
+/*
+ * print_pipeline_reply
+ *
+ * Print the output of one finished request of a pipelined session.
+ */
+static void
+print_pipeline_reply(const char *title, const char *subtitle, SessionReply *reply)
+{
+    printBorder("┌", "┐", YELLOW);
+    printTextBlock(title, BOLD GREEN, YELLOW);
+    printBorder("├", "┤", YELLOW);
+    printTextBlock(subtitle, CYAN, YELLOW);
+    if (reply->output->len > 0)
+        printTextBlock(reply->output->data, BOLD GREEN, YELLOW);
+    if (reply->status != 0) {
+        char note[64];
+
+        snprintf(note, sizeof(note), "request failed (status %d)", reply->status);
+        printTextBlock(note, CYAN, YELLOW);
+    }
+    printBorder("└", "┘", YELLOW);
+}
+
+/*
+ * remote_targets
+ *
+ * Fill targets with the components an action applies to, in the order it
+ * is to be sent: every component with --all, otherwise the component
+ * preceded by all it needs when --with-dependency is given.  With
+ * --all on one host, the components the inventory says it lacks are left
+ * out; a fan-out leaves them out host by host instead.  Returns how many
+ * there are.
+ */
+static int
+remote_targets(bool ALL, Component component, Component *targets)
+{
+    int ntargets = 0;
+
+    if (ALL) {
+        const InventoryHost *ih = many_hosts() ? NULL : target_inventory_host();
+
+        for (Component c = HDFS; c <= RANGER; c++)
+            if (component_to_string(c) && InventoryHostHas(ih, c))
+                targets[ntargets++] = c;
+    } else {
+        if (dependency) {
+            DepGraph graph;
+
+            /* everything it needs, each once, dependencies first */
+            if (DepGraphBuild(&graph, &component, 1) < 0)
+                exit(EXIT_FAILURE);
+            for (int i = 0; i < graph.nnodes; i++)
+                targets[ntargets++] = graph.nodes[i].component;
+        } else
+            targets[ntargets++] = component;
+    }
+    return ntargets;
+}
+
+/*
+ * pipeline_remote_components
+ *
+ * Send the action for every target as a tagged request of one pipelined
+ * session and print each component's output as soon as its request is
+ * done.  The agent runs read-only requests concurrently and keeps the others in
+ * the order they were sent, so dependencies are still handled first.
+ * With --with-metrics a metrics probe goes along, and is answered while
+ * the actions are still running.  An agent that does not support
+ * sessions gets the requests one by one.
+ */
+static void
+pipeline_remote_components(bool ALL, Component component, Action action,
+                           char *version , char *config_param , char *value)
+{
+    Conn *conn = connect_to_debo(host, port);
+    Component targets[RANGER + 8];
+    SessionMux mux;
+    int ntargets = 0;
+    int probe = -1;
+    int tag;
+
+    if (conn == NULL) {
+        fprintf(stderr, "Failed to connect to Debo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* an agent without sessions gets the requests one at a time */
+    if (!(conn->features & PROTO_FEATURE_SESSION)) {
+        if (PutMsgStart(CliMsg_Finish, conn) >= 0) {
+            PutMsgEnd(conn);
+            (void) Flush(conn);
+        }
+        handle_remote_components(ALL, component, action, version, config_param, value);
+        return;
+    }
+
+    ntargets = remote_targets(ALL, component, targets);
+
+    /* tags follow the order of submission, so target i has tag i */
+    SessionMuxInit(&mux, conn);
+    for (int i = 0; i < ntargets; i++) {
+        if (SessionMuxSubmitAction(&mux, targets[i], action, version,
+                                   config_param, value) < 0)
+            exit(EXIT_FAILURE);
+    }
+    if (pipeline_metrics &&
+        (probe = SessionMuxSubmit(&mux, CliMsg_Metrics, NULL, 0)) < 0)
+        exit(EXIT_FAILURE);
+    SessionMuxFinish(&mux);
+
+    while ((tag = SessionMuxNextDone(&mux)) >= 0) {
+        if (tag == probe)
+            print_pipeline_reply("Agent", "Metrics", &mux.replies[tag]);
+        else
+            print_pipeline_reply(component_to_string(targets[tag]),
+                                 action_to_string(action), &mux.replies[tag]);
+    }
+    if (mux.pending > 0)
+        exit(EXIT_FAILURE);
+    SessionMuxTerm(&mux);
+}
+
+/*
+ * daemon_connect
+ *
+ * The socket of the running debod, or -1 if there is none or --no-daemon
+ * was given.
+ */
+static int
+daemon_connect(void)
+{
+    return no_daemon ? -1 : DebodConnect();
+}
+
+/*
+ * daemon_remote_components
+ *
+ * Do what pipeline_remote_components does, over the session debod keeps
+ * to the agent instead of a connection of our own.  Returns false, having
+ * sent nothing, if no daemon is running.
+ */
+static bool
+daemon_remote_components(bool ALL, Component component, Action action,
+                         char *version , char *config_param , char *value)
+{
+    Component targets[RANGER + 8];
+    SessionReply replies[RANGER + 9];
+    ExpBufferData frame;
+    int sock;
+    int ntargets;
+    int nreplies;
+    int pending;
+    int probe = -1;
+
+    /* a bare --metrics is not a component action */
+    if (!ALL && component == NONE)
+        return false;
+    sock = daemon_connect();
+    if (sock < 0)
+        return false;
+
+    /* tags follow the order of submission, so target i has tag i */
+    ntargets = remote_targets(ALL, component, targets);
+    for (int i = 0; i < ntargets; i++) {
+        if (DebodSubmitAction(sock, i, host, port, targets[i], action,
+                              version, config_param, value) < 0)
+            exit(EXIT_FAILURE);
+    }
+    nreplies = ntargets;
+    if (pipeline_metrics) {
+        probe = nreplies++;
+        if (DebodSubmitRequest(sock, probe, host, port, CliMsg_Metrics, NULL, 0) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    memset(replies, 0, sizeof(replies));
+    for (int i = 0; i < nreplies; i++)
+        replies[i].output = createExpBuffer();
+
+    initExpBuffer(&frame);
+    for (pending = nreplies; pending > 0;) {
+        SessionReply *reply;
+        char type;
+        int tag;
+
+        if (DebodReadFrame(sock, &type, &tag, &frame) < 0)
+            exit(EXIT_FAILURE);
+        if (tag < 0 || tag >= nreplies || replies[tag].done)
+            continue;
+
+        reply = &replies[tag];
+        if (type == DebodMsg_Output)
+            appendBinaryExpBuffer(reply->output, frame.data, frame.len);
+        else if (type == DebodMsg_Done && frame.len >= 4) {
+            memcpy(&reply->status, frame.data, 4);
+            reply->done = true;
+            pending--;
+            if (tag == probe)
+                print_pipeline_reply("Agent", "Metrics", reply);
+            else
+                print_pipeline_reply(component_to_string(targets[tag]),
+                                     action_to_string(action), reply);
+        }
+    }
+    termExpBuffer(&frame);
+    for (int i = 0; i < nreplies; i++)
+        destroyExpBuffer(replies[i].output);
+    close(sock);
+    return true;
+}
+
+/*
+ * daemon_control_request
+ *
+ * Do what agent_control_request does, through debod.  The reply is
+ * printed as it arrives.  Returns false, having sent nothing, if no
+ * daemon is running.
+ */
+static bool
+daemon_control_request(unsigned char code, const char *body)
+{
+    ExpBufferData frame;
+    int sock = daemon_connect();
+    int status = -1;
+
+    if (sock < 0)
+        return false;
+
+    if (DebodSubmitRequest(sock, 0, host, port, code, body,
+                           body ? strlen(body) : 0) < 0)
+        exit(EXIT_FAILURE);
+
+    initExpBuffer(&frame);
+    for (;;) {
+        char type;
+        int tag;
+
+        if (DebodReadFrame(sock, &type, &tag, &frame) < 0)
+            exit(EXIT_FAILURE);
+        if (type == DebodMsg_Output) {
+            fwrite(frame.data, 1, frame.len, stdout);
+            fflush(stdout);
+        } else if (type == DebodMsg_Done && frame.len >= 4) {
+            memcpy(&status, frame.data, 4);
+            break;
+        }
+    }
+    termExpBuffer(&frame);
+    close(sock);
+    if (status != RESP_OK)
+        exit(EXIT_FAILURE);
+    return true;
+}
+
+/*
+ * show_daemon_status
+ *
+ * Print debod's health report of the agent sessions it keeps.
+ */
+static void
+show_daemon_status(void)
+{
+    ExpBufferData frame;
+    int sock = DebodConnect();
+
+    if (sock < 0) {
+        fprintf(stderr, "debod is not running (no socket at %s)\n",
+                debod_socket_path());
+        exit(EXIT_FAILURE);
+    }
+    if (DebodSubmitHealth(sock, 0) < 0)
+        exit(EXIT_FAILURE);
+
+    initExpBuffer(&frame);
+    for (;;) {
+        char type;
+        int tag;
+
+        if (DebodReadFrame(sock, &type, &tag, &frame) < 0)
+            exit(EXIT_FAILURE);
+        if (type == DebodMsg_Done)
+            break;
+        if (type == DebodMsg_Output)
+            fwrite(frame.data, 1, frame.len, stdout);
+    }
+    termExpBuffer(&frame);
+    close(sock);
+}
+
+/*
+ * fanout_hosts
+ *
+ * Collect the hosts of --hosts, --host-file and, with --cluster, the
+ * inventory into hosts, which is grown as needed.  In the file, blank
+ * lines and lines starting with # are skipped.  With --role or --tag only
+ * the inventory hosts that match are kept.  Returns how many there are;
+ * exits if the file cannot be read or there are none.
+ */
+static int
+fanout_hosts(char ***hosts)
+{
+    char **list = NULL;
+    int nhosts = 0;
+    int capacity = 0;
+    char line[MAX_LINE_LENGTH];
+    FILE *fp = NULL;
+    char *next = hosts_arg;
+    Inventory *inv = (cluster || role_filter || tag_filter) ? get_inventory(true) : NULL;
+    int ninventory = 0;
+    int kept = 0;
+
+    if (host_file && (fp = fopen(host_file, "r")) == NULL) {
+        fprintf(stderr, "Error: could not open host file \"%s\": %s\n",
+                host_file, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (;;) {
+        char *name;
+
+        if (next != NULL) {
+            name = strsep(&next, ",");
+        } else if (fp != NULL && fgets(line, sizeof(line), fp) != NULL) {
+            name = line;
+            if (name[0] == '#')
+                continue;
+        } else if (cluster && ninventory < inv->nhosts) {
+            snprintf(line, sizeof(line), "%s", inv->hosts[ninventory++].name);
+            name = line;
+        } else
+            break;
+
+        name = trim(name);
+        if (name[0] == '\0')
+            continue;
+        if (nhosts == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            list = realloc(list, capacity * sizeof(char *));
+            if (list == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        list[nhosts++] = apache_strdup(name);
+    }
+    if (fp != NULL)
+        fclose(fp);
+    if (nhosts == 0) {
+        fprintf(stderr, "Error: no hosts given\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (role_filter || tag_filter) {
+        for (int i = 0; i < nhosts; i++) {
+            InventoryHost *h = InventoryFind(inv, list[i]);
+
+            if (h != NULL && InventoryHostMatches(h, role_filter, tag_filter))
+                list[kept++] = list[i];
+            else
+                free(list[i]);
+        }
+        nhosts = kept;
+        if (nhosts == 0) {
+            fprintf(stderr, "Error: no inventory host matches%s%s%s%s\n",
+                    role_filter ? " --role=" : "", role_filter ? role_filter : "",
+                    tag_filter ? " --tag=" : "", tag_filter ? tag_filter : "");
+            exit(EXIT_FAILURE);
+        }
+    }
+    *hosts = list;
+    return nhosts;
+}
+
+/* What every host of a fan-out is sent */
+typedef struct FanoutRequest
+{
+    Component targets[RANGER + 8];
+    int ntargets;
+    Action action;
+    char *version;
+    char *config_param;
+    char *value;
+    unsigned char code;			/* or else a control request */
+    const char *body;
+    const char *title;			/* heading of each host's output */
+} FanoutRequest;
+
+/*
+ * host_targets
+ *
+ * The targets of req that host, given as host or host:port, has by the
+ * inventory, in the same order.  Returns how many there are.
+ */
+static int
+host_targets(const char *host, const FanoutRequest *req, Component *targets)
+{
+    const InventoryHost *ih = InventoryFind(get_inventory(false), host);
+    int ntargets = 0;
+
+    for (int i = 0; i < req->ntargets; i++)
+        if (InventoryHostHas(ih, req->targets[i]))
+            targets[ntargets++] = req->targets[i];
+    return ntargets;
+}
+
+/* The host of a fan-out as host:port, for the inventory and for people */
+static void
+fanout_host_name(const FanoutHost *h, char *name, size_t size)
+{
+    snprintf(name, size, "%s%s%s", h->host,
+             h->port ? ":" : "", h->port ? h->port : "");
+}
+
+static int
+fanout_queue(FanoutHost *h, void *arg)
+{
+    FanoutRequest *req = arg;
+    Conn *conn = h->conn;
+    Component targets[RANGER + 8];
+    char name[300];
+    int ntargets;
+    int nrequests = 0;
+
+    if (req->code) {
+        if (PutMsgStart(req->code, conn) < 0 ||
+            (req->body && Putnchar(req->body, strlen(req->body), conn) < 0) ||
+            PutMsgEnd(conn) < 0)
+            return -1;
+        return 1;
+    }
+    fanout_host_name(h, name, sizeof(name));
+    ntargets = host_targets(name, req, targets);
+    for (int i = 0; i < ntargets; i++) {
+        /* a version switch is an uninstall then an install */
+        if (req->action == VERSION_SWITCH) {
+            if (QueueComponentActionCommand(targets[i], UNINSTALL, NULL,
+                                            NULL, NULL, conn) < 0 ||
+                QueueComponentActionCommand(targets[i], INSTALL,
+                                            req->version, req->config_param,
+                                            req->value, conn) < 0)
+                return -1;
+            nrequests += 2;
+        } else {
+            if (QueueComponentActionCommand(targets[i], req->action,
+                                            req->version, req->config_param,
+                                            req->value, conn) < 0)
+                return -1;
+            nrequests++;
+        }
+    }
+    return nrequests;
+}
+
+/* The health check of a rolling operation: the targets' reports */
+static int
+fanout_queue_report(FanoutHost *h, void *arg)
+{
+    FanoutRequest *req = arg;
+    Component targets[RANGER + 8];
+    char name[300];
+    int ntargets;
+
+    fanout_host_name(h, name, sizeof(name));
+    ntargets = host_targets(name, req, targets);
+    for (int i = 0; i < ntargets; i++) {
+        if (QueueComponentActionCommand(targets[i], NO_ACTION, NULL,
+                                        NULL, NULL, h->conn) < 0)
+            return -1;
+    }
+    return ntargets;
+}
+
+/* Print a host's output as soon as it is done with */
+static void
+fanout_host_done(FanoutHost *h, void *arg)
+{
+    FanoutRequest *req = arg;
+    char title[300];
+    char note[320];
+
+    fanout_host_name(h, title, sizeof(title));
+    printBorder("┌", "┐", YELLOW);
+    printTextBlock(title, BOLD GREEN, YELLOW);
+    printBorder("├", "┤", YELLOW);
+    printTextBlock(req->title, CYAN, YELLOW);
+    if (h->output->len > 0)
+        printTextBlock(h->output->data, BOLD GREEN, YELLOW);
+    if (h->state != FANOUT_DONE) {
+        snprintf(note, sizeof(note), "%s: %s", FanoutStateName(h->state), h->error);
+        printTextBlock(note, CYAN, YELLOW);
+    } else if (h->status != 0) {
+        snprintf(note, sizeof(note), "request failed (status %d)", h->status);
+        printTextBlock(note, CYAN, YELLOW);
+    }
+    printBorder("└", "┘", YELLOW);
+    fflush(stdout);
+}
+
+/*
+ * prefetch_fanout_tickets
+ *
+ * Get the service tickets of the agents on hosts, entries of --hosts and
+ * --host-file, all at once: the KDC round trips overlap instead of each
+ * connection making its own.
+ */
+static void
+prefetch_fanout_tickets(char **hosts, int nhosts)
+{
+    const char **names = malloc(nhosts * sizeof(char *));
+
+    if (names == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nhosts; i++) {
+        char *colon = strchr(hosts[i], ':');
+
+        /* host:port, but not an IPv6 address */
+        if (colon != NULL && strchr(colon + 1, ':') == NULL)
+            names[i] = strndup(hosts[i], colon - hosts[i]);
+        else
+            names[i] = strdup(hosts[i]);
+        if (names[i] == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    (void) prefetch_service_tickets(names, nhosts);
+    for (int i = 0; i < nhosts; i++)
+        free((char *) names[i]);
+    free(names);
+}
+
+/*
+ * drop_idle_hosts
+ *
+ * Leave out of hosts, which keeps its order, the ones the inventory says
+ * have none of the components of req, and say how many those were.
+ * Returns how many hosts are left.
+ */
+static int
+drop_idle_hosts(char **hosts, int nhosts, const FanoutRequest *req)
+{
+    Component targets[RANGER + 8];
+    int kept = 0;
+
+    if (req->code)
+        return nhosts;
+    for (int i = 0; i < nhosts; i++) {
+        char name[MAX_PATH_LEN];
+        const char *colon = strchr(hosts[i], ':');
+
+        /* with the default port, as the inventory may name it */
+        if (colon == NULL && port)
+            snprintf(name, sizeof(name), "%s:%s", hosts[i], port);
+        else
+            snprintf(name, sizeof(name), "%s", hosts[i]);
+        if (host_targets(name, req, targets) > 0)
+            hosts[kept++] = hosts[i];
+        else
+            free(hosts[i]);
+    }
+    if (kept < nhosts)
+        printf("skipping %d host(s) that have none of the components, by the inventory\n",
+               nhosts - kept);
+    return kept;
+}
+
+/*
+ * run_fanout
+ *
+ * Send req to every host at once, print each host's output as it is done
+ * and then a summary of them all.  Exits unless every host succeeded.
+ */
+static void
+run_fanout(FanoutRequest *req)
+{
+    struct timespec start, end;
+    Fanout fan;
+    char **hosts;
+    int nhosts = fanout_hosts(&hosts);
+    int failed;
+    int succeeded = 0;
+    double slowest = 0;
+
+    nhosts = drop_idle_hosts(hosts, nhosts, req);
+    if (nhosts == 0) {
+        free(hosts);
+        return;
+    }
+    if (FanoutInit(&fan, (const char *const *) hosts, nhosts, port) < 0)
+        exit(EXIT_FAILURE);
+    fan.parallel = fanout_parallel;
+    fan.timeout_ms = fanout_timeout * 1000;
+    fan.queue = fanout_queue;
+    fan.done = fanout_host_done;
+    fan.arg = req;
+
+    prefetch_fanout_tickets(hosts, nhosts);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    failed = FanoutRun(&fan);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (failed < 0)
+        exit(EXIT_FAILURE);
+
+    printf("\n%-32s %-10s %6s %10s  %s\n", "HOST", "RESULT", "STATUS",
+           "ELAPSED", "ERROR");
+    for (int i = 0; i < nhosts; i++) {
+        FanoutHost *h = &fan.hosts[i];
+        char name[300];
+        const char *result;
+
+        fanout_host_name(h, name, sizeof(name));
+        if (h->state != FANOUT_DONE)
+            result = FanoutStateName(h->state);
+        else if (h->status != 0)
+            result = "error";
+        else {
+            result = "ok";
+            succeeded++;
+        }
+        if (h->elapsed_ms > slowest)
+            slowest = h->elapsed_ms;
+        if (h->state == FANOUT_DONE)
+            printf("%-32s %-10s %6d %8.0fms\n", name, result, h->status,
+                   h->elapsed_ms);
+        else
+            printf("%-32s %-10s %6s %8.0fms  %s\n", name, result, "-",
+                   h->elapsed_ms, h->error);
+    }
+    printf("%d/%d hosts succeeded in %.0f ms (slowest host %.0f ms)\n",
+           succeeded, nhosts,
+           (end.tv_sec - start.tv_sec) * 1000.0 +
+           (end.tv_nsec - start.tv_nsec) / 1000000.0, slowest);
+
+    FanoutTerm(&fan);
+    for (int i = 0; i < nhosts; i++)
+        free(hosts[i]);
+    free(hosts);
+    if (succeeded < nhosts)
+        exit(EXIT_FAILURE);
+}
+
+/*
+ * fanout_remote_components
+ *
+ * Do what handle_remote_components does on one host, on the agents of
+ * all the hosts of --hosts and --host-file at once.
+ */
+static void
+fanout_remote_components(Component component, Action action,
+                         char *version , char *config_param , char *value)
+{
+    FanoutRequest req;
+
+    memset(&req, 0, sizeof(req));
+    req.ntargets = remote_targets(all, component, req.targets);
+    req.action = action;
+    req.version = version;
+    req.config_param = config_param;
+    req.value = value;
+    req.title = all ? action_to_string(action) : component_to_string(component);
+    run_fanout(&req);
+}
+
+/*
+ * fanout_control_request
+ *
+ * Do what agent_control_request does, on the agents of all the hosts of
+ * --hosts and --host-file at once.
+ */
+static void
+fanout_control_request(unsigned char code, const char *body)
+{
+    FanoutRequest req;
+
+    memset(&req, 0, sizeof(req));
+    req.code = code;
+    req.body = body;
+    req.title = code == CliMsg_Agent_Stats ? "Agent statistics" : "Jobs";
+    run_fanout(&req);
+}
+
+/*
+ * rolling_remote_components
+ *
+ * Do what fanout_remote_components does, a batch of hosts at a time,
+ * waiting for the components' reports to come back healthy after each
+ * batch.  Exits unless every host ended up healthy.
+ */
+static void
+rolling_remote_components(Component component, Action action,
+                          char *version , char *config_param , char *value)
+{
+    FanoutRequest req;
+    char **hosts;
+    int nhosts = fanout_hosts(&hosts);
+    int remaining;
+
+    memset(&req, 0, sizeof(req));
+    req.ntargets = remote_targets(all, component, req.targets);
+    req.action = action;
+    req.version = version;
+    req.config_param = config_param;
+    req.value = value;
+    req.title = all ? action_to_string(action) : component_to_string(component);
+    nhosts = drop_idle_hosts(hosts, nhosts, &req);
+    if (nhosts == 0) {
+        free(hosts);
+        return;
+    }
+
+    if (rolling_plan.max_unavailable == 0)
+        rolling_plan.max_unavailable = rolling_plan.batch;
+    rolling_plan.timeout_ms = fanout_timeout * 1000;
+    rolling_plan.action = fanout_queue;
+    rolling_plan.health = fanout_queue_report;
+    rolling_plan.done = fanout_host_done;
+    rolling_plan.arg = &req;
+
+    prefetch_fanout_tickets(hosts, nhosts);
+    remaining = RollingRun(&rolling_plan, (const char *const *) hosts, nhosts, port);
+    for (int i = 0; i < nhosts; i++)
+        free(hosts[i]);
+    free(hosts);
+    if (remaining > 0)
+        exit(EXIT_FAILURE);
+}
+
+/*
+ * refresh_inventory
+ *
+ * Ask the agents of the inventory hosts, --role and --tag permitting,
+ * what they have installed, all at once, and keep the answers in the
+ * inventory cache.  A host that does not answer keeps what the cache said
+ * before.  Exits unless every host answered.
+ */
+static void
+refresh_inventory(void)
+{
+    Inventory *inv = get_inventory(true);
+    const char **names = malloc((inv->nhosts > 0 ? inv->nhosts : 1) * sizeof(char *));
+    InventoryHost **entries = malloc((inv->nhosts > 0 ? inv->nhosts : 1) * sizeof(InventoryHost *));
+    FanoutRequest req;
+    Fanout fan;
+    int nhosts = 0;
+    int failed;
+
+    if (names == NULL || entries == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < inv->nhosts; i++) {
+        if (!InventoryHostMatches(&inv->hosts[i], role_filter, tag_filter))
+            continue;
+        entries[nhosts] = &inv->hosts[i];
+        names[nhosts++] = inv->hosts[i].name;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.code = CliMsg_Inventory;
+    if (FanoutInit(&fan, names, nhosts, port) < 0)
+        exit(EXIT_FAILURE);
+    fan.parallel = fanout_parallel;
+    fan.timeout_ms = fanout_timeout * 1000;
+    fan.queue = fanout_queue;
+    fan.arg = &req;
+
+    prefetch_fanout_tickets((char **) names, nhosts);
+    if ((failed = FanoutRun(&fan)) < 0)
+        exit(EXIT_FAILURE);
+
+    for (int i = 0; i < nhosts; i++) {
+        FanoutHost *h = &fan.hosts[i];
+
+        if (h->state != FANOUT_DONE || h->status != 0) {
+            if (h->state == FANOUT_DONE) {
+                snprintf(h->error, sizeof(h->error), "request failed (status %d)", h->status);
+                failed++;
+            }
+            printf("%-32s %s\n", names[i], h->error);
+            continue;
+        }
+        printf("%-32s %d installed:", names[i],
+               InventoryParseInstalled(entries[i], h->output->data));
+        for (Component c = FLINK; c <= ZOOKEEPER; c++)
+            if (entries[i]->installed & COMPONENT_BIT(c))
+                printf(" %s", component_to_string(c));
+        printf("\n");
+    }
+    FanoutTerm(&fan);
+    free(names);
+    free(entries);
+
+    if (InventorySaveCache(inv) < 0)
+        exit(EXIT_FAILURE);
+    printf("%d/%d hosts refreshed\n", nhosts - failed, nhosts);
+    if (failed > 0)
+        exit(EXIT_FAILURE);
+}
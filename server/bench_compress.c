@@ -0,0 +1,210 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * bench_compress.c
+ *		Compare response compression against plain responses.
+ *
+ * Sends the same request to an agent a number of times over one
+ * connection, once without compression and once with each algorithm this
+ * client was built with, and reports per request how many bytes of
+ * output came back, how many bytes that took on the wire (after GSSAPI
+ * wrapping, as counted on the socket) and how long the response took.
+ *
+ *		bench_compress --host=HOST --port=PORT [--request=CODE] [--count=N]
+ *
+ * CODE is the request byte, in hex; the default is the HDFS report.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "getopt_long.h"
+#include "utiles.h"
+#include "connect.h"
+#include "protocol.h"
+
+#define BENCH_DEFAULT_COUNT		20
+
+/* what the rest of the client library expects the program to define */
+const char *port = NULL;
+const char *host = NULL;
+char	   *value = NULL;
+bool		dependency = false;
+bool		metrics = false;
+
+typedef struct BenchResult
+{
+    long		output;			/* output bytes, all requests */
+    long		wire;			/* bytes received, all requests */
+    double		total_ms;
+    double		min_ms;
+    double		max_ms;
+} BenchResult;
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+        (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/*
+ * Run the request count times on a new connection with the given
+ * compression.  Returns 0 on success, -1 if the agent could not be used.
+ */
+static int
+run_bench(const char *algorithm, unsigned char code, int count,
+          BenchResult *result)
+{
+    Conn	   *conn;
+    ExpBufferData output;
+
+    if (set_compress_offer(algorithm) < 0)
+        return -1;
+    conn = connect_to_debo(host, port);
+    if (conn == NULL)
+        return -1;
+    if (strcmp(algorithm, "none") != 0 && conn->compression == COMPRESS_NONE)
+    {
+        fprintf(stderr, "agent does not support %s compression\n", algorithm);
+        return -1;
+    }
+
+    memset(result, 0, sizeof(*result));
+    initExpBuffer(&output);
+    for (int i = 0; i < count; i++)
+    {
+        struct timespec start;
+        long		wire_before = conn->bytesReceived;
+        double		ms;
+
+        resetExpBuffer(&output);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (PutMsgStart(code, conn) < 0 || PutMsgEnd(conn) < 0 ||
+            Flush(conn) < 0 ||
+            ReadResponse(conn, RESPONSE_QUIET, &output) < 0)
+        {
+            fprintf(stderr, "request failed\n");
+            termExpBuffer(&output);
+            return -1;
+        }
+        ms = elapsed_ms(&start);
+
+        result->output += output.len;
+        result->wire += conn->bytesReceived - wire_before;
+        result->total_ms += ms;
+        if (i == 0 || ms < result->min_ms)
+            result->min_ms = ms;
+        if (ms > result->max_ms)
+            result->max_ms = ms;
+    }
+    termExpBuffer(&output);
+
+    if (PutMsgStart(CliMsg_Finish, conn) >= 0)
+    {
+        PutMsgEnd(conn);
+        (void) Flush(conn);
+    }
+    return 0;
+}
+
+static void
+print_result(const char *algorithm, int count, const BenchResult *result,
+             const BenchResult *plain)
+{
+    printf("%-6s %12ld %12ld %7.3f %10.3f %10.3f %10.3f\n",
+           algorithm,
+           result->output / count,
+           result->wire / count,
+           plain->wire > 0 ? (double) result->wire / plain->wire : 0.0,
+           result->total_ms / count, result->min_ms, result->max_ms);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        {"host", required_argument, NULL, 'H'},
+        {"port", required_argument, NULL, 'P'},
+        {"request", required_argument, NULL, 'r'},
+        {"count", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+    static const char *const algorithms[] = {"lz4", "zstd"};
+    unsigned char code = CliMsg_Hdfs;
+    int			count = BENCH_DEFAULT_COUNT;
+    BenchResult plain;
+    BenchResult result;
+    int			optindex;
+    int			c;
+
+    while ((c = getopt_long(argc, argv, "H:P:r:n:", long_options, &optindex)) != -1)
+    {
+        switch (c)
+        {
+            case 'H':
+                host = optarg;
+                break;
+            case 'P':
+                port = optarg;
+                break;
+            case 'r':
+                code = (unsigned char) strtoul(optarg, NULL, 16);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s --host=HOST --port=PORT [--request=CODE] [--count=N]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (host == NULL || port == NULL || count <= 0)
+    {
+        fprintf(stderr, "usage: %s --host=HOST --port=PORT [--request=CODE] [--count=N]\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("request 0x%02X, %d times per algorithm\n\n", code, count);
+    printf("%-6s %12s %12s %7s %10s %10s %10s\n",
+           "algo", "output/req", "wire/req", "ratio", "mean ms", "min ms", "max ms");
+
+    if (run_bench("none", code, count, &plain) < 0)
+        exit(EXIT_FAILURE);
+    print_result("none", count, &plain, &plain);
+
+    for (int i = 0; i < (int) (sizeof(algorithms) / sizeof(algorithms[0])); i++)
+    {
+        if (set_compress_offer(algorithms[i]) < 0)
+        {
+            printf("%-6s (not built in)\n", algorithms[i]);
+            continue;
+        }
+        if (run_bench(algorithms[i], code, count, &result) == 0)
+            print_result(algorithms[i], count, &result, &plain);
+    }
+    return 0;
+}
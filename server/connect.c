@@ -29,11 +29,13 @@
 #include <time.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/types.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "connect.h"
+#include "protocol.h"
 
 #ifdef WIN32
 #include "win32.h"
@@ -138,6 +140,9 @@ static const internalconninfoOption conninfoOptions[] = {
         "TCP-User-Timeout", "", 10, /* strlen(INT32_MAX) == 10 */
         offsetof(struct pg_conn, pgtcp_user_timeout)},
 
+    {"transport", "DEBO_TRANSPORT", "encrypt", NULL,
+        "Transport", "", 9,		/* sizeof("integrity") == 9 */
+        offsetof(struct pg_conn, transport)},
 
     /* Terminating entry --- MUST BE LAST */
     {NULL, NULL, NULL, NULL,
@@ -178,6 +183,13 @@ static conninfoOption *conninfo_storeval(conninfoOption *connOptions,
                                          ExpBuffer errorMessage, bool ignoreMissing, bool uri_decode);
 static conninfoOption *conninfo_find(conninfoOption *connOptions,
                                      const char *keyword);
+static Conn *connectStartInternal(const char *const *keywords,
+                                  const char *const *values, bool nonblocking);
+static bool next_address(Conn *conn);
+static bool start_connect(Conn *conn);
+static void drop_connection_attempt(Conn *conn);
+static bool local_agent_trusted(Conn *conn);
+static int	connectComplete(Conn *conn);
 /*
  *		connectStartParams
  *
@@ -198,6 +210,30 @@ static conninfoOption *conninfo_find(conninfoOption *connOptions,
 Conn *
 connectStartParams(const char *const *keywords,
                    const char *const *values)
+{
+    return connectStartInternal(keywords, values, false);
+}
+
+/*
+ *		connectStartParamsAsync
+ *
+ * Like connectStartParams, but returns as soon as the connection would
+ * have to wait, with the status CONNECTION_BAD on failure.  Otherwise
+ * call connectPoll whenever the socket is ready for what it asked for,
+ * until it returns PGRES_POLLING_OK or PGRES_POLLING_FAILED.  The
+ * connection stays non-blocking once made: Flush may then leave data
+ * unsent, and ReadData returns 0 when there is nothing to read.
+ */
+Conn *
+connectStartParamsAsync(const char *const *keywords,
+                        const char *const *values)
+{
+    return connectStartInternal(keywords, values, true);
+}
+
+static Conn *
+connectStartInternal(const char *const *keywords, const char *const *values,
+                     bool nonblocking)
 {
     Conn	   *conn;
     conninfoOption *connOptions;
@@ -210,6 +246,7 @@ connectStartParams(const char *const *keywords,
     conn = MakeEmptyConn();
     if (conn == NULL)
         return NULL;
+    conn->nonblocking = nonblocking;
 
     /*
      * Parse the conninfo arrays
@@ -437,7 +474,11 @@ ConnectOptions2(Conn *conn)
             ch->type = CHT_HOST_ADDRESS;
         else if (ch->host != NULL && ch->host[0] != '\0')
         {
-            ch->type = CHT_HOST_NAME;
+            /* an absolute path names the agent's Unix socket directory */
+            if (ch->host[0] == '/')
+                ch->type = CHT_UNIX_SOCKET;
+            else
+                ch->type = CHT_HOST_NAME;
         }
         else
         {
@@ -504,6 +545,24 @@ ConnectOptions2(Conn *conn)
     }
 
 
+    /*
+     * The transport has to match what the agent's port offers; an
+     * integrity-only or plaintext port is a separate listener.
+     */
+    if (conn->transport == NULL || strcmp(conn->transport, "encrypt") == 0)
+        conn->transport_mode = TRANSPORT_ENCRYPT;
+    else if (strcmp(conn->transport, "integrity") == 0)
+        conn->transport_mode = TRANSPORT_INTEGRITY;
+    else if (strcmp(conn->transport, "plain") == 0)
+        conn->transport_mode = TRANSPORT_PLAIN;
+    else
+    {
+        conn->status = CONNECTION_BAD;
+        fprintf(stderr, "invalid transport value: \"%s\" (expected encrypt, integrity or plain)\n",
+                conn->transport);
+        return false;
+    }
+
     /*
      * If password was not given, try to look it up in password file.  Note
      * that the result might be different for each host/port pair.
@@ -906,6 +965,9 @@ connectFailureMessage(Conn *conn, int errorno)
                     "%s\n",
                     SOCK_STRERROR(errorno, sebuf, sizeof(sebuf)));
 
+    /* whoever drives a non-blocking connection reports errorMessage */
+    if (Isnonblocking(conn))
+        return;
     if (conn->raddr.addr.ss_family == AF_UNIX)
         fprintf(stderr, "\tIs the server running locally and accepting connections on that socket?");
     else
@@ -945,9 +1007,15 @@ ConnectStart(Conn *conn)
      * so that it can easily be re-executed if needed again during the
      * asynchronous startup process.  However, we must run it once here,
      * because callers expect a success return from this routine to mean that
-     * we are in PGRES_POLLING_WRITING connection state.
+     * the connection is under way.  A blocking connection is also waited
+     * for here.
      */
-    if (connectPoll(conn))
+    if (Isnonblocking(conn))
+    {
+        if (connectPoll(conn) != PGRES_POLLING_FAILED)
+            return 1;
+    }
+    else if (connectComplete(conn))
         return 1;
 
 connect_errReturn:
@@ -956,6 +1024,49 @@ connect_errReturn:
 }
 
 
+/*
+ * local_agent_trusted -- is the process serving a Unix socket root, or
+ * the user named (or numbered) by DEBO_AGENT_USER?
+ *
+ * The Unix socket skips GSSAPI, so without this any local user who got to
+ * the socket path first would be sent our commands.
+ */
+static bool
+local_agent_trusted(Conn *conn)
+{
+    const char *agent_user = getenv("DEBO_AGENT_USER");
+    uid_t		uid;
+    gid_t		gid;
+
+    if (getpeereid(conn->sock, &uid, &gid) != 0)
+    {
+        appendExpBuffer(&conn->errorMessage,
+                        "could not get credentials of the local agent: %s\n",
+                        strerror(errno));
+        return false;
+    }
+    if (uid == 0)
+        return true;
+    if (agent_user != NULL && agent_user[0] != '\0')
+    {
+        struct passwd *pw;
+        char	   *endptr;
+        unsigned long val = strtoul(agent_user, &endptr, 10);
+
+        if (*endptr == '\0' && val == (unsigned long) uid)
+            return true;
+        pw = getpwnam(agent_user);
+        if (pw != NULL && pw->pw_uid == uid)
+            return true;
+    }
+    appendExpBuffer(&conn->errorMessage,
+                    "local agent socket is served by uid %u, not root%s%s\n",
+                    (unsigned int) uid,
+                    agent_user && agent_user[0] ? " or " : "",
+                    agent_user && agent_user[0] ? agent_user : "");
+    return false;
+}
+
 /*
  * BSD-style getpeereid() for platforms that lack it.
  */
@@ -1008,6 +1119,51 @@ getpeereid(int sock, uid_t *uid, gid_t *gid)
 }
 
 
+/*
+ *	getaddrinfo_unix - get unix socket info using IPv6-compatible API
+ *
+ * Bugs: only one addrinfo is set even though hintsp is NULL or
+ *		 ai_socktype is 0
+ */
+static int
+getaddrinfo_unix(const char *path, const struct addrinfo *hintsp,
+                 struct addrinfo **result)
+{
+    struct addrinfo *aip;
+    struct sockaddr_un *unp;
+
+    *result = NULL;
+
+    if (strlen(path) >= sizeof(unp->sun_path))
+        return EAI_FAIL;
+
+    aip = calloc(1, sizeof(struct addrinfo));
+    if (aip == NULL)
+        return EAI_MEMORY;
+
+    unp = calloc(1, sizeof(struct sockaddr_un));
+    if (unp == NULL)
+    {
+        free(aip);
+        return EAI_MEMORY;
+    }
+
+    aip->ai_family = AF_UNIX;
+    aip->ai_socktype = hintsp->ai_socktype ? hintsp->ai_socktype : SOCK_STREAM;
+    aip->ai_protocol = hintsp->ai_protocol;
+    aip->ai_next = NULL;
+    aip->ai_canonname = NULL;
+    *result = aip;
+
+    unp->sun_family = AF_UNIX;
+    aip->ai_addr = (struct sockaddr *) unp;
+    aip->ai_addrlen = sizeof(struct sockaddr_un);
+
+    strcpy(unp->sun_path, path);
+
+    return 0;
+}
+
 /*
  *	pg_getaddrinfo_all - get address info for Unix, IPv4 and IPv6 sockets
  */
@@ -1020,6 +1176,9 @@ pg_getaddrinfo_all(const char *hostname, const char *servname,
     /* not all versions of getaddrinfo() zero *result on failure */
     *result = NULL;
 
+    if (hintp->ai_family == AF_UNIX)
+        return getaddrinfo_unix(servname, hintp, result);
+
 
     /* NULL has special meaning to getaddrinfo(). */
     rc = getaddrinfo((!hostname || hostname[0] == '\0') ? NULL : hostname,
@@ -1035,52 +1194,174 @@ pg_getaddrinfo_all(const char *hostname, const char *servname,
  *
  * Poll an asynchronous connection.
  *
- * Before calling this function, use select(2) to determine when data
- * has arrived..
+ * Advances the connection as far as it can go without waiting, and says
+ * what to wait for before calling again: PGRES_POLLING_WRITING while
+ * connect() is in progress, PGRES_POLLING_READING or _WRITING during the
+ * security handshake.  PGRES_POLLING_OK means the connection is made and
+ * its status is CONNECTION_STARTED; PGRES_POLLING_FAILED means every
+ * address of every host failed, with the status CONNECTION_BAD.
+ *
+ * The socket is non-blocking throughout.  Once the connection is made it
+ * is put back into blocking mode, unless the connection was started with
+ * connectStartParamsAsync().
  *
- * You must call finish whether or not this fails.
+ * You must call CloseConn whether or not this fails.
  *
- * This function and connectStart are intended to allow connections to be
- * made without blocking the execution of your program on remote I/O. However,
- * there are a number of caveats:
+ * This function and connectStartParamsAsync are intended to allow
+ * connections to be made without blocking the execution of your program
+ * on remote I/O. However, there are a number of caveats:
  *
- *	 o	If you call trace, ensure that the stream object into which you trace
- *		will not block.
  *	 o	If you do not supply an IP address for the remote host (i.e. you
- *		supply a host name instead) then connectStart will block on
- *		getaddrinfo.  You will be fine if using Unix sockets (i.e. by
- *		supplying neither a host name nor a host address).
- *	 o	If your backend wants to use Kerberos authentication then you must
- *		supply both a host name and a host address, otherwise this function
- *		may block on gethostname.
+ *		supply a host name instead) then this function will block on
+ *		getaddrinfo the first time through for each host.
+ *	 o	Getting a Kerberos service ticket blocks on the KDC, unless the
+ *		ticket was prefetched, see pg_GSS_prefetch_tickets().
  *
  * ----------------
  */
-
-bool
+PollingStatusType
 connectPoll(Conn *conn)
 {
     char		sebuf[PG_STRERROR_R_BUFLEN];
     int			optval;
-    int			save_whichhost;
-    int			save_whichaddr;
+    socklen_t	optlen;
+    PollingStatusType gss_status;
 
     if (conn == NULL)
-        return false;
+        return PGRES_POLLING_FAILED;
 
-    save_whichhost = conn->whichhost;
-    save_whichaddr = conn->whichaddr;
+    for (;;)
+    {
+        switch (conn->status)
+        {
+        case CONNECTION_BAD:
+            return PGRES_POLLING_FAILED;
+
+        case CONNECTION_STARTED:
+            return PGRES_POLLING_OK;
 
-    for (; conn->whichhost < conn->nconnhost; conn->whichhost++)
+        case CONNECTION_NEEDED:
+            if (!next_address(conn))
+            {
+                conn->status = CONNECTION_BAD;
+                return PGRES_POLLING_FAILED;
+            }
+            if (!start_connect(conn))
+                continue;		/* try the next address */
+            conn->status = CONNECTION_MADE;
+            if (conn->connect_pending)
+                return PGRES_POLLING_WRITING;
+            continue;
+
+        case CONNECTION_MADE:
+            /* connect() is done, one way or the other */
+            optlen = sizeof(optval);
+            if (getsockopt(conn->sock, SOL_SOCKET, SO_ERROR,
+                           (char *) &optval, &optlen) == -1)
+            {
+                fprintf(stderr, "could not get socket error status: %s",
+                        SOCK_STRERROR(SOCK_ERRNO, sebuf, sizeof(sebuf)));
+                drop_connection_attempt(conn);
+                continue;
+            }
+            if (optval == EINPROGRESS)
+                return PGRES_POLLING_WRITING;
+            if (optval != 0)
+            {
+                connectFailureMessage(conn, optval);
+                drop_connection_attempt(conn);
+                continue;
+            }
+
+            conn->laddr.salen = sizeof(conn->laddr.addr);
+            if (getsockname(conn->sock,
+                            (struct sockaddr *) &conn->laddr.addr,
+                            &conn->laddr.salen) < 0)
+            {
+                fprintf(stderr, "could not get client address from socket: %s",
+                        SOCK_STRERROR(SOCK_ERRNO, sebuf, sizeof(sebuf)));
+                drop_connection_attempt(conn);
+                continue;
+            }
+            if (conn->raddr.addr.ss_family == AF_UNIX && !local_agent_trusted(conn))
+            {
+                drop_connection_attempt(conn);
+                continue;
+            }
+            conn->connect_pending = false;
+            conn->status = CONNECTION_GSS_STARTUP;
+            continue;
+
+        case CONNECTION_GSS_STARTUP:
+            /* the agent checks a local peer's credentials instead */
+            if (conn->raddr.addr.ss_family == AF_UNIX)
+                gss_status = pqsecure_open_local(conn);
+            else
+                gss_status = pqsecure_open_gss(conn);
+
+            switch (gss_status)
+            {
+            case PGRES_POLLING_OK:
+                if (!Isnonblocking(conn))
+                {
+                    int			flags = fcntl(conn->sock, F_GETFL, 0);
+
+                    fcntl(conn->sock, F_SETFL, flags & ~O_NONBLOCK);
+                }
+                conn->status = CONNECTION_STARTED;
+                return PGRES_POLLING_OK;
+
+            case PGRES_POLLING_READING:
+            case PGRES_POLLING_WRITING:
+                return gss_status;
+
+            case PGRES_POLLING_FAILED:
+                drop_connection_attempt(conn);
+                continue;
+
+            default:
+                fprintf(stderr, "unexpected GSSAPI polling status: %d",
+                        (int) gss_status);
+                drop_connection_attempt(conn);
+                continue;
+            }
+
+        default:
+            fprintf(stderr, "invalid connection state %d\n", (int) conn->status);
+            conn->status = CONNECTION_BAD;
+            return PGRES_POLLING_FAILED;
+        }
+    }
+}
+
+/*
+ * Move on to the next address to try: the next one of the current host,
+ * else the first of the next host that resolves.  Returns false when
+ * there are no more.
+ *
+ * connectStart() leaves whichhost at -1, before the first host, so the
+ * first call starts at host 0.  No connection may index connhost with
+ * whichhost before that: doing so crashed a second connection made by
+ * the same process.
+ */
+static bool
+next_address(Conn *conn)
+{
+    if (conn->whichhost >= 0 && conn->whichaddr + 1 < conn->naddr)
     {
-        pg_conn_host *ch;
+        conn->whichaddr++;
+        return true;
+    }
+
+    while (++conn->whichhost < conn->nconnhost)
+    {
+        pg_conn_host *ch = &conn->connhost[conn->whichhost];
         struct addrinfo hint;
         struct addrinfo *addrlist;
         int			thisport;
         int			ret;
         char		portstr[MAXPGPATH];
 
-        ch = &conn->connhost[conn->whichhost];
         MemSet(&hint, 0, sizeof(hint));
         hint.ai_socktype = SOCK_STREAM;
         hint.ai_family = AF_UNSPEC;
@@ -1090,7 +1371,7 @@ connectPoll(Conn *conn)
         else
         {
             if (!ParseIntParam(ch->port, &thisport, conn, "port"))
-                goto error_return;
+                return false;
 
             if (thisport < 1 || thisport > 65535)
             {
@@ -1107,7 +1388,7 @@ connectPoll(Conn *conn)
             if (ret || !addrlist)
             {
                 fprintf(stderr, "could not translate host name \"%s\" to address: %s",
-                                     ch->host, gai_strerror(ret));
+                        ch->host, gai_strerror(ret));
                 continue;
             }
             break;
@@ -1118,7 +1399,7 @@ connectPoll(Conn *conn)
             if (ret || !addrlist)
             {
                 fprintf(stderr, "could not parse network address \"%s\": %s",
-                                     ch->hostaddr, gai_strerror(ret));
+                        ch->hostaddr, gai_strerror(ret));
                 continue;
             }
             break;
@@ -1130,7 +1411,7 @@ connectPoll(Conn *conn)
             if (ret || !addrlist)
             {
                 fprintf(stderr, "could not translate Unix-domain socket path \"%s\" to address: %s",
-                                     portstr, gai_strerror(ret));
+                        portstr, gai_strerror(ret));
                 continue;
             }
             break;
@@ -1140,232 +1421,156 @@ connectPoll(Conn *conn)
         }
 
         if (store_conn_addrinfo(conn, addrlist))
-        {
-            //pg_freeaddrinfo_all(hint.ai_family, addrlist);
             continue;
-        }
+        return true;
+    }
+    return false;
+}
 
-        for (conn->whichaddr = (conn->whichhost == save_whichhost) ? save_whichaddr : 0;
-             conn->whichaddr < conn->naddr;
-             conn->whichaddr++)
-        {
-            char		host_addr[NI_MAXHOST];
-            int			sock_type;
-            AddrInfo   *addr_cur;
+/*
+ * Create a non-blocking socket for the current address and start
+ * connecting it.  Returns false, with no socket, if that failed already;
+ * otherwise conn->connect_pending says whether connect() is still in
+ * progress.
+ */
+static bool
+start_connect(Conn *conn)
+{
+    char		sebuf[PG_STRERROR_R_BUFLEN];
+    char		host_addr[NI_MAXHOST];
+    AddrInfo   *addr_cur = &conn->addr[conn->whichaddr];
+    int			sock_type;
+    int			optval;
 
-            addr_cur = &conn->addr[conn->whichaddr];
-            memcpy(&conn->raddr, &addr_cur->addr, sizeof(SockAddr));
+    memcpy(&conn->raddr, &addr_cur->addr, sizeof(SockAddr));
 
-            if (conn->connip != NULL)
-            {
-                free(conn->connip);
-                conn->connip = NULL;
-            }
-            getHostaddr(conn, host_addr, NI_MAXHOST);
-            if (host_addr[0])
-                conn->connip = strdup(host_addr);
+    if (conn->connip != NULL)
+    {
+        free(conn->connip);
+        conn->connip = NULL;
+    }
+    getHostaddr(conn, host_addr, NI_MAXHOST);
+    if (host_addr[0])
+        conn->connip = strdup(host_addr);
 
-            sock_type = SOCK_STREAM;
+    sock_type = SOCK_STREAM | SOCK_NONBLOCK;
 #ifdef SOCK_CLOEXEC
-            sock_type |= SOCK_CLOEXEC;
+    sock_type |= SOCK_CLOEXEC;
 #endif
-            conn->sock = socket(addr_cur->family, sock_type, 0);
-            if (conn->sock == PGINVALID_SOCKET)
-            {
-                int			errorno = SOCK_ERRNO;
-                fprintf(stderr, "could not create socket: %s",
-                                     SOCK_STRERROR(errorno, sebuf, sizeof(sebuf)));
-                continue;
-            }
-
-            if (addr_cur->family != AF_UNIX && !connectNoDelay(conn))
-            {
-                close(conn->sock);
-                conn->sock = PGINVALID_SOCKET;
-                continue;
-            }
+    conn->sock = socket(addr_cur->family, sock_type, 0);
+    if (conn->sock == PGINVALID_SOCKET)
+    {
+        int			errorno = SOCK_ERRNO;
 
-#ifndef SOCK_NONBLOCK
-            //	if (!pg_set_noblock(conn->sock))
-            //	{
-            //		db_append_conn_error(conn, "could not set socket to nonblocking mode: %s",
-            //							 SOCK_STRERROR(SOCK_ERRNO, sebuf, sizeof(sebuf)));
-            //		close(conn->sock);
-            //		conn->sock = PGINVALID_SOCKET;
-            //		continue;
-            //	}
-#endif
-            int flags = fcntl(conn->sock, F_GETFL, 0);
-            fcntl(conn->sock, F_SETFL, flags & ~O_NONBLOCK);  // Disable non-blocking mode
+        fprintf(stderr, "could not create socket: %s",
+                SOCK_STRERROR(errorno, sebuf, sizeof(sebuf)));
+        return false;
+    }
 
+    if (addr_cur->family != AF_UNIX && !connectNoDelay(conn))
+    {
+        drop_connection_attempt(conn);
+        return false;
+    }
 
 #ifndef SOCK_CLOEXEC
 #ifdef F_SETFD
-            if (fcntl(conn->sock, F_SETFD, FD_CLOEXEC) == -1)
-            {
-                fprintf(stderr, "could not set socket to close-on-exec mode: %s",
-                                     SOCK_STRERROR(SOCK_ERRNO, sebuf, sizeof(sebuf)));
-                close(conn->sock);
-                conn->sock = PGINVALID_SOCKET;
-                continue;
-            }
+    if (fcntl(conn->sock, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        fprintf(stderr, "could not set socket to close-on-exec mode: %s",
+                SOCK_STRERROR(SOCK_ERRNO, sebuf, sizeof(sebuf)));
+        drop_connection_attempt(conn);
+        return false;
+    }
 #endif
 #endif
 
-            conn->sigpipe_so = false;
+    conn->sigpipe_so = false;
 #ifdef MSG_NOSIGNAL
-            conn->sigpipe_flag = true;
+    conn->sigpipe_flag = true;
 #else
-            conn->sigpipe_flag = false;
+    conn->sigpipe_flag = false;
 #endif
 
 #ifdef SO_NOSIGPIPE
-            optval = 1;
-            if (setsockopt(conn->sock, SOL_SOCKET, SO_NOSIGPIPE,
-                           (char *) &optval, sizeof(optval)) == 0)
-            {
-                conn->sigpipe_so = true;
-                conn->sigpipe_flag = false;
-            }
+    optval = 1;
+    if (setsockopt(conn->sock, SOL_SOCKET, SO_NOSIGPIPE,
+                   (char *) &optval, sizeof(optval)) == 0)
+    {
+        conn->sigpipe_so = true;
+        conn->sigpipe_flag = false;
+    }
+#else
+    (void) optval;
 #endif
 
-            while (connect(conn->sock, (struct sockaddr *) &addr_cur->addr.addr,
-                           addr_cur->addr.salen) < 0)
-            {
-                if (errno == EINTR)
-                    continue;
-                connectFailureMessage(conn, errno);
-                close(conn->sock);
-                conn->sock = PGINVALID_SOCKET;
-                break;
-            }
-
-            if (conn->sock == PGINVALID_SOCKET)
-                continue;
-
-            socklen_t	optlen = sizeof(optval);
-            if (getsockopt(conn->sock, SOL_SOCKET, SO_ERROR,
-                           (char *) &optval, &optlen) == -1)
-            {
-                fprintf(stderr, "could not get socket error status: %s",
-                                     SOCK_STRERROR(SOCK_ERRNO, sebuf, sizeof(sebuf)));
-                close(conn->sock);
-                conn->sock = PGINVALID_SOCKET;
-                continue;
-            }
-            else if (optval != 0)
-            {
-                connectFailureMessage(conn, optval);
-                close(conn->sock);
-                conn->sock = PGINVALID_SOCKET;
-                continue;
-            }
-
-            conn->laddr.salen = sizeof(conn->laddr.addr);
-            if (getsockname(conn->sock,
-                            (struct sockaddr *) &conn->laddr.addr,
-                            &conn->laddr.salen) < 0)
-            {
-                fprintf(stderr, "could not get client address from socket: %s",
-                                     SOCK_STRERROR(SOCK_ERRNO, sebuf, sizeof(sebuf)));
-                close(conn->sock);
-                conn->sock = PGINVALID_SOCKET;
-                continue;
-            }
-
-            if (conn->requirepeer && conn->requirepeer[0] &&
-                conn->raddr.addr.ss_family == AF_UNIX)
-            {
-                uid_t		uid;
-                gid_t		gid;
+    conn->connect_pending = false;
+    while (connect(conn->sock, (struct sockaddr *) &addr_cur->addr.addr,
+                   addr_cur->addr.salen) < 0)
+    {
+        if (errno == EINTR)
+            continue;
+        if (errno == EINPROGRESS || errno == EAGAIN)
+        {
+            /* a Unix socket with a full backlog says EAGAIN */
+            conn->connect_pending = true;
+            break;
+        }
+        connectFailureMessage(conn, errno);
+        drop_connection_attempt(conn);
+        return false;
+    }
+    return true;
+}
 
-                errno = 0;
-                if (getpeereid(conn->sock, &uid, &gid) != 0)
-                {
-                    if (errno == ENOSYS)
-                        fprintf(stderr, "requirepeer parameter is not supported on this platform");
-                    else
-                        fprintf(stderr, "could not get peer credentials: %s",
-                                             strerror_r(errno, sebuf, sizeof(sebuf)));
-                    close(conn->sock);
-                    conn->sock = PGINVALID_SOCKET;
-                    continue;
-                }
-                Assert(false);
-            }
+/*
+ * Give up on the address being tried; the next call to connectPoll()
+ * moves on to the next one.
+ */
+static void
+drop_connection_attempt(Conn *conn)
+{
+    if (conn->sock != PGINVALID_SOCKET)
+        close(conn->sock);
+    conn->sock = PGINVALID_SOCKET;
+    conn->connect_pending = false;
+    pqsecure_close_gss(conn);
+    conn->status = CONNECTION_NEEDED;
+}
 
-            PollingStatusType gss_status;
-            bool		gss_done = false;
-            bool		gss_success = false;
+/*
+ * connectComplete
+ *	 - wait for a connection started by ConnectStart to be made
+ *
+ * Returns 1 if it was, 0 if not.
+ */
+static int
+connectComplete(Conn *conn)
+{
+    PollingStatusType flag = connectPoll(conn);
 
+    for (;;)
+    {
+        switch (flag)
+        {
+        case PGRES_POLLING_OK:
+            return 1;
 
-            while (!gss_done)
+        case PGRES_POLLING_READING:
+        case PGRES_POLLING_WRITING:
+            if (Wait(flag == PGRES_POLLING_READING,
+                     flag == PGRES_POLLING_WRITING, conn) < 0)
             {
-                gss_status = pqsecure_open_gss(conn);
-
-                switch (gss_status)
-                {
-                case PGRES_POLLING_OK:
-                    gss_done = true;
-                    gss_success = true;
-                    break;
-
-                case PGRES_POLLING_READING:
-                case PGRES_POLLING_WRITING:
-                    {
-                        fd_set		read_fds;
-                        fd_set		write_fds;
-                        int			nfds = conn->sock + 1;
-
-                        FD_ZERO(&read_fds);
-                        FD_ZERO(&write_fds);
-
-                        if (gss_status == PGRES_POLLING_READING)
-                            FD_SET(conn->sock, &read_fds);
-                        else
-                            FD_SET(conn->sock, &write_fds);
-
-                        if (select(nfds, &read_fds, &write_fds, NULL, NULL) < 0)
-                        {
-                            if (errno == EINTR)
-                                continue;
-                            fprintf(stderr, "select() failed: %s",
-                                                 strerror(errno));
-                            gss_done = true;
-                        }
-                    }
-                    break;
-
-                case PGRES_POLLING_FAILED:
-                    gss_done = true;
-                    break;
-
-                default:
-                    fprintf(stderr, "unexpected GSSAPI polling status: %d",
-                                         (int) gss_status);
-                    gss_done = true;
-                    break;
-                }
+                conn->status = CONNECTION_BAD;
+                return 0;
             }
+            break;
 
-            if (gss_success)
-            {
-                conn->status = CONNECTION_STARTED;
-                return true;
-            }
-            else
-            {
-                close(conn->sock);
-                conn->sock = PGINVALID_SOCKET;
-            }
+        default:
+            return 0;
         }
+        flag = connectPoll(conn);
     }
-
-error_return:
-    conn->whichhost = save_whichhost;
-    conn->whichaddr = save_whichaddr;
-    conn->status = CONNECTION_BAD;
-    return false;
 }
 
 /*
@@ -1427,6 +1632,49 @@ MakeEmptyConn(void)
     return conn;
 }
 
+/*
+ * CloseConn
+ *	 - close the connection's socket and free it with everything it holds
+ *
+ * A one-shot client simply exits, but a long-lived one such as debod
+ * drops connections that failed and makes new ones.
+ */
+void
+CloseConn(Conn *conn)
+{
+    const internalconninfoOption *option;
+
+    if (conn == NULL)
+        return;
+
+    if (conn->sock != PGINVALID_SOCKET)
+        close(conn->sock);
+    pqsecure_close_gss(conn);
+
+    for (option = conninfoOptions; option->keyword; option++)
+    {
+        if (option->connofs >= 0)
+            free(*(char **) ((char *) conn + option->connofs));
+    }
+    for (int i = 0; conn->connhost != NULL && i < conn->nconnhost; i++)
+    {
+        free(conn->connhost[i].host);
+        free(conn->connhost[i].hostaddr);
+        free(conn->connhost[i].port);
+        free(conn->connhost[i].password);
+    }
+    free(conn->connhost);
+    free(conn->connip);
+    free(conn->addr);
+    free(conn->write_err_msg);
+    free(conn->inBuffer);
+    free(conn->outBuffer);
+    free(conn->rowBuf);
+    termExpBuffer(&conn->errorMessage);
+    termExpBuffer(&conn->workBuffer);
+    free(conn);
+}
+
 
 /*
  * store_conn_addrinfo
@@ -1450,6 +1698,7 @@ store_conn_addrinfo(Conn *conn, struct addrinfo *addrlist)
         conn->naddr++;
     }
 
+    free(conn->addr);
     conn->addr = calloc(conn->naddr, sizeof(AddrInfo));
     if (conn->addr == NULL)
     {
@@ -1782,11 +2031,12 @@ conninfo_array_parse(const char *const *keywords, const char *const *values,
                 continue;
             }
 
-            /* Process only user, password, host, and port */
+            /* Process only user, password, host, port and transport */
             if (strcmp(pname, "user") != 0 &&
                 strcmp(pname, "password") != 0 &&
                 strcmp(pname, "host") != 0 &&
-                strcmp(pname, "port") != 0)
+                strcmp(pname, "port") != 0 &&
+                strcmp(pname, "transport") != 0)
             {
                 ++i;
                 continue;
@@ -1819,7 +2069,8 @@ conninfo_array_parse(const char *const *keywords, const char *const *values,
         if (strcmp(option->keyword, "user") != 0 &&
             strcmp(option->keyword, "password") != 0 &&
             strcmp(option->keyword, "host") != 0 &&
-            strcmp(option->keyword, "port") != 0)
+            strcmp(option->keyword, "port") != 0 &&
+            strcmp(option->keyword, "transport") != 0)
         {
             free(option->val);
             option->val = NULL;
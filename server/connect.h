@@ -163,7 +163,9 @@ typedef struct _conninfoOption
 extern Conn *connectStart(const char *conninfo);
 extern Conn *connectStartParams(const char *const *keywords,
                                 const char *const *values);
-extern bool connectPoll(Conn *conn);
+extern Conn *connectStartParamsAsync(const char *const *keywords,
+                                     const char *const *values);
+extern PollingStatusType connectPoll(Conn *conn);
 
 /* Synchronous (blocking) */
 extern Conn *connectdb(const char *conninfo);
@@ -417,7 +419,7 @@ typedef struct
 #define UNIXSOCK_PATH(path, port, sockdir) \
     (AssertMacro(sockdir), \
      AssertMacro(*(sockdir) != '\0'), \
-     snprintf(path, sizeof(path), "%s/.s.PGSQL.%d", \
+     snprintf(path, sizeof(path), "%s/.s.DEBO.%d", \
               (sockdir), (port)))
 
 
@@ -541,6 +543,8 @@ struct pg_conn
     char	   *keepalives_count;	/* maximum number of TCP keepalive
                                      * retransmits */
     char	   *requirepeer;	/* required peer credentials for local sockets */
+    char	   *transport;		/* transport the agent port offers
+                                 * (encrypt, integrity, plain) */
     char	   *target_session_attrs;	/* desired session properties */
 
     /* Optional file to write trace info to */
@@ -609,6 +613,7 @@ struct pg_conn
     bool		try_next_host;	/* time to advance to next connhost[]? */
     int			naddr;			/* number of addresses returned by getaddrinfo */
     int			whichaddr;		/* the address currently being tried */
+    bool		connect_pending;	/* connect() has not finished yet */
     AddrInfo   *addr;			/* the array of addresses for the currently
                                  * tried host */
     bool		send_appname;	/* okay to send application_name? */
@@ -641,6 +646,19 @@ struct pg_conn
                                  * msg has no length word */
     int			outMsgEnd;		/* offset to msg end (so far) */
 
+    /* Response compression agreed with the agent (COMPRESS_*) */
+    int			compression;
+
+    /* What the capability handshake settled, see NegotiateCapabilities() */
+    int			protocolVersion;	/* 0 if the agent predates it */
+    uint32		features;		/* PROTO_FEATURE_* both sides know */
+    int			maxRequest;		/* largest request message, 0 if unknown */
+    bool		legacyResponses;	/* agent answers in plain text, see
+                                     * ReadResponse() */
+
+    /* Bytes received on the socket, as they came off the wire */
+    long		bytesReceived;
+
     /* Row processor interface workspace */
     PGdataValue *rowBuf;		/* array for passing values to rowProcessor */
     int			rowBufLen;		/* number of entries allocated in rowBuf */
@@ -681,22 +699,30 @@ struct pg_conn
 
     /* The following are encryption-only */
     bool            gssenc;                 /* GSS encryption is usable */
+    bool            gsslocal;               /* Unix-socket session: same packets,
+                                             * not wrapped */
+    int             transport_mode;         /* TRANSPORT_* asked for by the
+                                             * transport option */
+    int             gss_transport;          /* TRANSPORT_* in effect */
+    bool            gss_transport_pending;  /* transport message sent, answer
+                                             * not read yet */
     gss_cred_id_t gcred;            /* GSS credential temp storage. */
 
     /* GSS encryption I/O state --- see fe-secure-gssapi.c */
     char       *gss_SendBuffer; /* Encrypted data waiting to be sent */
+    int                     gss_SendBufferSize;     /* Allocated size of gss_SendBuffer */
     int                     gss_SendLength; /* End of data available in gss_SendBuffer */
     int                     gss_SendNext;   /* Next index to send a byte from
                                              * gss_SendBuffer */
     int                     gss_SendConsumed;       /* Number of source bytes encrypted but
                                                      * not yet reported as sent */
     char       *gss_RecvBuffer; /* Received, encrypted data */
+    int                     gss_RecvBufferSize;     /* Allocated size of gss_RecvBuffer */
     int                     gss_RecvLength; /* End of data available in gss_RecvBuffer */
-    char       *gss_ResultBuffer;   /* Decryption of data in gss_RecvBuffer */
-    int                     gss_ResultLength;       /* End of data available in
-                                                     * gss_ResultBuffer */
+    int                     gss_ResultLength;       /* End of the packet decrypted in
+                                                     * place in gss_RecvBuffer */
     int                     gss_ResultNext; /* Next index to read a byte from
-                                             * gss_ResultBuffer */
+                                             * gss_RecvBuffer */
     uint32          gss_MaxPktSize; /* Maximum size we can encrypt and fit the
                                      * results into our output buffer */
     char       *gssdelegation;      /* Try to delegate GSS credentials? (0 or 1) */
@@ -741,6 +767,7 @@ extern bool  GetHomeDirectory(char *buf, int bufsize);
 extern bool  CopyConn(Conn *srcConn, Conn *dstConn);
 extern bool  ParseIntParam(const char *value, int *result, Conn *conn,
                            const char *context);
+extern int	 getpeereid(int sock, uid_t *uid, gid_t *gid);
 
 extern pgthreadlock_t pg_g_threadlock;
 
@@ -793,15 +820,20 @@ extern int	 PutInt(int value, size_t bytes, Conn *conn);
 extern int	 PutMsgStart(char msg_type, Conn *conn);
 extern int	 PutMsgEnd(Conn *conn);
 extern int	 ReadData(Conn *conn);
+extern bool  CompressionAvailable(int algorithm);
+extern int	 DecompressMessage(const char *data, int len, char *type,
+                               ExpBuffer buf);
 extern int	 Flush(Conn *conn);
 extern int	 Wait(int forRead, int forWrite, Conn *conn);
 extern int	 WaitTimed(int forRead, int forWrite, Conn *conn,
                        pg_usec_time_t end_time);
+extern bool  InputPending(Conn *conn);
 extern int	 ReadReady(Conn *conn);
 extern int	 WriteReady(Conn *conn);
 /* Poll a socket for reading and/or writing with an optional timeout */
 extern int      socketPoll(int sock, int forRead, int forWrite,
                            pg_usec_time_t end_time);
+extern pg_usec_time_t getCurrentTimeUSec(void);
 extern ssize_t pg_GSS_write(Conn *conn, const void *ptr, size_t len);
 extern ssize_t pg_GSS_read(Conn *conn, void *ptr, size_t len);
 void
@@ -811,12 +843,37 @@ int
 pg_GSS_load_servicename(Conn *conn);
 bool
 pg_GSS_have_cred_cache(gss_cred_id_t *cred_out);
+
+/* What pg_GSS_prefetch_tickets() did */
+typedef struct GSSPrefetchStats
+{
+    int			hosts;			/* service tickets asked for */
+    int			fetched;		/* ... and got */
+    double		wall_ms;		/* the whole prefetch */
+    double		kdc_min_ms;		/* per ticket, of those fetched */
+    double		kdc_avg_ms;
+    double		kdc_max_ms;
+} GSSPrefetchStats;
+
+int
+pg_GSS_prefetch_tickets(const char *const *hosts, int nhosts, int nworkers,
+                        GSSPrefetchStats *stats);
+gss_cred_id_t
+pg_GSS_shared_cred(void);
 ssize_t
 secure_raw_write(Conn *conn, const void *ptr, size_t len);
 ssize_t
 secure_raw_read(Conn *conn, void *ptr, size_t len);
 PollingStatusType
 pqsecure_open_gss(Conn *conn);
+PollingStatusType
+pqsecure_open_local(Conn *conn);
+int
+pqsecure_gss_set_packet_size(Conn *conn, int send_size, int recv_size);
+bool
+pqsecure_gss_read_pending(Conn *conn);
+void
+pqsecure_close_gss(Conn *conn);
 
 
 /* === miscellaneous macros === */
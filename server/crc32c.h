@@ -0,0 +1,37 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * crc32c.h
+ *		CRC-32C (Castagnoli), the checksum of file transfer blocks.
+ *
+ * The agent and the client keep identical copies of this file and of
+ * crc32c.c, as they do of protocol.h.
+ *-------------------------------------------------------------------------
+ */
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+extern uint32_t crc32c(const void *data, size_t len);
+extern uint32_t crc32c_extend(uint32_t crc, const void *data, size_t len);
+extern int	crc32c_file(int fd, off_t len, uint32_t *crc);
+
+#endif							/* CRC32C_H */
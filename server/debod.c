@@ -0,0 +1,1054 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * debod.c
+ *		The control daemon: warm agent sessions behind a Unix socket.
+ *
+ * Every agent has a link thread that owns the agent's connection, since a
+ * Conn cannot be shared between threads.  The link thread connects,
+ * opens a pipelined session (see session.h) and keeps it open for as long
+ * as the agent does, sending the requests that client threads queue for
+ * it and passing their output back to the client as it arrives.  While
+ * the session is idle the link probes the agent every so often, which
+ * keeps the connection warm and measures the round trip.  When the
+ * connection fails, the requests in flight fail with it and the link
+ * reconnects, backing off exponentially while the agent stays down;
+ * requests that come meanwhile fail at once rather than wait.
+ *
+ * Agents named with --agents are connected to at startup, after their
+ * service tickets are fetched in one go.  Any other agent a client asks
+ * for gets a link on first use.
+ *
+ *	debod [--agents=HOST[:PORT],...] [--socket=PATH]
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "debod.h"
+#include "session.h"
+#include "protocol.h"
+#include "getopt_long.h"
+
+/* seconds between reconnection attempts, doubling up to the most */
+#define DEBOD_MIN_BACKOFF		1
+#define DEBOD_MAX_BACKOFF		60
+
+/* milliseconds an idle session goes without a probe */
+#define DEBOD_PROBE_INTERVAL	30000
+
+/* seconds a client may take to read a reply before it is dropped */
+#define DEBOD_CLIENT_TIMEOUT	10
+
+/* largest output frame passed to a client */
+#define DEBOD_OUTPUT_CHUNK		(64 * 1024)
+
+typedef enum LinkState
+{
+    LINK_CONNECTING,
+    LINK_UP,
+    LINK_DOWN
+} LinkState;
+
+static const char *const link_state_names[] = {"connecting", "up", "down"};
+
+typedef struct DebodClient
+{
+    int			sock;
+    int			refcount;		/* its thread, and each request in flight */
+    bool		gone;			/* stop writing to sock */
+    pthread_mutex_t lock;		/* serializes replies, guards the above */
+} DebodClient;
+
+typedef struct DebodRequest
+{
+    struct DebodRequest *next;
+    DebodClient *client;		/* NULL for a probe of the link's own */
+    int			tag;			/* the client's */
+    char		type;			/* DebodMsg_Action or DebodMsg_Request */
+    Component	component;
+    Action		action;
+    char	   *version;
+    char	   *param_name;
+    char	   *param_value;
+    unsigned char code;
+    char	   *body;
+    int			len;
+    struct timespec start;
+} DebodRequest;
+
+typedef struct AgentLink
+{
+    struct AgentLink *next;
+    char	   *host;
+    char	   *port;
+    int			wake[2];		/* a byte is written when the queue grows */
+    pthread_mutex_t lock;		/* guards everything below */
+    DebodRequest *queue;		/* not sent yet, oldest first */
+    DebodRequest **queue_tail;
+    LinkState	state;
+    time_t		since;			/* when state was entered */
+    int			connects;
+    long		served;			/* requests the agent answered */
+    long		failed;			/* requests lost with the connection */
+    double		rtt_ms;			/* of the last probe, -1 before any */
+    char		last_error[128];
+} AgentLink;
+
+static AgentLink *links = NULL;
+static pthread_mutex_t links_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char socket_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+        (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void
+log_message(const char *fmt,...)
+{
+    char		stamp[32];
+    time_t		now = time(NULL);
+    va_list		args;
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(stderr, "%s debod: ", stamp);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+
+static void
+client_release(DebodClient *client)
+{
+    bool		last;
+
+    pthread_mutex_lock(&client->lock);
+    last = (--client->refcount == 0);
+    pthread_mutex_unlock(&client->lock);
+    if (last) {
+        close(client->sock);
+        pthread_mutex_destroy(&client->lock);
+        free(client);
+    }
+}
+
+static bool
+send_all(int sock, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t		n = send(sock, data, len, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Send a reply frame to a client.  A client that has gone away, or does
+ * not read within DEBOD_CLIENT_TIMEOUT, is not written to again; its
+ * requests still run to the end.
+ */
+static void
+client_send(DebodClient *client, char type, int tag, const char *data, int len)
+{
+    char		header[9];
+    int			msglen = 8 + len;
+
+    header[0] = type;
+    memcpy(header + 1, &msglen, 4);
+    memcpy(header + 5, &tag, 4);
+
+    pthread_mutex_lock(&client->lock);
+    if (!client->gone &&
+        (!send_all(client->sock, header, sizeof(header)) ||
+         !send_all(client->sock, data, len)))
+        client->gone = true;
+    pthread_mutex_unlock(&client->lock);
+}
+
+static void
+client_output(DebodClient *client, int tag, const char *data, size_t len)
+{
+    while (len > 0) {
+        int			chunk = len > DEBOD_OUTPUT_CHUNK ? DEBOD_OUTPUT_CHUNK : (int) len;
+
+        client_send(client, DebodMsg_Output, tag, data, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+static void
+client_done(DebodClient *client, int tag, int status)
+{
+    client_send(client, DebodMsg_Done, tag, (const char *) &status, 4);
+}
+
+
+static void
+free_request(DebodRequest *req)
+{
+    if (req->client)
+        client_release(req->client);
+    free(req->version);
+    free(req->param_name);
+    free(req->param_value);
+    free(req->body);
+    free(req);
+}
+
+/*
+ * The agent answered req with status: tell its client, or take the round
+ * trip of a probe.
+ */
+static void
+complete_request(AgentLink *link, DebodRequest *req, int status)
+{
+    pthread_mutex_lock(&link->lock);
+    if (req->client == NULL)
+        link->rtt_ms = elapsed_ms(&req->start);
+    else
+        link->served++;
+    pthread_mutex_unlock(&link->lock);
+
+    if (req->client)
+        client_done(req->client, req->tag, status);
+    free_request(req);
+}
+
+/*
+ * The agent will not answer req: tell its client why.
+ */
+static void
+fail_request(AgentLink *link, DebodRequest *req, const char *error)
+{
+    if (req->client) {
+        char		msg[256];
+        int			len;
+
+        len = snprintf(msg, sizeof(msg), "agent %s:%s is unreachable: %s\n",
+                       link->host, link->port, error);
+        client_output(req->client, req->tag, msg,
+                      len < (int) sizeof(msg) ? len : (int) sizeof(msg) - 1);
+        client_done(req->client, req->tag, -1);
+
+        pthread_mutex_lock(&link->lock);
+        link->failed++;
+        pthread_mutex_unlock(&link->lock);
+    }
+    free_request(req);
+}
+
+
+static void
+set_state(AgentLink *link, LinkState state, const char *error)
+{
+    pthread_mutex_lock(&link->lock);
+    if (link->state != state)
+        link->since = time(NULL);
+    link->state = state;
+    if (error)
+        snprintf(link->last_error, sizeof(link->last_error), "%s", error);
+    pthread_mutex_unlock(&link->lock);
+}
+
+/*
+ * Hand a request to the link's thread, unless the agent is known to be
+ * down, in which case it fails right away.
+ */
+static void
+enqueue_request(AgentLink *link, DebodRequest *req)
+{
+    char		error[sizeof(link->last_error)];
+
+    clock_gettime(CLOCK_MONOTONIC, &req->start);
+    req->next = NULL;
+
+    pthread_mutex_lock(&link->lock);
+    if (link->state == LINK_DOWN) {
+        memcpy(error, link->last_error, sizeof(error));
+        pthread_mutex_unlock(&link->lock);
+        fail_request(link, req, error);
+        return;
+    }
+    *link->queue_tail = req;
+    link->queue_tail = &req->next;
+    pthread_mutex_unlock(&link->lock);
+
+    (void) write(link->wake[1], "", 1);
+}
+
+static DebodRequest *
+take_queue(AgentLink *link)
+{
+    DebodRequest *queue;
+
+    pthread_mutex_lock(&link->lock);
+    queue = link->queue;
+    link->queue = NULL;
+    link->queue_tail = &link->queue;
+    pthread_mutex_unlock(&link->lock);
+    return queue;
+}
+
+/*
+ * Mark the link down and fail whatever was waiting for it.
+ */
+static void
+link_down(AgentLink *link, const char *error)
+{
+    DebodRequest *req;
+
+    set_state(link, LINK_DOWN, error);
+    req = take_queue(link);
+    while (req != NULL) {
+        DebodRequest *next = req->next;
+
+        fail_request(link, req, error);
+        req = next;
+    }
+}
+
+static int
+submit_request(SessionMux *mux, DebodRequest *req)
+{
+    if (req->type == DebodMsg_Action)
+        return SessionMuxSubmitAction(mux, req->component, req->action,
+                                      req->version, req->param_name,
+                                      req->param_value);
+    return SessionMuxSubmit(mux, req->code, req->body, req->len);
+}
+
+/*
+ * Pass the output that arrived since last time on to the clients, and
+ * drop it here.
+ */
+static void
+forward_output(SessionMux *mux, DebodRequest **inflight)
+{
+    for (int tag = 0; tag < mux->nreplies; tag++) {
+        ExpBuffer	output = mux->replies[tag].output;
+
+        if (output->len == 0)
+            continue;
+        if (inflight[tag] != NULL && inflight[tag]->client != NULL)
+            client_output(inflight[tag]->client, inflight[tag]->tag,
+                          output->data, output->len);
+        resetExpBuffer(output);
+    }
+}
+
+/*
+ * Ask the agent for its statistics on the link's own account, to time
+ * the round trip.
+ */
+static bool
+queue_probe(AgentLink *link)
+{
+    DebodRequest *probe = calloc(1, sizeof(DebodRequest));
+
+    if (probe == NULL)
+        return false;
+    probe->type = DebodMsg_Request;
+    probe->code = CliMsg_Agent_Stats;
+    enqueue_request(link, probe);
+    return true;
+}
+
+/*
+ * Run requests over an open session until the connection fails.  The
+ * first request is a probe, so the health report has a round trip from
+ * the start.  The session's tags start over whenever nothing is in
+ * flight, so the reply table stays as small as the most requests ever
+ * outstanding at once.  Returns why the session ended.
+ */
+static const char *
+serve(AgentLink *link, Conn *conn)
+{
+    SessionMux	mux;
+    DebodRequest **inflight = NULL;	/* by session tag */
+    int			capacity = 0;
+    struct timespec idle_since;
+    const char *error = NULL;
+
+    SessionMuxInit(&mux, conn);
+    clock_gettime(CLOCK_MONOTONIC, &idle_since);
+    if (!queue_probe(link))
+        error = "out of memory";
+
+    while (error == NULL) {
+        DebodRequest *req = take_queue(link);
+        bool		sent = (req != NULL);
+        int			tag;
+
+        while (req != NULL) {
+            DebodRequest *next = req->next;
+
+            tag = submit_request(&mux, req);
+            if (tag >= capacity) {
+                int			newcap = capacity ? capacity * 2 : 16;
+                DebodRequest **grown = realloc(inflight, newcap * sizeof(DebodRequest *));
+
+                if (grown == NULL) {
+                    error = "out of memory";
+                    fail_request(link, req, error);
+                    req = next;
+                    continue;
+                }
+                memset(grown + capacity, 0, (newcap - capacity) * sizeof(DebodRequest *));
+                inflight = grown;
+                capacity = newcap;
+            }
+            if (tag < 0) {
+                error = "could not queue the request";
+                fail_request(link, req, error);
+            } else
+                inflight[tag] = req;
+            req = next;
+        }
+        if (error != NULL)
+            break;
+        if (sent && Flush(conn) < 0) {
+            error = "could not send to the agent";
+            break;
+        }
+
+        if (!InputPending(conn)) {
+            struct pollfd fds[2];
+            int			timeout = -1;
+            char		drain[64];
+
+            if (mux.pending == 0) {
+                timeout = DEBOD_PROBE_INTERVAL - (int) elapsed_ms(&idle_since);
+                if (timeout <= 0) {
+                    if (!queue_probe(link)) {
+                        error = "out of memory";
+                        break;
+                    }
+                    clock_gettime(CLOCK_MONOTONIC, &idle_since);
+                    continue;
+                }
+            }
+
+            fds[0].fd = conn->sock;
+            fds[0].events = POLLIN;
+            fds[1].fd = link->wake[0];
+            fds[1].events = POLLIN;
+            if (poll(fds, 2, timeout) < 0) {
+                if (errno == EINTR)
+                    continue;
+                error = strerror(errno);
+                break;
+            }
+            if (fds[1].revents & POLLIN)
+                while (read(link->wake[0], drain, sizeof(drain)) > 0)
+                    ;
+            if (fds[0].revents == 0)
+                continue;
+            if (mux.pending == 0) {
+                /* nothing asked, so this can only be the end */
+                error = "the agent closed the session";
+                break;
+            }
+        }
+
+        tag = SessionMuxReadFrame(&mux);
+        if (tag == -2) {
+            error = "lost the connection to the agent";
+            break;
+        }
+        forward_output(&mux, inflight);
+        if (tag >= 0) {
+            mux.replies[tag].collected = true;
+            complete_request(link, inflight[tag], mux.replies[tag].status);
+            inflight[tag] = NULL;
+        }
+        if (mux.pending == 0 && mux.nreplies > 0) {
+            SessionMuxTerm(&mux);
+            SessionMuxInit(&mux, conn);
+            clock_gettime(CLOCK_MONOTONIC, &idle_since);
+        }
+    }
+
+    for (int tag = 0; tag < mux.nreplies && tag < capacity; tag++) {
+        if (inflight[tag] != NULL)
+            fail_request(link, inflight[tag], error);
+    }
+    free(inflight);
+    SessionMuxTerm(&mux);
+    return error;
+}
+
+static void *
+link_main(void *arg)
+{
+    AgentLink  *link = arg;
+    int			backoff = 0;
+
+    for (;;) {
+        Conn	   *conn;
+        const char *error;
+
+        set_state(link, LINK_CONNECTING, NULL);
+        conn = connect_to_debo(link->host, link->port);
+        if (conn == NULL)
+            error = "could not connect";
+        else if (!(conn->features & PROTO_FEATURE_SESSION)) {
+            error = "the agent does not support sessions";
+            CloseConn(conn);
+            conn = NULL;
+        }
+        if (conn == NULL) {
+            backoff = backoff ? backoff * 2 : DEBOD_MIN_BACKOFF;
+            if (backoff > DEBOD_MAX_BACKOFF)
+                backoff = DEBOD_MAX_BACKOFF;
+            log_message("agent %s:%s is down: %s, retrying in %d s",
+                        link->host, link->port, error, backoff);
+            link_down(link, error);
+            sleep(backoff);
+            continue;
+        }
+
+        backoff = 0;
+        pthread_mutex_lock(&link->lock);
+        link->connects++;
+        pthread_mutex_unlock(&link->lock);
+        set_state(link, LINK_UP, NULL);
+        log_message("agent %s:%s is up", link->host, link->port);
+
+        error = serve(link, conn);
+        CloseConn(conn);
+        log_message("agent %s:%s: %s", link->host, link->port, error);
+        link_down(link, error);
+    }
+    return NULL;
+}
+
+/*
+ * Find the link to host:port, starting one if there is none.  Returns
+ * NULL if out of resources.
+ */
+static AgentLink *
+get_link(const char *host, const char *port)
+{
+    AgentLink  *link;
+    pthread_t	thread;
+
+    if (port == NULL || port[0] == '\0')
+        port = DEFAULT_DEBO_PORT;
+
+    pthread_mutex_lock(&links_lock);
+    for (link = links; link != NULL; link = link->next) {
+        if (strcmp(link->host, host) == 0 && strcmp(link->port, port) == 0)
+            break;
+    }
+    if (link == NULL) {
+        link = calloc(1, sizeof(AgentLink));
+        if (link == NULL ||
+            (link->host = strdup(host)) == NULL ||
+            (link->port = strdup(port)) == NULL ||
+            pipe(link->wake) < 0) {
+            log_message("could not add agent %s:%s: %s", host, port, strerror(errno));
+            if (link) {
+                free(link->host);
+                free(link->port);
+                free(link);
+            }
+            pthread_mutex_unlock(&links_lock);
+            return NULL;
+        }
+        fcntl(link->wake[0], F_SETFL, O_NONBLOCK);
+        fcntl(link->wake[1], F_SETFL, O_NONBLOCK);
+        pthread_mutex_init(&link->lock, NULL);
+        link->queue_tail = &link->queue;
+        link->state = LINK_CONNECTING;
+        link->since = time(NULL);
+        link->rtt_ms = -1;
+
+        if (pthread_create(&thread, NULL, link_main, link) != 0) {
+            log_message("could not start a thread for agent %s:%s", host, port);
+            close(link->wake[0]);
+            close(link->wake[1]);
+            free(link->host);
+            free(link->port);
+            free(link);
+            pthread_mutex_unlock(&links_lock);
+            return NULL;
+        }
+        pthread_detach(thread);
+        link->next = links;
+        links = link;
+    }
+    pthread_mutex_unlock(&links_lock);
+    return link;
+}
+
+/*
+ * One line per agent: state and for how long, connections made, last
+ * probe round trip, requests answered and failed, and why it last went
+ * down.
+ */
+static void
+health_report(ExpBuffer out)
+{
+    time_t		now = time(NULL);
+
+    appendExpBuffer(out, "%-28s %-10s %8s %8s %8s %8s %8s  %s\n",
+                    "AGENT", "STATE", "FOR(s)", "CONNECTS", "RTT(ms)",
+                    "SERVED", "FAILED", "LAST ERROR");
+    pthread_mutex_lock(&links_lock);
+    for (AgentLink *link = links; link != NULL; link = link->next) {
+        char		name[128];
+        char		rtt[16];
+
+        snprintf(name, sizeof(name), "%s:%s", link->host, link->port);
+        pthread_mutex_lock(&link->lock);
+        if (link->rtt_ms < 0)
+            snprintf(rtt, sizeof(rtt), "-");
+        else
+            snprintf(rtt, sizeof(rtt), "%.2f", link->rtt_ms);
+        appendExpBuffer(out, "%-28s %-10s %8ld %8d %8s %8ld %8ld  %s\n",
+                        name, link_state_names[link->state],
+                        (long) (now - link->since), link->connects, rtt,
+                        link->served, link->failed, link->last_error);
+        pthread_mutex_unlock(&link->lock);
+    }
+    pthread_mutex_unlock(&links_lock);
+}
+
+
+static bool
+recv_all(int sock, char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t		n = recv(sock, buf, len, 0);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* the next string of a request body, or NULL if it runs off the end */
+static char *
+get_string(char **cursor, char *end)
+{
+    char	   *str = *cursor;
+    char	   *nul = memchr(str, '\0', end - str);
+
+    if (nul == NULL)
+        return NULL;
+    *cursor = nul + 1;
+    return str;
+}
+
+static bool
+get_int32(char **cursor, char *end, int *value)
+{
+    if (end - *cursor < 4)
+        return false;
+    memcpy(value, *cursor, 4);
+    *cursor += 4;
+    return true;
+}
+
+/* a copy of str, NULL for the empty string */
+static char *
+optional_copy(const char *str)
+{
+    return str[0] ? strdup(str) : NULL;
+}
+
+/*
+ * Turn a DebodMsg_Action or DebodMsg_Request body into a request for its
+ * agent.  Returns false if it is malformed.
+ */
+static bool
+parse_request(char type, char *body, char *end, DebodRequest *req,
+              char **host, char **port)
+{
+    int			component;
+    int			action;
+
+    if ((*host = get_string(&body, end)) == NULL ||
+        (*port = get_string(&body, end)) == NULL)
+        return false;
+
+    req->type = type;
+    if (type == DebodMsg_Action) {
+        char	   *version;
+        char	   *param_name;
+        char	   *param_value;
+
+        if (!get_int32(&body, end, &component) ||
+            !get_int32(&body, end, &action) ||
+            (version = get_string(&body, end)) == NULL ||
+            (param_name = get_string(&body, end)) == NULL ||
+            (param_value = get_string(&body, end)) == NULL)
+            return false;
+        req->component = (Component) component;
+        req->action = (Action) action;
+        req->version = optional_copy(version);
+        req->param_name = optional_copy(param_name);
+        req->param_value = optional_copy(param_value);
+        return true;
+    }
+
+    if (body >= end)
+        return false;
+    req->code = (unsigned char) *body++;
+    req->len = end - body;
+    if (req->len > 0) {
+        req->body = malloc(req->len);
+        if (req->body == NULL)
+            return false;
+        memcpy(req->body, body, req->len);
+    }
+    return true;
+}
+
+static void *
+client_main(void *arg)
+{
+    DebodClient *client = arg;
+    char	   *buf = NULL;
+
+    for (;;) {
+        char		header[5];
+        int			len;
+        int			tag;
+        char	   *host;
+        char	   *port;
+        DebodRequest *req;
+        AgentLink  *link;
+
+        if (!recv_all(client->sock, header, sizeof(header)))
+            break;
+        memcpy(&len, header + 1, 4);
+        if (len < 8 || len > DEBOD_MAX_MESSAGE)
+            break;
+        len -= 4;
+        free(buf);
+        if ((buf = malloc(len)) == NULL || !recv_all(client->sock, buf, len))
+            break;
+        memcpy(&tag, buf, 4);
+
+        if (header[0] == DebodMsg_Health) {
+            ExpBufferData report;
+
+            initExpBuffer(&report);
+            health_report(&report);
+            client_output(client, tag, report.data, report.len);
+            client_done(client, tag, 0);
+            termExpBuffer(&report);
+            continue;
+        }
+
+        req = calloc(1, sizeof(DebodRequest));
+        if (req == NULL ||
+            (header[0] != DebodMsg_Action && header[0] != DebodMsg_Request) ||
+            !parse_request(header[0], buf + 4, buf + len, req, &host, &port) ||
+            (link = get_link(host, port)) == NULL) {
+            if (req)
+                free_request(req);
+            client_done(client, tag, -1);
+            continue;
+        }
+        req->tag = tag;
+        req->client = client;
+        pthread_mutex_lock(&client->lock);
+        client->refcount++;
+        pthread_mutex_unlock(&client->lock);
+        enqueue_request(link, req);
+    }
+    free(buf);
+
+    pthread_mutex_lock(&client->lock);
+    client->gone = true;
+    pthread_mutex_unlock(&client->lock);
+    client_release(client);
+    return NULL;
+}
+
+/*
+ * Take clients as they connect.  Only the user running the daemon may
+ * use it: the sessions are authenticated as that user.
+ */
+static void
+accept_clients(int listener)
+{
+    struct timeval timeout = {DEBOD_CLIENT_TIMEOUT, 0};
+
+    for (;;) {
+        DebodClient *client;
+        pthread_t	thread;
+        uid_t		uid;
+        gid_t		gid;
+        int			sock = accept(listener, NULL, NULL);
+
+        if (sock < 0) {
+            if (errno != EINTR) {
+                log_message("could not accept a client: %s", strerror(errno));
+                sleep(1);
+            }
+            continue;
+        }
+        if (getpeereid(sock, &uid, &gid) < 0 || uid != geteuid()) {
+            close(sock);
+            continue;
+        }
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        client = calloc(1, sizeof(DebodClient));
+        if (client == NULL) {
+            close(sock);
+            continue;
+        }
+        client->sock = sock;
+        client->refcount = 1;
+        pthread_mutex_init(&client->lock, NULL);
+        if (pthread_create(&thread, NULL, client_main, client) != 0) {
+            client_release(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/*
+ * Listen on path, unless another daemon already does.  Returns the
+ * socket, or -1.
+ */
+static int
+open_listener(const char *path)
+{
+    struct sockaddr_un addr;
+    mode_t		mask;
+    int			sock;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "debod: socket path \"%s\" is too long\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        fprintf(stderr, "debod: could not create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "debod: another daemon is listening on \"%s\"\n", path);
+        close(sock);
+        return -1;
+    }
+    unlink(path);
+
+    /* the socket is the user's alone from the start */
+    mask = umask(077);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(sock, 64) < 0) {
+        umask(mask);
+        fprintf(stderr, "debod: could not listen on \"%s\": %s\n", path, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    umask(mask);
+    return sock;
+}
+
+static void
+shutdown_handler(int signo)
+{
+    (void) signo;
+    unlink(socket_path);
+    _exit(0);
+}
+
+/*
+ * Create the directory of the default socket path if it is missing, and
+ * make sure it is ours alone, so nobody else can put a socket there.
+ */
+static int
+make_socket_dir(const char *path)
+{
+    char		dir[sizeof(socket_path)];
+    char	   *slash;
+    struct stat st;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    slash = strrchr(dir, '/');
+    if (slash == NULL || slash == dir)
+        return 0;
+    *slash = '\0';
+
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        fprintf(stderr, "debod: could not create directory \"%s\": %s\n", dir, strerror(errno));
+        return -1;
+    }
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & 077) != 0) {
+        fprintf(stderr, "debod: \"%s\" is not a directory of your own with mode 0700\n", dir);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Start links to the comma-separated HOST[:PORT] list, fetching the
+ * service tickets of all of them first.
+ */
+static void
+start_agents(char *list)
+{
+    const char **hosts;
+    char	  **ports;
+    int			n = 1;
+
+    for (char *p = list; *p; p++)
+        if (*p == ',')
+            n++;
+    hosts = malloc(n * sizeof(char *));
+    ports = malloc(n * sizeof(char *));
+    if (hosts == NULL || ports == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    n = 0;
+    for (char *h = strtok(list, ","); h != NULL; h = strtok(NULL, ",")) {
+        char	   *colon = strrchr(h, ':');
+
+        ports[n] = NULL;
+        if (colon != NULL) {
+            *colon = '\0';
+            ports[n] = colon + 1;
+        }
+        hosts[n++] = h;
+    }
+
+    (void) prefetch_service_tickets(hosts, n);
+    for (int i = 0; i < n; i++)
+        (void) get_link(hosts[i], ports[i]);
+    free(hosts);
+    free(ports);
+}
+
+static void
+help(const char *progname)
+{
+    printf("%s keeps authenticated sessions to Debo agents for the debo CLI.\n\n", progname);
+    printf("Usage:\n");
+    printf("  %s [OPTION]...\n\n", progname);
+    printf("Options:\n");
+    printf("  --agents=HOST[:PORT],...  connect to these agents at startup\n");
+    printf("                            (default $DEBOD_AGENTS; others on first use)\n");
+    printf("  --socket=PATH             listen on PATH (default $DEBOD_SOCKET,\n");
+    printf("                            else $XDG_RUNTIME_DIR/debod.sock,\n");
+    printf("                            else /tmp/debod-UID/debod.sock)\n");
+    printf("  --help                    show this help, then exit\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        {"agents", required_argument, NULL, 'a'},
+        {"socket", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0}
+    };
+    char	   *agents = getenv("DEBOD_AGENTS");
+    const char *path = NULL;
+    int			optindex;
+    int			listener;
+    int			c;
+
+    if (argc > 1 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") == 0)) {
+        help(argv[0]);
+        exit(EXIT_SUCCESS);
+    }
+    while ((c = getopt_long(argc, argv, "a:s:", long_options, &optindex)) != -1) {
+        switch (c) {
+        case 'a':
+            agents = optarg;
+            break;
+        case 's':
+            path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Try %s --help for more information.\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (path == NULL) {
+        const char *env = getenv("DEBOD_SOCKET");
+
+        path = debod_socket_path();
+        if ((env == NULL || env[0] == '\0') && make_socket_dir(path) < 0)
+            exit(EXIT_FAILURE);
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s", path);
+    listener = open_listener(socket_path);
+    if (listener < 0)
+        exit(EXIT_FAILURE);
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGTERM, shutdown_handler);
+    signal(SIGINT, shutdown_handler);
+
+    if (agents != NULL && agents[0] != '\0')
+        start_agents(strdup(agents));
+
+    log_message("listening on %s", socket_path);
+    accept_clients(listener);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * debod.h
+ *		Talking to the local control daemon.
+ *
+ * debod keeps an authenticated pipelined session open to every agent it
+ * knows of and lets the CLI use them over a Unix socket, so a command
+ * costs a local round trip instead of a connection and a GSSAPI
+ * handshake.  Messages on the socket are framed as agent messages are:
+ * a type byte, then an int32 length that counts itself, then the body,
+ * with integers in host byte order since the socket never leaves the
+ * machine.  Every request starts with an int32 tag chosen by the
+ * client, and every reply frame carries the tag of its request:
+ *
+ *	DebodMsg_Action		tag, host\0, port\0, int32 component, int32 action,
+ *						version\0, param\0, value\0 (empty for none)
+ *	DebodMsg_Request	tag, host\0, port\0, code byte, request body
+ *	DebodMsg_Health		tag
+ *
+ *	DebodMsg_Output		tag, bytes printed by the request, as they come
+ *	DebodMsg_Done		tag, int32 RESP_* status, -1 if the agent could
+ *						not be reached or refused the request
+ *-------------------------------------------------------------------------
+ */
+#ifndef DEBOD_H
+#define DEBOD_H
+
+#include "utiles.h"
+
+#define DebodMsg_Action			'A'
+#define DebodMsg_Request		'C'
+#define DebodMsg_Health			'H'
+#define DebodMsg_Output			'O'
+#define DebodMsg_Done			'D'
+
+/* longest message either side accepts */
+#define DEBOD_MAX_MESSAGE		(1024 * 1024)
+
+extern const char *debod_socket_path(void);
+extern int	DebodConnect(void);
+extern int	DebodSubmitAction(int sock, int tag, const char *host,
+                              const char *port, Component component,
+                              Action action, const char *version,
+                              const char *param_name,
+                              const char *param_value);
+extern int	DebodSubmitRequest(int sock, int tag, const char *host,
+                               const char *port, unsigned char code,
+                               const char *body, int len);
+extern int	DebodSubmitHealth(int sock, int tag);
+extern int	DebodReadFrame(int sock, char *type, int *tag,
+                           ExpBuffer payload);
+
+#endif							/* DEBOD_H */
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * debod_client.c
+ *		The CLI's side of the control daemon's socket.
+ *
+ * Requests are small, so each one is built whole and written with one
+ * call; replies are read a frame at a time.  See debod.h for the
+ * messages.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "debod.h"
+
+/*
+ * debod_socket_path -- where the daemon listens
+ *
+ * $DEBOD_SOCKET, else debod.sock in $XDG_RUNTIME_DIR, else in a directory
+ * of the user's own under /tmp, which debod creates with mode 0700.
+ */
+const char *
+debod_socket_path(void)
+{
+    static char path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+    const char *env = getenv("DEBOD_SOCKET");
+
+    if (env != NULL && env[0] != '\0')
+        return env;
+    env = getenv("XDG_RUNTIME_DIR");
+    if (env != NULL && env[0] == '/')
+        snprintf(path, sizeof(path), "%s/debod.sock", env);
+    else
+        snprintf(path, sizeof(path), "/tmp/debod-%d/debod.sock", (int) getuid());
+    return path;
+}
+
+/*
+ * DebodConnect -- connect to the daemon
+ *
+ * Returns the socket, or -1 if no daemon is listening.  Says nothing
+ * either way: running without the daemon is the normal case.  A socket
+ * served by another user is refused with a warning, since whoever runs
+ * it would see our requests.
+ */
+int
+DebodConnect(void)
+{
+    struct sockaddr_un addr;
+    const char *path = debod_socket_path();
+    uid_t		uid;
+    gid_t		gid;
+    int			sock;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    if (getpeereid(sock, &uid, &gid) < 0 || uid != getuid()) {
+        fprintf(stderr, "warning: ignoring debod socket \"%s\" that is not served by you\n",
+                path);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void
+append_int32(ExpBuffer buf, int value)
+{
+    appendBinaryExpBuffer(buf, (const char *) &value, 4);
+}
+
+/* a string with its terminator; NULL goes as the empty string */
+static void
+append_string(ExpBuffer buf, const char *str)
+{
+    appendBinaryExpBuffer(buf, str ? str : "", (str ? strlen(str) : 0) + 1);
+}
+
+/*
+ * Start a message whose length is filled in by send_message().
+ */
+static void
+start_message(ExpBuffer buf, char type, int tag)
+{
+    initExpBuffer(buf);
+    appendExpBufferChar(buf, type);
+    append_int32(buf, 0);
+    append_int32(buf, tag);
+}
+
+static int
+send_message(int sock, ExpBuffer buf)
+{
+    int			len = (int) buf->len - 1;
+    size_t		sent = 0;
+
+    if (buf->len > DEBOD_MAX_MESSAGE) {
+        fprintf(stderr, "request to debod is too long\n");
+        termExpBuffer(buf);
+        return -1;
+    }
+    memcpy(buf->data + 1, &len, 4);
+    while (sent < buf->len) {
+        ssize_t		n = send(sock, buf->data + sent, buf->len - sent, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            fprintf(stderr, "could not send request to debod: %s\n", strerror(errno));
+            termExpBuffer(buf);
+            return -1;
+        }
+        sent += n;
+    }
+    termExpBuffer(buf);
+    return 0;
+}
+
+/*
+ * DebodSubmitAction -- ask for a component action on the agent at
+ * host:port
+ */
+int
+DebodSubmitAction(int sock, int tag, const char *host, const char *port,
+                  Component component, Action action, const char *version,
+                  const char *param_name, const char *param_value)
+{
+    ExpBufferData buf;
+
+    start_message(&buf, DebodMsg_Action, tag);
+    append_string(&buf, host);
+    append_string(&buf, port);
+    append_int32(&buf, (int) component);
+    append_int32(&buf, (int) action);
+    append_string(&buf, version);
+    append_string(&buf, param_name);
+    append_string(&buf, param_value);
+    return send_message(sock, &buf);
+}
+
+/*
+ * DebodSubmitRequest -- pass request code with its body to the agent at
+ * host:port
+ */
+int
+DebodSubmitRequest(int sock, int tag, const char *host, const char *port,
+                   unsigned char code, const char *body, int len)
+{
+    ExpBufferData buf;
+
+    start_message(&buf, DebodMsg_Request, tag);
+    append_string(&buf, host);
+    append_string(&buf, port);
+    appendExpBufferChar(&buf, (char) code);
+    if (len > 0)
+        appendBinaryExpBuffer(&buf, body, len);
+    return send_message(sock, &buf);
+}
+
+/*
+ * DebodSubmitHealth -- ask for the state of every agent session
+ */
+int
+DebodSubmitHealth(int sock, int tag)
+{
+    ExpBufferData buf;
+
+    start_message(&buf, DebodMsg_Health, tag);
+    return send_message(sock, &buf);
+}
+
+static int
+read_exact(int sock, char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t		n = recv(sock, buf, len, 0);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * DebodReadFrame -- read one reply frame
+ *
+ * Replaces the contents of payload with the frame's body after the tag.
+ * Returns 0, or -1 if the daemon went away or sent garbage.
+ */
+int
+DebodReadFrame(int sock, char *type, int *tag, ExpBuffer payload)
+{
+    char		header[9];
+    int			len;
+
+    if (read_exact(sock, header, sizeof(header)) < 0) {
+        fprintf(stderr, "lost the connection to debod\n");
+        return -1;
+    }
+    memcpy(&len, header + 1, 4);
+    if (len < 8 || len > DEBOD_MAX_MESSAGE) {
+        fprintf(stderr, "invalid frame length %d from debod\n", len);
+        return -1;
+    }
+    *type = header[0];
+    memcpy(tag, header + 5, 4);
+
+    resetExpBuffer(payload);
+    len -= 8;
+    if (enlargeExpBuffer(payload, len) == 0 ||
+        read_exact(sock, payload->data, len) < 0) {
+        fprintf(stderr, "lost the connection to debod\n");
+        return -1;
+    }
+    payload->len = len;
+    payload->data[len] = '\0';
+    return 0;
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * depgraph.c
+ *		Components with all their dependencies, as a graph.
+ *
+ * A run is a fan-out with an entry for each component, all to the same
+ * agent, whose ready callback holds a component back until the ones it
+ * waits for are done.  Output is printed a line at a time as it arrives,
+ * each line prefixed with its component, so the branches running at once
+ * can be told apart.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "depgraph.h"
+
+typedef struct DepRun
+{
+    const DepGraph *graph;
+    const DepPlan *plan;
+    Fanout		fan;			/* host i is node i */
+    bool		ordered;		/* false for a report */
+    bool		reverse;		/* dependents go first */
+    int			width;			/* of the widest prefix */
+    ExpBufferData partial[DEPGRAPH_MAX_NODES];	/* output short of a newline */
+} DepRun;
+
+/*
+ * Add comp and, before it, what it needs, unless it is in the graph
+ * already.  Returns its index, or -1 if the dependencies go round.
+ */
+static int
+visit(DepGraph *graph, Component comp, int *index, bool *visiting)
+{
+    int			deps[DEPGRAPH_MAX_NODES];
+    int			ndeps = 0;
+    unsigned int needs = 0;
+    int			count = 0;
+    Component  *direct;
+    DepNode    *node;
+
+    if (index[comp] >= 0)
+        return index[comp];
+    if (visiting[comp]) {
+        fprintf(stderr, "Error: the dependencies of %s go round in a circle\n",
+                component_to_string(comp));
+        return -1;
+    }
+    visiting[comp] = true;
+    direct = get_dependencies(comp, &count);
+    for (int i = 0; i < count; i++) {
+        int			d = visit(graph, direct[i], index, visiting);
+        bool		seen = false;
+
+        if (d < 0)
+            return -1;
+        needs |= (1u << d) | graph->nodes[d].needs;
+        for (int j = 0; j < ndeps; j++)
+            seen |= deps[j] == d;
+        if (!seen)
+            deps[ndeps++] = d;
+    }
+    visiting[comp] = false;
+
+    node = &graph->nodes[graph->nnodes];
+    node->component = comp;
+    node->root = false;
+    memcpy(node->deps, deps, ndeps * sizeof(int));
+    node->ndeps = ndeps;
+    node->needs = needs;
+    index[comp] = graph->nnodes++;
+    return index[comp];
+}
+
+/*
+ * DepGraphBuild -- the roots and everything they need, directly or not
+ *
+ * Returns the number of components in the graph, or -1 if the
+ * dependencies go round, having said so.
+ */
+int
+DepGraphBuild(DepGraph *graph, const Component *roots, int nroots)
+{
+    int			index[DEPGRAPH_MAX_NODES];
+    bool		visiting[DEPGRAPH_MAX_NODES];
+
+    memset(graph, 0, sizeof(*graph));
+    for (int i = 0; i < DEPGRAPH_MAX_NODES; i++) {
+        index[i] = -1;
+        visiting[i] = false;
+    }
+    for (int i = 0; i < nroots; i++) {
+        int			n = visit(graph, roots[i], index, visiting);
+
+        if (n < 0)
+            return -1;
+        graph->nodes[n].root = true;
+    }
+    return graph->nnodes;
+}
+
+static bool
+succeeded(const FanoutHost *h)
+{
+    return h->state == FANOUT_DONE && h->status == 0;
+}
+
+/*
+ * The first node that node i waits for and that has not succeeded, or -1
+ * if there is none.
+ */
+static int
+blocker(const DepRun *run, int i)
+{
+    const DepGraph *graph = run->graph;
+
+    if (!run->ordered)
+        return -1;
+    if (!run->reverse) {
+        for (int d = 0; d < graph->nodes[i].ndeps; d++) {
+            int			dep = graph->nodes[i].deps[d];
+
+            if (!succeeded(&run->fan.hosts[dep]))
+                return dep;
+        }
+        return -1;
+    }
+    for (int j = 0; j < graph->nnodes; j++) {
+        for (int d = 0; d < graph->nodes[j].ndeps; d++)
+            if (graph->nodes[j].deps[d] == i && !succeeded(&run->fan.hosts[j]))
+                return j;
+    }
+    return -1;
+}
+
+static bool
+node_ready(FanoutHost *h, void *arg)
+{
+    DepRun	   *run = arg;
+
+    return blocker(run, h - run->fan.hosts) < 0;
+}
+
+static int
+node_queue(FanoutHost *h, void *arg)
+{
+    DepRun	   *run = arg;
+    const DepPlan *plan = run->plan;
+    const DepNode *node = &run->graph->nodes[h - run->fan.hosts];
+    char	   *version = node->root ? plan->version : NULL;
+    char	   *config_param = node->root ? plan->config_param : NULL;
+    char	   *value = node->root ? plan->value : NULL;
+
+    /* a version switch is an uninstall then an install */
+    if (plan->action == VERSION_SWITCH) {
+        if (QueueComponentActionCommand(node->component, UNINSTALL, NULL,
+                                        NULL, NULL, h->conn) < 0 ||
+            QueueComponentActionCommand(node->component, INSTALL, version,
+                                        config_param, value, h->conn) < 0)
+            return -1;
+        return 2;
+    }
+    if (QueueComponentActionCommand(node->component, plan->action, version,
+                                    config_param, value, h->conn) < 0)
+        return -1;
+    return 1;
+}
+
+/* Print the lines of node i's output that are complete, or all of it */
+static void
+print_lines(DepRun *run, int i, bool all)
+{
+    ExpBuffer	partial = &run->partial[i];
+    const char *name = component_to_string(run->graph->nodes[i].component);
+    size_t		start = 0;
+
+    for (size_t end = 0; end < partial->len; end++) {
+        if (partial->data[end] != '\n')
+            continue;
+        printf("[%s]%*s %.*s\n", name, (int) (run->width - strlen(name)), "",
+               (int) (end - start), partial->data + start);
+        start = end + 1;
+    }
+    if (all && start < partial->len) {
+        printf("[%s]%*s %s\n", name, (int) (run->width - strlen(name)), "",
+               partial->data + start);
+        start = partial->len;
+    }
+    if (start > 0) {
+        memmove(partial->data, partial->data + start, partial->len - start);
+        partial->len -= start;
+        partial->data[partial->len] = '\0';
+    }
+}
+
+static void
+node_output(FanoutHost *h, const char *data, size_t len, void *arg)
+{
+    DepRun	   *run = arg;
+    int			i = h - run->fan.hosts;
+
+    appendBinaryExpBuffer(&run->partial[i], data, len);
+    print_lines(run, i, false);
+    fflush(stdout);
+}
+
+static void
+node_done(FanoutHost *h, void *arg)
+{
+    DepRun	   *run = arg;
+    int			i = h - run->fan.hosts;
+    const char *name = component_to_string(run->graph->nodes[i].component);
+    int			pad = (int) (run->width - strlen(name));
+
+    print_lines(run, i, true);
+    if (h->state != FANOUT_DONE)
+        printf("[%s]%*s %s after %.1f s: %s\n", name, pad, "",
+               FanoutStateName(h->state), h->elapsed_ms / 1000.0, h->error);
+    else if (h->status != 0)
+        printf("[%s]%*s failed (status %d) after %.1f s\n", name, pad, "",
+               h->status, h->elapsed_ms / 1000.0);
+    else
+        printf("[%s]%*s done in %.1f s\n", name, pad, "", h->elapsed_ms / 1000.0);
+    fflush(stdout);
+    if (run->plan->done)
+        run->plan->done(&run->graph->nodes[i], h, run->plan->arg);
+}
+
+/*
+ * DepGraphRun -- carry out plan on every component of graph, on the
+ * agent at host and port
+ *
+ * Prints each component's output as it arrives and, at the end, how long
+ * the run took next to how long the components took one after another.
+ * Returns the number of components that did not succeed, the ones never
+ * run included, or -1 if out of memory.
+ */
+int
+DepGraphRun(const DepGraph *graph, const DepPlan *plan, const char *host,
+            const char *port)
+{
+    const char *hosts[DEPGRAPH_MAX_NODES];
+    struct timespec start, end;
+    DepRun		run;
+    double		serial_ms = 0;
+    int			failed;
+
+    memset(&run, 0, sizeof(run));
+    run.graph = graph;
+    run.plan = plan;
+    run.ordered = plan->action != NO_ACTION;
+    run.reverse = plan->action == STOP || plan->action == UNINSTALL;
+    for (int i = 0; i < graph->nnodes; i++) {
+        size_t		len = strlen(component_to_string(graph->nodes[i].component));
+
+        hosts[i] = host;
+        if ((int) len > run.width)
+            run.width = len;
+        initExpBuffer(&run.partial[i]);
+    }
+
+    if (FanoutInit(&run.fan, hosts, graph->nnodes, port) < 0)
+        return -1;
+    run.fan.parallel = plan->parallel;
+    run.fan.timeout_ms = plan->timeout_ms;
+    run.fan.queue = node_queue;
+    run.fan.done = node_done;
+    run.fan.ready = node_ready;
+    run.fan.output = node_output;
+    run.fan.arg = &run;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    failed = FanoutRun(&run.fan);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; failed >= 0 && i < graph->nnodes; i++) {
+        FanoutHost *h = &run.fan.hosts[i];
+        const char *name = component_to_string(graph->nodes[i].component);
+        int			b;
+
+        serial_ms += h->elapsed_ms;
+        if (h->state == FANOUT_DONE && h->status != 0)
+            failed++;			/* FanoutRun counts it as done */
+        if (h->state != FANOUT_WAITING)
+            continue;
+        b = blocker(&run, i);
+        printf("[%s]%*s skipped: %s did not succeed\n", name,
+               (int) (run.width - strlen(name)), "",
+               b >= 0 ? component_to_string(graph->nodes[b].component) : "a dependency");
+    }
+    if (failed >= 0)
+        printf("%d of %d components succeeded in %.1f s (%.1f s one after another)\n",
+               graph->nnodes - failed, graph->nnodes,
+               ((end.tv_sec - start.tv_sec) * 1000.0 +
+                (end.tv_nsec - start.tv_nsec) / 1000000.0) / 1000.0,
+               serial_ms / 1000.0);
+
+    FanoutTerm(&run.fan);
+    for (int i = 0; i < graph->nnodes; i++)
+        termExpBuffer(&run.partial[i]);
+    return failed;
+}
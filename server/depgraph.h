@@ -0,0 +1,76 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * depgraph.h
+ *		Components with all their dependencies, as a graph.
+ *
+ * The graph is the closure of get_dependencies() over the components
+ * asked for, with each component in it once however many others need it.
+ * Running it on an agent sends each component's request on a connection
+ * of its own as soon as the ones it has to wait for are done, so branches
+ * that do not need each other go at once and the whole takes as long as
+ * its longest chain rather than the sum of them.
+ *
+ * Installing, starting and restarting wait for the dependencies;
+ * stopping and uninstalling wait for the dependents instead; a report
+ * waits for nothing.  A component whose wait ends in a failure is not
+ * run at all.
+ *-------------------------------------------------------------------------
+ */
+#ifndef DEPGRAPH_H
+#define DEPGRAPH_H
+
+#include "fanout.h"
+
+/* more than there are components */
+#define DEPGRAPH_MAX_NODES	32
+
+typedef struct DepNode
+{
+    Component	component;
+    bool		root;			/* asked for, not only needed */
+    int			deps[DEPGRAPH_MAX_NODES];	/* nodes it needs, by index */
+    int			ndeps;
+    unsigned int needs;			/* bit i: needs node i, directly or not */
+} DepNode;
+
+typedef struct DepGraph
+{
+    DepNode		nodes[DEPGRAPH_MAX_NODES];	/* dependencies first */
+    int			nnodes;
+} DepGraph;
+
+typedef struct DepPlan
+{
+    Action		action;
+    char	   *version;		/* these three for the roots only */
+    char	   *config_param;
+    char	   *value;
+    int			parallel;		/* components at once, 0 for all */
+    int			timeout_ms;		/* per component, 0 for none */
+
+    /* sees each component that was run once it is done */
+    void		(*done) (const DepNode *node, FanoutHost *host, void *arg);
+    void	   *arg;
+} DepPlan;
+
+extern int	DepGraphBuild(DepGraph *graph, const Component *roots, int nroots);
+extern int	DepGraphRun(const DepGraph *graph, const DepPlan *plan,
+                        const char *host, const char *port);
+
+#endif							/* DEPGRAPH_H */
@@ -0,0 +1,414 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * fanout.c
+ *		The same requests to the agents of many hosts at once.
+ *
+ * A host goes through connecting (connectPoll), sending (Flush until
+ * nothing is left) and reading (ReadData until the socket is drained,
+ * taking whole messages as they complete) without ever waiting on its
+ * own; the loop in FanoutRun() waits for all of them together.  The
+ * requests follow a CliMsg_Hello, so the agent answers them with typed
+ * messages, and are followed by CliMsg_Finish, so the agent closes the
+ * connection once it has answered them.
+ *
+ * Looking up a host name still blocks in getaddrinfo(), and so does
+ * getting a service ticket that was not prefetched.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "fanout.h"
+#include "protocol.h"
+
+#define ntoh32(x) (x)
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+        (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/*
+ * FanoutInit -- set up fan to go to each of hosts
+ *
+ * A host may be given as host:port; the others use port.  The callbacks
+ * and limits are left for the caller to fill in.  Returns 0, or -1 if out
+ * of memory.
+ */
+int
+FanoutInit(Fanout *fan, const char *const *hosts, int nhosts, const char *port)
+{
+    memset(fan, 0, sizeof(*fan));
+    fan->parallel = FANOUT_DEFAULT_PARALLEL;
+    fan->hosts = calloc(nhosts > 0 ? nhosts : 1, sizeof(FanoutHost));
+    if (fan->hosts == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    fan->nhosts = nhosts;
+
+    for (int i = 0; i < nhosts; i++) {
+        FanoutHost *h = &fan->hosts[i];
+        const char *colon = strchr(hosts[i], ':');
+
+        /* more than one colon is an IPv6 address without a port */
+        if (colon != NULL && strchr(colon + 1, ':') == NULL) {
+            h->host = strndup(hosts[i], colon - hosts[i]);
+            h->port = strdup(colon + 1);
+        } else {
+            h->host = strdup(hosts[i]);
+            h->port = port ? strdup(port) : NULL;
+        }
+        h->output = createExpBuffer();
+        if (h->host == NULL || (h->port == NULL && port != NULL) ||
+            h->output == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+FanoutTerm(Fanout *fan)
+{
+    for (int i = 0; i < fan->nhosts; i++) {
+        FanoutHost *h = &fan->hosts[i];
+
+        CloseConn(h->conn);
+        free(h->host);
+        free(h->port);
+        destroyExpBuffer(h->output);
+    }
+    free(fan->hosts);
+    fan->hosts = NULL;
+    fan->nhosts = 0;
+}
+
+const char *
+FanoutStateName(FanoutState state)
+{
+    switch (state) {
+    case FANOUT_WAITING:
+        return "not started";
+    case FANOUT_CONNECTING:
+        return "connecting";
+    case FANOUT_SENDING:
+        return "sending";
+    case FANOUT_READING:
+        return "reading";
+    case FANOUT_DONE:
+        return "done";
+    case FANOUT_FAILED:
+        return "failed";
+    case FANOUT_TIMED_OUT:
+        return "timed out";
+    }
+    return "unknown";
+}
+
+static bool
+host_active(const FanoutHost *h)
+{
+    return h->state == FANOUT_CONNECTING || h->state == FANOUT_SENDING ||
+        h->state == FANOUT_READING;
+}
+
+/*
+ * Leave the host in its final state, with the connection closed, and hand
+ * it to the done callback.
+ */
+static void
+finish_host(Fanout *fan, FanoutHost *h, FanoutState state)
+{
+    h->state = state;
+    h->elapsed_ms = elapsed_ms(&h->started);
+    CloseConn(h->conn);
+    h->conn = NULL;
+    if (fan->done)
+        fan->done(h, fan->arg);
+}
+
+/*
+ * Fail the host for the reason why, or for the connection's own error
+ * message if why is NULL.
+ */
+static void
+fail_host(Fanout *fan, FanoutHost *h, const char *why)
+{
+    if (why == NULL && h->conn != NULL && h->conn->errorMessage.len > 0)
+        why = h->conn->errorMessage.data;
+    snprintf(h->error, sizeof(h->error), "%s", why ? why : "connection failed");
+    /* one line for the summary */
+    h->error[strcspn(h->error, "\n")] = '\0';
+    finish_host(fan, h, FANOUT_FAILED);
+}
+
+/*
+ * Take the messages that have arrived complete.  Returns false if the
+ * host is finished, one way or the other.
+ */
+static bool
+parse_responses(Fanout *fan, FanoutHost *h)
+{
+    ExpBufferData msg;
+    char		type;
+    int			result;
+    int			status;
+
+    initExpBuffer(&msg);
+    while ((result = ParseResponseMessage(h->conn, &type, &msg)) > 0) {
+        switch (type) {
+        case RespMsg_Output:
+            appendBinaryExpBuffer(h->output, msg.data, msg.len);
+            if (fan->output)
+                fan->output(h, msg.data, msg.len, fan->arg);
+            break;
+        case RespMsg_Progress:
+            if (msg.len > 4) {
+                appendBinaryExpBuffer(h->output, msg.data + 4, msg.len - 4);
+                if (fan->output)
+                    fan->output(h, msg.data + 4, msg.len - 4, fan->arg);
+            }
+            break;
+        case RespMsg_Result:
+            if (msg.len >= 4) {
+                memcpy(&status, msg.data, 4);
+                status = ntoh32(status);
+                if (h->status == 0)
+                    h->status = status;
+            }
+            break;
+        case RespMsg_End:
+            h->responses++;
+            break;
+        default:
+            /* unknown message types are skipped */
+            break;
+        }
+        resetExpBuffer(&msg);
+        if (h->responses == h->requests)
+            break;
+    }
+    termExpBuffer(&msg);
+
+    if (result < 0) {
+        fail_host(fan, h, "malformed response");
+        return false;
+    }
+    if (h->responses == h->requests) {
+        finish_host(fan, h, FANOUT_DONE);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Take the host as far as it goes without waiting.
+ */
+static void
+advance_host(Fanout *fan, FanoutHost *h)
+{
+    PollingStatusType polling;
+    int			result;
+
+    switch (h->state) {
+    case FANOUT_CONNECTING:
+        polling = connectPoll(h->conn);
+        if (polling == PGRES_POLLING_FAILED) {
+            fail_host(fan, h, NULL);
+            return;
+        }
+        if (polling != PGRES_POLLING_OK) {
+            h->wait_for = polling;
+            return;
+        }
+
+        /* typed responses are only sent after the handshake */
+        if (QueueHello(h->conn) < 0) {
+            fail_host(fan, h, "could not queue the requests");
+            return;
+        }
+        h->requests = fan->queue(h, fan->arg);
+        if (h->requests >= 0)
+            h->requests++;		/* the handshake's reply */
+        if (h->requests < 0 ||
+            PutMsgStart(CliMsg_Finish, h->conn) < 0 || PutMsgEnd(h->conn) < 0) {
+            fail_host(fan, h, "could not queue the requests");
+            return;
+        }
+        h->state = FANOUT_SENDING;
+        /* FALLTHROUGH */
+
+    case FANOUT_SENDING:
+        result = Flush(h->conn);
+        if (result < 0) {
+            fail_host(fan, h, NULL);
+            return;
+        }
+        if (result > 0)
+            return;				/* wait till the socket takes more */
+        h->state = FANOUT_READING;
+        /* FALLTHROUGH */
+
+    case FANOUT_READING:
+        for (;;) {
+            if (!parse_responses(fan, h))
+                return;
+            result = ReadData(h->conn);
+            if (result < 0) {
+                fail_host(fan, h, NULL);
+                return;
+            }
+            if (result == 0)
+                return;			/* drained */
+        }
+
+    default:
+        return;
+    }
+}
+
+static void
+start_host(Fanout *fan, FanoutHost *h)
+{
+    clock_gettime(CLOCK_MONOTONIC, &h->started);
+    h->state = FANOUT_CONNECTING;
+    h->conn = connect_to_debo_async(h->host, h->port);
+    if (h->conn == NULL || h->conn->status == CONNECTION_BAD) {
+        fail_host(fan, h, NULL);
+        return;
+    }
+    /* connect() is in progress, or done already, which the poll sees too */
+    h->wait_for = PGRES_POLLING_WRITING;
+}
+
+/*
+ * FanoutRun -- send every host its requests and read the responses
+ *
+ * Hosts start in order, as the parallel limit and the ready callback
+ * allow.  The done callback sees each host as it finishes, in the order
+ * they do.  Returns the number of hosts that failed, timed out or never
+ * started, or -1 if out of memory.
+ */
+int
+FanoutRun(Fanout *fan)
+{
+    struct pollfd *fds;
+    int		   *fd_host;
+    int			next = 0;		/* hosts before it have all started */
+    int			failed = 0;
+
+    fds = malloc((fan->nhosts > 0 ? fan->nhosts : 1) * sizeof(struct pollfd));
+    fd_host = malloc((fan->nhosts > 0 ? fan->nhosts : 1) * sizeof(int));
+    if (fds == NULL || fd_host == NULL) {
+        fprintf(stderr, "out of memory\n");
+        free(fds);
+        free(fd_host);
+        return -1;
+    }
+
+    for (;;) {
+        int			active = 0;
+        int			nfds = 0;
+        int			timeout = -1;
+
+        for (int i = 0; i < fan->nhosts; i++)
+            if (host_active(&fan->hosts[i]))
+                active++;
+        for (int i = next; i < fan->nhosts &&
+             (fan->parallel <= 0 || active < fan->parallel); i++) {
+            FanoutHost *h = &fan->hosts[i];
+
+            if (h->state != FANOUT_WAITING ||
+                (fan->ready && !fan->ready(h, fan->arg)))
+                continue;
+            start_host(fan, h);
+            if (host_active(h))
+                active++;
+        }
+        while (next < fan->nhosts && fan->hosts[next].state != FANOUT_WAITING)
+            next++;
+        /* nothing in progress, so whatever has not started never will */
+        if (active == 0)
+            break;
+
+        for (int i = 0; i < fan->nhosts; i++) {
+            FanoutHost *h = &fan->hosts[i];
+            short		events;
+
+            if (!host_active(h))
+                continue;
+            if (h->state == FANOUT_CONNECTING)
+                events = h->wait_for == PGRES_POLLING_READING ? POLLIN : POLLOUT;
+            else if (h->state == FANOUT_SENDING)
+                events = POLLIN | POLLOUT;
+            else
+                events = POLLIN;
+            fds[nfds].fd = h->conn->sock;
+            fds[nfds].events = events;
+            fds[nfds].revents = 0;
+            fd_host[nfds++] = i;
+
+            if (fan->timeout_ms > 0) {
+                int			left = fan->timeout_ms - (int) elapsed_ms(&h->started);
+
+                if (left < 0)
+                    left = 0;
+                if (timeout < 0 || left < timeout)
+                    timeout = left;
+            }
+        }
+
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+            fprintf(stderr, "poll() failed: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            FanoutHost *h = &fan->hosts[fd_host[i]];
+
+            if (fds[i].revents != 0)
+                advance_host(fan, h);
+            if (host_active(h) && fan->timeout_ms > 0 &&
+                elapsed_ms(&h->started) >= fan->timeout_ms) {
+                snprintf(h->error, sizeof(h->error),
+                         "no answer within %d ms while %s",
+                         fan->timeout_ms, FanoutStateName(h->state));
+                finish_host(fan, h, FANOUT_TIMED_OUT);
+            }
+        }
+    }
+
+    for (int i = 0; i < fan->nhosts; i++)
+        if (fan->hosts[i].state != FANOUT_DONE)
+            failed++;
+    free(fds);
+    free(fd_host);
+    return failed;
+}
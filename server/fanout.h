@@ -0,0 +1,105 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * fanout.h
+ *		The same requests to the agents of many hosts at once.
+ *
+ * Every host gets a connection of its own, and all of them are driven
+ * non-blocking from one poll() loop: connecting, sending the requests,
+ * reading the responses.  So an operation over a cluster takes about as
+ * long as its slowest host rather than the sum of them all.  At most
+ * `parallel` hosts are in progress at a time, and a host that is not done
+ * within `timeout_ms` of being started is given up on.
+ *-------------------------------------------------------------------------
+ */
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <time.h>
+
+#include "utiles.h"
+
+typedef enum FanoutState
+{
+    FANOUT_WAITING,				/* not started yet */
+    FANOUT_CONNECTING,
+    FANOUT_SENDING,
+    FANOUT_READING,
+    FANOUT_DONE,				/* every response read */
+    FANOUT_FAILED,
+    FANOUT_TIMED_OUT
+} FanoutState;
+
+typedef struct FanoutHost
+{
+    char	   *host;
+    char	   *port;
+    FanoutState state;
+    Conn	   *conn;
+    int			wait_for;		/* PGRES_POLLING_* while connecting */
+    int			requests;		/* responses the requests are answered with */
+    int			responses;		/* responses read so far */
+    int			status;			/* first failing RESP_* status, else 0 */
+    ExpBuffer	output;			/* everything the requests printed */
+    char		error[256];		/* why the host failed */
+    struct timespec started;
+    double		elapsed_ms;		/* from start to done or failure */
+} FanoutHost;
+
+/*
+ * Queues the requests for one host on host->conn, without flushing.
+ * Returns how many responses they are answered with, or -1 on failure.
+ */
+typedef int (*FanoutQueueFn) (FanoutHost *host, void *arg);
+
+/* Called as each host finishes, whatever the outcome. */
+typedef void (*FanoutDoneFn) (FanoutHost *host, void *arg);
+
+/*
+ * Whether a host that has not started may start now.  A host that never
+ * may is left FANOUT_WAITING once nothing else is in progress.
+ */
+typedef bool (*FanoutReadyFn) (FanoutHost *host, void *arg);
+
+/* Called with each piece of a host's output as it arrives. */
+typedef void (*FanoutOutputFn) (FanoutHost *host, const char *data, size_t len,
+                                void *arg);
+
+typedef struct Fanout
+{
+    FanoutHost *hosts;
+    int			nhosts;
+    int			parallel;		/* hosts in progress at once, 0 for all */
+    int			timeout_ms;		/* per host, 0 for none */
+    FanoutQueueFn queue;
+    FanoutDoneFn done;
+    FanoutReadyFn ready;		/* NULL to start hosts in order */
+    FanoutOutputFn output;		/* optional */
+    void	   *arg;			/* passed to the callbacks */
+} Fanout;
+
+/* default for Fanout.parallel */
+#define FANOUT_DEFAULT_PARALLEL	64
+
+extern int	FanoutInit(Fanout *fan, const char *const *hosts, int nhosts,
+                       const char *port);
+extern int	FanoutRun(Fanout *fan);
+extern const char *FanoutStateName(FanoutState state);
+extern void FanoutTerm(Fanout *fan);
+
+#endif							/* FANOUT_H */
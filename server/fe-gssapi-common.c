@@ -10,9 +10,13 @@
 
 #include <gssapi.h>
 #include <gssapi/gssapi.h>
+#include <gssapi/gssapi_ext.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include "expbuffer.h"
 #include "connect.h"
 
@@ -84,7 +88,7 @@ PQhost(const Conn *conn)
     if (!conn)
         return NULL;
 
-    if (conn->connhost != NULL)
+    if (conn->connhost != NULL && conn->whichhost >= 0)
     {
         /*
          * Return the verbatim host value provided by user, or hostaddr in its
@@ -102,26 +106,14 @@ PQhost(const Conn *conn)
 }
 
 /*
- * Try to load service name for a connection
+ * Import the agent's service principal on host, debo@host.
  */
-int
-pg_GSS_load_servicename(Conn *conn)
+static OM_uint32
+import_service_name(OM_uint32 *min_stat, const char *host, gss_name_t *name)
 {
-    OM_uint32   maj_stat,
-                min_stat;
+    OM_uint32   maj_stat;
     int         maxlen;
     gss_buffer_desc temp_gbuf;
-    char       *host;
-
-    if (conn->gtarg_nam != NULL)
-        return STATUS_OK;
-
-    host = PQhost(conn);
-    if (!(host && host[0] != '\0'))
-    {
-        fprintf(stderr, "host name must be specified");
-        return STATUS_ERROR;
-    }
 
     // Hardcode service name to "debo"
     const char *service_name = "debo";  // Modification here
@@ -130,17 +122,40 @@ pg_GSS_load_servicename(Conn *conn)
     temp_gbuf.value = (char *) malloc(maxlen);
     if (!temp_gbuf.value)
     {
-        fprintf(stderr, "out of memory");
-        return STATUS_ERROR;
+        *min_stat = 0;
+        return GSS_S_FAILURE;
     }
     snprintf(temp_gbuf.value, maxlen, "%s@%s",
              service_name, host);  // Updated
     temp_gbuf.length = strlen(temp_gbuf.value);
 
-    maj_stat = gss_import_name(&min_stat, &temp_gbuf,
-                               GSS_C_NT_HOSTBASED_SERVICE, &conn->gtarg_nam);
+    maj_stat = gss_import_name(min_stat, &temp_gbuf,
+                               GSS_C_NT_HOSTBASED_SERVICE, name);
     free(temp_gbuf.value);
+    return maj_stat;
+}
 
+/*
+ * Try to load service name for a connection
+ */
+int
+pg_GSS_load_servicename(Conn *conn)
+{
+    OM_uint32   maj_stat,
+                min_stat;
+    char       *host;
+
+    if (conn->gtarg_nam != NULL)
+        return STATUS_OK;
+
+    host = PQhost(conn);
+    if (!(host && host[0] != '\0'))
+    {
+        fprintf(stderr, "host name must be specified");
+        return STATUS_ERROR;
+    }
+
+    maj_stat = import_service_name(&min_stat, host, &conn->gtarg_nam);
     if (maj_stat != GSS_S_COMPLETE)
     {
         pg_GSS_error("GSSAPI name import error",  // Removed libpq_gettext for simplicity
@@ -150,3 +165,232 @@ pg_GSS_load_servicename(Conn *conn)
     }
     return STATUS_OK;
 }
+
+/*
+ * Service ticket prefetch.
+ *
+ * Left to itself, every connection asks the KDC for the ticket of its
+ * agent while it sets up its context, so an operation over many agents
+ * waits for one KDC round trip after another.  pg_GSS_prefetch_tickets()
+ * gets them all up front from a pool of threads, into a MEMORY ccache
+ * behind one credential handle, which every connection then initiates
+ * with: pqsecure_open_gss() finds its ticket already there.
+ */
+static gss_cred_id_t shared_cred = GSS_C_NO_CREDENTIAL;
+
+typedef struct PrefetchWork
+{
+    const char *const *hosts;
+    int			nhosts;
+    int			next;			/* next host to take */
+    int			fetched;
+    double		kdc_min_ms;
+    double		kdc_max_ms;
+    double		kdc_total_ms;
+    pthread_mutex_t lock;
+} PrefetchWork;
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+        (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*
+ * Get the ticket for one host: the first step of a context needs it, and
+ * leaves it in the shared credential's ccache.  The context itself is
+ * thrown away.  Returns the time it took in milliseconds, or -1.
+ */
+static double
+prefetch_one(const char *host)
+{
+    OM_uint32	major,
+                minor;
+    gss_name_t	name = GSS_C_NO_NAME;
+    gss_ctx_id_t ctx = GSS_C_NO_CONTEXT;
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+    struct timespec start;
+    double		ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    major = import_service_name(&minor, host, &name);
+    if (major == GSS_S_COMPLETE)
+        major = gss_init_sec_context(&minor, shared_cred, &ctx, name,
+                                     GSS_C_NO_OID, GSS_C_MUTUAL_FLAG, 0, 0,
+                                     GSS_C_NO_BUFFER, NULL, &output, NULL,
+                                     NULL);
+    ms = elapsed_ms(&start);
+
+    if (GSS_ERROR(major))
+    {
+        ExpBufferData msg;
+
+        initExpBuffer(&msg);
+        pg_GSS_error_int(&msg, major, GSS_C_GSS_CODE);
+        appendExpBufferChar(&msg, ':');
+        pg_GSS_error_int(&msg, minor, GSS_C_MECH_CODE);
+        fprintf(stderr, "could not get a service ticket for debo@%s:%s\n",
+                host, msg.data);
+        termExpBuffer(&msg);
+        ms = -1;
+    }
+
+    gss_release_buffer(&minor, &output);
+    if (ctx != GSS_C_NO_CONTEXT)
+        gss_delete_sec_context(&minor, &ctx, GSS_C_NO_BUFFER);
+    if (name != GSS_C_NO_NAME)
+        gss_release_name(&minor, &name);
+    return ms;
+}
+
+static void *
+prefetch_worker(void *arg)
+{
+    PrefetchWork *work = (PrefetchWork *) arg;
+
+    for (;;)
+    {
+        int			i;
+        double		ms;
+
+        pthread_mutex_lock(&work->lock);
+        i = work->next++;
+        pthread_mutex_unlock(&work->lock);
+        if (i >= work->nhosts)
+            break;
+
+        ms = prefetch_one(work->hosts[i]);
+        if (ms < 0)
+            continue;
+
+        pthread_mutex_lock(&work->lock);
+        if (work->fetched == 0 || ms < work->kdc_min_ms)
+            work->kdc_min_ms = ms;
+        if (ms > work->kdc_max_ms)
+            work->kdc_max_ms = ms;
+        work->kdc_total_ms += ms;
+        work->fetched++;
+        pthread_mutex_unlock(&work->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Set up the shared credential: the default ccache's TGT copied into a
+ * MEMORY ccache of this process, so that the tickets fetched with it stay
+ * in memory and out of the user's ccache.  If the copy fails, the default
+ * credential is shared as it is.
+ */
+static bool
+acquire_shared_cred(void)
+{
+    OM_uint32	major,
+                minor;
+    gss_cred_id_t cred = GSS_C_NO_CREDENTIAL;
+    gss_key_value_element_desc element;
+    gss_key_value_set_desc store;
+    char		ccache[64];
+
+    if (shared_cred != GSS_C_NO_CREDENTIAL)
+        return true;
+    if (!pg_GSS_have_cred_cache(&cred))
+        return false;
+
+    snprintf(ccache, sizeof(ccache), "MEMORY:debo-tickets-%d", (int) getpid());
+    element.key = "ccache";
+    element.value = ccache;
+    store.count = 1;
+    store.elements = &element;
+
+    major = gss_store_cred_into(&minor, cred, GSS_C_INITIATE, GSS_C_NO_OID,
+                                1, 0, &store, NULL, NULL);
+    if (major == GSS_S_COMPLETE)
+        major = gss_acquire_cred_from(&minor, GSS_C_NO_NAME, 0,
+                                      GSS_C_NO_OID_SET, GSS_C_INITIATE,
+                                      &store, &shared_cred, NULL, NULL);
+    if (major == GSS_S_COMPLETE)
+        gss_release_cred(&minor, &cred);
+    else
+    {
+        shared_cred = cred;
+        fprintf(stderr, "could not set up a MEMORY ccache, prefetching into the default one\n");
+    }
+    return true;
+}
+
+/*
+ * pg_GSS_prefetch_tickets -- get the service tickets of the agents on
+ * hosts from nworkers threads at once
+ *
+ * Fills in stats, and returns the number of hosts whose ticket could not
+ * be had, or -1 if there is no credential to start from.  Connections
+ * made afterwards share the credential, see pg_GSS_shared_cred().
+ */
+int
+pg_GSS_prefetch_tickets(const char *const *hosts, int nhosts, int nworkers,
+                        GSSPrefetchStats *stats)
+{
+    PrefetchWork work;
+    pthread_t  *threads;
+    struct timespec start;
+    int			started = 0;
+    int			i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->hosts = nhosts;
+    if (!acquire_shared_cred())
+    {
+        fprintf(stderr, "no Kerberos credentials to prefetch service tickets with\n");
+        return -1;
+    }
+    if (nhosts <= 0)
+        return 0;
+    if (nworkers < 1)
+        nworkers = 1;
+    if (nworkers > nhosts)
+        nworkers = nhosts;
+
+    memset(&work, 0, sizeof(work));
+    work.hosts = hosts;
+    work.nhosts = nhosts;
+    pthread_mutex_init(&work.lock, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    threads = malloc(nworkers * sizeof(pthread_t));
+    if (threads != NULL)
+    {
+        for (; started < nworkers - 1; started++)
+        {
+            if (pthread_create(&threads[started], NULL, prefetch_worker, &work) != 0)
+                break;
+        }
+    }
+    /* this thread is the last worker, and the only one if none started */
+    prefetch_worker(&work);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    stats->wall_ms = elapsed_ms(&start);
+    pthread_mutex_destroy(&work.lock);
+
+    stats->fetched = work.fetched;
+    stats->kdc_min_ms = work.kdc_min_ms;
+    stats->kdc_max_ms = work.kdc_max_ms;
+    if (work.fetched > 0)
+        stats->kdc_avg_ms = work.kdc_total_ms / work.fetched;
+    return nhosts - work.fetched;
+}
+
+/*
+ * The credential connections initiate with, GSS_C_NO_CREDENTIAL (the
+ * default ccache) unless tickets were prefetched.
+ */
+gss_cred_id_t
+pg_GSS_shared_cred(void)
+{
+    return shared_cred;
+}
@@ -13,9 +13,11 @@
 
 #include "connect.h"
 #include "utiles.h"
+#include "protocol.h"
 #include <gssapi.h>
 #include "expbuffer.h"
 #include <gssapi/gssapi.h>
+#include <gssapi/gssapi_ext.h>
 
 
 #define db_hton32(x) (x)
@@ -56,7 +58,14 @@
  * would have to allocate memory for them to then pass them to GSSAPI.
  *
  * Therefore, these two #define's are effectively part of the protocol
- * spec and can't ever be changed.
+ * spec and can't ever be changed.  Connections start out with them; the
+ * capability handshake may then settle on larger packets (see
+ * pqsecure_gss_set_packet_size()).
+ *
+ * Packets are wrapped and unwrapped in place, as in be-secure-gssapi.c:
+ * the data is encrypted in its slot of the send buffer, between the
+ * header and trailer GSSAPI asks for, and decrypted where it was
+ * received.  The concatenated slots are an ordinary gss_wrap() token.
  */
 #define PQ_GSS_SEND_BUFFER_SIZE 16384
 #define PQ_GSS_RECV_BUFFER_SIZE 16384
@@ -67,16 +76,160 @@
  * these macros.
  */
 #define PqGSSSendBuffer (conn->gss_SendBuffer)
+#define PqGSSSendBufferSize (conn->gss_SendBufferSize)
 #define PqGSSSendLength (conn->gss_SendLength)
 #define PqGSSSendNext (conn->gss_SendNext)
 #define PqGSSSendConsumed (conn->gss_SendConsumed)
 #define PqGSSRecvBuffer (conn->gss_RecvBuffer)
+#define PqGSSRecvBufferSize (conn->gss_RecvBufferSize)
 #define PqGSSRecvLength (conn->gss_RecvLength)
-#define PqGSSResultBuffer (conn->gss_ResultBuffer)
 #define PqGSSResultLength (conn->gss_ResultLength)
 #define PqGSSResultNext (conn->gss_ResultNext)
 #define PqGSSMaxPktSize (conn->gss_MaxPktSize)
 
+/*
+ * Put the next packet, len bytes from data, into PqGSSSendBuffer after
+ * the length word, wrapping it in place as the transport has it: encrypted,
+ * only signed, or not at all (a local session or a plaintext port).
+ *
+ * Returns the length of the packet, or -1 after reporting a failure.
+ */
+static ssize_t
+wrap_packet(Conn *conn, const char *data, size_t len)
+{
+    OM_uint32	major,
+                minor;
+    gss_iov_buffer_desc iov[4];
+    char	   *slot = PqGSSSendBuffer + PqGSSSendLength + sizeof(uint32);
+    size_t		room = PqGSSSendBufferSize - PqGSSSendLength - sizeof(uint32);
+    size_t		pktlen = 0;
+    int			conf_state = 0;
+    int			i;
+
+    if (conn->gss_transport != TRANSPORT_PLAIN)
+    {
+        iov[0].type = GSS_IOV_BUFFER_TYPE_HEADER;
+        iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+        iov[2].type = GSS_IOV_BUFFER_TYPE_PADDING;
+        iov[3].type = GSS_IOV_BUFFER_TYPE_TRAILER;
+        for (i = 0; i < 4; i++)
+        {
+            iov[i].buffer.value = NULL;
+            iov[i].buffer.length = 0;
+        }
+        iov[1].buffer.length = len;
+
+        major = gss_wrap_iov_length(&minor, conn->gctx,
+                                    conn->gss_transport == TRANSPORT_ENCRYPT,
+                                    GSS_C_QOP_DEFAULT, NULL, iov, 4);
+        if (major != GSS_S_COMPLETE)
+        {
+            pg_GSS_error(libpq_gettext("GSSAPI wrap error"), conn, major, minor);
+            return -1;
+        }
+        for (i = 0; i < 4; i++)
+            pktlen += iov[i].buffer.length;
+    }
+    else
+        pktlen = len;
+
+    if (pktlen > room)
+    {
+        fprintf(stderr, "client tried to send oversize GSSAPI packet (%zu > %zu)",
+                pktlen, room);
+        return -1;
+    }
+
+    /*
+     * A local session (see pqsecure_open_local()) or a plaintext port sends
+     * the data as is.
+     */
+    if (conn->gss_transport == TRANSPORT_PLAIN)
+    {
+        memcpy(slot, data, len);
+        return pktlen;
+    }
+
+    /* header, data, padding and trailer follow each other in the packet */
+    for (i = 0; i < 4; i++)
+    {
+        iov[i].buffer.value = slot;
+        slot += iov[i].buffer.length;
+    }
+    memcpy(iov[1].buffer.value, data, len);
+
+    major = gss_wrap_iov(&minor, conn->gctx,
+                         conn->gss_transport == TRANSPORT_ENCRYPT,
+                         GSS_C_QOP_DEFAULT, &conf_state, iov, 4);
+    if (major != GSS_S_COMPLETE)
+    {
+        pg_GSS_error(libpq_gettext("GSSAPI wrap error"), conn, major, minor);
+        return -1;
+    }
+    if (conf_state == 0 && conn->gss_transport == TRANSPORT_ENCRYPT)
+    {
+        fprintf(stderr, "outgoing GSSAPI message would not use confidentiality");
+        return -1;
+    }
+    return pktlen;
+}
+
+/*
+ * Decrypt the packet of len bytes waiting in PqGSSRecvBuffer after the
+ * length word, in place, and make it the result to return.  The packets
+ * of a local session or a plaintext port are not wrapped.
+ *
+ * Returns 0, or -1 after reporting a failure.
+ */
+static int
+unwrap_packet(Conn *conn, size_t len)
+{
+    OM_uint32	major,
+                minor;
+    gss_iov_buffer_desc iov[2];
+    char	   *data;
+    int			conf_state = 0;
+
+    if (conn->gss_transport == TRANSPORT_PLAIN)
+    {
+        PqGSSResultNext = sizeof(uint32);
+        PqGSSResultLength = sizeof(uint32) + len;
+        return 0;
+    }
+
+    iov[0].type = GSS_IOV_BUFFER_TYPE_STREAM;
+    iov[0].buffer.value = PqGSSRecvBuffer + sizeof(uint32);
+    iov[0].buffer.length = len;
+    iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+    iov[1].buffer.value = NULL;
+    iov[1].buffer.length = 0;
+
+    major = gss_unwrap_iov(&minor, conn->gctx, &conf_state, NULL, iov, 2);
+    if (major != GSS_S_COMPLETE)
+    {
+        pg_GSS_error(libpq_gettext("GSSAPI unwrap error"), conn, major, minor);
+        return -1;
+    }
+    if (conf_state == 0 && conn->gss_transport == TRANSPORT_ENCRYPT)
+    {
+        fprintf(stderr, "incoming GSSAPI message did not use confidentiality");
+        return -1;
+    }
+
+    /* the data is left inside the token, which is all we sized for */
+    data = iov[1].buffer.value;
+    if (data < PqGSSRecvBuffer + sizeof(uint32) ||
+        data + iov[1].buffer.length > PqGSSRecvBuffer + sizeof(uint32) + len)
+    {
+        fprintf(stderr, "GSSAPI unwrapped a packet out of place");
+        gss_release_iov_buffer(&minor, iov, 2);
+        return -1;
+    }
+    PqGSSResultNext = data - PqGSSRecvBuffer;
+    PqGSSResultLength = PqGSSResultNext + iov[1].buffer.length;
+    return 0;
+}
+
 
 /*
  * Attempt to write len bytes of data from ptr to a GSSAPI-encrypted connection.
@@ -93,14 +246,8 @@
 ssize_t
 pg_GSS_write(Conn *conn, const void *ptr, size_t len)
 {
-    OM_uint32	major,
-                minor;
-    gss_buffer_desc input,
-                    output = GSS_C_EMPTY_BUFFER;
-    ssize_t		ret = -1;
     size_t		bytes_to_encrypt;
     size_t		bytes_encrypted;
-    gss_ctx_id_t gctx = conn->gctx;
 
     /*
      * When we get a retryable failure, we must not tell the caller we have
@@ -138,7 +285,8 @@ pg_GSS_write(Conn *conn, const void *ptr, size_t len)
      */
     while (bytes_to_encrypt || PqGSSSendLength)
     {
-        int			conf_state = 0;
+        size_t		input_length;
+        ssize_t		pktlen;
         uint32		netlen;
 
         /*
@@ -182,58 +330,30 @@ pg_GSS_write(Conn *conn, const void *ptr, size_t len)
          * through all the data.
          */
         if (bytes_to_encrypt > PqGSSMaxPktSize)
-            input.length = PqGSSMaxPktSize;
+            input_length = PqGSSMaxPktSize;
         else
-            input.length = bytes_to_encrypt;
-
-        input.value = (char *) ptr + bytes_encrypted;
-
-        output.value = NULL;
-        output.length = 0;
+            input_length = bytes_to_encrypt;
 
         /*
          * Create the next encrypted packet.  Any failure here is considered a
          * hard failure, so we return -1 even if some data has been sent.
          */
-        major = gss_wrap(&minor, gctx, 1, GSS_C_QOP_DEFAULT,
-                         &input, &conf_state, &output);
-        if (major != GSS_S_COMPLETE)
-        {
-            pg_GSS_error(libpq_gettext("GSSAPI wrap error"), conn, major, minor);
-            errno = EIO;		/* for lack of a better idea */
-            goto cleanup;
-        }
-
-        if (conf_state == 0)
+        pktlen = wrap_packet(conn, (const char *) ptr + bytes_encrypted,
+                             input_length);
+        if (pktlen < 0)
         {
-            fprintf(stderr, "outgoing GSSAPI message would not use confidentiality");
             errno = EIO;		/* for lack of a better idea */
-            goto cleanup;
-        }
-
-        if (output.length > PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32))
-        {
-            fprintf(stderr, "client tried to send oversize GSSAPI packet (%zu > %zu)",
-                                 (size_t) output.length,
-                                 PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32));
-            errno = EIO;		/* for lack of a better idea */
-            goto cleanup;
+            return -1;
         }
 
-        bytes_encrypted += input.length;
-        bytes_to_encrypt -= input.length;
-        PqGSSSendConsumed += input.length;
+        bytes_encrypted += input_length;
+        bytes_to_encrypt -= input_length;
+        PqGSSSendConsumed += input_length;
 
-        /* 4 network-order bytes of length, then payload */
-        netlen = db_hton32(output.length);
+        /* 4 network-order bytes of length, then the packet, already in place */
+        netlen = db_hton32(pktlen);
         memcpy(PqGSSSendBuffer + PqGSSSendLength, &netlen, sizeof(uint32));
-        PqGSSSendLength += sizeof(uint32);
-
-        memcpy(PqGSSSendBuffer + PqGSSSendLength, output.value, output.length);
-        PqGSSSendLength += output.length;
-
-        /* Release buffer storage allocated by GSSAPI */
-        gss_release_buffer(&minor, &output);
+        PqGSSSendLength += sizeof(uint32) + pktlen;
     }
 
     /* If we get here, our counters should all match up. */
@@ -243,13 +363,7 @@ pg_GSS_write(Conn *conn, const void *ptr, size_t len)
     /* We're reporting all the data as sent, so reset PqGSSSendConsumed. */
     PqGSSSendConsumed = 0;
 
-    ret = bytes_encrypted;
-
-cleanup:
-    /* Release GSSAPI buffer storage, if we didn't already */
-    if (output.value != NULL)
-        gss_release_buffer(&minor, &output);
-    return ret;
+    return bytes_encrypted;
 }
 
 /*
@@ -266,24 +380,18 @@ cleanup:
 ssize_t
 pg_GSS_read(Conn *conn, void *ptr, size_t len)
 {
-    OM_uint32	major,
-                minor;
-    gss_buffer_desc input = GSS_C_EMPTY_BUFFER,
-                    output = GSS_C_EMPTY_BUFFER;
+    size_t		input_length;
     ssize_t		ret;
     size_t		bytes_returned = 0;
-    gss_ctx_id_t gctx = conn->gctx;
 
     /*
      * The plan here is to read one incoming encrypted packet into
-     * PqGSSRecvBuffer, decrypt it into PqGSSResultBuffer, and then dole out
-     * data from there to the caller.  When we exhaust the current input
-     * packet, read another.
+     * PqGSSRecvBuffer, decrypt it where it is, and then dole out data from
+     * there to the caller.  When we exhaust the current input packet, read
+     * another.
      */
     while (bytes_returned < len)
     {
-        int			conf_state = 0;
-
         /* Check if we have data in our buffer that we can return immediately */
         if (PqGSSResultNext < PqGSSResultLength)
         {
@@ -294,7 +402,7 @@ pg_GSS_read(Conn *conn, void *ptr, size_t len)
              * Copy the data from our result buffer into the caller's buffer,
              * at the point where we last left off filling their buffer.
              */
-            memcpy((char *) ptr + bytes_returned, PqGSSResultBuffer + PqGSSResultNext, bytes_to_copy);
+            memcpy((char *) ptr + bytes_returned, PqGSSRecvBuffer + PqGSSResultNext, bytes_to_copy);
             PqGSSResultNext += bytes_to_copy;
             bytes_returned += bytes_to_copy;
 
@@ -324,7 +432,7 @@ pg_GSS_read(Conn *conn, void *ptr, size_t len)
         /*
          * At this point, our result buffer is empty with more bytes being
          * requested to be read.  We are now ready to load the next packet and
-         * decrypt it (entirely) into our result buffer.
+         * decrypt it (entirely) where it lands.
          */
 
         /* Collect the length if we haven't already */
@@ -339,22 +447,23 @@ pg_GSS_read(Conn *conn, void *ptr, size_t len)
 
             PqGSSRecvLength += ret;
 
-            /* If we still haven't got the length, return to the caller */
+            /*
+             * If we still haven't got the length, read on.  A short read is
+             * no reason to give up on a blocking socket, and on one that
+             * isn't, the next read says whether it would block.
+             */
             if (PqGSSRecvLength < sizeof(uint32))
-            {
-                errno = EWOULDBLOCK;
-                return -1;
-            }
+                continue;
         }
 
         /* Decode the packet length and check for overlength packet */
-        input.length = db_ntoh32(*(uint32 *) PqGSSRecvBuffer);
+        input_length = db_ntoh32(*(uint32 *) PqGSSRecvBuffer);
 
-        if (input.length > PQ_GSS_RECV_BUFFER_SIZE - sizeof(uint32))
+        if (input_length > PqGSSRecvBufferSize - sizeof(uint32))
         {
             fprintf(stderr, "oversize GSSAPI packet sent by the server (%zu > %zu)",
-                                 (size_t) input.length,
-                                 PQ_GSS_RECV_BUFFER_SIZE - sizeof(uint32));
+                                 input_length,
+                                 PqGSSRecvBufferSize - sizeof(uint32));
             errno = EIO;		/* for lack of a better idea */
             return -1;
         }
@@ -364,65 +473,34 @@ pg_GSS_read(Conn *conn, void *ptr, size_t len)
          * wherever we left off from the last time we were called.
          */
         ret = secure_raw_read(conn, PqGSSRecvBuffer + PqGSSRecvLength,
-                              input.length - (PqGSSRecvLength - sizeof(uint32)));
+                              input_length - (PqGSSRecvLength - sizeof(uint32)));
         /* If ret <= 0, secure_raw_read already set the correct errno */
         if (ret <= 0)
             return ret;
 
         PqGSSRecvLength += ret;
 
-        /* If we don't yet have the whole packet, return to the caller */
-        if (PqGSSRecvLength - sizeof(uint32) < input.length)
-        {
-            errno = EWOULDBLOCK;
-            return -1;
-        }
+        /* If we don't yet have the whole packet, read on, as above */
+        if (PqGSSRecvLength - sizeof(uint32) < input_length)
+            continue;
 
         /*
-         * We now have the full packet and we can perform the decryption and
-         * refill our result buffer, then loop back up to pass data back to
-         * the caller.  Note that error exits below here must take care of
-         * releasing the gss output buffer.
+         * We now have the full packet and we can perform the decryption,
+         * then loop back up to pass data back to the caller.  The data stays
+         * in PqGSSRecvBuffer until the caller has had all of it, and only
+         * then is the next packet read.
          */
-        output.value = NULL;
-        output.length = 0;
-        input.value = PqGSSRecvBuffer + sizeof(uint32);
-
-        major = gss_unwrap(&minor, gctx, &input, &output, &conf_state, NULL);
-        if (major != GSS_S_COMPLETE)
+        if (unwrap_packet(conn, input_length) < 0)
         {
-            pg_GSS_error(libpq_gettext("GSSAPI unwrap error"), conn,
-                         major, minor);
-            ret = -1;
-            errno = EIO;		/* for lack of a better idea */
-            goto cleanup;
-        }
-
-        if (conf_state == 0)
-        {
-            fprintf(stderr, "incoming GSSAPI message did not use confidentiality");
-            ret = -1;
             errno = EIO;		/* for lack of a better idea */
-            goto cleanup;
+            return -1;
         }
 
-        memcpy(PqGSSResultBuffer, output.value, output.length);
-        PqGSSResultLength = output.length;
-
-        /* Our receive buffer is now empty, reset it */
+        /* The packet is taken apart; the next one starts from scratch */
         PqGSSRecvLength = 0;
-
-        /* Release buffer storage allocated by GSSAPI */
-        gss_release_buffer(&minor, &output);
     }
 
-    ret = bytes_returned;
-
-cleanup:
-    /* Release GSSAPI buffer storage, if we didn't already */
-    if (output.value != NULL)
-        gss_release_buffer(&minor, &output);
-    return ret;
+    return bytes_returned;
 }
 
 /*
@@ -470,11 +548,275 @@ gss_read(Conn *conn, void *recv_buffer, size_t length, ssize_t *ret)
     return PGRES_POLLING_OK;
 }
 
+/*
+ * Set up a session on the agent's Unix socket.
+ *
+ * The agent identifies us by our uid and gid instead of a Kerberos
+ * handshake, and the data goes in the usual length-prefixed packets
+ * without being wrapped.  The agent answers the connection with 'S' if we
+ * are allowed in, or with 'E' and a message if we are not.
+ */
+PollingStatusType
+pqsecure_open_local(Conn *conn)
+{
+    char		verdict;
+    ssize_t		ret;
+
+    if (PqGSSSendBuffer == NULL)
+    {
+        PqGSSSendBuffer = malloc(PQ_GSS_SEND_BUFFER_SIZE);
+        PqGSSRecvBuffer = malloc(PQ_GSS_RECV_BUFFER_SIZE);
+        if (!PqGSSSendBuffer || !PqGSSRecvBuffer)
+        {
+            fprintf(stderr, "out of memory");
+            return PGRES_POLLING_FAILED;
+        }
+        PqGSSSendBufferSize = PQ_GSS_SEND_BUFFER_SIZE;
+        PqGSSRecvBufferSize = PQ_GSS_RECV_BUFFER_SIZE;
+    }
+    PqGSSSendLength = PqGSSSendNext = PqGSSSendConsumed = 0;
+    PqGSSRecvLength = PqGSSResultLength = PqGSSResultNext = 0;
+    PqGSSMaxPktSize = PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32);
+
+    do
+        ret = secure_raw_read(conn, &verdict, 1);
+    while (ret < 0 && errno == EINTR);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return PGRES_POLLING_READING;
+    if (ret != 1)
+        return PGRES_POLLING_FAILED;
+
+    if (verdict == 'E')
+    {
+        ret = secure_raw_read(conn, PqGSSRecvBuffer, PQ_GSS_RECV_BUFFER_SIZE - 1);
+        PqGSSRecvBuffer[ret > 0 ? ret : 0] = '\0';
+        appendExpBuffer(&conn->errorMessage, "%s\n", PqGSSRecvBuffer);
+        return PGRES_POLLING_FAILED;
+    }
+    if (verdict != 'S')
+        return PGRES_POLLING_FAILED;
+
+    conn->gsslocal = true;
+    conn->gss_transport = TRANSPORT_PLAIN;
+    return PGRES_POLLING_OK;
+}
+
+/*
+ * Is there unwrapped data that a read would return without touching the
+ * socket?
+ */
+bool
+pqsecure_gss_read_pending(Conn *conn)
+{
+    return PqGSSResultNext < PqGSSResultLength;
+}
+
+/*
+ * Release the security context, the target name and the packet buffers
+ * of a connection that is being closed.
+ */
+void
+pqsecure_close_gss(Conn *conn)
+{
+    OM_uint32	minor;
+
+    if (conn->gctx != GSS_C_NO_CONTEXT)
+        gss_delete_sec_context(&minor, &conn->gctx, GSS_C_NO_BUFFER);
+    if (conn->gtarg_nam != GSS_C_NO_NAME)
+        gss_release_name(&minor, &conn->gtarg_nam);
+    if (conn->gcred != GSS_C_NO_CREDENTIAL)
+        gss_release_cred(&minor, &conn->gcred);
+
+    free(PqGSSSendBuffer);
+    free(PqGSSRecvBuffer);
+    PqGSSSendBuffer = PqGSSRecvBuffer = NULL;
+    PqGSSSendBufferSize = PqGSSRecvBufferSize = 0;
+    PqGSSSendLength = PqGSSSendNext = PqGSSSendConsumed = 0;
+    PqGSSRecvLength = PqGSSResultLength = PqGSSResultNext = 0;
+    conn->gssenc = conn->gsslocal = false;
+}
+
+/*
+ * Take packets of up to recv_size bytes from the agent, and send packets
+ * of up to send_size, length words included; 0 leaves that direction as
+ * it is.  The capability handshake raises the receiving side as it makes
+ * its offer and the sending side once the agent has answered.  Sizes
+ * below the default are raised to it.  Whatever is waiting in the
+ * buffers stays.
+ *
+ * Returns 0, or -1 if out of memory or the size check failed, in which
+ * case the old sizes stay.
+ */
+int
+pqsecure_gss_set_packet_size(Conn *conn, int send_size, int recv_size)
+{
+    OM_uint32	major,
+                minor;
+    OM_uint32	max_pkt_size;
+    char	   *buffer;
+
+    if (PqGSSSendBuffer == NULL || PqGSSRecvBuffer == NULL)
+        return 0;
+
+    if (recv_size > 0)
+    {
+        if (recv_size < PQ_GSS_RECV_BUFFER_SIZE)
+            recv_size = PQ_GSS_RECV_BUFFER_SIZE;
+        if (recv_size < PqGSSRecvLength || recv_size < PqGSSResultLength)
+            return -1;
+        buffer = realloc(PqGSSRecvBuffer, recv_size);
+        if (buffer == NULL)
+            return -1;
+        PqGSSRecvBuffer = buffer;
+        PqGSSRecvBufferSize = recv_size;
+    }
+
+    if (send_size > 0)
+    {
+        if (send_size < PQ_GSS_SEND_BUFFER_SIZE)
+            send_size = PQ_GSS_SEND_BUFFER_SIZE;
+        if (send_size < PqGSSSendLength)
+            return -1;
+        if (conn->gss_transport == TRANSPORT_PLAIN)
+            max_pkt_size = send_size - sizeof(uint32);
+        else
+        {
+            major = gss_wrap_size_limit(&minor, conn->gctx,
+                                        conn->gss_transport == TRANSPORT_ENCRYPT,
+                                        GSS_C_QOP_DEFAULT,
+                                        send_size - sizeof(uint32),
+                                        &max_pkt_size);
+            if (GSS_ERROR(major))
+            {
+                pg_GSS_error(libpq_gettext("GSSAPI size check error"), conn,
+                             major, minor);
+                return -1;
+            }
+        }
+        buffer = realloc(PqGSSSendBuffer, send_size);
+        if (buffer == NULL)
+            return -1;
+        PqGSSSendBuffer = buffer;
+        PqGSSSendBufferSize = send_size;
+        PqGSSMaxPktSize = max_pkt_size;
+    }
+    return 0;
+}
+
+/*
+ * Queue the transport message asking for the transport option's mode, for
+ * a port that does not encrypt.  It goes out wrapped with confidentiality
+ * like the agent's answer, see protocol.h.
+ *
+ * Returns 0, or -1 after reporting a failure.
+ */
+static int
+queue_transport_request(Conn *conn)
+{
+    OM_uint32	major,
+                minor;
+    gss_buffer_desc input,
+                output = GSS_C_EMPTY_BUFFER;
+    char		message[TRANSPORT_MESSAGE_LEN];
+    int			conf_state = 0;
+    uint32		netlen;
+
+    memcpy(message, TRANSPORT_MAGIC, 4);
+    message[4] = (char) conn->transport_mode;
+    input.value = message;
+    input.length = TRANSPORT_MESSAGE_LEN;
+
+    major = gss_wrap(&minor, conn->gctx, 1, GSS_C_QOP_DEFAULT, &input,
+                     &conf_state, &output);
+    if (major != GSS_S_COMPLETE || conf_state == 0 ||
+        output.length > PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32))
+    {
+        pg_GSS_error(libpq_gettext("GSSAPI wrap error"), conn, major, minor);
+        gss_release_buffer(&minor, &output);
+        return -1;
+    }
+
+    netlen = db_hton32(output.length);
+    memcpy(PqGSSSendBuffer, (char *) &netlen, sizeof(uint32));
+    memcpy(PqGSSSendBuffer + sizeof(uint32), output.value, output.length);
+    PqGSSSendLength = sizeof(uint32) + output.length;
+    PqGSSSendNext = 0;
+    gss_release_buffer(&minor, &output);
+
+    conn->gss_transport_pending = true;
+    return 0;
+}
+
+/*
+ * Check the agent's answer to the transport message, the packet in input,
+ * and settle the transport if the port offers the one we asked for.
+ */
+static PollingStatusType
+check_transport_answer(Conn *conn, gss_buffer_desc *input)
+{
+    OM_uint32	major,
+                minor;
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+    int			conf_state = 0;
+    int			offered;
+
+    major = gss_unwrap(&minor, conn->gctx, input, &output, &conf_state, NULL);
+    PqGSSRecvLength = 0;
+    if (major != GSS_S_COMPLETE)
+    {
+        pg_GSS_error(libpq_gettext("GSSAPI unwrap error"), conn, major, minor);
+        return PGRES_POLLING_FAILED;
+    }
+    if (conf_state == 0 || output.length != TRANSPORT_MESSAGE_LEN ||
+        memcmp(output.value, TRANSPORT_MAGIC, 4) != 0)
+    {
+        appendExpBuffer(&conn->errorMessage,
+                        "agent sent an invalid transport answer\n");
+        gss_release_buffer(&minor, &output);
+        return PGRES_POLLING_FAILED;
+    }
+    offered = ((unsigned char *) output.value)[4];
+    gss_release_buffer(&minor, &output);
+
+    if (offered != conn->transport_mode)
+    {
+        appendExpBuffer(&conn->errorMessage,
+                        "agent port offers the %s transport, not %s\n",
+                        offered == TRANSPORT_PLAIN ? "plain" :
+                        offered == TRANSPORT_INTEGRITY ? "integrity" : "encrypt",
+                        conn->transport);
+        return PGRES_POLLING_FAILED;
+    }
+
+    conn->gss_transport_pending = false;
+    conn->gss_transport = offered;
+    conn->gssenc = true;
+
+    if (offered == TRANSPORT_PLAIN)
+        PqGSSMaxPktSize = PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32);
+    else
+    {
+        major = gss_wrap_size_limit(&minor, conn->gctx, 0, GSS_C_QOP_DEFAULT,
+                                    PQ_GSS_SEND_BUFFER_SIZE - sizeof(uint32),
+                                    &PqGSSMaxPktSize);
+        if (GSS_ERROR(major))
+        {
+            pg_GSS_error(libpq_gettext("GSSAPI size check error"), conn,
+                         major, minor);
+            return PGRES_POLLING_FAILED;
+        }
+    }
+    return PGRES_POLLING_OK;
+}
+
 /*
  * Negotiate GSSAPI transport for a connection.  When complete, returns
  * PGRES_POLLING_OK.  Will return PGRES_POLLING_READING or
  * PGRES_POLLING_WRITING as appropriate whenever it would block, and
  * PGRES_POLLING_FAILED if transport could not be negotiated.
+ *
+ * Asking for an integrity-only or plaintext transport adds one round trip
+ * after the handshake, see queue_transport_request().
  */
 PollingStatusType
 pqsecure_open_gss(Conn *conn)
@@ -498,12 +840,13 @@ pqsecure_open_gss(Conn *conn)
     {
         PqGSSSendBuffer = malloc(PQ_GSS_SEND_BUFFER_SIZE);
         PqGSSRecvBuffer = malloc(PQ_GSS_RECV_BUFFER_SIZE);
-        PqGSSResultBuffer = malloc(PQ_GSS_RECV_BUFFER_SIZE);
-        if (!PqGSSSendBuffer || !PqGSSRecvBuffer || !PqGSSResultBuffer)
+        if (!PqGSSSendBuffer || !PqGSSRecvBuffer)
         {
             fprintf(stderr, "out of memory");
             return PGRES_POLLING_FAILED;
         }
+        PqGSSSendBufferSize = PQ_GSS_SEND_BUFFER_SIZE;
+        PqGSSRecvBufferSize = PQ_GSS_RECV_BUFFER_SIZE;
         PqGSSSendLength = PqGSSSendNext = PqGSSSendConsumed = 0;
         PqGSSRecvLength = PqGSSResultLength = PqGSSResultNext = 0;
     }
@@ -547,6 +890,16 @@ pqsecure_open_gss(Conn *conn)
         {
             /* Attempt to get the length first */
             result = gss_read(conn, PqGSSRecvBuffer + PqGSSRecvLength, sizeof(uint32) - PqGSSRecvLength, &ret);
+            if (result == PGRES_POLLING_FAILED && conn->gss_transport_pending)
+            {
+                /* an encrypting port, or an agent that predates transports */
+                appendExpBuffer(&conn->errorMessage,
+                                "agent closed the connection: port %s may not offer the %s transport\n",
+                                conn->connhost[conn->whichhost].port ?
+                                conn->connhost[conn->whichhost].port : "",
+                                conn->transport);
+                return result;
+            }
             if (result != PGRES_POLLING_OK)
                 return result;
 
@@ -619,6 +972,9 @@ pqsecure_open_gss(Conn *conn)
             return PGRES_POLLING_READING;
 
         input.value = PqGSSRecvBuffer + sizeof(uint32);
+
+        if (conn->gss_transport_pending)
+            return check_transport_answer(conn, &input);
     }
 
     /* Load the service name (no-op if already done */
@@ -645,9 +1001,14 @@ pqsecure_open_gss(Conn *conn)
 
     /*
      * Call GSS init context, either with an empty input, or with a complete
-     * packet from the server.
+     * packet from the server.  Without a credential of its own the
+     * connection takes the shared one, whose ccache holds any prefetched
+     * ticket; it is not ours to release.
      */
-    major = gss_init_sec_context(&minor, conn->gcred, &conn->gctx,
+    major = gss_init_sec_context(&minor,
+                                 conn->gcred != GSS_C_NO_CREDENTIAL ?
+                                 conn->gcred : pg_GSS_shared_cred(),
+                                 &conn->gctx,
                                  conn->gtarg_nam, GSS_C_NO_OID,
                                  gss_flags, 0, 0, &input, NULL,
                                  &output, NULL, NULL);
@@ -664,11 +1025,6 @@ pqsecure_open_gss(Conn *conn)
 
     if (output.length == 0)
     {
-        /*
-         * We're done - hooray!  Set flag to tell the low-level I/O routines
-         * to do GSS wrapping/unwrapping.
-         */
-        conn->gssenc = true;
         conn->gssapi_used = true;
 
         /* Clean up */
@@ -676,6 +1032,21 @@ pqsecure_open_gss(Conn *conn)
         conn->gcred = GSS_C_NO_CREDENTIAL;
         gss_release_buffer(&minor, &output);
 
+        /* a port that does not encrypt has to agree on the transport first */
+        if (conn->transport_mode != TRANSPORT_ENCRYPT)
+        {
+            if (queue_transport_request(conn) < 0)
+                return PGRES_POLLING_FAILED;
+            return PGRES_POLLING_WRITING;
+        }
+
+        /*
+         * We're done - hooray!  Set flag to tell the low-level I/O routines
+         * to do GSS wrapping/unwrapping.
+         */
+        conn->gssenc = true;
+        conn->gss_transport = TRANSPORT_ENCRYPT;
+
         /*
          * Determine the max packet size which will fit in our buffer, after
          * accounting for the length.  pg_GSS_write will need this.
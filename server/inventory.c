@@ -0,0 +1,410 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * inventory.c
+ *		Reading the inventory and its cache of installed components.
+ *
+ * The cache has a line for each host whose agent has been asked:
+ *
+ *	host[:port] <TAB> refreshed, in seconds since the epoch <TAB> hdfs,zookeeper
+ *
+ * It is written whole to a temporary file that is then renamed over the
+ * old one, so a reader never sees half of it.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "inventory.h"
+
+/* Daemons a role can name, and the component each belongs to */
+static const struct
+{
+    const char *role;
+    Component	component;
+}			role_map[] = {
+    {"namenode", HDFS},
+    {"secondarynamenode", HDFS},
+    {"datanode", HDFS},
+    {"journalnode", HDFS},
+    {"zkfc", HDFS},
+    {"hmaster", HBASE},
+    {"regionserver", HBASE},
+    {"broker", KAFKA},
+    {"zk", ZOOKEEPER},
+    {"quorum", ZOOKEEPER},
+    {"spark-master", SPARK},
+    {"spark-worker", SPARK},
+    {"hiveserver2", HIVE},
+    {"metastore", HIVE},
+    {"nimbus", STORM},
+    {"supervisor", STORM},
+    {"presto-coordinator", PRESTO},
+    {"presto-worker", PRESTO},
+    {"jobmanager", FLINK},
+    {"taskmanager", FLINK},
+};
+
+/*
+ * inventory_default_path -- $DEBO_INVENTORY, else ~/.debo/inventory
+ */
+const char *
+inventory_default_path(void)
+{
+    static char path[MAX_PATH_LEN];
+    const char *env = getenv("DEBO_INVENTORY");
+    const char *home = getenv("HOME");
+
+    if (env != NULL && env[0] != '\0')
+        return env;
+    if (home == NULL || home[0] == '\0')
+        return NULL;
+    snprintf(path, sizeof(path), "%s/.debo/inventory", home);
+    return path;
+}
+
+/* The component a role stands for, NONE if it is not one */
+static Component
+role_component(const char *role)
+{
+    for (size_t i = 0; i < sizeof(role_map) / sizeof(role_map[0]); i++)
+        if (strcasecmp(role, role_map[i].role) == 0)
+            return role_map[i].component;
+    return string_to_component(role);
+}
+
+/*
+ * Bits of the components named in list, which is comma-separated and
+ * is modified.  Names that are not components are complained about if
+ * what is not NULL.
+ */
+static unsigned int
+parse_components(char *list, const char *what, const char *host)
+{
+    unsigned int bits = 0;
+    char	   *name;
+
+    while ((name = strsep(&list, ",")) != NULL) {
+        Component	c;
+
+        if (name[0] == '\0' || strcmp(name, "-") == 0)
+            continue;
+        c = role_component(name);
+        if (c == NONE) {
+            if (what != NULL)
+                fprintf(stderr, "inventory: unknown %s \"%s\" for %s\n",
+                        what, name, host);
+            continue;
+        }
+        bits |= COMPONENT_BIT(c);
+    }
+    return bits;
+}
+
+/* Host name of an inventory entry: host[:port], not an IPv6 address */
+static size_t
+host_name_len(const char *name)
+{
+    const char *colon = strchr(name, ':');
+
+    if (colon != NULL && strchr(colon + 1, ':') == NULL)
+        return colon - name;
+    return strlen(name);
+}
+
+/*
+ * InventoryFind -- the entry of host, given as host or host:port
+ *
+ * An entry without a port matches the host with any port.
+ */
+InventoryHost *
+InventoryFind(const Inventory *inv, const char *host)
+{
+    size_t		len = host_name_len(host);
+
+    if (inv == NULL)
+        return NULL;
+    for (int i = 0; i < inv->nhosts; i++) {
+        const char *name = inv->hosts[i].name;
+
+        if (strcmp(name, host) == 0)
+            return &inv->hosts[i];
+    }
+    for (int i = 0; i < inv->nhosts; i++) {
+        const char *name = inv->hosts[i].name;
+
+        if (host_name_len(name) == strlen(name) && strlen(name) == len &&
+            strncasecmp(name, host, len) == 0)
+            return &inv->hosts[i];
+    }
+    return NULL;
+}
+
+static int
+load_cache(Inventory *inv)
+{
+    char		path[MAX_PATH_LEN];
+    char		line[MAX_LINE_LENGTH];
+    FILE	   *fp;
+
+    snprintf(path, sizeof(path), "%s.cache", inv->path);
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return errno == ENOENT ? 0 : -1;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char	   *rest = line;
+        char	   *name = strsep(&rest, "\t");
+        char	   *stamp = strsep(&rest, "\t");
+        InventoryHost *h;
+
+        if (rest == NULL || stamp == NULL)
+            continue;
+        rest[strcspn(rest, "\r\n")] = '\0';
+        h = InventoryFind(inv, name);
+        if (h == NULL || strcmp(h->name, name) != 0)
+            continue;			/* no longer in the inventory */
+        h->refreshed = (time_t) strtoll(stamp, NULL, 10);
+        h->installed = parse_components(rest, NULL, name);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * InventoryLoad -- read the inventory at path, and its cache
+ *
+ * Returns 0, 1 if there is no inventory at path, or -1 if it could not
+ * be read, having said why.
+ */
+int
+InventoryLoad(Inventory *inv, const char *path)
+{
+    char		line[MAX_LINE_LENGTH];
+    int			capacity = 0;
+    int			lineno = 0;
+    FILE	   *fp;
+
+    memset(inv, 0, sizeof(*inv));
+    if (path == NULL)
+        return 1;
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        if (errno == ENOENT)
+            return 1;
+        fprintf(stderr, "could not open inventory \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    inv->path = strdup(path);
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char	   *rest = line;
+        char	   *name;
+        char	   *roles;
+        char	   *field;
+        InventoryHost *h;
+
+        lineno++;
+        rest[strcspn(rest, "#\r\n")] = '\0';
+        while ((name = strsep(&rest, " \t")) != NULL && name[0] == '\0')
+            ;
+        if (name == NULL)
+            continue;			/* blank or a comment */
+        while ((roles = strsep(&rest, " \t")) != NULL && roles[0] == '\0')
+            ;
+
+        if (inv->nhosts == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            inv->hosts = realloc(inv->hosts, capacity * sizeof(InventoryHost));
+            if (inv->hosts == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        h = &inv->hosts[inv->nhosts++];
+        memset(h, 0, sizeof(*h));
+        h->name = strdup(name);
+        h->roles = strdup(roles ? roles : "-");
+        if (roles != NULL)
+            h->role_components = parse_components(roles, "role", h->name);
+
+        while ((field = strsep(&rest, " \t")) != NULL) {
+            if (field[0] == '\0')
+                continue;
+            if (strchr(field, '=') == NULL) {
+                fprintf(stderr, "%s:%d: tag \"%s\" is not key=value\n",
+                        path, lineno, field);
+                continue;
+            }
+            h->tags = realloc(h->tags, (h->ntags + 1) * sizeof(char *));
+            if (h->tags == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            h->tags[h->ntags++] = strdup(field);
+        }
+    }
+    fclose(fp);
+
+    if (load_cache(inv) < 0)
+        fprintf(stderr, "could not read the inventory cache of \"%s\": %s\n",
+                path, strerror(errno));
+    return 0;
+}
+
+/*
+ * InventorySaveCache -- write what the agents said they have installed
+ *
+ * Returns 0, or -1 having said why not.
+ */
+int
+InventorySaveCache(const Inventory *inv)
+{
+    char		path[MAX_PATH_LEN];
+    char		tmp[MAX_PATH_LEN + 8];
+    FILE	   *fp;
+
+    snprintf(path, sizeof(path), "%s.cache", inv->path);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "could not write \"%s\": %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < inv->nhosts; i++) {
+        const InventoryHost *h = &inv->hosts[i];
+        const char *sep = "";
+
+        if (h->refreshed == 0)
+            continue;
+        fprintf(fp, "%s\t%lld\t", h->name, (long long) h->refreshed);
+        for (Component c = FLINK; c <= ZOOKEEPER; c++) {
+            if (h->installed & COMPONENT_BIT(c)) {
+                fprintf(fp, "%s%s", sep, component_to_string(c));
+                sep = ",";
+            }
+        }
+        fputc('\n', fp);
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "could not write \"%s\": %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void
+InventoryTerm(Inventory *inv)
+{
+    for (int i = 0; i < inv->nhosts; i++) {
+        InventoryHost *h = &inv->hosts[i];
+
+        free(h->name);
+        free(h->roles);
+        for (int j = 0; j < h->ntags; j++)
+            free(h->tags[j]);
+        free(h->tags);
+    }
+    free(inv->hosts);
+    free(inv->path);
+    memset(inv, 0, sizeof(*inv));
+}
+
+/*
+ * InventoryHostMatches -- does the host have role (a role or component
+ * name) and tag (key=value)?  NULL matches anything.
+ */
+bool
+InventoryHostMatches(const InventoryHost *h, const char *role, const char *tag)
+{
+    if (role != NULL) {
+        Component	c = role_component(role);
+        bool		found = false;
+        char	   *copy = strdup(h->roles);
+        char	   *rest = copy;
+        char	   *name;
+
+        while ((name = strsep(&rest, ",")) != NULL && !found)
+            found = strcasecmp(name, role) == 0;
+        free(copy);
+        if (!found && (c == NONE || !(h->role_components & COMPONENT_BIT(c))))
+            return false;
+    }
+    if (tag != NULL) {
+        bool		found = false;
+
+        for (int i = 0; i < h->ntags && !found; i++)
+            found = strcmp(h->tags[i], tag) == 0;
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * InventoryHostHas -- should the host get requests for component?
+ *
+ * It should if one of its roles is the component's, or, without roles,
+ * if its agent last said the component is installed.  A host with
+ * neither gets everything, as it did before there was an inventory.
+ */
+bool
+InventoryHostHas(const InventoryHost *h, Component component)
+{
+    if (h == NULL)
+        return true;
+    if (h->role_components != 0)
+        return (h->role_components & COMPONENT_BIT(component)) != 0;
+    if (h->refreshed != 0)
+        return (h->installed & COMPONENT_BIT(component)) != 0;
+    return true;
+}
+
+/*
+ * InventoryParseInstalled -- take the agent's answer to CliMsg_Inventory
+ * as what the host has installed now
+ *
+ * Returns the number of components.
+ */
+int
+InventoryParseInstalled(InventoryHost *h, const char *reply)
+{
+    char	   *copy = strdup(reply ? reply : "");
+    char	   *rest = copy;
+    char	   *name;
+    int			n = 0;
+
+    h->installed = 0;
+    while ((name = strsep(&rest, "\n")) != NULL) {
+        Component	c = string_to_component(trim(name));
+
+        if (c != NONE) {
+            h->installed |= COMPONENT_BIT(c);
+            n++;
+        }
+    }
+    free(copy);
+    h->refreshed = time(NULL);
+    return n;
+}
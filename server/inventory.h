@@ -0,0 +1,75 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * inventory.h
+ *		Which hosts of the cluster run which components.
+ *
+ * The inventory is a text file, $DEBO_INVENTORY or ~/.debo/inventory,
+ * with a line for each host:
+ *
+ *	# host[:port]		roles					tags
+ *	nn1.example.com		namenode,zookeeper		rack=r1
+ *	dn1.example.com		datanode,regionserver	rack=r2 disk=ssd
+ *
+ * Roles are daemons, such as namenode or broker, or component names,
+ * such as hdfs; "-" is none.  Next to it the CLI keeps a cache, the same
+ * path with ".cache" appended, of the components each host's agent last
+ * said are installed (CliMsg_Inventory).  An action then goes only to the
+ * components a host has: those of its roles, or else the installed ones,
+ * or else, for a host the inventory knows nothing about, all of them.
+ *-------------------------------------------------------------------------
+ */
+#ifndef INVENTORY_H
+#define INVENTORY_H
+
+#include <time.h>
+
+#include "utiles.h"
+
+/* the bit of a component in the masks below */
+#define COMPONENT_BIT(c)	(1u << (unsigned int) (c))
+
+typedef struct InventoryHost
+{
+    char	   *name;			/* as in the file, host or host:port */
+    char	   *roles;			/* as in the file */
+    unsigned int role_components;	/* bit per Component of the roles */
+    unsigned int installed;		/* bit per Component, from the cache */
+    time_t		refreshed;		/* of the cache entry, 0 for none */
+    char	  **tags;			/* key=value */
+    int			ntags;
+} InventoryHost;
+
+typedef struct Inventory
+{
+    char	   *path;
+    InventoryHost *hosts;
+    int			nhosts;
+} Inventory;
+
+extern const char *inventory_default_path(void);
+extern int	InventoryLoad(Inventory *inv, const char *path);
+extern int	InventorySaveCache(const Inventory *inv);
+extern void InventoryTerm(Inventory *inv);
+extern InventoryHost *InventoryFind(const Inventory *inv, const char *host);
+extern bool InventoryHostMatches(const InventoryHost *h, const char *role,
+                                 const char *tag);
+extern bool InventoryHostHas(const InventoryHost *h, Component component);
+extern int	InventoryParseInstalled(InventoryHost *h, const char *reply);
+
+#endif							/* INVENTORY_H */
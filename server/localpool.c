@@ -0,0 +1,269 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * localpool.c
+ *		An action on several components of this host at once.
+ *
+ * The parent reads the workers' pipes in one poll loop.  A worker is done
+ * once it has exited, not once its pipe ends: a daemon it started may
+ * hold the pipe open for good, so the loop also looks for exited workers
+ * every REAP_INTERVAL_MS and takes whatever they left in the pipe.
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "localpool.h"
+#include "depgraph.h"
+
+/* how often to look for workers that exited */
+#define REAP_INTERVAL_MS	200
+
+typedef struct LocalWorker
+{
+    Component	comp;
+    int			node;			/* in the dependency graph */
+    pid_t		pid;			/* 0 until started */
+    int			fd;				/* read end of its output, -1 once closed */
+    bool		done;
+    int			status;			/* as from waitpid(), -1 if never started */
+    ExpBufferData output;
+} LocalWorker;
+
+/* Does w have to wait for other? */
+static bool
+waits_for(const LocalPool *pool, const DepGraph *graph, const LocalWorker *w,
+          const LocalWorker *other)
+{
+    if (!pool->ordered || w == other)
+        return false;
+    if (pool->reverse)
+        return (graph->nodes[other->node].needs & (1u << w->node)) != 0;
+    return (graph->nodes[w->node].needs & (1u << other->node)) != 0;
+}
+
+static bool
+worker_ready(const LocalPool *pool, const DepGraph *graph,
+             const LocalWorker *workers, int n, const LocalWorker *w)
+{
+    for (int i = 0; i < n; i++)
+        if (!workers[i].done && waits_for(pool, graph, w, &workers[i]))
+            return false;
+    return true;
+}
+
+static void
+start_worker(const LocalPool *pool, LocalWorker *w)
+{
+    int			fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        appendExpBuffer(&w->output, "could not create a pipe: %s\n", strerror(errno));
+        w->status = -1;
+        w->done = true;
+        return;
+    }
+    /* or the worker prints what is buffered here again */
+    fflush(stdout);
+    fflush(stderr);
+
+    w->pid = fork();
+    if (w->pid < 0) {
+        appendExpBuffer(&w->output, "could not fork: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        w->status = -1;
+        w->done = true;
+        return;
+    }
+    if (w->pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        pool->run(w->comp, pool->arg);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(0);
+    }
+    close(fds[1]);
+    w->fd = fds[0];
+    fcntl(w->fd, F_SETFL, O_NONBLOCK);
+}
+
+/*
+ * Take what there is of w's output, closing the pipe at its end or, with
+ * all set, in any case.
+ */
+static void
+drain(LocalWorker *w, bool all)
+{
+    char		buf[8192];
+    ssize_t		n;
+
+    while (w->fd >= 0) {
+        n = read(w->fd, buf, sizeof(buf));
+        if (n > 0) {
+            appendBinaryExpBuffer(&w->output, buf, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN && !all)
+            return;
+        close(w->fd);
+        w->fd = -1;
+    }
+}
+
+/* Is the worker done?  Waits for it only if its pipe has ended. */
+static void
+reap(LocalWorker *w)
+{
+    int			status;
+    pid_t		pid;
+
+    do
+        pid = waitpid(w->pid, &status, w->fd < 0 ? 0 : WNOHANG);
+    while (pid < 0 && errno == EINTR);
+    if (pid == 0)
+        return;
+    drain(w, true);
+    w->status = pid < 0 ? -1 : status;
+    w->done = true;
+}
+
+static void
+print_worker(LocalWorker *w)
+{
+    const char *name = component_to_string(w->comp);
+
+    fwrite(w->output.data, 1, w->output.len, stdout);
+    fflush(stdout);
+    if (w->status == -1)
+        fprintf(stderr, "%s: the worker did not run\n", name);
+    else if (WIFSIGNALED(w->status))
+        fprintf(stderr, "%s: the worker was killed by signal %d\n", name,
+                WTERMSIG(w->status));
+    else if (WEXITSTATUS(w->status) != 0)
+        fprintf(stderr, "%s: the worker exited with status %d\n", name,
+                WEXITSTATUS(w->status));
+}
+
+/*
+ * LocalPoolRun -- run pool->run on each of comps, in workers
+ *
+ * Returns the number of workers that did not run or did not exit cleanly,
+ * or -1 if that could not be tried at all.
+ */
+int
+LocalPoolRun(const LocalPool *pool, const Component *comps, int ncomps)
+{
+    DepGraph	graph;
+    LocalWorker *workers;
+    struct pollfd *fds;
+    int		   *fd_worker;
+    int			next_print = 0;
+    int			failed = 0;
+
+    if (DepGraphBuild(&graph, comps, ncomps) < 0)
+        return -1;
+    workers = calloc(ncomps > 0 ? ncomps : 1, sizeof(LocalWorker));
+    fds = malloc((ncomps > 0 ? ncomps : 1) * sizeof(struct pollfd));
+    fd_worker = malloc((ncomps > 0 ? ncomps : 1) * sizeof(int));
+    if (workers == NULL || fds == NULL || fd_worker == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ncomps; i++) {
+        LocalWorker *w = &workers[i];
+
+        w->comp = comps[i];
+        for (int j = 0; j < graph.nnodes; j++)
+            if (graph.nodes[j].component == comps[i])
+                w->node = j;
+        w->fd = -1;
+        initExpBuffer(&w->output);
+    }
+
+    while (next_print < ncomps) {
+        int			active = 0;
+        int			nfds = 0;
+
+        for (int i = 0; i < ncomps; i++)
+            if (workers[i].pid > 0 && !workers[i].done)
+                active++;
+        for (int i = 0; i < ncomps &&
+             (pool->parallel <= 0 || active < pool->parallel); i++) {
+            LocalWorker *w = &workers[i];
+
+            if (w->pid != 0 || w->done ||
+                !worker_ready(pool, &graph, workers, ncomps, w))
+                continue;
+            start_worker(pool, w);
+            if (!w->done)
+                active++;
+        }
+
+        for (int i = 0; i < ncomps; i++) {
+            if (workers[i].fd < 0)
+                continue;
+            fds[nfds].fd = workers[i].fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            fd_worker[nfds++] = i;
+        }
+        if (nfds > 0) {
+            if (poll(fds, nfds, REAP_INTERVAL_MS) < 0 && errno != EINTR) {
+                fprintf(stderr, "poll() failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            for (int i = 0; i < nfds; i++)
+                if (fds[i].revents != 0)
+                    drain(&workers[fd_worker[i]], false);
+        } else if (active > 0)
+            usleep(REAP_INTERVAL_MS * 1000);
+
+        for (int i = 0; i < ncomps; i++)
+            if (workers[i].pid > 0 && !workers[i].done)
+                reap(&workers[i]);
+
+        /* in the order given, as soon as those before are printed too */
+        while (next_print < ncomps && workers[next_print].done) {
+            LocalWorker *w = &workers[next_print++];
+
+            print_worker(w);
+            if (w->status != 0)
+                failed++;
+        }
+    }
+
+    for (int i = 0; i < ncomps; i++)
+        termExpBuffer(&workers[i].output);
+    free(workers);
+    free(fds);
+    free(fd_worker);
+    return failed;
+}
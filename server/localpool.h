@@ -0,0 +1,57 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * localpool.h
+ *		An action on several components of this host at once.
+ *
+ * Each component gets a worker process of its own, forked from the CLI,
+ * with its standard output and error going into a pipe.  The code that
+ * acts on a component prints as it goes and keeps its state in statics,
+ * so processes rather than threads keep the components apart.  Whatever
+ * a worker prints is held until it is done and then printed whole, in the
+ * order the components were given, so the output reads as if they had
+ * gone one after another.
+ *
+ * With ordered set a component waits for those in the list it needs,
+ * directly or not; with reverse set too it waits for those that need it
+ * instead, as stopping should.
+ *-------------------------------------------------------------------------
+ */
+#ifndef LOCALPOOL_H
+#define LOCALPOOL_H
+
+#include "utiles.h"
+
+/* Acts on comp; runs in the worker, whose output is collected. */
+typedef void (*LocalPoolFn) (Component comp, void *arg);
+
+typedef struct LocalPool
+{
+    int			parallel;		/* workers at once, 0 for all */
+    bool		ordered;		/* respect the dependencies */
+    bool		reverse;		/* dependents first */
+    LocalPoolFn run;
+    void	   *arg;
+} LocalPool;
+
+/* default for LocalPool.parallel */
+#define LOCALPOOL_DEFAULT_PARALLEL	4
+
+extern int	LocalPoolRun(const LocalPool *pool, const Component *comps, int ncomps);
+
+#endif							/* LOCALPOOL_H */
@@ -31,6 +31,9 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include "metrics.h"
+#include "protocol.h"
+
 
 typedef struct {
     unsigned long long user;
@@ -742,3 +745,278 @@ char *get_network_metrics() {
     }
     return result;
 }
+
+////////////////////////////binary record/////////////////////////
+
+/*
+ * Decoding of the metrics record an agent sends for CliMsg_Metrics_Record;
+ * the layout is in protocol.h.  The record holds raw counters, so what is
+ * shown here is either the counters themselves or shares computed from
+ * them, such as CPU time busy since boot.
+ */
+
+typedef struct {
+    const char *data;
+    int len;
+    int cursor;
+    bool failed;			/* ran past the end */
+} RecordReader;
+
+static uint64_t read_uint(RecordReader *r, int size) {
+    uint64_t v64;
+    uint32_t v32;
+    uint16_t v16;
+
+    if (r->failed || r->cursor + size > r->len) {
+        r->failed = true;
+        return 0;
+    }
+    /* integers are in the byte order of the other messages */
+    switch (size) {
+    case 2:
+        memcpy(&v16, r->data + r->cursor, 2);
+        v64 = v16;
+        break;
+    case 4:
+        memcpy(&v32, r->data + r->cursor, 4);
+        v64 = v32;
+        break;
+    default:
+        memcpy(&v64, r->data + r->cursor, 8);
+        break;
+    }
+    r->cursor += size;
+    return v64;
+}
+
+static void read_short_string(RecordReader *r, char *dst) {
+    int len = (int) (r->cursor < r->len ? (unsigned char) r->data[r->cursor] : 0);
+
+    if (r->failed || r->cursor + 1 + len > r->len) {
+        r->failed = true;
+        dst[0] = '\0';
+        return;
+    }
+    memcpy(dst, r->data + r->cursor + 1, len);
+    dst[len] = '\0';
+    r->cursor += 1 + len;
+}
+
+/*
+ * Read one array of entries, each with nstrings strings (name, then
+ * device) and ncounters int64 counters.  Returns the number read.
+ */
+static int read_entries(RecordReader *r, MetricsEntry **entries,
+                        int nstrings, int ncounters) {
+    int n = (int) read_uint(r, 2);
+
+    *entries = NULL;
+    if (r->failed || n == 0)
+        return 0;
+    *entries = calloc(n, sizeof(MetricsEntry));
+    if (*entries == NULL) {
+        r->failed = true;
+        return 0;
+    }
+    for (int i = 0; i < n && !r->failed; i++) {
+        read_short_string(r, (*entries)[i].name);
+        if (nstrings > 1)
+            read_short_string(r, (*entries)[i].device);
+        for (int j = 0; j < ncounters; j++)
+            (*entries)[i].counters[j] = read_uint(r, 8);
+    }
+    return n;
+}
+
+/*
+ * decode_metrics_record -- parse the body of a RespMsg_Metrics message
+ *
+ * Returns 0 on success, -1 if the record is truncated or of a version
+ * before METRICS_RECORD_VERSION.  Data after the known fields is ignored.
+ */
+int decode_metrics_record(const char *data, int len, MetricsRecord *rec) {
+    RecordReader r = {data, len, 0, false};
+
+    memset(rec, 0, sizeof(*rec));
+    rec->version = (int) read_uint(&r, 2);
+    if (r.failed || rec->version < METRICS_RECORD_VERSION)
+        return -1;
+    (void) read_uint(&r, 2);
+    rec->timestamp_usec = read_uint(&r, 8);
+    rec->clock_ticks = (uint32_t) read_uint(&r, 4);
+    rec->ncpu = (uint32_t) read_uint(&r, 4);
+    for (int i = 0; i < 8; i++)
+        rec->cpu[i] = read_uint(&r, 8);
+    for (int i = 0; i < 3; i++)
+        rec->load[i] = (uint32_t) read_uint(&r, 4);
+    for (int i = 0; i < 8; i++)
+        rec->memory_kib[i] = read_uint(&r, 8);
+    rec->ndisks = read_entries(&r, &rec->disks, 1, 7);
+    rec->nfilesystems = read_entries(&r, &rec->filesystems, 2, 3);
+    rec->ninterfaces = read_entries(&r, &rec->interfaces, 1, 8);
+
+    if (r.failed) {
+        free_metrics_record(rec);
+        return -1;
+    }
+    return 0;
+}
+
+void free_metrics_record(MetricsRecord *rec) {
+    free(rec->disks);
+    free(rec->filesystems);
+    free(rec->interfaces);
+    rec->disks = rec->filesystems = rec->interfaces = NULL;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole > 0 ? (double) part * 100.0 / (double) whole : 0.0;
+}
+
+static void print_metrics_json(const MetricsRecord *rec) {
+    static const char *const cpu_names[] = {
+        "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal"
+    };
+    static const char *const memory_names[] = {
+        "total", "free", "available", "buffers", "cached",
+        "sreclaimable", "swap_total", "swap_free"
+    };
+    static const char *const disk_names[] = {
+        "reads", "read_sectors", "read_ms", "writes", "write_sectors",
+        "write_ms", "io_ms"
+    };
+    static const char *const interface_names[] = {
+        "rx_bytes", "rx_packets", "rx_errors", "rx_dropped",
+        "tx_bytes", "tx_packets", "tx_errors", "tx_dropped"
+    };
+
+    printf("{\"version\": %d, \"timestamp_usec\": %llu, \"clock_ticks\": %u, \"cpus\": %u,\n",
+           rec->version, (unsigned long long) rec->timestamp_usec,
+           rec->clock_ticks, rec->ncpu);
+
+    printf(" \"cpu_ticks\": {");
+    for (int i = 0; i < 8; i++)
+        printf("%s\"%s\": %llu", i ? ", " : "", cpu_names[i], (unsigned long long) rec->cpu[i]);
+    printf("},\n \"load\": [%.2f, %.2f, %.2f],\n",
+           rec->load[0] / 100.0, rec->load[1] / 100.0, rec->load[2] / 100.0);
+
+    printf(" \"memory_kib\": {");
+    for (int i = 0; i < 8; i++)
+        printf("%s\"%s\": %llu", i ? ", " : "", memory_names[i],
+               (unsigned long long) rec->memory_kib[i]);
+    printf("},\n");
+
+    printf(" \"disks\": [");
+    for (int i = 0; i < rec->ndisks; i++) {
+        char *name = escape_json(rec->disks[i].name);
+
+        printf("%s\n  {\"name\": \"%s\"", i ? "," : "", name ? name : "");
+        for (int j = 0; j < 7; j++)
+            printf(", \"%s\": %llu", disk_names[j],
+                   (unsigned long long) rec->disks[i].counters[j]);
+        printf("}");
+        free(name);
+    }
+    printf("],\n");
+
+    printf(" \"filesystems\": [");
+    for (int i = 0; i < rec->nfilesystems; i++) {
+        char *mount = escape_json(rec->filesystems[i].name);
+        char *device = escape_json(rec->filesystems[i].device);
+
+        printf("%s\n  {\"mount\": \"%s\", \"device\": \"%s\", \"total_bytes\": %llu,"
+               " \"free_bytes\": %llu, \"available_bytes\": %llu}",
+               i ? "," : "", mount ? mount : "", device ? device : "",
+               (unsigned long long) rec->filesystems[i].counters[0],
+               (unsigned long long) rec->filesystems[i].counters[1],
+               (unsigned long long) rec->filesystems[i].counters[2]);
+        free(mount);
+        free(device);
+    }
+    printf("],\n");
+
+    printf(" \"interfaces\": [");
+    for (int i = 0; i < rec->ninterfaces; i++) {
+        char *name = escape_json(rec->interfaces[i].name);
+
+        printf("%s\n  {\"name\": \"%s\"", i ? "," : "", name ? name : "");
+        for (int j = 0; j < 8; j++)
+            printf(", \"%s\": %llu", interface_names[j],
+                   (unsigned long long) rec->interfaces[i].counters[j]);
+        printf("}");
+        free(name);
+    }
+    printf("]}\n");
+}
+
+static void print_metrics_human(const MetricsRecord *rec) {
+    uint64_t total = 0;
+    uint64_t idle = rec->cpu[3] + rec->cpu[4];
+    char size[3][64];
+    time_t when = (time_t) (rec->timestamp_usec / 1000000);
+    char stamp[64];
+
+    for (int i = 0; i < 8; i++)
+        total += rec->cpu[i];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&when));
+
+    printf("=== CPU METRICS === (%s)\n", stamp);
+    printf("CPUs: %u  Busy since boot: %.1f%% (iowait %.1f%%)  Load: %.2f %.2f %.2f\n\n",
+           rec->ncpu, percent(total - idle, total), percent(rec->cpu[4], total),
+           rec->load[0] / 100.0, rec->load[1] / 100.0, rec->load[2] / 100.0);
+
+    printf("=== MEMORY METRICS ===\n");
+    format_memory_size(size[0], sizeof(size[0]), rec->memory_kib[0] - rec->memory_kib[2]);
+    format_memory_size(size[1], sizeof(size[1]), rec->memory_kib[2]);
+    format_memory_size(size[2], sizeof(size[2]), rec->memory_kib[6] - rec->memory_kib[7]);
+    printf("Used: %s (%.1f%%), Available: %s, Swap used: %s\n\n",
+           size[0], percent(rec->memory_kib[0] - rec->memory_kib[2], rec->memory_kib[0]),
+           size[1], size[2]);
+
+    printf("=== DISK METRICS ===\n");
+    printf("%-16s %14s %14s %12s %12s %12s\n",
+           "device", "reads", "writes", "read MiB", "written MiB", "busy ms");
+    for (int i = 0; i < rec->ndisks; i++) {
+        const MetricsEntry *d = &rec->disks[i];
+
+        printf("%-16s %14llu %14llu %12llu %12llu %12llu\n", d->name,
+               (unsigned long long) d->counters[0], (unsigned long long) d->counters[3],
+               (unsigned long long) (d->counters[1] / 2048),
+               (unsigned long long) (d->counters[4] / 2048),
+               (unsigned long long) d->counters[6]);
+    }
+    printf("\n%-24s %-20s %10s %10s %10s %5s\n",
+           "mount", "device", "size", "used", "avail", "use%");
+    for (int i = 0; i < rec->nfilesystems; i++) {
+        const MetricsEntry *f = &rec->filesystems[i];
+        uint64_t used = f->counters[0] - f->counters[1];
+
+        format_memory_size(size[0], sizeof(size[0]), f->counters[0] / 1024);
+        format_memory_size(size[1], sizeof(size[1]), used / 1024);
+        format_memory_size(size[2], sizeof(size[2]), f->counters[2] / 1024);
+        printf("%-24s %-20s %10s %10s %10s %4.0f%%\n", f->name, f->device,
+               size[0], size[1], size[2], percent(used, used + f->counters[2]));
+    }
+
+    printf("\n=== NETWORK METRICS ===\n");
+    printf("%-16s %16s %12s %8s %16s %12s %8s\n",
+           "interface", "rx bytes", "rx packets", "rx err", "tx bytes", "tx packets", "tx err");
+    for (int i = 0; i < rec->ninterfaces; i++) {
+        const MetricsEntry *n = &rec->interfaces[i];
+
+        printf("%-16s %16llu %12llu %8llu %16llu %12llu %8llu\n", n->name,
+               (unsigned long long) n->counters[0], (unsigned long long) n->counters[1],
+               (unsigned long long) n->counters[2], (unsigned long long) n->counters[4],
+               (unsigned long long) n->counters[5], (unsigned long long) n->counters[6]);
+    }
+}
+
+/*
+ * print_metrics_record -- show a decoded record as text or as JSON
+ */
+void print_metrics_record(const MetricsRecord *rec, bool json) {
+    if (json)
+        print_metrics_json(rec);
+    else
+        print_metrics_human(rec);
+}
@@ -16,8 +16,39 @@
  * limitations under the License.
  */
 
+#include <stdbool.h>
+#include <stdint.h>
+
 char *get_cpu_usage_extended();
 char *get_memory_usage();
 char* get_disk_metrics();
 char *get_network_metrics();
+
+/* One disk, filesystem or interface of a metrics record */
+typedef struct {
+    char name[256];
+    char device[256];			/* filesystems: the device mounted */
+    uint64_t counters[8];		/* in the order protocol.h lists them */
+} MetricsEntry;
+
+/* A decoded RespMsg_Metrics record, see protocol.h */
+typedef struct {
+    int version;
+    uint64_t timestamp_usec;
+    uint32_t clock_ticks;
+    uint32_t ncpu;
+    uint64_t cpu[8];
+    uint32_t load[3];			/* x 100 */
+    uint64_t memory_kib[8];
+    int ndisks;
+    MetricsEntry *disks;
+    int nfilesystems;
+    MetricsEntry *filesystems;
+    int ninterfaces;
+    MetricsEntry *interfaces;
+} MetricsRecord;
+
+int decode_metrics_record(const char *data, int len, MetricsRecord *rec);
+void free_metrics_record(MetricsRecord *rec);
+void print_metrics_record(const MetricsRecord *rec, bool json);
 #endif
@@ -31,10 +31,18 @@
 #endif
 
 #include "connect.h"
+#include "protocol.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #define db_ntoh16(x) (x)
 #define db_hton32(x) (x)
 #define db_ntoh32(x) (x)
@@ -69,6 +77,8 @@ secure_raw_read(Conn *conn, void *ptr, size_t len)
     SOCK_ERRNO_SET(0);
 
     n = recv(conn->sock, ptr, len, 0);
+    if (n > 0)
+        conn->bytesReceived += n;
 
     if (n < 0)
     {
@@ -703,6 +713,15 @@ PutMsgEnd(Conn *conn)
     {
         uint32		msgLen = conn->outMsgEnd - conn->outMsgStart;
 
+        /* the agent would drop the connection over it; drop the message */
+        if (conn->maxRequest > 0 && msgLen > (uint32) conn->maxRequest)
+        {
+            fprintf(stderr, "request of %u bytes is larger than the agent accepts (%d)\n",
+                    msgLen, conn->maxRequest);
+            conn->outMsgEnd = conn->outCount;
+            return EOF;
+        }
+
         msgLen = db_hton32(msgLen);
         memcpy(conn->outBuffer + conn->outMsgStart, &msgLen, 4);
     }
@@ -732,6 +751,86 @@ PutMsgEnd(Conn *conn)
     return 0;
 }
 
+/*
+ * CompressionAvailable: was this client built with the compression
+ * algorithm (COMPRESS_* in protocol.h)?
+ */
+bool
+CompressionAvailable(int algorithm)
+{
+    switch (algorithm)
+    {
+#ifdef HAVE_LZ4
+        case COMPRESS_LZ4:
+            return true;
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+/*
+ * DecompressMessage: unwrap the body of a RespMsg_Compressed message
+ *
+ * The body is the algorithm byte, the type byte of the wrapped message,
+ * the int32 length of its body and the compressed body.  The wrapped
+ * body is appended to buf and its type stored in *type.
+ *
+ * Returns 0 if OK, EOF if the message is malformed or the algorithm is
+ * not available.
+ */
+int
+DecompressMessage(const char *data, int len, char *type, ExpBuffer buf)
+{
+    int			algorithm;
+    int			rawlen;
+    char	   *dst;
+
+    if (len < 6)
+        return EOF;
+    algorithm = (unsigned char) data[0];
+    *type = data[1];
+    memcpy(&rawlen, data + 2, 4);
+    rawlen = db_ntoh32(rawlen);
+    data += 6;
+    len -= 6;
+
+    if (rawlen < 0 || !enlargeExpBuffer(buf, rawlen))
+        return EOF;
+    dst = buf->data + buf->len;
+
+    switch (algorithm)
+    {
+#ifdef HAVE_LZ4
+        case COMPRESS_LZ4:
+            if (LZ4_decompress_safe(data, dst, len, rawlen) != rawlen)
+                return EOF;
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+            {
+                size_t		n = ZSTD_decompress(dst, rawlen, data, len);
+
+                if (ZSTD_isError(n) || n != (size_t) rawlen)
+                    return EOF;
+            }
+            break;
+#endif
+        default:
+            (void) dst;
+            return EOF;
+    }
+
+    buf->len += rawlen;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
 /* ----------
  * ReadData: read more data, if any is available
  * Possible return values:
@@ -843,9 +942,14 @@ retry3:
          * Since we left-justified the data above, conn->inEnd gives the
          * amount of data already read in the current message.  We consider
          * the message "long" once we have acquired 32k ...
+         *
+         * The socket is in blocking mode, so only go back for more when some
+         * has arrived: the agent may be waiting on us, as it does for the
+         * acknowledgements of a file download.
          */
         if (conn->inEnd > 32768 &&
-            (conn->inBufSize - conn->inEnd) >= 8192)
+            (conn->inBufSize - conn->inEnd) >= 8192 &&
+            ReadReady(conn) > 0)
         {
             someread = 1;
             goto retry3;
@@ -914,10 +1018,16 @@ retry4:
      * means the connection has been closed.  Cope.
      */
 definitelyEOF:
-    fprintf(stderr, "server closed the connection unexpectedly\n"
-                         "\tThis probably means the server terminated abnormally\n"
-                         "\tbefore or while processing the request.");
-                         exit(EXIT_FAILURE);
+    appendExpBuffer(&conn->errorMessage, "server closed the connection unexpectedly\n");
+
+    /*
+     * The caller may have other connections to look after, so this is no
+     * longer fatal; a non-blocking caller reports errorMessage itself.
+     */
+    if (!Isnonblocking(conn))
+        fprintf(stderr, "server closed the connection unexpectedly\n"
+                "\tThis probably means the server terminated abnormally\n"
+                "\tbefore or while processing the request.\n");
 
     /* Come here if lower-level code already set a suitable errorMessage */
 definitelyFailed:
@@ -1175,6 +1285,16 @@ WaitTimed(int forRead, int forWrite, Conn *conn, pg_usec_time_t end_time)
     return 0;
 }
 
+/*
+ * InputPending: has data been received that is not parsed yet?  Waiting
+ * for the socket to turn readable could then wait for nothing.
+ */
+bool
+InputPending(Conn *conn)
+{
+    return conn->inStart < conn->inEnd || pqsecure_gss_read_pending(conn);
+}
+
 /*
  * ReadReady: is select() saying the file is ready to read?
  * Returns -1 on failure, 0 if not ready, 1 if ready.
@@ -1209,8 +1329,8 @@ SocketCheck(Conn *conn, int forRead, int forWrite, pg_usec_time_t end_time)
         return -1;
     if (conn->sock == DBINVALID_SOCKET)
     {
-        fprintf(stderr, "invalid socket");
-        exit(EXIT_FAILURE);
+        appendExpBufferStr(&conn->errorMessage, "invalid socket\n");
+        return -1;
     }
 
 
@@ -197,6 +197,207 @@
 #define CliMsg_Zeppelin_Install 0xAF
 #define CliMsg_Zeppelin_Configure 0xC2
 
+/* Agent Control */
+#define CliMsg_Agent_Stats      0xE1   /* Agent process/pool statistics */
+
+/* Background jobs */
+#define CliMsg_Job_Submit       0xE2   /* Run the enclosed request as a job */
+#define CliMsg_Job_Poll         0xE3   /* Job status, all jobs if no id */
+#define CliMsg_Job_Tail         0xE4   /* Last bytes of a job's log */
+#define CliMsg_Job_Attach       0xE5   /* Stream a job's log until it ends */
+#define CliMsg_Job_Cancel       0xE6   /* Terminate a running job */
+
+/* Agent Upgrade */
+#define CliMsg_Agent_Upgrade    0xE7   /* Hand over to the binary on disk */
+
+/* Pipelined session */
+#define CliMsg_Session          0xE8   /* Tagged request, see agent/session.h */
+
+/* Response compression */
+#define CliMsg_Compress         0xEB   /* Offer algorithms, preferred first */
+
+/* Structured metrics */
+#define CliMsg_Metrics_Record   0xEC   /* Answered with a RespMsg_Metrics */
+
+/* Capability handshake */
+#define CliMsg_Hello            0xED   /* Answered with a RespMsg_Hello */
+
+/* File transfer */
+#define CliMsg_File_Put         0xEE   /* Upload a file, see below */
+#define CliMsg_File_Get         0xEF   /* Download a file, see below */
+#define CliMsg_File_Block       0xF0   /* Block of an upload */
+#define CliMsg_File_Ack         0xF1   /* Progress of a download */
+
+/* Inventory */
+#define CliMsg_Inventory        0xF2   /* Installed components, one a line */
+
+/*
+ * Response messages, agent to client.  Each is the type byte, an int32
+ * length counting itself and the body, then the body.  A response is any
+ * number of output and progress messages followed by one result and the
+ * end marker.
+ */
+#define RespMsg_Output          'O'    /* Chunk of command output */
+#define RespMsg_Progress        'P'    /* int32 percent (-1 unknown), text */
+#define RespMsg_Result          'R'    /* int32 status (RESP_*) */
+#define RespMsg_End             'Z'    /* End of the response */
+#define RespMsg_Compression     'C'    /* byte algorithm, int32 threshold */
+#define RespMsg_Compressed      'X'    /* byte algorithm, byte type,
+                                        * int32 raw length, data */
+#define RespMsg_Metrics         'M'    /* Metrics record, see below */
+#define RespMsg_Hello           'V'    /* Capabilities settled, see below */
+#define RespMsg_File_Start      'F'    /* Transfer set up, see below */
+#define RespMsg_File_Block      'B'    /* Block of a download */
+#define RespMsg_File_Ack        'A'    /* Progress of an upload */
+
+/*
+ * Capability handshake.  A client sends CliMsg_Hello as the first request
+ * on a connection, once GSSAPI (or the Unix socket check) is done:
+ *
+ *	int16 highest protocol version
+ *	int16 largest GSSAPI packet it takes from now on, in KiB, length word
+ *	included; 0 to stay at the 16 KiB every connection starts with
+ *	int32 PROTO_FEATURE_* bits the client understands
+ *	int32 output chunk it would like to receive, in bytes
+ *	compression algorithms it accepts, one byte each, preferred first
+ *
+ * The agent answers with a RespMsg_Hello, then the usual result:
+ *
+ *	int16 protocol version both use
+ *	int16 GSSAPI packet size both send from now on, in KiB; 0 if the
+ *	client offered none
+ *	int32 PROTO_FEATURE_* bits both understand
+ *	int32 largest request message the agent accepts, length word included
+ *	int32 output chunk the agent will send
+ *	byte compression algorithm, int32 threshold, as in RespMsg_Compression
+ *
+ * An agent that predates the handshake answers with output and a result
+ * but no RespMsg_Hello; that is protocol version 0, with no features.  A
+ * client that never sends CliMsg_Hello, or offers version 0, gets what
+ * clients got before response messages existed: each piece of output as
+ * plain text in a write of its own, and no result or end marker.
+ * Requests that only make sense as typed messages are refused until the
+ * handshake is done.
+ */
+#define PROTOCOL_VERSION        1
+
+#define PROTO_FEATURE_COMPRESS  0x0001 /* RespMsg_Compressed */
+#define PROTO_FEATURE_SESSION   0x0002 /* CliMsg_Session */
+#define PROTO_FEATURE_JOBS      0x0004 /* CliMsg_Job_* */
+#define PROTO_FEATURE_METRICS_RECORD 0x0008 /* CliMsg_Metrics_Record */
+#define PROTO_FEATURE_FILE_TRANSFER 0x0010 /* CliMsg_File_Put, _Get */
+
+/*
+ * File transfer.  A file travels in order, in blocks of at most the
+ * agreed block size, each one
+ *
+ *	int64 offset, int32 CRC-32C of the data, data
+ *
+ * The receiver checks each block, appends it to "<destination>.debo-part"
+ * and acknowledges with an int64 offset up to which everything is on
+ * disk, at least every half window; the sender keeps no more than window
+ * blocks' worth of data unacknowledged.  The part file carries the mtime
+ * of the source whenever it is left behind, so a later transfer of the
+ * same file resumes from it; once complete, it is renamed over the
+ * destination.  The mtime alone does not prove that the part holds what
+ * the source does, so the CRC-32C of the part is checked against that of
+ * as much of the source before resuming.
+ *
+ * Either side stops a transfer by sending offset -1 in place of a block
+ * or an acknowledgement, with no data.  The other side answers the same
+ * way, and each discards blocks and acknowledgements until it has the
+ * other's -1.  The agent's result then says why.
+ *
+ * Upload: CliMsg_File_Put
+ *	string destination, int64 size, int64 mtime (ns since the epoch),
+ *	int32 mode, int32 block size and int32 window wanted (0: default)
+ * answered with RespMsg_File_Start
+ *	int64 offset to start at, int32 block size, int32 window,
+ *	int32 CRC-32C of the part up to offset
+ * then CliMsg_File_Block one way and RespMsg_File_Ack the other, and the
+ * result once the file is in place.  A client whose file does not match
+ * the part sends its first block at offset 0 instead, and the agent
+ * starts the part over.  A part as long as the file is never resumed.
+ *
+ * Download: CliMsg_File_Get
+ *	string source, int64 length, int64 mtime and int32 CRC-32C of the
+ *	part the client has (all 0 for none), int32 block size and int32
+ *	window wanted
+ * answered with RespMsg_File_Start
+ *	int64 offset to start at, int32 block size, int32 window,
+ *	int64 size, int64 mtime, int32 mode
+ * then RespMsg_File_Block one way and CliMsg_File_Ack the other, the
+ * last one for the whole file, and the result.
+ *
+ * A request the agent refuses is answered with the result alone.
+ */
+#define FILE_BLOCK_HEADER       12
+#define FILE_OFFSET_STOP        (-1)
+
+/*
+ * Compression algorithms.  After the agent has picked anything but
+ * COMPRESS_NONE, in answer to CliMsg_Compress or CliMsg_Hello, any message
+ * of the connection may come wrapped in a RespMsg_Compressed message,
+ * whose data decompresses to the body of a message of the inner type.
+ */
+#define COMPRESS_NONE           0
+#define COMPRESS_LZ4            1
+#define COMPRESS_ZSTD           2
+
+/*
+ * Metrics record, the body of a RespMsg_Metrics message.  Counters are
+ * cumulative, as the kernel keeps them; rates are up to the reader, from
+ * two records and their timestamps.  Integers are in the byte order of
+ * the other messages, strings are a byte length followed by the bytes.
+ *
+ *	int16 version, int16 reserved (0)
+ *	int64 sample time, microseconds since the epoch
+ *	int32 clock ticks per second, int32 online CPUs
+ *	int64 x 8	CPU ticks: user, nice, system, idle, iowait, irq, softirq, steal
+ *	int32 x 3	load averages x 100
+ *	int64 x 8	memory KiB: total, free, available, buffers, cached,
+ *				reclaimable slab, swap total, swap free
+ *	int16 n, then n disks: string name, int64 x 7 reads, sectors read,
+ *				ms reading, writes, sectors written, ms writing, ms doing I/O
+ *	int16 n, then n filesystems: string mount point, string device,
+ *				int64 x 3 bytes total, free, available to users
+ *	int16 n, then n interfaces: string name, int64 x 8 received bytes,
+ *				packets, errors, drops, sent bytes, packets, errors, drops
+ *
+ * Later versions only add to the end of the record, so a reader accepts
+ * any version from the one it was written for on.
+ */
+#define METRICS_RECORD_VERSION  1
+
+/*
+ * Transport protection.  A listener of the agent, and a client, are set
+ * up for one of these; the GSSAPI handshake authenticates both ends
+ * whichever it is.  TRANSPORT_INTEGRITY wraps packets without
+ * confidentiality (conf_req_flag 0); TRANSPORT_PLAIN sends them in the
+ * same length-prefixed packets, unwrapped, as a Unix socket session.
+ *
+ * With anything but TRANSPORT_ENCRYPT the client sends one packet right
+ * after the handshake, wrapped with confidentiality:
+ *
+ *	"DTRN", byte TRANSPORT_* it wants
+ *
+ * and a listener that does not encrypt answers the same way with its own
+ * transport, then closes the connection unless the two agree.  An
+ * encrypting listener takes no such packet.
+ */
+#define TRANSPORT_ENCRYPT       0
+#define TRANSPORT_INTEGRITY     1
+#define TRANSPORT_PLAIN         2
+#define TRANSPORT_MAGIC         "DTRN"
+#define TRANSPORT_MESSAGE_LEN   5
+
+/* Result status codes */
+#define RESP_OK                 0
+#define RESP_ERROR              1      /* The request failed */
+#define RESP_NOT_INSTALLED      2      /* Component is not installed */
+#define RESP_ALREADY_INSTALLED  3      /* Component is already installed */
+#define RESP_UNSUPPORTED        4      /* Request or parameter not supported */
+
 /* Shared Parameters */
 #define CliMsg_Value            0xFF   /* Changed from '~' */
 
@@ -0,0 +1,384 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * rolling.c
+ *		An action over a cluster a batch of hosts at a time.
+ *
+ * Both the action and the health checks of a batch go out as fan-outs,
+ * so a batch takes as long as its slowest host.  The health check is
+ * repeated for the hosts that are not healthy yet, until they all are
+ * or the health timeout passes.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "rolling.h"
+
+/* how long a health port gets to accept a connection */
+#define PORT_PROBE_TIMEOUT_MS	2000
+
+typedef enum RollingResult
+{
+    ROLLING_SKIPPED,			/* never reached */
+    ROLLING_OK,
+    ROLLING_FAILED,				/* the action failed */
+    ROLLING_UNHEALTHY			/* did not turn healthy in time */
+} RollingResult;
+
+typedef struct RollingHost
+{
+    RollingResult result;
+    int			batch;
+    double		action_ms;
+    double		health_ms;
+    char		detail[256];
+} RollingHost;
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+        (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static const char *
+result_name(RollingResult result)
+{
+    switch (result) {
+    case ROLLING_SKIPPED:
+        return "skipped";
+    case ROLLING_OK:
+        return "ok";
+    case ROLLING_FAILED:
+        return "failed";
+    case ROLLING_UNHEALTHY:
+        return "unhealthy";
+    }
+    return "unknown";
+}
+
+/*
+ * Does host accept a TCP connection on port within the probe timeout?
+ */
+static bool
+probe_port(const char *host, int port)
+{
+    struct addrinfo hint;
+    struct addrinfo *addrs;
+    char		portstr[16];
+    bool		open = false;
+
+    memset(&hint, 0, sizeof(hint));
+    hint.ai_socktype = SOCK_STREAM;
+    hint.ai_family = AF_UNSPEC;
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    if (getaddrinfo(host, portstr, &hint, &addrs) != 0)
+        return false;
+
+    for (struct addrinfo *ai = addrs; ai != NULL && !open; ai = ai->ai_next) {
+        struct pollfd pfd;
+        int			sock = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int			err = 0;
+        socklen_t	errlen = sizeof(err);
+
+        if (sock < 0)
+            continue;
+        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+            open = true;
+        else if (errno == EINPROGRESS) {
+            pfd.fd = sock;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, PORT_PROBE_TIMEOUT_MS) == 1 &&
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 &&
+                err == 0)
+                open = true;
+        }
+        close(sock);
+    }
+    freeaddrinfo(addrs);
+    return open;
+}
+
+/*
+ * Run the action on hosts[first .. first + n - 1].  Marks the hosts it
+ * failed on and returns how many those are.
+ */
+static int
+run_action(const RollingPlan *plan, const char *const *hosts, int first,
+           int n, const char *port, RollingHost *state)
+{
+    Fanout		fan;
+    int			failed = 0;
+
+    if (FanoutInit(&fan, hosts + first, n, port) < 0)
+        exit(EXIT_FAILURE);
+    fan.parallel = 0;
+    fan.timeout_ms = plan->timeout_ms;
+    fan.queue = plan->action;
+    fan.done = plan->done;
+    fan.arg = plan->arg;
+    if (FanoutRun(&fan) < 0)
+        exit(EXIT_FAILURE);
+
+    for (int i = 0; i < n; i++) {
+        FanoutHost *h = &fan.hosts[i];
+        RollingHost *s = &state[first + i];
+
+        s->action_ms = h->elapsed_ms;
+        if (h->state != FANOUT_DONE) {
+            s->result = ROLLING_FAILED;
+            snprintf(s->detail, sizeof(s->detail), "%s: %s",
+                     FanoutStateName(h->state), h->error);
+        } else if (h->status != 0) {
+            s->result = ROLLING_FAILED;
+            snprintf(s->detail, sizeof(s->detail),
+                     "request failed (status %d)", h->status);
+        } else
+            continue;
+        failed++;
+    }
+    FanoutTerm(&fan);
+    return failed;
+}
+
+/*
+ * Wait for the hosts of the batch that took the action to turn healthy.
+ * Marks the ones that do not and returns how many those are.
+ */
+static int
+wait_healthy(const RollingPlan *plan, const char *const *hosts, int first,
+             int n, const char *port, RollingHost *state)
+{
+    const char **waiting = malloc(n * sizeof(char *));
+    int		   *index = malloc(n * sizeof(int));
+    struct timespec start;
+    int			nwaiting = 0;
+
+    if (waiting == NULL || index == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = first; i < first + n; i++) {
+        if (state[i].result == ROLLING_FAILED)
+            continue;
+        index[nwaiting] = i;
+        waiting[nwaiting++] = hosts[i];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (nwaiting > 0) {
+        Fanout		fan;
+        int			still = 0;
+
+        if (FanoutInit(&fan, waiting, nwaiting, port) < 0)
+            exit(EXIT_FAILURE);
+        fan.parallel = 0;
+        fan.timeout_ms = plan->health_timeout_ms;
+        fan.queue = plan->health;
+        fan.arg = plan->arg;
+        if (FanoutRun(&fan) < 0)
+            exit(EXIT_FAILURE);
+
+        for (int i = 0; i < nwaiting; i++) {
+            FanoutHost *h = &fan.hosts[i];
+            RollingHost *s = &state[index[i]];
+            bool		healthy = false;
+
+            if (h->state != FANOUT_DONE)
+                snprintf(s->detail, sizeof(s->detail), "health check %s: %s",
+                         FanoutStateName(h->state), h->error);
+            else if (h->status != 0)
+                snprintf(s->detail, sizeof(s->detail),
+                         "health check failed (status %d)", h->status);
+            else if (plan->health_expect &&
+                     (h->output->data == NULL ||
+                      strstr(h->output->data, plan->health_expect) == NULL))
+                snprintf(s->detail, sizeof(s->detail),
+                         "report does not say \"%s\"", plan->health_expect);
+            else if (plan->health_port > 0 &&
+                     !probe_port(h->host, plan->health_port))
+                snprintf(s->detail, sizeof(s->detail),
+                         "port %d does not accept connections", plan->health_port);
+            else
+                healthy = true;
+
+            if (healthy) {
+                s->result = ROLLING_OK;
+                s->detail[0] = '\0';
+                s->health_ms = elapsed_ms(&start);
+            } else {
+                index[still] = index[i];
+                waiting[still++] = waiting[i];
+            }
+        }
+        FanoutTerm(&fan);
+        nwaiting = still;
+
+        if (nwaiting == 0 ||
+            elapsed_ms(&start) + plan->health_interval_ms > plan->health_timeout_ms)
+            break;
+        usleep(plan->health_interval_ms * 1000);
+    }
+
+    for (int i = 0; i < nwaiting; i++) {
+        state[index[i]].result = ROLLING_UNHEALTHY;
+        state[index[i]].health_ms = elapsed_ms(&start);
+    }
+    free(waiting);
+    free(index);
+    return nwaiting;
+}
+
+/*
+ * Ask on the terminal whether to go on.  No terminal means no.
+ */
+static bool
+confirm_continue(int failed)
+{
+    char		answer[16];
+    FILE	   *tty = fopen("/dev/tty", "r+");
+    bool		yes;
+
+    if (tty == NULL)
+        return false;
+    fprintf(tty, "%d host(s) failed. Continue the rollout? [y/N] ", failed);
+    fflush(tty);
+    yes = fgets(answer, sizeof(answer), tty) != NULL &&
+        (answer[0] == 'y' || answer[0] == 'Y');
+    fclose(tty);
+    return yes;
+}
+
+static void
+print_summary(const char *const *hosts, int nhosts, const RollingHost *state,
+              double total_ms)
+{
+    int			counts[ROLLING_UNHEALTHY + 1] = {0};
+
+    printf("\n%-32s %5s %-10s %10s %10s  %s\n", "HOST", "BATCH", "RESULT",
+           "ACTION", "HEALTHY", "DETAIL");
+    for (int i = 0; i < nhosts; i++) {
+        const RollingHost *s = &state[i];
+
+        counts[s->result]++;
+        if (s->result == ROLLING_SKIPPED) {
+            printf("%-32s %5s %-10s\n", hosts[i], "-", result_name(s->result));
+            continue;
+        }
+        printf("%-32s %5d %-10s %8.0fms", hosts[i], s->batch,
+               result_name(s->result), s->action_ms);
+        if (s->result == ROLLING_FAILED)
+            printf(" %10s", "-");
+        else
+            printf(" %8.0fms", s->health_ms);
+        printf("  %s\n", s->detail);
+    }
+    printf("%d ok, %d failed, %d unhealthy, %d skipped in %.1f s\n",
+           counts[ROLLING_OK], counts[ROLLING_FAILED],
+           counts[ROLLING_UNHEALTHY], counts[ROLLING_SKIPPED],
+           total_ms / 1000.0);
+}
+
+/*
+ * RollingRun -- carry out plan over hosts, a batch at a time
+ *
+ * A host may be given as host:port; the others use port.  Prints the
+ * progress of each batch and a summary at the end.  Returns the number
+ * of hosts that did not end up healthy, the ones never reached included.
+ */
+int
+RollingRun(const RollingPlan *plan, const char *const *hosts, int nhosts,
+           const char *port)
+{
+    RollingHost *state = calloc(nhosts > 0 ? nhosts : 1, sizeof(RollingHost));
+    struct timespec start;
+    int			max_failures = plan->max_failures;
+    int			failed = 0;
+    int			next = 0;
+    int			nbatch = 0;
+    int			remaining;
+
+    if (state == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (next < nhosts) {
+        struct timespec batch_start;
+        int			room = plan->max_unavailable - failed;
+        int			n = plan->batch;
+        int			batch_failed;
+
+        if (room <= 0) {
+            printf("stopping: %d host(s) are down, at most %d may be\n",
+                   failed, plan->max_unavailable);
+            break;
+        }
+        if (n > room)
+            n = room;
+        if (n > nhosts - next)
+            n = nhosts - next;
+
+        nbatch++;
+        printf("batch %d: %d host(s), %s%s\n", nbatch, n, hosts[next],
+               n > 1 ? " ..." : "");
+        fflush(stdout);
+        clock_gettime(CLOCK_MONOTONIC, &batch_start);
+        for (int i = next; i < next + n; i++)
+            state[i].batch = nbatch;
+
+        batch_failed = run_action(plan, hosts, next, n, port, state);
+        batch_failed += wait_healthy(plan, hosts, next, n, port, state);
+        failed += batch_failed;
+        next += n;
+
+        printf("batch %d: %d of %d host(s) healthy in %.1f s\n", nbatch,
+               n - batch_failed, n, elapsed_ms(&batch_start) / 1000.0);
+        fflush(stdout);
+
+        if (failed > max_failures && next < nhosts) {
+            if (!plan->pause_on_failure || !confirm_continue(failed)) {
+                printf("stopping: %d host(s) failed, at most %d may\n",
+                       failed, max_failures);
+                break;
+            }
+            /* the operator accepted these, so only new failures stop us */
+            max_failures = failed;
+        }
+    }
+
+    print_summary(hosts, nhosts, state, elapsed_ms(&start));
+    remaining = 0;
+    for (int i = 0; i < nhosts; i++)
+        if (state[i].result != ROLLING_OK)
+            remaining++;
+    free(state);
+    return remaining;
+}
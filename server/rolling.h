@@ -0,0 +1,67 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * rolling.h
+ *		An action over a cluster a batch of hosts at a time.
+ *
+ * Each batch gets the action at once, through a fan-out, and then has to
+ * turn healthy again before the next batch starts.  A host that fails
+ * the action or does not turn healthy stays counted as unavailable, so
+ * batches shrink to keep at most max_unavailable hosts down at any time.
+ * Once more than max_failures hosts have failed the rollout stops, or
+ * asks whether to go on.
+ *-------------------------------------------------------------------------
+ */
+#ifndef ROLLING_H
+#define ROLLING_H
+
+#include "fanout.h"
+
+typedef struct RollingPlan
+{
+    int			batch;			/* hosts per batch */
+    int			max_unavailable;	/* hosts down at once, failed ones
+                                     * included */
+    int			max_failures;	/* failed hosts tolerated */
+    bool		pause_on_failure;	/* ask instead of stopping */
+    int			timeout_ms;		/* per host for the action, 0 for none */
+
+    /*
+     * A host is healthy when the health requests succeed, their output
+     * contains health_expect if that is set, and health_port, if not 0,
+     * accepts connections.  Checked every health_interval_ms until
+     * health_timeout_ms after the action.
+     */
+    const char *health_expect;
+    int			health_port;
+    int			health_timeout_ms;
+    int			health_interval_ms;
+
+    FanoutQueueFn action;		/* queues the action */
+    FanoutQueueFn health;		/* queues the health check */
+    FanoutDoneFn done;			/* sees each host's action output */
+    void	   *arg;			/* passed to the three of them */
+} RollingPlan;
+
+#define ROLLING_DEFAULT_HEALTH_TIMEOUT	(120 * 1000)
+#define ROLLING_DEFAULT_HEALTH_INTERVAL	(2 * 1000)
+
+extern int	RollingRun(const RollingPlan *plan, const char *const *hosts,
+                       int nhosts, const char *port);
+
+#endif							/* ROLLING_H */
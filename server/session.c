@@ -0,0 +1,232 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * session.c
+ *		Several requests in flight over one connection.
+ *
+ * Tags are indexes into the reply array, handed out in the order the
+ * requests are sent.  Requests are only queued in the output buffer when
+ * they are submitted; the buffer goes out before the mux waits for an
+ * answer, so requests submitted together travel together.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "session.h"
+#include "protocol.h"
+
+#define ntoh32(x) (x)
+
+void
+SessionMuxInit(SessionMux *mux, Conn *conn)
+{
+    memset(mux, 0, sizeof(*mux));
+    mux->conn = conn;
+}
+
+/*
+ * Make room for one more reply.  Returns its tag, or -1 if out of memory.
+ */
+static int
+new_reply(SessionMux *mux)
+{
+    SessionReply *reply;
+
+    if (mux->nreplies == mux->capacity) {
+        int			capacity = mux->capacity ? mux->capacity * 2 : 16;
+        SessionReply *replies = realloc(mux->replies, capacity * sizeof(SessionReply));
+
+        if (replies == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return -1;
+        }
+        mux->replies = replies;
+        mux->capacity = capacity;
+    }
+    reply = &mux->replies[mux->nreplies];
+    memset(reply, 0, sizeof(*reply));
+    reply->output = createExpBuffer();
+    mux->pending++;
+    return mux->nreplies++;
+}
+
+/*
+ * SessionMuxSubmit -- queue the request code with its parameters body
+ *
+ * Returns the request's tag, or -1 on failure.
+ */
+int
+SessionMuxSubmit(SessionMux *mux, unsigned char code, const char *body, int len)
+{
+    int			tag = new_reply(mux);
+
+    if (tag < 0)
+        return -1;
+    if (PutMsgStart(CliMsg_Session, mux->conn) < 0 ||
+        PutInt(tag, 4, mux->conn) < 0 ||
+        Putnchar((const char *) &code, 1, mux->conn) < 0 ||
+        (len > 0 && Putnchar(body, len, mux->conn) < 0) ||
+        PutMsgEnd(mux->conn) < 0) {
+        fprintf(stderr, "Failed to queue session request\n");
+        return -1;
+    }
+    return tag;
+}
+
+/*
+ * SessionMuxSubmitAction -- queue a component action, as the agent would
+ * get it outside a session
+ *
+ * Returns the request's tag, or -1 on failure.
+ */
+int
+SessionMuxSubmitAction(SessionMux *mux, Component component, Action action,
+                       const char *version, const char *param_name,
+                       const char *param_value)
+{
+    int			tag = new_reply(mux);
+
+    if (tag < 0)
+        return -1;
+    if (SendComponentSessionRequest(tag, component, action, version,
+                                    param_name, param_value, mux->conn) < 0)
+        return -1;
+    return tag;
+}
+
+/*
+ * SessionMuxReadFrame -- read one frame and file it under its request
+ *
+ * For callers that wait for the connection themselves, along with other
+ * things.  Returns the tag of the request it finished, -1 if it finished
+ * none, or -2 if the connection failed.
+ */
+int
+SessionMuxReadFrame(SessionMux *mux)
+{
+    ExpBufferData data;
+    SessionReply *reply;
+    char		type;
+    int			tag;
+    int			status;
+
+    initExpBuffer(&data);
+    if (ReadSessionFrame(mux->conn, &type, &tag, &data) < 0) {
+        termExpBuffer(&data);
+        fprintf(stderr, "Failed to read from socket\n");
+        return -2;
+    }
+
+    /* frames for no request we sent, such as a refused malformed one */
+    if (tag < 0 || tag >= mux->nreplies || mux->replies[tag].done) {
+        termExpBuffer(&data);
+        return -1;
+    }
+
+    reply = &mux->replies[tag];
+    if (type == SessionMsg_Output)
+        appendBinaryExpBuffer(reply->output, data.data, data.len);
+    else if (type == SessionMsg_Done && data.len >= 4) {
+        memcpy(&status, data.data, 4);
+        reply->status = ntoh32(status);
+        reply->done = true;
+        mux->pending--;
+    }
+    termExpBuffer(&data);
+    return reply->done ? tag : -1;
+}
+
+/*
+ * SessionMuxNextDone -- wait for the next request to finish
+ *
+ * Sends whatever has been submitted, then reads until a request that has
+ * not been handed out yet is done, holding on to the output of the others
+ * in the meantime.  Returns its tag, or -1 if nothing is pending or the
+ * connection failed.
+ */
+int
+SessionMuxNextDone(SessionMux *mux)
+{
+    int			tag;
+
+    for (tag = 0; tag < mux->nreplies; tag++) {
+        if (mux->replies[tag].done && !mux->replies[tag].collected) {
+            mux->replies[tag].collected = true;
+            return tag;
+        }
+    }
+    if (mux->pending == 0 || Flush(mux->conn) < 0)
+        return -1;
+
+    do
+        tag = SessionMuxReadFrame(mux);
+    while (tag == -1);
+    if (tag < 0)
+        return -1;
+    mux->replies[tag].collected = true;
+    return tag;
+}
+
+/*
+ * SessionMuxWait -- wait for the request with the given tag to finish
+ *
+ * Other requests keep collecting output meanwhile; those that finish stay
+ * for SessionMuxNextDone().  Returns the reply, or NULL if the tag is
+ * unknown or the connection failed.
+ */
+SessionReply *
+SessionMuxWait(SessionMux *mux, int tag)
+{
+    if (tag < 0 || tag >= mux->nreplies)
+        return NULL;
+    if (!mux->replies[tag].done && Flush(mux->conn) < 0)
+        return NULL;
+    while (!mux->replies[tag].done) {
+        if (SessionMuxReadFrame(mux) == -2)
+            return NULL;
+    }
+    mux->replies[tag].collected = true;
+    return &mux->replies[tag];
+}
+
+/*
+ * SessionMuxFinish -- tell the agent no more requests are coming
+ *
+ * The requests already sent are still answered.
+ */
+void
+SessionMuxFinish(SessionMux *mux)
+{
+    if (PutMsgStart(CliMsg_Finish, mux->conn) >= 0)
+        PutMsgEnd(mux->conn);
+    (void) Flush(mux->conn);
+}
+
+void
+SessionMuxTerm(SessionMux *mux)
+{
+    int			tag;
+
+    for (tag = 0; tag < mux->nreplies; tag++)
+        destroyExpBuffer(mux->replies[tag].output);
+    free(mux->replies);
+    memset(mux, 0, sizeof(*mux));
+}
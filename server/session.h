@@ -0,0 +1,68 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * session.h
+ *		Several requests in flight over one connection.
+ *
+ * A SessionMux opens a pipelined session (see agent/session.h) and gives
+ * every request it sends a tag of its own.  The agent interleaves the
+ * output of the requests it runs concurrently; the mux sorts the frames
+ * into a reply per tag, so the caller can wait for any one request, or
+ * for whichever finishes next, and send more in the meantime.
+ *-------------------------------------------------------------------------
+ */
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "utiles.h"
+
+/* session frame types, as the agent sends them */
+#define SessionMsg_Output		'O'
+#define SessionMsg_Done			'D'
+
+typedef struct SessionReply
+{
+    ExpBuffer	output;			/* everything the request printed so far */
+    bool		done;
+    bool		collected;		/* handed out by SessionMuxNextDone() */
+    int			status;			/* RESP_*, -1 if refused; once done */
+} SessionReply;
+
+typedef struct SessionMux
+{
+    Conn	   *conn;
+    SessionReply *replies;		/* indexed by tag */
+    int			nreplies;
+    int			capacity;
+    int			pending;		/* sent and not done yet */
+} SessionMux;
+
+extern void SessionMuxInit(SessionMux *mux, Conn *conn);
+extern int	SessionMuxSubmit(SessionMux *mux, unsigned char code,
+                             const char *body, int len);
+extern int	SessionMuxSubmitAction(SessionMux *mux, Component component,
+                                   Action action, const char *version,
+                                   const char *param_name,
+                                   const char *param_value);
+extern int	SessionMuxReadFrame(SessionMux *mux);
+extern int	SessionMuxNextDone(SessionMux *mux);
+extern SessionReply *SessionMuxWait(SessionMux *mux, int tag);
+extern void SessionMuxFinish(SessionMux *mux);
+extern void SessionMuxTerm(SessionMux *mux);
+
+#endif							/* SESSION_H */
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * test_crc32c.c
+ *		Unit tests of CRC-32C, no agent needed.
+ *
+ * crc32c() is the one linked in, built with SSE 4.2 where the Makefile
+ * can; the table method is included here under other names, so the two
+ * are checked against known values and against each other.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "crc32c.h"
+
+#undef __SSE4_2__
+#define crc32c table_crc32c
+#define crc32c_extend table_crc32c_extend
+#define crc32c_file table_crc32c_file
+#include "crc32c.c"
+#undef crc32c
+#undef crc32c_extend
+#undef crc32c_file
+
+static int	failures;
+
+static void
+check(bool ok, const char *name)
+{
+    printf("%s: %s\n", name, ok ? "PASSED" : "FAILED");
+    if (!ok)
+        failures++;
+}
+
+typedef struct KnownCase
+{
+    const char *name;
+    unsigned char data[48];
+    size_t		len;
+    uint32_t	crc;
+} KnownCase;
+
+/* from RFC 3720, B.4, and the usual check value */
+static const KnownCase known_cases[] = {
+    {"empty", {0}, 0, 0x00000000},
+    {"check value", "123456789", 9, 0xE3069283},
+    {"32 zeros", {0}, 32, 0x8A9136AA},
+    {"32 ones",
+     {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}, 32, 0x62A8AB43},
+    {"32 incrementing",
+     {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31},
+     32, 0x46DD794E},
+};
+
+static void
+test_known(void)
+{
+    for (size_t c = 0; c < sizeof(known_cases) / sizeof(known_cases[0]); c++) {
+        const KnownCase *tc = &known_cases[c];
+
+        check(crc32c(tc->data, tc->len) == tc->crc &&
+              table_crc32c(tc->data, tc->len) == tc->crc, tc->name);
+    }
+}
+
+/*
+ * Every length up to a few words past the 8-byte steps, at every
+ * alignment, and in two pieces through crc32c_extend().
+ */
+static void
+test_against_table(void)
+{
+    unsigned char buf[512 + 8];
+    bool		ok = true;
+    bool		ok_extend = true;
+
+    srand(1221);
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = rand() & 0xFF;
+    for (int align = 0; align < 8; align++) {
+        for (size_t len = 0; len <= 512; len++) {
+            const unsigned char *p = buf + align;
+            uint32_t	crc = table_crc32c(p, len);
+            size_t		split = len / 3;
+
+            ok &= crc32c(p, len) == crc;
+            ok_extend &= crc32c_extend(crc32c(p, split), p + split, len - split) == crc &&
+                table_crc32c_extend(table_crc32c(p, split), p + split, len - split) == crc;
+        }
+    }
+    check(ok, "linked method against table");
+    check(ok_extend, "extend in two pieces");
+}
+
+static void
+test_file(void)
+{
+    char		path[] = "/tmp/test_crc32cXXXXXX";
+    unsigned char buf[200000];
+    uint32_t	crc;
+    int			fd;
+
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (i * 7 + 3) & 0xFF;
+    fd = mkstemp(path);
+    if (fd < 0 || write(fd, buf, sizeof(buf)) != (ssize_t) sizeof(buf)) {
+        check(false, "file prefix");
+        return;
+    }
+    unlink(path);
+
+    check(crc32c_file(fd, 0, &crc) == 0 && crc == 0, "file prefix of nothing");
+    check(crc32c_file(fd, 100000, &crc) == 0 && crc == crc32c(buf, 100000),
+          "file prefix");
+    check(crc32c_file(fd, sizeof(buf), &crc) == 0 && crc == crc32c(buf, sizeof(buf)),
+          "whole file");
+    check(crc32c_file(fd, sizeof(buf) + 1, &crc) < 0, "file shorter than asked");
+    close(fd);
+}
+
+int
+main(void)
+{
+    test_known();
+    test_against_table();
+    test_file();
+
+    if (failures > 0) {
+        printf("%d crc32c tests FAILED\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All crc32c tests PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * test_depgraph.c
+ *		Unit tests of the dependency graph, no agent needed.
+ *
+ * depgraph.c is included rather than linked so that visit() and
+ * blocker() can be reached, with get_dependencies() swapped for a table
+ * each case fills in.
+ *-------------------------------------------------------------------------
+ */
+
+#define get_dependencies test_dependencies
+#include "depgraph.c"
+#undef get_dependencies
+
+/* the edges of the graph under test: component, then what it needs */
+#define MAX_EDGES	8
+
+typedef struct Edges
+{
+    Component	from;
+    Component	to[4];
+    int			nto;
+} Edges;
+
+static Edges edges[MAX_EDGES];
+static int	nedges;
+
+Component *
+test_dependencies(Component comp, int *count)
+{
+    for (int i = 0; i < nedges; i++) {
+        if (edges[i].from == comp) {
+            *count = edges[i].nto;
+            return edges[i].to;
+        }
+    }
+    *count = 0;
+    return NULL;
+}
+
+static int	failures;
+
+static void
+check(bool ok, const char *name)
+{
+    printf("%s: %s\n", name, ok ? "PASSED" : "FAILED");
+    if (!ok)
+        failures++;
+}
+
+typedef struct BuildCase
+{
+    const char *name;
+    Edges		edges[MAX_EDGES];
+    int			nedges;
+    Component	roots[4];
+    int			nroots;
+    int			nnodes;			/* what DepGraphBuild() returns */
+    Component	order[8];		/* the nodes, dependencies first */
+    int			ndeps[8];		/* direct dependencies of each */
+} BuildCase;
+
+static const BuildCase build_cases[] = {
+    {
+        "chain",
+        {{HBASE, {HDFS}, 1}, {HDFS, {ZOOKEEPER}, 1}}, 2,
+        {HBASE}, 1,
+        3, {ZOOKEEPER, HDFS, HBASE}, {0, 1, 1}
+    },
+    {
+        "diamond shares the common dependency",
+        {{ATLAS, {HBASE, KAFKA}, 2}, {HBASE, {ZOOKEEPER}, 1},
+         {KAFKA, {ZOOKEEPER}, 1}}, 3,
+        {ATLAS}, 1,
+        4, {ZOOKEEPER, HBASE, KAFKA, ATLAS}, {0, 1, 1, 2}
+    },
+    {
+        "repeated dependency counted once",
+        {{SPARK, {HDFS, HDFS}, 2}}, 1,
+        {SPARK}, 1,
+        2, {HDFS, SPARK}, {0, 1}
+    },
+    {
+        "roots that need each other",
+        {{LIVY, {SPARK}, 1}, {SPARK, {HDFS}, 1}}, 2,
+        {SPARK, LIVY, HDFS}, 3,
+        3, {HDFS, SPARK, LIVY}, {0, 1, 1}
+    },
+    {
+        "cycle",
+        {{HIVE, {TEZ}, 1}, {TEZ, {HDFS, HIVE}, 2}}, 2,
+        {HIVE}, 1,
+        -1, {NONE}, {0}
+    },
+    {
+        "component that needs itself",
+        {{PIG, {PIG}, 1}}, 1,
+        {PIG}, 1,
+        -1, {NONE}, {0}
+    },
+};
+
+static void
+set_edges(const Edges *e, int n)
+{
+    memcpy(edges, e, n * sizeof(Edges));
+    nedges = n;
+}
+
+static void
+test_build(void)
+{
+    for (size_t c = 0; c < sizeof(build_cases) / sizeof(build_cases[0]); c++) {
+        const BuildCase *tc = &build_cases[c];
+        DepGraph	graph;
+        int			n;
+        bool		ok;
+
+        set_edges(tc->edges, tc->nedges);
+        n = DepGraphBuild(&graph, tc->roots, tc->nroots);
+        ok = n == tc->nnodes;
+        for (int i = 0; ok && i < n; i++) {
+            const DepNode *node = &graph.nodes[i];
+
+            ok = node->component == tc->order[i] && node->ndeps == tc->ndeps[i];
+            /* a node needs what its dependencies need, and only after them */
+            for (int d = 0; ok && d < node->ndeps; d++)
+                ok = node->deps[d] < i &&
+                    (node->needs & (1u << node->deps[d])) &&
+                    (node->needs & graph.nodes[node->deps[d]].needs) ==
+                    graph.nodes[node->deps[d]].needs;
+        }
+        for (int r = 0; ok && r < tc->nroots; r++)
+            for (int i = 0; i < n; i++)
+                if (graph.nodes[i].component == tc->roots[r])
+                    ok = graph.nodes[i].root;
+        check(ok, tc->name);
+    }
+}
+
+/* ZOOKEEPER <- HDFS <- HBASE, and SPARK needing HDFS alongside HBASE */
+static const Edges run_edges[] = {
+    {HBASE, {HDFS}, 1}, {SPARK, {HDFS}, 1}, {HDFS, {ZOOKEEPER}, 1}
+};
+
+enum {ZK, FS, HB, SP};			/* their nodes, as DepGraphBuild() has them */
+
+typedef struct BlockerCase
+{
+    const char *name;
+    Action		action;
+    FanoutState state[4];
+    int			status[4];
+    int			blocker[4];		/* what blocker() says of each node */
+} BlockerCase;
+
+#define W	FANOUT_WAITING
+#define R	FANOUT_READING
+#define D	FANOUT_DONE
+
+static const BlockerCase blocker_cases[] = {
+    {"start waits for dependencies", START,
+     {W, W, W, W}, {0}, {-1, ZK, FS, FS}},
+    {"start goes on once they succeed", START,
+     {D, D, W, W}, {0}, {-1, -1, -1, -1}},
+    {"start waits for one still running", START,
+     {D, R, W, W}, {0}, {-1, -1, FS, FS}},
+    {"start skips what needs a failure", START,
+     {D, W, W, W}, {2}, {-1, ZK, FS, FS}},
+    {"stop waits for dependents", STOP,
+     {W, W, W, W}, {0}, {FS, HB, -1, -1}},
+    {"stop waits for every dependent", STOP,
+     {W, W, D, W}, {0}, {FS, SP, -1, -1}},
+    {"stop goes on once dependents stop", STOP,
+     {W, W, D, D}, {0}, {FS, -1, -1, -1}},
+    {"stop skips under a failed dependent", UNINSTALL,
+     {W, W, D, D}, {0, 0, 0, 3}, {FS, SP, -1, -1}},
+    {"report waits for nothing", NO_ACTION,
+     {W, W, W, W}, {0}, {-1, -1, -1, -1}},
+};
+
+static void
+test_blocker(void)
+{
+    Component	roots[] = {HBASE, SPARK};
+    DepGraph	graph;
+
+    set_edges(run_edges, sizeof(run_edges) / sizeof(run_edges[0]));
+    if (DepGraphBuild(&graph, roots, 2) != 4 ||
+        graph.nodes[ZK].component != ZOOKEEPER || graph.nodes[FS].component != HDFS ||
+        graph.nodes[HB].component != HBASE || graph.nodes[SP].component != SPARK) {
+        check(false, "blocker graph");
+        return;
+    }
+
+    for (size_t c = 0; c < sizeof(blocker_cases) / sizeof(blocker_cases[0]); c++) {
+        const BlockerCase *tc = &blocker_cases[c];
+        FanoutHost	hosts[4];
+        DepRun		run;
+        bool		ok = true;
+
+        memset(&run, 0, sizeof(run));
+        memset(hosts, 0, sizeof(hosts));
+        run.graph = &graph;
+        run.fan.hosts = hosts;
+        run.fan.nhosts = 4;
+        run.ordered = tc->action != NO_ACTION;
+        run.reverse = tc->action == STOP || tc->action == UNINSTALL;
+        for (int i = 0; i < 4; i++) {
+            hosts[i].state = tc->state[i];
+            hosts[i].status = tc->status[i];
+        }
+        for (int i = 0; i < 4; i++)
+            ok &= blocker(&run, i) == tc->blocker[i] &&
+                node_ready(&hosts[i], &run) == (tc->blocker[i] < 0);
+        check(ok, tc->name);
+    }
+}
+
+static int	done_count;
+
+static void
+count_done(const DepNode *node, FanoutHost *host, void *arg)
+{
+    (void) node;
+    (void) host;
+    (void) arg;
+    done_count++;
+}
+
+/*
+ * A whole run against a port nothing listens on: ZooKeeper fails to
+ * connect, and everything that needs it is never run.
+ */
+static void
+test_skip_on_failure(void)
+{
+    Component	roots[] = {HBASE, SPARK};
+    DepGraph	graph;
+    DepPlan		plan;
+    int			failed;
+
+    set_edges(run_edges, sizeof(run_edges) / sizeof(run_edges[0]));
+    if (DepGraphBuild(&graph, roots, 2) != 4) {
+        check(false, "skip on failure");
+        return;
+    }
+    memset(&plan, 0, sizeof(plan));
+    plan.action = START;
+    plan.timeout_ms = 5000;
+    plan.done = count_done;
+    done_count = 0;
+    failed = DepGraphRun(&graph, &plan, "127.0.0.1", "1");
+    check(failed == 4 && done_count == 1, "skip on failure");
+}
+
+int
+main(void)
+{
+    test_build();
+    test_blocker();
+    test_skip_on_failure();
+
+    if (failures > 0) {
+        printf("%d depgraph tests FAILED\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All depgraph tests PASSED\n");
+    return EXIT_SUCCESS;
+}
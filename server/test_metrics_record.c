@@ -0,0 +1,230 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * test_metrics_record.c
+ *		Unit tests of decoding metrics records, no agent needed.
+ *
+ * Records are written here field by field as protocol.h lays them out,
+ * then cut short or added to, as a later agent would.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "metrics.h"
+#include "protocol.h"
+
+typedef struct RecordWriter
+{
+    char		data[4096];
+    int			len;
+} RecordWriter;
+
+static void
+put_bytes(RecordWriter *w, const void *p, int len)
+{
+    memcpy(w->data + w->len, p, len);
+    w->len += len;
+}
+
+static void
+put16(RecordWriter *w, uint16_t v)
+{
+    put_bytes(w, &v, 2);
+}
+
+static void
+put32(RecordWriter *w, uint32_t v)
+{
+    put_bytes(w, &v, 4);
+}
+
+static void
+put64(RecordWriter *w, uint64_t v)
+{
+    put_bytes(w, &v, 8);
+}
+
+static void
+put_string(RecordWriter *w, const char *s)
+{
+    unsigned char len = (unsigned char) strlen(s);
+
+    put_bytes(w, &len, 1);
+    put_bytes(w, s, len);
+}
+
+/*
+ * A record of the given version with two disks, one filesystem and one
+ * interface, every counter set to a value that says where it is.
+ */
+static void
+write_record(RecordWriter *w, uint16_t version)
+{
+    w->len = 0;
+    put16(w, version);
+    put16(w, 0);
+    put64(w, 1700000000123456ULL);
+    put32(w, 100);
+    put32(w, 4);
+    for (int i = 0; i < 8; i++)
+        put64(w, 1000 + i);
+    for (int i = 0; i < 3; i++)
+        put32(w, 150 + i);
+    for (int i = 0; i < 8; i++)
+        put64(w, 2000 + i);
+
+    put16(w, 2);
+    put_string(w, "sda");
+    for (int i = 0; i < 7; i++)
+        put64(w, 3000 + i);
+    put_string(w, "nvme0n1");
+    for (int i = 0; i < 7; i++)
+        put64(w, 3100 + i);
+
+    put16(w, 1);
+    put_string(w, "/var/lib");
+    put_string(w, "/dev/sda1");
+    for (int i = 0; i < 3; i++)
+        put64(w, 4000 + i);
+
+    put16(w, 1);
+    put_string(w, "eth0");
+    for (int i = 0; i < 8; i++)
+        put64(w, 5000 + i);
+}
+
+/* Does rec hold what write_record() wrote? */
+static bool
+record_matches(const MetricsRecord *rec, int version)
+{
+    bool		ok;
+
+    ok = rec->version == version && rec->timestamp_usec == 1700000000123456ULL &&
+        rec->clock_ticks == 100 && rec->ncpu == 4;
+    for (int i = 0; i < 8; i++)
+        ok &= rec->cpu[i] == (uint64_t) 1000 + i && rec->memory_kib[i] == (uint64_t) 2000 + i;
+    for (int i = 0; i < 3; i++)
+        ok &= rec->load[i] == (uint32_t) 150 + i;
+    if (!ok || rec->ndisks != 2 || rec->nfilesystems != 1 || rec->ninterfaces != 1)
+        return false;
+
+    ok = strcmp(rec->disks[0].name, "sda") == 0 &&
+        strcmp(rec->disks[1].name, "nvme0n1") == 0 &&
+        strcmp(rec->filesystems[0].name, "/var/lib") == 0 &&
+        strcmp(rec->filesystems[0].device, "/dev/sda1") == 0 &&
+        strcmp(rec->interfaces[0].name, "eth0") == 0;
+    for (int i = 0; i < 7; i++)
+        ok &= rec->disks[0].counters[i] == (uint64_t) 3000 + i &&
+            rec->disks[1].counters[i] == (uint64_t) 3100 + i;
+    for (int i = 0; i < 3; i++)
+        ok &= rec->filesystems[0].counters[i] == (uint64_t) 4000 + i;
+    for (int i = 0; i < 8; i++)
+        ok &= rec->interfaces[0].counters[i] == (uint64_t) 5000 + i;
+    return ok;
+}
+
+typedef struct RecordCase
+{
+    const char *name;
+    uint16_t	version;
+    int			appended;		/* bytes added after the known fields */
+    int			cut;			/* bytes taken off the end */
+    bool		decodes;
+} RecordCase;
+
+static const RecordCase record_cases[] = {
+    {"version 1 record", METRICS_RECORD_VERSION, 0, 0, true},
+    {"later version with fields appended", METRICS_RECORD_VERSION + 1, 40, 0, true},
+    {"much later version with an appended array", METRICS_RECORD_VERSION + 7, 2 + 200, 0, true},
+    {"version 1 with trailing bytes", METRICS_RECORD_VERSION, 3, 0, true},
+    {"version before the first", 0, 0, 0, false},
+    {"last counter cut short", METRICS_RECORD_VERSION, 0, 1, false},
+    {"interface missing", METRICS_RECORD_VERSION, 0, 1 + 4 + 8 * 8, false},
+    {"cut inside a string", METRICS_RECORD_VERSION, 0, 8 * 8 + 2, false},
+};
+
+static int	failures;
+
+static void
+check(bool ok, const char *name)
+{
+    printf("%s: %s\n", name, ok ? "PASSED" : "FAILED");
+    if (!ok)
+        failures++;
+}
+
+static void
+test_records(void)
+{
+    for (size_t c = 0; c < sizeof(record_cases) / sizeof(record_cases[0]); c++) {
+        const RecordCase *tc = &record_cases[c];
+        RecordWriter w;
+        MetricsRecord rec;
+        int			result;
+
+        write_record(&w, tc->version);
+        for (int i = 0; i < tc->appended; i++)
+            w.data[w.len++] = (char) (0xA5 ^ i);
+        w.len -= tc->cut;
+
+        result = decode_metrics_record(w.data, w.len, &rec);
+        if (tc->decodes)
+            check(result == 0 && record_matches(&rec, tc->version), tc->name);
+        else
+            check(result < 0 && rec.disks == NULL && rec.filesystems == NULL &&
+                  rec.interfaces == NULL, tc->name);
+        if (result == 0)
+            free_metrics_record(&rec);
+    }
+}
+
+/* every prefix of a record short of the whole is refused */
+static void
+test_every_cut(void)
+{
+    RecordWriter w;
+    MetricsRecord rec;
+    bool		ok = true;
+
+    write_record(&w, METRICS_RECORD_VERSION);
+    for (int len = 0; len < w.len; len++) {
+        if (decode_metrics_record(w.data, len, &rec) == 0) {
+            free_metrics_record(&rec);
+            ok = false;
+        }
+    }
+    check(ok, "every truncated record refused");
+}
+
+int
+main(void)
+{
+    test_records();
+    test_every_cut();
+
+    if (failures > 0) {
+        printf("%d metrics record tests FAILED\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All metrics record tests PASSED\n");
+    return EXIT_SUCCESS;
+}
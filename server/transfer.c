@@ -0,0 +1,464 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * transfer.c
+ *		Uploading files to an agent's host and downloading them from it.
+ *
+ * Upload blocks are read from the file straight into the output buffer
+ * of the connection, behind their header, so each block is copied once
+ * on its way to the socket.  The agent decides the block size and the
+ * window; the client only keeps to them.
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "transfer.h"
+#include "crc32c.h"
+#include "protocol.h"
+#include "utiles.h"
+
+#define PART_SUFFIX		".debo-part"
+
+/* what send_block() made of a block */
+#define BLOCK_SENT			0
+#define BLOCK_LOST			(-1)	/* the connection failed */
+#define BLOCK_UNREADABLE	1		/* the file could not be read */
+
+static int64
+mtime_ns(const struct stat *st)
+{
+    return (int64) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static double
+elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Give the part file the mtime of its source, which is what lets a later
+ * transfer resume from it.
+ */
+static void
+mark_part(int fd, int64 mtime)
+{
+    struct timespec times[2];
+
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = mtime / 1000000000;
+    times[1].tv_nsec = mtime % 1000000000;
+    (void) futimens(fd, times);
+}
+
+static int
+put_int64(int64 value, Conn *conn)
+{
+    return Putnchar((const char *) &value, 8, conn);
+}
+
+static int64
+get_int64(const char *p)
+{
+    int64		value;
+
+    memcpy(&value, p, 8);
+    return value;
+}
+
+static uint32
+get_int32(const char *p)
+{
+    uint32		value;
+
+    memcpy(&value, p, 4);
+    return value;
+}
+
+/*
+ * Send a block, or a stop if offset is FILE_OFFSET_STOP, as message type
+ * msg_type.  Returns 0 on success, EOF if the connection failed.
+ */
+static int
+send_offset(Conn *conn, char msg_type, int64 offset)
+{
+    if (PutMsgStart(msg_type, conn) < 0 || put_int64(offset, conn) < 0 ||
+        (msg_type == (char) CliMsg_File_Block && PutInt(0, 4, conn) < 0) ||
+        PutMsgEnd(conn) < 0 || Flush(conn) < 0)
+        return EOF;
+    return 0;
+}
+
+/*
+ * Read the next message of a transfer.  Output goes to stderr and the
+ * result is kept in *status; anything else is returned to the caller.
+ * Returns 0 on success, -1 if the connection failed.
+ */
+static int
+next_message(Conn *conn, char *type, ExpBuffer msg, int *status)
+{
+    for (;;) {
+        resetExpBuffer(msg);
+        if (GetResponseMessage(conn, type, msg) < 0)
+            return -1;
+        if (*type == RespMsg_Output)
+            fwrite(msg->data, 1, msg->len, stderr);
+        else if (*type == RespMsg_Result && msg->len >= 4)
+            *status = (int) get_int32(msg->data);
+        else
+            return 0;
+    }
+}
+
+/*
+ * Queue the block of len bytes at offset, read from the file straight
+ * into the output buffer.
+ */
+static int
+send_block(Conn *conn, int fd, int64 offset, int len)
+{
+    uint32		crc;
+    ssize_t		n;
+
+    if (PutMsgStart(CliMsg_File_Block, conn) < 0 || put_int64(offset, conn) < 0 ||
+        PutInt(0, 4, conn) < 0 ||
+        CheckOutBufferSpace(conn->outMsgEnd + len, conn))
+        return BLOCK_LOST;
+
+    do
+        n = pread(fd, conn->outBuffer + conn->outMsgEnd, len, offset);
+    while (n < 0 && errno == EINTR);
+    if (n != len) {
+        /* drop the message begun above */
+        conn->outMsgEnd = conn->outCount;
+        if (n >= 0)
+            errno = EIO;
+        return BLOCK_UNREADABLE;
+    }
+
+    crc = crc32c(conn->outBuffer + conn->outMsgEnd, len);
+    memcpy(conn->outBuffer + conn->outMsgEnd - 4, &crc, 4);
+    conn->outMsgEnd += len;
+    return PutMsgEnd(conn) < 0 ? BLOCK_LOST : BLOCK_SENT;
+}
+
+/*
+ * UploadFile -- copy local to the path remote on the agent's host
+ *
+ * Returns 0 once the file is in place there, -1 on failure, which has
+ * been reported on stderr.  The connection can be used for more requests
+ * unless it failed.
+ */
+int
+UploadFile(Conn *conn, const char *local, const char *remote,
+           TransferResult *result)
+{
+    ExpBufferData msg;
+    struct timespec start;
+    struct stat st;
+    int			fd;
+    int			status = RESP_ERROR;
+    int64		sent = 0;
+    int64		acked = 0;
+    int			block = 0;
+    int			window = 0;
+    int			saved_max = conn->maxRequest;
+    bool		started = false;
+    bool		stopping = false;
+    bool		failed = false;
+    char		type = 0;
+
+    memset(result, 0, sizeof(*result));
+    fd = open(local, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "could not open %s: %s\n", local, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "not a regular file: %s\n", local);
+        close(fd);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (PutMsgStart(CliMsg_File_Put, conn) < 0 || Puts(remote, conn) < 0 ||
+        put_int64(st.st_size, conn) < 0 || put_int64(mtime_ns(&st), conn) < 0 ||
+        PutInt(st.st_mode & 07777, 4, conn) < 0 ||
+        PutInt(0, 4, conn) < 0 || PutInt(0, 4, conn) < 0 ||
+        PutMsgEnd(conn) < 0 || Flush(conn) < 0) {
+        fprintf(stderr, "Failed to send request\n");
+        close(fd);
+        return -1;
+    }
+
+    initExpBuffer(&msg);
+    for (;;) {
+        int64		size = st.st_size;
+
+        if (started && !stopping && sent < size &&
+            sent - acked < (int64) window * block) {
+            int			len = size - sent < block ? (int) (size - sent) : block;
+            int			r = send_block(conn, fd, sent, len);
+
+            if (r == BLOCK_LOST)
+                break;
+            if (r == BLOCK_UNREADABLE) {
+                fprintf(stderr, "could not read %s: %s\n", local, strerror(errno));
+                failed = stopping = true;
+                if (send_offset(conn, CliMsg_File_Block, FILE_OFFSET_STOP) < 0)
+                    break;
+                continue;
+            }
+            sent += len;
+            continue;
+        }
+
+        if (Flush(conn) < 0 || next_message(conn, &type, &msg, &status) < 0)
+            break;
+        if (type == RespMsg_End) {
+            started = started && !failed;
+            break;
+        }
+        if (type == RespMsg_File_Start && msg.len >= 20) {
+            uint32		crc;
+
+            sent = acked = get_int64(msg.data);
+            block = (int) get_int32(msg.data + 8);
+            window = (int) get_int32(msg.data + 12);
+            /* the agent starts over when the first block is at offset 0 */
+            if (sent > 0 && (crc32c_file(fd, sent, &crc) < 0 ||
+                             crc != get_int32(msg.data + 16)))
+                sent = acked = 0;
+            result->resumed = sent;
+            started = true;
+            /* the agent takes blocks bigger than ordinary requests */
+            if (conn->maxRequest > 0)
+                conn->maxRequest = 4 + FILE_BLOCK_HEADER + block;
+        } else if (type == RespMsg_File_Ack && msg.len >= 8) {
+            int64		offset = get_int64(msg.data);
+
+            if (offset == FILE_OFFSET_STOP) {
+                /* the agent stopped; answer so it knows nothing more is coming */
+                if (!stopping &&
+                    send_offset(conn, CliMsg_File_Block, FILE_OFFSET_STOP) < 0)
+                    break;
+                failed = stopping = true;
+            } else if (!stopping)
+                acked = offset;
+        }
+    }
+    termExpBuffer(&msg);
+    close(fd);
+    conn->maxRequest = saved_max;
+
+    result->bytes = sent - result->resumed;
+    result->seconds = elapsed_seconds(&start);
+    if (type != RespMsg_End) {
+        fprintf(stderr, "Connection to the agent failed during the upload\n");
+        return -1;
+    }
+    return (started && status == RESP_OK) ? 0 : -1;
+}
+
+/*
+ * DownloadFile -- copy the path remote on the agent's host to local
+ *
+ * Returns 0 once the file is in place, -1 on failure, which has been
+ * reported on stderr.  The connection can be used for more requests
+ * unless it failed.
+ */
+int
+DownloadFile(Conn *conn, const char *remote, const char *local,
+             TransferResult *result)
+{
+    ExpBufferData msg;
+    struct timespec start;
+    struct stat st;
+    char		part[PATH_MAX];
+    int			fd;
+    int			status = RESP_ERROR;
+    uint32		part_crc;
+    int64		received = 0;
+    int64		size = 0;
+    int64		mtime = 0;
+    int			mode = 0600;
+    int			window = 1;
+    int			since_ack = 0;
+    bool		started = false;
+    bool		stopping = false;
+    bool		failed = false;
+    char		type = 0;
+
+    memset(result, 0, sizeof(*result));
+    if (snprintf(part, sizeof(part), "%s" PART_SUFFIX, local) >= (int) sizeof(part)) {
+        fprintf(stderr, "path too long: %s\n", local);
+        return -1;
+    }
+    fd = open(part, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "could not open %s: %s\n", part, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "not a regular file: %s\n", part);
+        close(fd);
+        return -1;
+    }
+    /* the agent resumes only if its file has the same checksum up to there */
+    if (crc32c_file(fd, st.st_size, &part_crc) < 0) {
+        fprintf(stderr, "could not read %s: %s\n", part, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (PutMsgStart(CliMsg_File_Get, conn) < 0 || Puts(remote, conn) < 0 ||
+        put_int64(st.st_size, conn) < 0 || put_int64(mtime_ns(&st), conn) < 0 ||
+        PutInt((int) part_crc, 4, conn) < 0 ||
+        PutInt(0, 4, conn) < 0 || PutInt(0, 4, conn) < 0 ||
+        PutMsgEnd(conn) < 0 || Flush(conn) < 0) {
+        fprintf(stderr, "Failed to send request\n");
+        close(fd);
+        return -1;
+    }
+
+    initExpBuffer(&msg);
+    for (;;) {
+        const char *data;
+        int			len;
+        int64		offset;
+
+        if (next_message(conn, &type, &msg, &status) < 0)
+            break;
+        if (type == RespMsg_End)
+            break;
+
+        if (type == RespMsg_File_Start && msg.len >= 36) {
+            received = get_int64(msg.data);
+            window = (int) get_int32(msg.data + 12);
+            size = get_int64(msg.data + 16);
+            mtime = get_int64(msg.data + 24);
+            mode = (int) get_int32(msg.data + 32);
+            result->resumed = received;
+            started = true;
+            if (ftruncate(fd, received) < 0) {
+                fprintf(stderr, "could not prepare %s: %s\n", part, strerror(errno));
+                failed = stopping = true;
+                if (send_offset(conn, CliMsg_File_Ack, FILE_OFFSET_STOP) < 0)
+                    break;
+            }
+            continue;
+        }
+        if (type != RespMsg_File_Block || msg.len < FILE_BLOCK_HEADER)
+            continue;
+
+        offset = get_int64(msg.data);
+        if (offset == FILE_OFFSET_STOP) {
+            /* the agent stopped; answer so it knows nothing more is coming */
+            if (!stopping &&
+                send_offset(conn, CliMsg_File_Ack, FILE_OFFSET_STOP) < 0)
+                break;
+            failed = stopping = true;
+            continue;
+        }
+        if (stopping)
+            continue;
+
+        data = msg.data + FILE_BLOCK_HEADER;
+        len = msg.len - FILE_BLOCK_HEADER;
+        if (offset != received || len > size - received ||
+            crc32c(data, len) != get_int32(msg.data + 8)) {
+            fprintf(stderr, "bad block at %lld from the agent\n", (long long) offset);
+            failed = true;
+        } else if (pwrite(fd, data, len, offset) != len) {
+            fprintf(stderr, "could not write %s: %s\n", part, strerror(errno));
+            failed = true;
+        }
+        if (failed) {
+            /* keep what was verified, and have the agent stop sending */
+            if (ftruncate(fd, received) == 0)
+                mark_part(fd, mtime);
+            stopping = true;
+            if (send_offset(conn, CliMsg_File_Ack, FILE_OFFSET_STOP) < 0)
+                break;
+            continue;
+        }
+
+        /*
+         * Marked after every block: unlike the agent, this process can be
+         * killed in the middle of a download and still leave a part file
+         * that resumes.
+         */
+        mark_part(fd, mtime);
+        received += len;
+        if (received == size || ++since_ack >= (window > 1 ? window / 2 : 1)) {
+            if (send_offset(conn, CliMsg_File_Ack, received) < 0)
+                break;
+            since_ack = 0;
+        }
+    }
+    termExpBuffer(&msg);
+
+    result->bytes = received - result->resumed;
+    result->seconds = elapsed_seconds(&start);
+    if (type != RespMsg_End) {
+        if (started)
+            mark_part(fd, mtime);
+        close(fd);
+        fprintf(stderr, "Connection to the agent failed during the download\n");
+        return -1;
+    }
+    if (!started || failed || status != RESP_OK || received != size) {
+        if (started && !failed)
+            mark_part(fd, mtime);
+        close(fd);
+        /* refused outright: do not leave an empty part file behind */
+        if (!started && st.st_size == 0)
+            (void) unlink(part);
+        return -1;
+    }
+
+    /* in place only once it is all on disk, with the source's mode and mtime */
+    if (fsync(fd) < 0 || fchmod(fd, mode & 07777) < 0) {
+        fprintf(stderr, "could not finish %s: %s\n", part, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    mark_part(fd, mtime);
+    close(fd);
+    if (rename(part, local) < 0) {
+        fprintf(stderr, "could not rename %s to %s: %s\n", part, local, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2025 Surafel Temesgen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*-------------------------------------------------------------------------
+ *
+ * transfer.h
+ *		Uploading files to an agent's host and downloading them from it.
+ *
+ * The file moves over the agent connection in checksummed blocks, as
+ * protocol.h describes.  A transfer that is cut short leaves a
+ * "<destination>.debo-part" file behind, and doing the same transfer
+ * again picks up from it.
+ *-------------------------------------------------------------------------
+ */
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "connect.h"
+
+typedef struct TransferResult
+{
+    long long	bytes;			/* moved by this transfer */
+    long long	resumed;		/* already there from an earlier one */
+    double		seconds;
+} TransferResult;
+
+extern int	UploadFile(Conn *conn, const char *local, const char *remote,
+                       TransferResult *result);
+extern int	DownloadFile(Conn *conn, const char *remote, const char *local,
+                         TransferResult *result);
+
+#endif							/* TRANSFER_H */
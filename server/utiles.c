@@ -24,10 +24,15 @@
 #include <string.h>
 #include <ctype.h>
 #include <limits.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 
+#define ntoh16(x) (x)
+#define ntoh32(x) (x)
 
 extern bool dependency;
 char *
@@ -733,36 +738,41 @@ const char* component_to_string(Component comp) {
 
 Component string_to_component(const char* name) {
     // Flink
-    if (strcmp(name, "flink") == 0) return FLINK;
-    if (strcmp(name, "hdfs") == 0) return HDFS;
+    if (strcasecmp(name, "flink") == 0) return FLINK;
+    if (strcasecmp(name, "hdfs") == 0) return HDFS;
 
     // HBase
-    if (strcmp(name, "hbase") == 0) return HBASE;
+    if (strcasecmp(name, "hbase") == 0) return HBASE;
     // Hive
-    if (strcmp(name, "hive") == 0) return HIVE;
+    if (strcasecmp(name, "hive") == 0) return HIVE;
 
     // Kafka
-    if (strcmp(name, "kafka") == 0) return KAFKA;
+    if (strcasecmp(name, "kafka") == 0) return KAFKA;
 
     // Livy
-    if (strcmp(name, "livy") == 0) return LIVY;
+    if (strcasecmp(name, "livy") == 0) return LIVY;
 
     // Phoenix
-    if (strcmp(name, "phoenix") == 0) return PHOENIX;
+    if (strcasecmp(name, "phoenix") == 0) return PHOENIX;
 
     // Ranger
-    if (strcmp(name, "ranger") == 0) return RANGER;
+    if (strcasecmp(name, "ranger") == 0) return RANGER;
 
     // Solr
-    if (strcmp(name, "solr") == 0) return SOLR;
+    if (strcasecmp(name, "solr") == 0) return SOLR;
     // Tez
-    if (strcmp(name, "tez") == 0) return TEZ;
+    if (strcasecmp(name, "tez") == 0) return TEZ;
+    if (strcasecmp(name, "atlas") == 0) return ATLAS;
+    if (strcasecmp(name, "storm") == 0) return STORM;
+    if (strcasecmp(name, "pig") == 0) return PIG;
+    if (strcasecmp(name, "spark") == 0) return SPARK;
+    if (strcasecmp(name, "presto") == 0) return PRESTO;
 
     // Zeppelin
-    if (strcmp(name, "zeppelin") == 0) return ZEPPELIN;
+    if (strcasecmp(name, "zeppelin") == 0) return ZEPPELIN;
 
     // Zookeeper
-    if (strcmp(name, "zookeeper") == 0) return ZOOKEEPER;
+    if (strcasecmp(name, "zookeeper") == 0) return ZOOKEEPER;
     return NONE;
 }
 
@@ -799,7 +809,14 @@ char* trim_leading(char* str) {
 
 
 
-Conn* connect_to_debo(const char* host, const char* port) {
+/*
+ * Transport asked of TCP agent ports, see set_transport_mode(); NULL for
+ * the connection default, encryption.
+ */
+static const char* transport_mode = NULL;
+
+static Conn* start_debo_connection(const char* host, const char* port,
+                                   bool nonblocking) {
     const char* keywords[5] = {NULL};  // Connection parameters + NULL terminator
     const char* values[5] = {NULL};
     int param_index = 0;
@@ -815,23 +832,452 @@ Conn* connect_to_debo(const char* host, const char* port) {
         values[param_index] = port;
         param_index++;
     }
+    if (transport_mode) {
+        keywords[param_index] = "transport";
+        values[param_index] = transport_mode;
+        param_index++;
+    }
 
 
     // Terminate the parameter arrays
     keywords[param_index] = NULL;
     values[param_index] = NULL;
 
+    if (nonblocking)
+        return connectStartParamsAsync(keywords, values);
+    return connectStartParams(keywords, values);
+}
+
+/*
+ * Does host name this machine?  No host at all counts as local.
+ */
+static bool host_is_local(const char* host) {
+    char self[256];
+
+    if (host == NULL || host[0] == '\0')
+        return true;
+    if (strcmp(host, "localhost") == 0 || strcmp(host, "127.0.0.1") == 0 ||
+        strcmp(host, "::1") == 0)
+        return true;
+    if (gethostname(self, sizeof(self)) != 0)
+        return false;
+    self[sizeof(self) - 1] = '\0';
+    if (strcasecmp(host, self) == 0)
+        return true;
+    // short name of a fully qualified host name
+    size_t short_len = strcspn(self, ".");
+    return strlen(host) == short_len && strncasecmp(host, self, short_len) == 0;
+}
+
+/*
+ * Directory holding the local agent's Unix socket for port, or NULL if
+ * there is no such socket.
+ */
+static const char* local_agent_socket_dir(const char* port) {
+    const char* dir = getenv("DEBO_UNIX_SOCKET_DIR");
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (dir == NULL)
+        dir = DEFAULT_DEBO_SOCKET_DIR;
+    if (dir[0] != '/')
+        return NULL;
+    snprintf(path, sizeof(path), "%s/.s.DEBO.%s", dir,
+             (port && port[0]) ? port : DEFAULT_DEBO_PORT);
+    if (stat(path, &st) != 0 || !S_ISSOCK(st.st_mode))
+        return NULL;
+    return dir;
+}
+
+/*
+ * Compression algorithms offered to the agent after connecting, in order
+ * of preference; see set_compress_offer().
+ */
+static unsigned char compress_offer[2];
+static int compress_offer_len = 0;
+
+/*
+ * Ask agents for response compression from now on: with name "lz4" or
+ * "zstd" for that algorithm, with NULL or "auto" for whichever this
+ * client and the agent both support, lz4 first.  "none" turns it off.
+ *
+ * Returns 0 on success, -1 if the name is unknown or this client was
+ * built without the algorithm.
+ */
+int set_compress_offer(const char* name) {
+    compress_offer_len = 0;
+    if (name != NULL && strcmp(name, "none") == 0)
+        return 0;
+    if (name == NULL || strcmp(name, "auto") == 0) {
+        if (CompressionAvailable(COMPRESS_LZ4))
+            compress_offer[compress_offer_len++] = COMPRESS_LZ4;
+        if (CompressionAvailable(COMPRESS_ZSTD))
+            compress_offer[compress_offer_len++] = COMPRESS_ZSTD;
+    } else if (strcmp(name, "lz4") == 0) {
+        if (CompressionAvailable(COMPRESS_LZ4))
+            compress_offer[compress_offer_len++] = COMPRESS_LZ4;
+    } else if (strcmp(name, "zstd") == 0) {
+        if (CompressionAvailable(COMPRESS_ZSTD))
+            compress_offer[compress_offer_len++] = COMPRESS_ZSTD;
+    }
+    return compress_offer_len > 0 ? 0 : -1;
+}
+
+/*
+ * Ask agents for the transport name from now on: "encrypt" (the default),
+ * "integrity" for signed but readable packets, or "plain" for unwrapped
+ * ones.  The agent's port has to offer it; Kerberos still authenticates
+ * the connection, and a local Unix-socket session is unaffected.
+ *
+ * Returns 0 on success, -1 if the name is unknown.
+ */
+int set_transport_mode(const char* name) {
+    if (name == NULL || (strcmp(name, "encrypt") != 0 &&
+                         strcmp(name, "integrity") != 0 &&
+                         strcmp(name, "plain") != 0))
+        return -1;
+    transport_mode = strcmp(name, "encrypt") == 0 ? NULL : name;
+    return 0;
+}
+
+/*
+ * Threads fetching service tickets at once; the KDC answers each in a
+ * round trip, so this is about how many round trips to overlap.
+ */
+#define TICKET_PREFETCH_WORKERS 16
+
+/*
+ * Get the service tickets of the agents on hosts before connecting to
+ * them, in parallel, and report how long the KDC took.  The local ones
+ * are skipped: they are reached over the Unix socket without Kerberos.
+ *
+ * Returns the number of tickets that could not be had, or -1 if there are
+ * no Kerberos credentials.
+ */
+int prefetch_service_tickets(const char* const* hosts, int nhosts) {
+    const char** remote = malloc((nhosts > 0 ? nhosts : 1) * sizeof(char*));
+    GSSPrefetchStats stats;
+    int nremote = 0;
+    int result;
+
+    if (remote == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < nhosts; i++) {
+        if (!host_is_local(hosts[i]))
+            remote[nremote++] = hosts[i];
+    }
+    if (nremote == 0) {
+        free(remote);
+        return 0;
+    }
+
+    result = pg_GSS_prefetch_tickets(remote, nremote, TICKET_PREFETCH_WORKERS,
+                                     &stats);
+    free(remote);
+    if (result < 0)
+        return result;
+    fprintf(stderr, "prefetched %d/%d service tickets in %.1f ms "
+            "(KDC min %.1f avg %.1f max %.1f ms)\n",
+            stats.fetched, stats.hosts, stats.wall_ms,
+            stats.kdc_min_ms, stats.kdc_avg_ms, stats.kdc_max_ms);
+    return result;
+}
+
+/*
+ * Offer the agent the algorithms in compress_offer and record the one it
+ * picks in conn->compression, COMPRESS_NONE if it picks none.  For agents
+ * that predate the capability handshake; one that does not know the
+ * request either answers without a choice.
+ *
+ * Returns 0 on success, -1 if the connection failed.
+ */
+static int NegotiateCompression(Conn* conn) {
+    ExpBufferData msg;
+    char type;
+    int result = 0;
+
+    conn->compression = COMPRESS_NONE;
+    if (PutMsgStart(CliMsg_Compress, conn) < 0 ||
+        Putnchar((const char *) compress_offer, compress_offer_len, conn) < 0 ||
+        PutMsgEnd(conn) < 0 || Flush(conn) < 0)
+        return -1;
+
+    initExpBuffer(&msg);
+    for (;;) {
+        resetExpBuffer(&msg);
+        if (GetResponseMessage(conn, &type, &msg) < 0) {
+            result = -1;
+            break;
+        }
+        if (type == RespMsg_End)
+            break;
+        if (type == RespMsg_Compression && msg.len >= 1 &&
+            CompressionAvailable((unsigned char) msg.data[0]))
+            conn->compression = (unsigned char) msg.data[0];
+    }
+    termExpBuffer(&msg);
+    return result;
+}
+
+/* output chunk this client asks agents for, see NegotiateCapabilities() */
+#define CLIENT_OUTPUT_CHUNK (64 * 1024)
+
+/* GSSAPI packet size, in KiB, this client offers agents */
+#define CLIENT_GSS_PACKET_KB 256
+
+/*
+ * How long an agent has to answer the handshake.  One that stays quiet
+ * longer, or answers in plain text, predates typed responses.
+ */
+#define HELLO_TIMEOUT_MS 10000
+
+/*
+ * Such an agent marks no end of a response, so one is taken to be over
+ * once the agent has been quiet for LEGACY_QUIET_MS after sending
+ * something; the first output may take up to LEGACY_FIRST_MS.
+ */
+#define LEGACY_QUIET_MS 2000
+#define LEGACY_FIRST_MS (10 * 60 * 1000)
+
+/*
+ * Wait up to timeout_ms for data from the agent.  Returns 1 if there is
+ * some, including data read before, 0 on timeout, -1 on failure.
+ */
+static int wait_for_agent(Conn* conn, int timeout_ms) {
+    pg_usec_time_t end_time;
+    int result;
+
+    if (InputPending(conn))
+        return 1;
+    end_time = getCurrentTimeUSec() + (pg_usec_time_t) timeout_ms * 1000;
+    do
+        result = socketPoll(conn->sock, 1, 0, end_time);
+    while (result < 0 && errno == EINTR);
+    return result;
+}
+
+/*
+ * Does what the agent sent start with a typed response message?  An
+ * agent that predates them answers an unknown request in plain text.
+ */
+static bool starts_with_message(Conn* conn) {
+    switch (conn->inBuffer[conn->inStart]) {
+    case RespMsg_Hello:
+    case RespMsg_Output:
+    case RespMsg_Progress:
+    case RespMsg_Result:
+    case RespMsg_End:
+    case RespMsg_Compressed:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int put_hello(Conn* conn, int packet_kb, uint32 features, int chunk,
+                     const unsigned char* algorithms, int nalgorithms) {
+    if (PutMsgStart(CliMsg_Hello, conn) < 0 ||
+        PutInt(PROTOCOL_VERSION, 2, conn) < 0 ||
+        PutInt(packet_kb, 2, conn) < 0 ||
+        PutInt((int) features, 4, conn) < 0 ||
+        PutInt(chunk, 4, conn) < 0 ||
+        Putnchar((const char *) algorithms, nalgorithms, conn) < 0 ||
+        PutMsgEnd(conn) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * Queue a handshake that asks for nothing but typed responses, for
+ * callers that send their requests right behind it without waiting.
+ * Its reply is one more response for them to skip.
+ *
+ * Returns 0 on success, -1 if the connection failed.
+ */
+int QueueHello(Conn* conn) {
+    return put_hello(conn, 0, 0, 0, NULL, 0);
+}
+
+/*
+ * Trade capabilities with the agent: offer this client's protocol
+ * version, the GSSAPI packet size it takes, the features it knows, the
+ * output chunk it would like and the algorithms in compress_offer, and
+ * record what the agent settles on in conn.
+ *
+ * An agent that answers with typed messages but no RespMsg_Hello is left
+ * at protocol version 0, with no features; it is still offered
+ * compression the old way.  One that does not answer within
+ * HELLO_TIMEOUT_MS, or answers in plain text, predates typed responses:
+ * its answer is dropped and the connection is marked legacyResponses.
+ *
+ * Returns 0 on success, -1 if the connection failed.
+ */
+int NegotiateCapabilities(Conn* conn) {
+    ExpBufferData msg;
+    char type;
+    int result = 0;
+    int packet_offer;
+
+    conn->protocolVersion = 0;
+    conn->features = 0;
+    conn->maxRequest = 0;
+    conn->compression = COMPRESS_NONE;
+    conn->legacyResponses = false;
+
+    /*
+     * The agent may use the larger packets as soon as it has the offer; if
+     * there is no room for them, stay with the default.
+     */
+    packet_offer = CLIENT_GSS_PACKET_KB;
+    if (pqsecure_gss_set_packet_size(conn, 0, packet_offer * 1024) < 0)
+        packet_offer = 0;
+    if (put_hello(conn, packet_offer,
+                  PROTO_FEATURE_COMPRESS | PROTO_FEATURE_SESSION |
+                  PROTO_FEATURE_JOBS | PROTO_FEATURE_METRICS_RECORD |
+                  PROTO_FEATURE_FILE_TRANSFER,
+                  CLIENT_OUTPUT_CHUNK, compress_offer, compress_offer_len) < 0 ||
+        Flush(conn) < 0)
+        return -1;
+
+    for (;;) {
+        int ready = wait_for_agent(conn, HELLO_TIMEOUT_MS);
+
+        if (ready < 0)
+            return -1;
+        if (ready == 0 || conn->inStart < conn->inEnd)
+            break;
+        if (ReadData(conn) < 0)
+            return -1;
+    }
+    if (conn->inStart == conn->inEnd || !starts_with_message(conn)) {
+        /* drop what it said about the unknown request */
+        do
+            conn->inStart = conn->inEnd;
+        while (wait_for_agent(conn, LEGACY_QUIET_MS / 4) > 0 &&
+               ReadData(conn) >= 0);
+        conn->inStart = conn->inEnd;
+        conn->legacyResponses = true;
+        return 0;
+    }
+
+    initExpBuffer(&msg);
+    for (;;) {
+        resetExpBuffer(&msg);
+        if (GetResponseMessage(conn, &type, &msg) < 0) {
+            result = -1;
+            break;
+        }
+        if (type == RespMsg_End)
+            break;
+        if (type == RespMsg_Hello && msg.len >= 21) {
+            const unsigned char* p = (const unsigned char *) msg.data;
+            uint16 version, packet_kb;
+            uint32 features, max_request, chunk;
+
+            memcpy(&version, p, 2);
+            memcpy(&packet_kb, p + 2, 2);
+            memcpy(&features, p + 4, 4);
+            memcpy(&max_request, p + 8, 4);
+            memcpy(&chunk, p + 12, 4);
+            conn->protocolVersion = ntoh16(version);
+            conn->features = ntoh32(features);
+            conn->maxRequest = (int) ntoh32(max_request);
+            if (CompressionAvailable(p[16]))
+                conn->compression = p[16];
+            // room for a whole chunk of output in one read
+            if (CheckInBufferSpace((size_t) ntoh32(chunk) + 8192, conn) < 0)
+                result = -1;
+            // the agent takes packets of the size it settled on from now on
+            packet_kb = ntoh16(packet_kb);
+            if (packet_kb > 0 && packet_kb <= packet_offer &&
+                pqsecure_gss_set_packet_size(conn, packet_kb * 1024, 0) < 0)
+                result = -1;
+        }
+    }
+    termExpBuffer(&msg);
+    if (result == 0 && conn->protocolVersion == 0 && compress_offer_len > 0)
+        result = NegotiateCompression(conn);
+    return result;
+}
+
+/*
+ * Connect to the agent on host.  When host is this machine and the agent
+ * has a Unix socket, use that: the agent authenticates us by uid instead
+ * of a Kerberos handshake, and connectPoll() checks that the socket is
+ * served by root or DEBO_AGENT_USER.  If it is missing or either side
+ * refuses the other, fall back to TCP and GSSAPI.  Either way the capability handshake follows, which
+ * also sets up the response compression asked for with
+ * set_compress_offer().
+ */
+Conn* connect_to_debo(const char* host, const char* port) {
+    Conn* connection = NULL;
+
+    if (host_is_local(host)) {
+        const char* socket_dir = local_agent_socket_dir(port);
+
+        if (socket_dir != NULL) {
+            Conn* local = start_debo_connection(socket_dir, port, false);
+
+            if (local != NULL && local->status == CONNECTION_STARTED)
+                connection = local;
+            else
+                CloseConn(local);
+        }
+        if (host == NULL || host[0] == '\0')
+            host = "localhost";
+    }
+
     // Establish database connection using parameter arrays
-    Conn* connection = connectStartParams(keywords, values);
+    if (connection == NULL)
+        connection = start_debo_connection(host, port, false);
 
     // Verify connection success
-    if (connection->status != CONNECTION_STARTED) {
-        fprintf(stderr, "Debo connection error: \n");
+    if (connection == NULL || connection->status != CONNECTION_STARTED) {
+        /* such as a transport the agent's port does not offer */
+        const char* reason = connection && connection->errorMessage.data ?
+                             connection->errorMessage.data : "";
+
+        fprintf(stderr, "Debo connection error: %s%s", reason,
+                reason[0] && reason[strlen(reason) - 1] == '\n' ? "" : "\n");
+        CloseConn(connection);
+        return NULL;
+    }
+
+    if (NegotiateCapabilities(connection) < 0) {
+        fprintf(stderr, "Debo connection error: capability handshake failed\n");
+        CloseConn(connection);
         return NULL;
     }
 
     return connection;
 }
+
+/*
+ * Start connecting to the agent on host without waiting, for callers
+ * that drive many connections at once: call connectPoll() until it says
+ * the connection is made.  The local agent is reached over its Unix
+ * socket as connect_to_debo() would, but there is no falling back to TCP
+ * if it refuses us, and no capability handshake: queue one with
+ * QueueHello() ahead of the requests to get typed responses, which come
+ * uncompressed.
+ *
+ * Returns NULL if out of memory, else a connection whose status is
+ * CONNECTION_BAD if it failed already.
+ */
+Conn* connect_to_debo_async(const char* host, const char* port) {
+    if (host_is_local(host)) {
+        const char* socket_dir = local_agent_socket_dir(port);
+
+        if (socket_dir != NULL)
+            return start_debo_connection(socket_dir, port, true);
+        if (host == NULL || host[0] == '\0')
+            host = "localhost";
+    }
+    return start_debo_connection(host, port, true);
+}
+
 void reset_connection_buffers(Conn *conn) {
     if (conn == NULL) {
         return;
@@ -877,13 +1323,13 @@ Component* get_dependencies(Component comp, int *count) {
     case HIVE: *count = 2; return hive_deps;          // Updated count
     case PHOENIX: *count = 1; return phoenix_deps;
     case STORM: *count = 1; return storm_deps;
-    case SPARK: *count = 2; return spark_deps;        // Updated count
+    case SPARK: *count = 1; return spark_deps;
     case TEZ: *count = 1; return tez_deps;            // Updated count
     case LIVY: *count = 1; return livy_deps;
     case RANGER: *count = 2; return ranger_deps;      // Updated count
                                                       // New cases for previously missing components
     case ATLAS: *count = 3; return atlas_deps;
-    case PIG: *count = 2; return pig_deps;
+    case PIG: *count = 1; return pig_deps;
     case SOLR: *count = 1; return solr_deps;
     case FLINK: *count = 1; return flink_deps;
                 // Components with no dependencies
@@ -896,6 +1342,53 @@ Component* get_dependencies(Component comp, int *count) {
 }
 
 
+/*
+ * Append the parameters of a component action to the message being built.
+ * Returns -1 if the parameters are invalid or could not be queued.
+ */
+static int
+put_action_params(Action action, const char* version,
+                  const char* param_name, const char* param_value,
+                  Conn* conn) {
+    switch (action) {
+    case CONFIGURE:
+        if (!param_name || !param_value) {
+            fprintf(stderr, "Invalid configuration parameters\n");
+            return -1;
+        }
+        char *result = concatenate_strings(param_name, param_value);
+
+        if (Putnchar(result, strlen(result), conn) < 0) {
+            fprintf(stderr, "Failed to send configuration parameters\n");
+            return -1;
+        }
+        break;
+
+    case INSTALL:
+        // Send version if provided
+
+        if (version) {
+            if (Putnchar(version, strlen(version), conn) < 0) {
+                fprintf(stderr, "Failed to send version\n");
+                return -1;
+            }
+        }
+        break;
+
+    case START:
+    case STOP:
+    case RESTART:
+    case UNINSTALL:
+    case METRICS:
+    case NONE:
+        // No additional parameters needed
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
 /**
  * Sends a command message based on the specified protocol.
  *
@@ -912,9 +1405,25 @@ void SendComponentActionCommand(Component component, Action action,
                                 const char* version,
                                 const char* param_name, const char* param_value,
                                 Conn* conn) {
+    if (QueueComponentActionCommand(component, action, version,
+                                    param_name, param_value, conn) < 0)
+        return;
+    (void) Flush(conn);
+}
+
+/**
+ * Queues the message SendComponentActionCommand() sends, without
+ * flushing, so that several can go out together.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int QueueComponentActionCommand(Component component, Action action,
+                                const char* version,
+                                const char* param_name, const char* param_value,
+                                Conn* conn) {
     if (!conn) {
         fprintf(stderr, "Invalid connection object\n");
-        return;
+        return -1;
     }
 
     // Convert enums to protocol codes
@@ -923,61 +1432,259 @@ void SendComponentActionCommand(Component component, Action action,
     // Send component and action codes
     if (PutMsgStart(comp_code, conn) < 0) {
         fprintf(stderr, "Failed to send component/action\n");
-        return;
+        return -1;
     }
     // Handle action-specific parameters
-    switch (action) {
-    case START:
-        PutMsgEnd(conn);
-        break;
-    case STOP:
-        PutMsgEnd(conn);
-        break;
-    case RESTART:
-        PutMsgEnd(conn);
-        break;
-    case UNINSTALL:
-        PutMsgEnd(conn);
-        break;
-    case METRICS:
-        PutMsgEnd(conn);
-        break;
-    case CONFIGURE:
-        if (!param_name || !param_value) {
-            fprintf(stderr, "Invalid configuration parameters\n");
-            return;
+    if (put_action_params(action, version, param_name, param_value, conn) < 0)
+        return -1;
+    return PutMsgEnd(conn);
+}
+
+/**
+ * Submits a component action to run as a background job on the agent.
+ * The agent answers with the job id and runs the action detached from
+ * this connection.
+ *
+ * Parameters are the same as for SendComponentActionCommand().
+ */
+void SendComponentJobSubmit(Component component, Action action,
+                            const char* version,
+                            const char* param_name, const char* param_value,
+                            Conn* conn) {
+    if (!conn) {
+        fprintf(stderr, "Invalid connection object\n");
+        return;
+    }
+
+    unsigned char comp_code = get_protocol_code(component, action, version);
+
+    // The job body is the wrapped request: its code, then its parameters
+    if (PutMsgStart(CliMsg_Job_Submit, conn) < 0 ||
+        Putnchar((char *) &comp_code, 1, conn) < 0) {
+        fprintf(stderr, "Failed to send job request\n");
+        return;
+    }
+    if (put_action_params(action, version, param_name, param_value, conn) < 0)
+        return;
+    PutMsgEnd(conn);
+    (void) Flush(conn);
+}
+
+/**
+ * Queues a component action as one tagged request of a pipelined
+ * session (CliMsg_Session).  Nothing is flushed, so any number of
+ * requests can be queued and then sent together with Flush().  The agent
+ * answers with frames carrying the same tag; see ReadSessionFrame().
+ *
+ * The other parameters are the same as for SendComponentActionCommand().
+ * Returns 0 on success, -1 on failure.
+ */
+int SendComponentSessionRequest(int tag, Component component, Action action,
+                                const char* version,
+                                const char* param_name, const char* param_value,
+                                Conn* conn) {
+    if (!conn) {
+        fprintf(stderr, "Invalid connection object\n");
+        return -1;
+    }
+
+    unsigned char comp_code = get_protocol_code(component, action, version);
+
+    if (PutMsgStart(CliMsg_Session, conn) < 0 ||
+        PutInt(tag, 4, conn) < 0 ||
+        Putnchar((char *) &comp_code, 1, conn) < 0) {
+        fprintf(stderr, "Failed to queue session request\n");
+        return -1;
+    }
+    if (put_action_params(action, version, param_name, param_value, conn) < 0)
+        return -1;
+    return PutMsgEnd(conn);
+}
+
+/**
+ * Reads the next typed message from the agent: a type byte, an int32
+ * length that counts itself and the body, then the body, which is
+ * appended to body.  Waits for more data as long as the message is
+ * incomplete.  A compressed message is returned as the message it wraps.
+ *
+ * Returns 0 on success, -1 if the connection failed or the message is
+ * malformed.
+ */
+int GetResponseMessage(Conn* conn, char* type, ExpBuffer body) {
+    for (;;) {
+        int result = ParseResponseMessage(conn, type, body);
+
+        if (result != 0)
+            return result > 0 ? 0 : -1;
+        if (ReadData(conn) < 0)
+            return -1;
+    }
+}
+
+/**
+ * Takes the next typed message from what has been read from the agent,
+ * as GetResponseMessage() does, but never reads or waits: for callers
+ * that read non-blocking connections themselves.
+ *
+ * Returns 1 if a message was taken, 0 if it has not all arrived yet, -1
+ * if the message is malformed.
+ */
+int ParseResponseMessage(Conn* conn, char* type, ExpBuffer body) {
+    int len;
+
+    conn->inCursor = conn->inStart;
+    if (Getc(type, conn) != 0 || GetInt(&len, 4, conn) != 0)
+        return 0;
+    if (len < 4) {
+        fprintf(stderr, "Invalid message length %d\n", len);
+        return -1;
+    }
+    if (conn->inCursor + (len - 4) > conn->inEnd)
+        return 0;
+
+    const char *data = conn->inBuffer + conn->inCursor;
+
+    if (*type == RespMsg_Compressed) {
+        if (DecompressMessage(data, len - 4, type, body) != 0) {
+            fprintf(stderr, "Invalid compressed message\n");
+            return -1;
         }
-        char *result = concatenate_strings(param_name, param_value);
+    } else
+        appendBinaryExpBuffer(body, data, len - 4);
+    conn->inCursor += len - 4;
+    ParseDone(conn, conn->inCursor);
+    return 1;
+}
 
-        if (Putnchar(result, strlen(result), conn) < 0) {
-            fprintf(stderr, "Failed to send configuration parameters\n");
-            return;
+/*
+ * Read the response of an agent that predates typed responses: plain
+ * text, shown as it arrives, with no end marker.  The response is taken
+ * to be over when the agent closes the connection or has been quiet for
+ * LEGACY_QUIET_MS; such an agent reports no status.
+ *
+ * Returns RESP_OK if anything came, -1 otherwise.
+ */
+static int ReadLegacyResponse(Conn* conn, ResponseDisplay display, ExpBuffer output) {
+    int timeout_ms = LEGACY_FIRST_MS;
+    bool got_any = false;
+
+    while (wait_for_agent(conn, timeout_ms) > 0) {
+        int len;
+
+        if (conn->inStart == conn->inEnd && ReadData(conn) < 0)
+            break;
+        len = conn->inEnd - conn->inStart;
+        if (len == 0)
+            continue;
+        if (output)
+            appendBinaryExpBuffer(output, conn->inBuffer + conn->inStart, len);
+        if (display == RESPONSE_BLOCKS) {
+            ExpBufferData text;
+
+            initExpBuffer(&text);
+            appendBinaryExpBuffer(&text, conn->inBuffer + conn->inStart, len);
+            printTextBlock(text.data, BOLD GREEN, YELLOW);
+            termExpBuffer(&text);
+        } else if (display == RESPONSE_RAW) {
+            fwrite(conn->inBuffer + conn->inStart, 1, len, stdout);
+            fflush(stdout);
         }
-        PutMsgEnd(conn);
-        break;
+        conn->inStart = conn->inEnd;
+        got_any = true;
+        timeout_ms = LEGACY_QUIET_MS;
+    }
+    return got_any ? RESP_OK : -1;
+}
 
-    case INSTALL:
-        // Send version if provided
+/**
+ * Reads the complete response to one request.
+ *
+ * Output chunks and progress notes are shown as they arrive, as text
+ * blocks or as plain text depending on display, and output is also
+ * appended to output if that is not NULL.  Reading stops at the end
+ * marker, so no more is read than the request produced.
+ *
+ * Returns the request's status (RESP_*), or -1 if the connection failed.
+ */
+int ReadResponse(Conn* conn, ResponseDisplay display, ExpBuffer output) {
+    ExpBufferData msg;
+    int status = -1;
+    char type;
+
+    if (conn->legacyResponses)
+        return ReadLegacyResponse(conn, display, output);
+
+    initExpBuffer(&msg);
+    for (;;) {
+        resetExpBuffer(&msg);
+        if (GetResponseMessage(conn, &type, &msg) < 0) {
+            status = -1;
+            break;
+        }
+        if (type == RespMsg_End)
+            break;
 
-        if (version) {
-            if (Putnchar(version, strlen(version), conn) < 0) {
-                fprintf(stderr, "Failed to send version\n");
-                return;
+        switch (type) {
+        case RespMsg_Output:
+            if (output)
+                appendBinaryExpBuffer(output, msg.data, msg.len);
+            if (display == RESPONSE_BLOCKS)
+                printTextBlock(msg.data, BOLD GREEN, YELLOW);
+            else if (display == RESPONSE_RAW) {
+                fwrite(msg.data, 1, msg.len, stdout);
+                fflush(stdout);
             }
+            break;
+        case RespMsg_Progress:
+            if (msg.len > 4 && display != RESPONSE_QUIET) {
+                const char *text = msg.data + 4;
+
+                if (display == RESPONSE_BLOCKS)
+                    printTextBlock(text, CYAN, YELLOW);
+                else {
+                    fputs(text, stdout);
+                    fflush(stdout);
+                }
+            }
+            break;
+        case RespMsg_Result:
+            if (msg.len >= 4) {
+                memcpy(&status, msg.data, 4);
+                status = ntoh32(status);
+            }
+            break;
+        default:
+            /* unknown message types are skipped */
+            break;
         }
-        PutMsgEnd(conn);
-        break;
-
-    case NONE:
-        PutMsgEnd(conn);
-        // No additional parameters needed
-        break;
-    default:
-        return;
-        return;
     }
-    (void) Flush(conn);
+    termExpBuffer(&msg);
+    return status;
+}
 
+/**
+ * Reads the next frame of a pipelined session.
+ *
+ * A frame is a typed message whose body starts with the int32 tag of the
+ * request it belongs to; the rest of the body is appended to data.  For
+ * a done frame that is the request's int32 status.
+ *
+ * Returns 0 on success, -1 if the connection failed or the frame is
+ * malformed.
+ */
+int ReadSessionFrame(Conn* conn, char* type, int* tag, ExpBuffer data) {
+    ExpBufferData frame;
+    int result = -1;
+
+    initExpBuffer(&frame);
+    if (GetResponseMessage(conn, type, &frame) == 0 && frame.len >= 4) {
+        memcpy(tag, frame.data, 4);
+        *tag = ntoh32(*tag);
+        appendBinaryExpBuffer(data, frame.data + 4, frame.len - 4);
+        result = 0;
+    }
+    termExpBuffer(&frame);
+    return result;
 }
 
 bool executeSystemCommand(const char *cmd) {
@@ -1179,12 +1886,6 @@ static void get_component_info(Component comp, const char **env_var, const char
     }
 }
 
-bool check_installed_message(const char* str) {
-    if (str == NULL) {
-        return false;
-    }
-    return (strstr(str, "is already installed") != NULL);
-}
 
 static bool directory_exists(const char *path) {
     struct stat info;
@@ -44,6 +44,10 @@
 #define MAX_PATH_LEN 1024
 #define MAX_LINE_LENGTH 8096
 
+/* where the local agent's Unix socket lives unless DEBO_UNIX_SOCKET_DIR is set */
+#define DEFAULT_DEBO_SOCKET_DIR "/run/debo"
+#define DEFAULT_DEBO_PORT "1221"
+
 extern const char *port;
 extern const char       *host;
 extern const char       *user;
@@ -139,6 +143,13 @@ typedef struct {
 typedef enum {NO_ACTION, START, STOP, RESTART, INSTALL, VERSION_SWITCH,
     UNINSTALL, REPORT ,CONFIGURE, METRICS} Action;
 
+/* How ReadResponse() shows the output of a request */
+typedef enum {
+    RESPONSE_BLOCKS,            /* framed text blocks */
+    RESPONSE_RAW,               /* plain text on stdout */
+    RESPONSE_QUIET              /* nothing, only collect it */
+} ResponseDisplay;
+
 typedef struct PromptInterruptContext
 {
     /* To avoid including <setjmp.h> here, jmpbuf is declared "void *" */
@@ -203,6 +214,12 @@ int validate_file_path(const char* path);
 bool executeSystemCommand(const char *cmd);
 bool isComponentVersionSupported(Component component, const char *version);
 Conn* connect_to_debo(const char* host, const char* port);
+Conn* connect_to_debo_async(const char* host, const char* port);
+int set_compress_offer(const char* name);
+int set_transport_mode(const char* name);
+int prefetch_service_tickets(const char* const* hosts, int nhosts);
+int NegotiateCapabilities(Conn* conn);
+int QueueHello(Conn* conn);
 void  reset_connection_buffers(Conn *conn);
 void handle_result(ConfigStatus status, const char *config_param, const char *config_value, const char *config_file);
 bool handleValidationResult(ValidationResult result);
@@ -270,6 +287,22 @@ void SendComponentActionCommand(Component component, Action action,
                                 const char* version,
                                 const char* param_name, const char* param_value,
                                 Conn* conn);
+int QueueComponentActionCommand(Component component, Action action,
+                                const char* version,
+                                const char* param_name, const char* param_value,
+                                Conn* conn);
+void SendComponentJobSubmit(Component component, Action action,
+                            const char* version,
+                            const char* param_name, const char* param_value,
+                            Conn* conn);
+int SendComponentSessionRequest(int tag, Component component, Action action,
+                                const char* version,
+                                const char* param_name, const char* param_value,
+                                Conn* conn);
+int GetResponseMessage(Conn* conn, char* type, ExpBuffer body);
+int ParseResponseMessage(Conn* conn, char* type, ExpBuffer body);
+int ReadResponse(Conn* conn, ResponseDisplay display, ExpBuffer output);
+int ReadSessionFrame(Conn* conn, char* type, int* tag, ExpBuffer data);
 Component* get_dependencies(Component comp, int *count);
 int update_config(const char *param, const char *value, const char *file_path);
 int create_xml_file(const char *directory_path, const char *xml_file_name);
@@ -279,5 +312,4 @@ int start_stdout_capture(Component comp);
 int stop_stdout_capture(void);
 char* get_component_config_path(Component comp, const char* config_filename);
 bool isComponentInstalled(Component comp);
-bool check_installed_message(const char* str);
 #endif